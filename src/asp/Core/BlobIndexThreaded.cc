@@ -25,6 +25,7 @@
 #include <vw/Core/ThreadPool.h>
 
 #include <math.h>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 
@@ -32,54 +33,44 @@ using namespace vw;
 using namespace blob;
 
 void BlobCompressed::shift_x( int32 const& value ) {
-  for ( uint32 i = 0; i < m_row_end.size(); i++ )
-    for ( std::list<int32>::iterator iter_start = m_row_start[i].begin(),
-            iter_end = m_row_end[i].begin(); iter_start != m_row_start[i].end();
-          iter_start++, iter_end++ ) {
-      *iter_start -= value;
-      *iter_end -= value;
-    }
-  m_min[0] += value;
-}
-
-void BlobCompressed::refactor() {
-  for ( uint32 i = 0; i < m_row_end.size(); i++ ) {
-    std::list<int32>::iterator iter_n_start = m_row_start[i].begin(),
-      iter_end = m_row_end[i].begin();
-    iter_n_start++;
-    while ( iter_n_start != m_row_start[i].end() ) {
-      if ( *iter_n_start == *iter_end ) {
-        iter_n_start = m_row_start[i].erase( iter_n_start );
-        iter_end = m_row_end[i].erase( iter_end );
-      } else {
-        iter_n_start++;
-        iter_end++;
-      }
-    }
+  for ( size_t k = 0; k < m_row_start.size(); k++ ) {
+    m_row_start[k] -= value;
+    m_row_end[k] -= value;
   }
+  m_min[0] += value;
 }
 
 BlobCompressed::BlobCompressed( vw::Vector2i const& top_left,
                                 std::vector<std::list<vw::int32> > const& row_start,
                                 std::vector<std::list<vw::int32> > const& row_end ) :
-  m_min(top_left), m_row_start(row_start), m_row_end(row_end) {
+  m_min(top_left), m_row_offset(1,0) {
   VW_DEBUG_ASSERT( row_start.size() == row_end.size(),
                    vw::InputErr() << "Input vectors do not have the same length." );
   for ( size_t i = 0; i < row_start.size(); i++ ) {
     VW_DEBUG_ASSERT( row_start[i].size() == row_end[i].size(),
                      vw::InputErr() << "List at row " << i << " doesn't have matched starts and ends." );
+    m_row_start.insert( m_row_start.end(), row_start[i].begin(), row_start[i].end() );
+    m_row_end.insert( m_row_end.end(), row_end[i].begin(), row_end[i].end() );
+    m_row_offset.push_back( m_row_start.size() );
   }
 }
 
+BlobCompressed::BlobCompressed( vw::Vector2i const& top_left,
+                                std::vector<vw::int32> const& row_offset,
+                                std::vector<vw::int32> const& row_start,
+                                std::vector<vw::int32> const& row_end ) :
+  m_min(top_left), m_row_offset(row_offset), m_row_start(row_start), m_row_end(row_end) {
+  VW_DEBUG_ASSERT( row_start.size() == row_end.size() && !row_offset.empty() &&
+                   row_offset.back() == int32(row_start.size()),
+                   vw::InputErr() << "Row offsets do not match the segments." );
+}
+
 BlobCompressed::BlobCompressed() : m_min(-1,-1) {}
 
 int32 BlobCompressed::size() const {
   int32 sum = 0;
-  for ( uint32 r = 0; r < m_row_end.size(); r++ )
-    for ( std::list<int32>::const_iterator iter_start = m_row_start[r].begin(),
-            iter_end = m_row_end[r].begin(); iter_start != m_row_start[r].end();
-          iter_start++, iter_end++ )
-      sum += *iter_end - *iter_start;
+  for ( size_t k = 0; k < m_row_start.size(); k++ )
+    sum += m_row_end[k] - m_row_start[k];
   return sum;
 }
 
@@ -87,13 +78,21 @@ vw::Vector2i const& BlobCompressed::min() const { return m_min; }
 
 vw::Vector2i & BlobCompressed::min() { return m_min; }
 
-vw::int32 BlobCompressed::num_rows() const { return m_row_start.size(); }
+vw::int32 BlobCompressed::num_rows() const {
+  return m_row_offset.empty() ? 0 : int32(m_row_offset.size()) - 1;
+}
 
-std::list<vw::int32> const&
-BlobCompressed::start( vw::uint32 const& index ) const { return m_row_start[index]; }
+BlobCompressed::segment_range
+BlobCompressed::start( vw::uint32 const& index ) const {
+  return segment_range( m_row_start.begin() + m_row_offset[index],
+                        m_row_start.begin() + m_row_offset[index+1] );
+}
 
-std::list<vw::int32> const&
-BlobCompressed::end( vw::uint32 const& index ) const { return m_row_end[index]; }
+BlobCompressed::segment_range
+BlobCompressed::end( vw::uint32 const& index ) const {
+  return segment_range( m_row_end.begin() + m_row_offset[index],
+                        m_row_end.begin() + m_row_offset[index+1] );
+}
 
 // Access points to intersting information
 vw::uint32 BlobIndexCustom::num_blobs() const { return m_blob_count; }
@@ -102,33 +101,128 @@ vw::uint32 BlobIndexCustom::num_blobs() const { return m_blob_count; }
 BlobCompressed const&
 BlobIndexCustom::blob( vw::uint32 const& index ) const { return m_c_blob[index]; }
 
+void BlobIndexCustom::label_runs( std::vector<int32> const& row_offset,
+                                  std::vector<int32> const& run_start,
+                                  std::vector<int32> const& run_end ) {
+  int32 num_runs = run_start.size();
+  int32 num_rows = int32(row_offset.size()) - 1;
+
+  // Join each run with the runs of the previous row which touch it,
+  // diagonals included. Both rows are sorted so a merge-like sweep
+  // visits every touching pair.
+  DisjointSets sets( num_runs );
+  for ( int32 r = 1; r < num_rows; r++ ) {
+    int32 p = row_offset[r-1], p_end = row_offset[r];
+    int32 q = row_offset[r],   q_end = row_offset[r+1];
+    while ( p < p_end && q < q_end ) {
+      if ( run_start[q] <= run_end[p] && run_start[p] <= run_end[q] )
+        sets.join( p, q );
+      if ( run_end[p] < run_end[q] )
+        p++;
+      else
+        q++;
+    }
+  }
+
+  // Number the blobs in order of their first run, and count their runs
+  std::vector<int32> run_label( num_runs ), run_row( num_runs );
+  std::vector<int32> blob_num_runs;
+  for ( int32 r = 0; r < num_rows; r++ ) {
+    for ( int32 k = row_offset[r]; k < row_offset[r+1]; k++ ) {
+      run_row[k] = r;
+      int32 root = sets.find( k );
+      if ( root == k ) {
+        run_label[k] = blob_num_runs.size();
+        blob_num_runs.push_back( 0 );
+      } else {
+        run_label[k] = run_label[root];
+      }
+      blob_num_runs[run_label[k]]++;
+    }
+  }
+
+  // Sort the runs by blob. This keeps them in row major order
+  // within a blob.
+  m_blob_count = blob_num_runs.size();
+  std::vector<int32> blob_first( m_blob_count + 1, 0 );
+  for ( uint32 b = 0; b < m_blob_count; b++ )
+    blob_first[b+1] = blob_first[b] + blob_num_runs[b];
+  std::vector<int32> sorted_runs( num_runs ), fill( blob_first.begin(), blob_first.end()-1 );
+  for ( int32 k = 0; k < num_runs; k++ )
+    sorted_runs[fill[run_label[k]]++] = k;
+
+  // Second pass: write out each blob
+  m_c_blob.clear();
+  m_c_blob.reserve( m_blob_count );
+  for ( uint32 b = 0; b < m_blob_count; b++ ) {
+    int32 first = blob_first[b], last = blob_first[b+1];
+    Vector2i top_left( run_start[sorted_runs[first]], run_row[sorted_runs[first]] );
+    for ( int32 i = first; i < last; i++ )
+      top_left.x() = std::min( top_left.x(), run_start[sorted_runs[i]] );
+
+    std::vector<int32> offset(1,0), start, end;
+    start.reserve( last - first );
+    end.reserve( last - first );
+    for ( int32 i = first; i < last; i++ ) {
+      int32 k = sorted_runs[i];
+      while ( int32(offset.size()) - 1 < run_row[k] - top_left.y() )
+        offset.push_back( start.size() );
+      start.push_back( run_start[k] - top_left.x() );
+      end.push_back( run_end[k] - top_left.x() );
+    }
+    offset.push_back( start.size() );
+    m_c_blob.push_back( BlobCompressed( top_left, offset, start, end ) );
+  }
+}
+
+DisjointSets::DisjointSets( size_t num_elements ) : m_parent( num_elements ) {
+  for ( size_t i = 0; i < num_elements; i++ )
+    m_parent[i] = i;
+}
+
+int32 DisjointSets::find( int32 element ) {
+  // Path halving
+  while ( m_parent[element] != element ) {
+    m_parent[element] = m_parent[m_parent[element]];
+    element = m_parent[element];
+  }
+  return element;
+}
+
+void DisjointSets::join( int32 a, int32 b ) {
+  a = find( a );
+  b = find( b );
+  if ( a < b )
+    m_parent[b] = a;
+  else if ( b < a )
+    m_parent[a] = b;
+}
+
 BBox2i BlobCompressed::bounding_box() const {
   BBox2i bbox;
   bbox.min() = m_min;
   int32 max_col = 0;
-  for ( uint32 i = 0; i < m_row_end.size(); i++ )
-    for ( std::list<int32>::const_iterator iter = m_row_end[i].begin();
-          iter != m_row_end[i].end(); iter++ )
-      if ( *iter > max_col )
-        max_col = *iter;
-  bbox.max() = Vector2i(m_min.x()+max_col,m_min.y()+m_row_start.size());
+  for ( size_t k = 0; k < m_row_end.size(); k++ )
+    if ( m_row_end[k] > max_col )
+      max_col = m_row_end[k];
+  bbox.max() = Vector2i(m_min.x()+max_col,m_min.y()+num_rows());
   return bbox;
 }
 
 bool BlobCompressed::intersects( vw::BBox2i const& input ) const {
   // Check if Y's overlap.
   if ( input.max().y() <= m_min.y() ||
-       input.min().y() >= m_min.y() + int32(m_row_start.size()) )
+       input.min().y() >= m_min.y() + num_rows() )
     return false;
 
   // Check X for each row.
-  for ( size_t i = 0; i < m_row_start.size(); i++ ) {
-    if ( !m_row_start[i].size() ||
-         m_min.y() + int32(i) < input.min().y() ||
-         m_min.y() + int32(i) >= input.max().y() )
+  for ( int32 i = 0; i < num_rows(); i++ ) {
+    if ( m_row_offset[i] == m_row_offset[i+1] ||
+         m_min.y() + i < input.min().y() ||
+         m_min.y() + i >= input.max().y() )
       continue;
-    if ( m_row_end[i].back() + m_min.x() > input.min().x() &&
-         m_row_start[i].front() + m_min.x() < input.max().x() ) {
+    if ( m_row_end[m_row_offset[i+1]-1] + m_min.x() > input.min().x() &&
+         m_row_start[m_row_offset[i]] + m_min.x() < input.max().x() ) {
       return true;
     }
   }
@@ -139,36 +233,31 @@ bool BlobCompressed::is_on_right( BlobCompressed const& right ) const {
   int32 y_offset = m_min.y()-right.min().y()-1;
   // Starting r_i on the index above
   for( int32 i = 0, r_i = y_offset;
-       (i < int32(m_row_end.size()))&&(r_i < right.num_rows());
+       (i < num_rows())&&(r_i < right.num_rows());
        i++, r_i++ ) {
-    if ( r_i >= 0 && r_i < int32(right.num_rows()) )
-      if ( m_row_end[i].back() + m_min.x() ==
-           right.m_row_start[r_i].front()+right.min().x() )
-        return true;
-    if ( r_i+1 >= 0 && r_i+1 < int32(right.num_rows()) )
-      if ( m_row_end[i].back() + m_min.x() ==
-           right.m_row_start[r_i+1].front()+right.min().x() )
-        return true;
-    if ( r_i+2 >= 0 && r_i+2 < int32(right.num_rows()) )
-      if ( m_row_end[i].back() + m_min.x() ==
-           right.m_row_start[r_i+2].front()+right.min().x() )
+    if ( m_row_offset[i] == m_row_offset[i+1] )
+      continue;
+    int32 row_end = m_row_end[m_row_offset[i+1]-1] + m_min.x();
+    for ( int32 j = r_i; j < r_i + 3; j++ ) {
+      if ( j < 0 || j >= right.num_rows() ||
+           right.m_row_offset[j] == right.m_row_offset[j+1] )
+        continue;
+      if ( row_end == right.m_row_start[right.m_row_offset[j]]+right.min().x() )
         return true;
+    }
   }
   return false;
 }
 
 bool BlobCompressed::is_on_bottom( BlobCompressed const& bottom ) const {
-  if ( bottom.min().y() != m_min.y()+int32(m_row_start.size()) )
+  if ( num_rows() == 0 || bottom.num_rows() == 0 ||
+       bottom.min().y() != m_min.y()+num_rows() )
     return false;
   // Are the rows connected ?
-  for ( std::list<int32>::const_iterator top_start = m_row_start.back().begin(),
-          top_end = m_row_end.back().begin(); top_start != m_row_start.back().end();
-        top_start++, top_end++ )
-    for ( std::list<int32>::const_iterator bot_start = bottom.m_row_start[0].begin(),
-            bot_end = bottom.m_row_end[0].begin(); bot_start != bottom.m_row_start[0].end();
-          bot_start++, bot_end++ ) {
-      if ( (*top_end+m_min.x() >= *bot_start + bottom.min().x()) &&
-           (*top_start+m_min.x() <= *bot_end+bottom.min().x()) )
+  for ( int32 t = m_row_offset[num_rows()-1]; t < m_row_offset[num_rows()]; t++ )
+    for ( int32 b = bottom.m_row_offset[0]; b < bottom.m_row_offset[1]; b++ ) {
+      if ( (m_row_end[t]+m_min.x() >= bottom.m_row_start[b] + bottom.min().x()) &&
+           (m_row_start[t]+m_min.x() <= bottom.m_row_end[b]+bottom.min().x()) )
         return true;
     }
   return false;
@@ -176,31 +265,31 @@ bool BlobCompressed::is_on_bottom( BlobCompressed const& bottom ) const {
 
 void BlobCompressed::add_row( Vector2i const& start,
                               int const& width ) {
-  if ( m_min[0] == -1 ) {
+  if ( m_row_offset.empty() ) {
     // First insertion
     m_min = start;
-    m_row_start.resize(1);
-    m_row_end.resize(1);
-    m_row_start[0].push_back(0);
-    m_row_end[0].push_back(width);
+    m_row_offset.push_back(0);
+    m_row_offset.push_back(1);
+    m_row_start.push_back(0);
+    m_row_end.push_back(width);
   } else { // If not first
-    if ( !( (start.y() == m_min.y()+int32(m_row_start.size()) ) ||
-            (start.y() == m_min.y()+int32(m_row_start.size())-1) ) )
+    if ( !( (start.y() == m_min.y()+num_rows() ) ||
+            (start.y() == m_min.y()+num_rows()-1) ) )
       vw_throw(vw::NoImplErr() << "Add_row expects rows to be added in order.\n" );
-    if ( start.y() == m_min.y()+int32(m_row_start.size()) ) {
-      m_row_start.resize(m_row_start.size()+1);
-      m_row_end.resize(m_row_start.size());
-    } else if ( (start.x() < m_row_start.back().back()+m_min.x()) &&
-                !m_row_start.back().empty() ) {
+    if ( start.y() == m_min.y()+num_rows() ) {
+      m_row_offset.push_back( m_row_offset.back() );
+    } else if ( m_row_offset[num_rows()-1] != m_row_offset[num_rows()] &&
+                (start.x() < m_row_start.back()+m_min.x()) ) {
       // If we are not appending, check to see if were adding to this row in order
       vw_out(ErrorMessage) << "start: " << start << " w: " << width << std::endl;
-      vw_out(ErrorMessage) << "front() = " <<  m_row_start.back().back() << std::endl;
+      vw_out(ErrorMessage) << "back() = " <<  m_row_start.back() << std::endl;
       vw_out(ErrorMessage) << "min.x() << " << m_min.x() << std::endl;
       vw_throw(vw::NoImplErr() << "It appears a segment is trying to be inserted out of order.\n" );
     }
 
-    m_row_start.back().push_back(start.x()-m_min.x());
-    m_row_end.back().push_back(start.x()-m_min.x()+width);
+    m_row_start.push_back(start.x()-m_min.x());
+    m_row_end.push_back(start.x()-m_min.x()+width);
+    m_row_offset.back()++;
     if ( m_min.x() > start.x() ) {
       int32 offset = start.x()-m_min.x();
       this->shift_x(offset); // I guess this is really only need at the end
@@ -211,190 +300,90 @@ void BlobCompressed::add_row( Vector2i const& start,
 
 void BlobCompressed::absorb( BlobCompressed const& victim ) {
 
+  if ( victim.num_rows() == 0 )
+    return;
+
   // First check to see if I'm empty
-  if ( m_row_start.empty() ) {
-    m_min = victim.min();
-    for ( int i = 0; i < victim.num_rows(); i++ ) {
-      m_row_start.push_back( victim.m_row_start[i] );
-      m_row_end.push_back( victim.m_row_end[i] );
-    }
+  if ( num_rows() == 0 ) {
+    *this = victim;
     return;
   }
 
-  // Normal operations
-  int y_offset =- m_min.y() + victim.min().y();
-  for ( int i = 0; i < victim.num_rows(); i++ ) {
-    // Index i is in terms of the victim
-    // m_index is in terms of this
-    int m_index = y_offset+i;
-
-    // Checking if can insert
-    if ( m_index >= 0 && m_index < int32(m_row_start.size()) ) {
-
-      // Inserting victim's connected rows in singletons at a time
-      // become sometimes they connect like zippers.
-      for ( std::list<int32>::const_iterator v_singleton_start = victim.m_row_start[i].begin(),
-              v_singleton_end = victim.m_row_end[i].begin(); v_singleton_start != victim.m_row_start[i].end();
-            v_singleton_start++, v_singleton_end++ ) {
-
-        std::list<int32>::iterator start_insertion_point = m_row_start[m_index].begin(),
-          end_insertion_point = m_row_end[m_index].begin(),
-          start_lookahead = m_row_start[m_index].begin();
-        bool found_good_spot = false;
-        if ( m_row_start[m_index].empty()  )
-          found_good_spot = true;
-        else if ( *v_singleton_end+victim.min().x()-m_min.x() <=
-                  m_row_start[m_index].front() )
-          found_good_spot = true;
-        else {
-          start_lookahead++;
-        }
-        while ( start_lookahead != m_row_start[m_index].end() &&
-                !found_good_spot ) {
-          if ( (*v_singleton_start+victim.min().x()-m_min.x() >=
-                *end_insertion_point ) &&
-               (*v_singleton_end+victim.min().x()-m_min.x() <=
-                *start_lookahead ) ) {
-            found_good_spot = true;
-          }
-          start_insertion_point++;
-          end_insertion_point++;
-          start_lookahead++;
-        }
-        // If insert on end
-        if ( (start_lookahead == m_row_start[m_index].end()) &&
-             !found_good_spot ) {
-          if ( *v_singleton_start+victim.min().x()-m_min.x() >=
-               *end_insertion_point ) {
-            found_good_spot = true;
-            start_insertion_point++;
-            end_insertion_point++;
-          }
-        }
-        // Checking for error and debug
-        if ( !found_good_spot ) {
-          vw_out() << "index =  " << m_index << std::endl;
-          vw_out() << "Have: min[" << m_min << "] ";
-          for ( std::list<int32>::const_iterator m_i_str = m_row_start[m_index].begin(),
-                  m_i_end = m_row_end[m_index].begin();
-                m_i_str != m_row_start[m_index].end(); m_i_str++, m_i_end++ )
-            vw_out() << "(" << *m_i_str << "-" << *m_i_end << ")";
-          vw_out() << "\nTrying to insert singleton: (" << *v_singleton_start << "-"
-                   << *v_singleton_end << ")\n";
-
-          vw_throw( vw::NoImplErr() << "BlobCompressed: Seems to be inserting an overlapping blob compressed object.\n" );
-        }
-        // Inserting ( but apply offset fix first)
-        // Is there a simpler way of inserting, without making an intermediate
-        { // Start
-          std::list<int32> temp;
-          temp.push_back( *v_singleton_start+victim.min().x()-m_min.x() );
-          m_row_start[m_index].insert(start_insertion_point,
-                                      temp.begin(),temp.end() );
-        }
-        { // End
-          std::list<int32> temp;
-          temp.push_back( *v_singleton_end+victim.min().x()-m_min.x() );
-          m_row_end[m_index].insert(end_insertion_point,
-                                    temp.begin(), temp.end() );
-        }
-      }
+  // Merge the two blobs row by row into new flat storage. Rows that
+  // only one of us covers are copied, and rows covered by neither
+  // are left blank. This happens when building a blob from many
+  // that happen out of connection order. Think a U rotated 90 to the
+  // left.
+  Vector2i new_min( std::min( m_min.x(), victim.min().x() ),
+                    std::min( m_min.y(), victim.min().y() ) );
+  int32 new_max_y = std::max( m_min.y() + num_rows(),
+                              victim.min().y() + victim.num_rows() );
+  int32 m_shift = m_min.x() - new_min.x();
+  int32 v_shift = victim.min().x() - new_min.x();
+
+  std::vector<int32> offset(1,0), start, end;
+  start.reserve( m_row_start.size() + victim.m_row_start.size() );
+  end.reserve( start.capacity() );
+  for ( int32 y = new_min.y(); y < new_max_y; y++ ) {
+    int32 m_i = y - m_min.y(), v_i = y - victim.min().y();
+    int32 m_k = 0, m_k_end = 0, v_k = 0, v_k_end = 0;
+    if ( m_i >= 0 && m_i < num_rows() ) {
+      m_k = m_row_offset[m_i];
+      m_k_end = m_row_offset[m_i+1];
     }
-  }
-  // Now handle the rows that didn't previously exist
-  // > Insert any on top?
-  if ( victim.min().y() < m_min.y() ) {
-    std::vector<std::list<int32> > temp_start;
-    std::vector<std::list<int32> > temp_end;
-    for ( int v_i = 0; v_i < m_min.y()-victim.min().y(); v_i++ ) {
-      if ( v_i < victim.num_rows() ) {
-        temp_start.push_back(victim.m_row_start[v_i]);
-        temp_end.push_back(victim.m_row_end[v_i]);
-        for ( std::list<int32>::iterator i_start = temp_start.back().begin(),
-                i_stop = temp_end.back().begin();
-              i_start != temp_start.back().end(); i_start++, i_stop++ ) {
-          *i_start += victim.min().x()-m_min.x();
-          *i_stop += victim.min().x()-m_min.x();
-        }
+    if ( v_i >= 0 && v_i < victim.num_rows() ) {
+      v_k = victim.m_row_offset[v_i];
+      v_k_end = victim.m_row_offset[v_i+1];
+    }
+    size_t row_first = start.size();
+    while ( m_k < m_k_end || v_k < v_k_end ) {
+      int32 s, e;
+      if ( v_k == v_k_end ||
+           ( m_k < m_k_end && m_row_start[m_k] + m_shift <
+             victim.m_row_start[v_k] + v_shift ) ) {
+        s = m_row_start[m_k] + m_shift;
+        e = m_row_end[m_k] + m_shift;
+        m_k++;
       } else {
-        // Blank filling. This happens when building a blob from many
-        // that happen out of connection order. Think a U rotated 90
-        // to the left.
-        temp_start.push_back(std::list<int32>());
-        temp_end.push_back(std::list<int32>());
+        s = victim.m_row_start[v_k] + v_shift;
+        e = victim.m_row_end[v_k] + v_shift;
+        v_k++;
       }
-    }
-    m_row_start.insert( m_row_start.begin(),
-                        temp_start.begin(),
-                        temp_start.end() );
-    m_row_end.insert( m_row_end.begin(),
-                      temp_end.begin(),
-                      temp_end.end() );
-    m_min.y()=victim.min().y();
-  }
-  // > Insert any on bottom?
-  if ( victim.num_rows()+victim.min().y() >
-       m_min.y() + int32(m_row_end.size()) ) {
-    std::vector<std::list<int32> > temp_start;
-    std::vector<std::list<int32> > temp_end;
-    for ( int v_i = m_row_end.size()+m_min.y()-victim.min().y();
-          v_i < victim.num_rows(); v_i++ ) {
-      if ( v_i < 0 ) {
-        // Blank filling
-        temp_start.push_back(std::list<int32>());
-        temp_end.push_back(std::list<int32>());
+      if ( start.size() > row_first && s < end.back() ) {
+        vw_out() << "Row " << y << ": segment (" << s << "-" << e
+                 << ") overlaps (" << start.back() << "-" << end.back() << ")\n";
+        vw_throw( vw::NoImplErr() << "BlobCompressed: Seems to be inserting an overlapping blob compressed object.\n" );
+      }
+      if ( start.size() > row_first && s == end.back() ) {
+        end.back() = e; // Segments meeting end to end become one
       } else {
-        temp_start.push_back( victim.m_row_start[v_i] );
-        temp_end.push_back( victim.m_row_end[v_i] );
-        for ( std::list<int32>::iterator i_start = temp_start.back().begin(),
-                i_stop = temp_end.back().begin();
-              i_start != temp_start.back().end(); i_start++, i_stop++ ) {
-          *i_start += victim.min().x()-m_min.x();
-          *i_stop += victim.min().x()-m_min.x();
-        }
+        start.push_back( s );
+        end.push_back( e );
       }
     }
-    m_row_start.insert( m_row_start.end(),
-                        temp_start.begin(),
-                        temp_start.end() );
-    m_row_end.insert( m_row_end.end(),
-                      temp_end.begin(),
-                      temp_end.end() );
-  }
-  // Recalculate min.x()
-  size_t valid_first = 0;
-  while ( valid_first < m_row_start.size() ) {
-    if ( m_row_start[valid_first].size() )
-      break;
-    valid_first++;
+    offset.push_back( start.size() );
   }
-  int32 lowest_value = m_row_start[valid_first].front();
-  for (size_t i = ++valid_first; i < m_row_start.size(); i++ ) {
-    if ( m_row_start[i].front() < lowest_value )
-      lowest_value = m_row_start[i].front();
-  }
-  this->shift_x( lowest_value );
-  this->refactor();
+
+  m_min = new_min;
+  m_row_offset.swap( offset );
+  m_row_start.swap( start );
+  m_row_end.swap( end );
 }
 
 void BlobCompressed::decompress( std::list<Vector2i>& output ) const {
   output.clear();
-  for (int32 r = 0; r < int32(m_row_end.size()); r++ )
-    for ( std::list<int32>::const_iterator iter_start = m_row_start[r].begin(),
-            iter_end = m_row_end[r].begin(); iter_start != m_row_start[r].end();
-          iter_start++, iter_end++ )
-      for ( int c = *iter_start; c < *iter_end; c++ )
+  for ( int32 r = 0; r < num_rows(); r++ )
+    for ( int32 k = m_row_offset[r]; k < m_row_offset[r+1]; k++ )
+      for ( int c = m_row_start[k]; c < m_row_end[k]; c++ )
         output.push_back( Vector2i(c,r)+m_min );
 }
 
 void BlobCompressed::print() const {
   vw::vw_out() << "BlobCompressed | min: " << m_min << "\n";
-  for ( vw::uint32 i = 0; i < m_row_start.size(); i++ ) {
+  for ( int32 i = 0; i < num_rows(); i++ ) {
     vw::vw_out() << " " << i << "|";
-    for ( std::list<vw::int32>::const_iterator s_iter = m_row_start[i].begin(),
-            e_iter = m_row_end[i].begin(); s_iter != m_row_start[i].end();
-          s_iter++, e_iter++ )
-      vw::vw_out() << "(" << *s_iter << "<>" << *e_iter << ")";
+    for ( int32 k = m_row_offset[i]; k < m_row_offset[i+1]; k++ )
+      vw::vw_out() << "(" << m_row_start[k] << "<>" << m_row_end[k] << ")";
     vw::vw_out() <<"\n";
   }
 }
@@ -474,10 +463,8 @@ void BlobIndexThreaded::consolidate( Vector2i const& image_size,
   for ( uint32 i = 1; i < y_divisions; i++ )
     y_div.push_back( proc_block_size[1]*i );
 
-  // Set up graph
-  typedef boost::adjacency_list<boost::vecS,boost::vecS,boost::undirectedS> Graph;
-  Graph connections;
-  add_edge(m_blob_bbox.size()-1,m_blob_bbox.size()-1,connections);
+  // Blobs that touch across a division line are joined into one set
+  DisjointSets connections( m_blob_bbox.size() );
 
   // Check for bbox on the division line
   // --> x div
@@ -498,7 +485,7 @@ void BlobIndexThreaded::consolidate( Vector2i const& image_size,
         if ( ( m_blob_bbox[l].max().y()+1 >= m_blob_bbox[r].min().y() ) &&
              ( m_blob_bbox[r].max().y()+1 >= m_blob_bbox[l].min().y() ) )
           if ( m_c_blob[l].is_on_right(m_c_blob[r]) )
-            add_edge(l,r,connections);
+            connections.join(l,r);
       }
   }
   // --> y div
@@ -521,12 +508,17 @@ void BlobIndexThreaded::consolidate( Vector2i const& image_size,
         if ( ( m_blob_bbox[u].max().x()+1 >= m_blob_bbox[d].min().x() ) &&
              ( m_blob_bbox[d].max().x()+1 >= m_blob_bbox[u].min().x() ) )
           if ( m_c_blob[u].is_on_bottom(m_c_blob[d]) )
-            add_edge(u,d,connections);
+            connections.join(u,d);
       }
   }
 
-  std::vector<uint32> component(boost::num_vertices(connections));
-  int final_num = boost::connected_components(connections,&component[0]);
+  // Number the sets consecutively
+  std::vector<uint32> component( m_blob_bbox.size() );
+  int final_num = 0;
+  for ( uint32 b_i = 0; b_i < m_blob_bbox.size(); b_i++ ) {
+    uint32 root = uint32( connections.find( b_i ) );
+    component[b_i] = ( root == b_i ) ? final_num++ : component[root];
+  }
 
   // Spawn threads to coagulate blobs. Creating 2x max number threads
   // jobs incase the individual jobs are not evenally distributed with
@@ -40,9 +40,7 @@
 // Boost
 #include <boost/noncopyable.hpp>
 #include <boost/smart_ptr/shared_ptr.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/connected_components.hpp>
-#include <boost/graph/graph_selectors.hpp>
+#include <boost/range/iterator_range.hpp>
 
 // BlobIndex (Multi) Threaded
 ///////////////////////////////////////
@@ -53,6 +51,8 @@
 // --> Lower Memory Impact
 //     via a new internal compressed format
 // --> Allows for limiting on size.
+// --> Labels runs of pixels rather than pixels, joining them
+//     with union-find instead of a graph.
 
 namespace blob {
 
@@ -61,25 +61,35 @@ namespace blob {
   // A nice way to describe a blob,
   // but reducing our memory foot print
   class BlobCompressed {
-    // This describes a blob as lines of rows
-    // to reduce the memory foot print
+    // This describes a blob as lines of rows to reduce the memory
+    // foot print. The segments of row i are [m_row_start[k],
+    // m_row_end[k]) for k in [m_row_offset[i], m_row_offset[i+1]),
+    // ordered and relative to m_min. All rows share the same flat
+    // storage.
     vw::Vector2i m_min;
-    std::vector<std::list<vw::int32> > m_row_start; // assumed to be ordered
-    std::vector<std::list<vw::int32> > m_row_end;
+    std::vector<vw::int32> m_row_offset;
+    std::vector<vw::int32> m_row_start;
+    std::vector<vw::int32> m_row_end;
     void shift_x( vw::int32 const& value );
-    void refactor();
   public:
+    typedef std::vector<vw::int32>::const_iterator segment_iterator;
+    typedef boost::iterator_range<segment_iterator> segment_range;
+
     BlobCompressed( vw::Vector2i const& top_left,
                     std::vector<std::list<vw::int32> > const& row_start,
                     std::vector<std::list<vw::int32> > const& row_end );
+    BlobCompressed( vw::Vector2i const& top_left,
+                    std::vector<vw::int32> const& row_offset,
+                    std::vector<vw::int32> const& row_start,
+                    std::vector<vw::int32> const& row_end );
     BlobCompressed();
 
     // Standard Access point
     vw::Vector2i const& min() const;
     vw::Vector2i & min();
     vw::int32 num_rows() const;
-    std::list<vw::int32> const& start( vw::uint32 const& index ) const;
-    std::list<vw::int32> const& end( vw::uint32 const& index ) const;
+    segment_range start( vw::uint32 const& index ) const;
+    segment_range end( vw::uint32 const& index ) const;
     vw::int32 size() const; // Please use sparingly
     vw::BBox2i bounding_box() const;
     bool intersects( vw::BBox2i const& input ) const;
@@ -107,174 +117,47 @@ namespace blob {
     std::vector<BlobCompressed> m_c_blob;
     uint m_blob_count;
 
+    // Group the runs of valid pixels into 8-connected blobs. The
+    // runs of row r are [run_start[k], run_end[k]) for k in
+    // [row_offset[r], row_offset[r+1]).
+    void label_runs( std::vector<vw::int32> const& row_offset,
+                     std::vector<vw::int32> const& run_start,
+                     std::vector<vw::int32> const& run_end );
+
   public:
     // Constructor performs processing
     template <class SourceT>
-    BlobIndexCustom( vw::ImageViewBase<SourceT> const& src,
-                     vw::ImageView<vw::uint32>& dst,
-                     uint /*max_area*/=0 ) {
+    BlobIndexCustom( vw::ImageViewBase<SourceT> const& src ) {
 
       if ( src.impl().planes() > 1 )
         vw_throw( vw::NoImplErr()
                   << "Blob index currently only works with 2D images." );
-      dst.set_size( src.impl().cols(),
-                    src.impl().rows() );
-      fill(dst,0);
-
-      // Initialize Graph used to pair blobs
-      typedef boost::adjacency_list<boost::vecS,boost::vecS,boost::undirectedS> Graph;
-      Graph connections;
-      m_blob_count=1;
-
-      { // Initial Pass
-        typename SourceT::pixel_accessor s_acc = src.impl().origin();
-        typename SourceT::pixel_accessor p_s_acc = src.impl().origin(); // previous
-        typename vw::ImageView<vw::uint32>::pixel_accessor d_acc = dst.origin();
-        typename vw::ImageView<vw::uint32>::pixel_accessor p_d_acc = dst.origin(); // previous
-
-        // Top Corner
-        if ( is_valid(*s_acc) ) {
-          *d_acc = m_blob_count;
-          m_blob_count++;
-        }
 
-        // Top Row
-        s_acc.next_col();
-        d_acc.next_col();
-        for ( vw::int32 i = 1; i < dst.cols(); i++ ) {
-          if ( is_valid(*s_acc) ) {
-            if ( is_valid(*p_s_acc) ) {
-              *d_acc = *p_d_acc;
-            } else {
-              *d_acc = m_blob_count;
-              m_blob_count++;
-            }
+      // First pass: find the runs of valid pixels in each row. The
+      // second pass, joining them into blobs, works on the runs only.
+      std::vector<vw::int32> row_offset(1, 0), run_start, run_end;
+      typename SourceT::pixel_accessor row_acc = src.impl().origin();
+      for ( vw::int32 r = 0; r < src.impl().rows(); r++ ) {
+        typename SourceT::pixel_accessor s_acc = row_acc;
+        bool building_run = false;
+        for ( vw::int32 c = 0; c < src.impl().cols(); c++ ) {
+          bool valid = is_valid(*s_acc);
+          if ( valid && !building_run ) {
+            run_start.push_back(c);
+            building_run = true;
+          } else if ( !valid && building_run ) {
+            run_end.push_back(c);
+            building_run = false;
           }
           s_acc.next_col();
-          d_acc.next_col();
-          p_s_acc.next_col();
-          p_d_acc.next_col();
-        }
-      }
-
-      { // Everything else (9 connected)
-        typename SourceT::pixel_accessor s_acc_row = src.impl().origin();
-        typename vw::ImageView<vw::uint32>::pixel_accessor d_acc_row = dst.origin();
-        s_acc_row.advance(0,1);
-        d_acc_row.advance(0,1);
-
-        for (int j = dst.rows()-1; j; --j ) { // Not for indexing
-          typename SourceT::pixel_accessor s_acc = s_acc_row;
-          typename SourceT::pixel_accessor p_s_acc = s_acc_row;
-          typename vw::ImageView<vw::uint32>::pixel_accessor d_acc = d_acc_row;
-          typename vw::ImageView<vw::uint32>::pixel_accessor p_d_acc = d_acc_row;
-
-          // Process
-          for ( int i = dst.cols(); i; --i ) {
-            if ( is_valid(*s_acc) ) {
-              if ( i != dst.cols() ) {
-                // Left
-                p_s_acc.advance(-1,0);
-                p_d_acc.advance(-1,0);
-                if ( is_valid(*p_s_acc) ) {
-                  if ( (*d_acc != 0) && (*d_acc != *p_d_acc) )
-                    boost::add_edge(*p_d_acc,*d_acc,connections);
-                  else
-                    *d_acc = *p_d_acc;
-                }
-                // Upper Left
-                p_s_acc.advance(0,-1);
-                p_d_acc.advance(0,-1);
-                if ( is_valid(*p_s_acc) ) {
-                  if ( (*d_acc != 0) && (*d_acc != *p_d_acc) )
-                    boost::add_edge(*p_d_acc,*d_acc,connections);
-                  else
-                    *d_acc = *p_d_acc;
-                }
-              } else {
-                p_s_acc.advance(-1,-1);
-                p_d_acc.advance(-1,-1);
-              }
-              // Upper
-              p_s_acc.advance(1,0);
-              p_d_acc.advance(1,0);
-              if ( is_valid(*p_s_acc) ) {
-                if ( (*d_acc != 0) && (*d_acc != *p_d_acc) )
-                  boost::add_edge(*p_d_acc,*d_acc,connections);
-                else
-                  *d_acc = *p_d_acc;
-              }
-              // Upper Right
-              p_s_acc.advance(1,0);
-              p_d_acc.advance(1,0);
-              if ( i != 1 ) {
-                if ( is_valid(*p_s_acc) ) {
-                  if ( (*d_acc != 0) && (*d_acc != *p_d_acc) )
-                    boost::add_edge(*p_d_acc,*d_acc,connections);
-                  else
-                    *d_acc = *p_d_acc;
-                }
-              }
-              // Setting if not
-              p_s_acc.advance(-1,1);
-              p_d_acc.advance(-1,1);
-              if ( *d_acc == 0 ) {
-                *d_acc = m_blob_count;
-                m_blob_count++;
-              }
-            }
-            s_acc.next_col();
-            p_s_acc.next_col();
-            d_acc.next_col();
-            p_d_acc.next_col();
-          } // end row process
-
-          s_acc_row.next_row();
-          d_acc_row.next_row();
-        }
-      }
-
-      // Making sure connections has vertices for all indexes made
-      add_edge(m_blob_count-1,m_blob_count-1,connections);
-      std::vector<vw::uint32> component(boost::num_vertices(connections));
-      m_blob_count = boost::connected_components(connections, &component[0])-1;
-      m_c_blob.resize(m_blob_count);
-
-      { // Update index map to optimal numbering
-        vw::ImageView<vw::uint32>::pixel_accessor p_d_acc = dst.origin(); // previous
-
-        for ( vw::int32 r = 0; r < dst.rows(); r++ ) {
-          vw::ImageView<vw::uint32>::pixel_accessor d_acc = p_d_acc;
-          bool building_segment=false;
-          vw::int32 start_c = 0;
-          vw::uint32 index = 0;
-          for ( vw::int32 c = 0; c < dst.cols(); c++ ) {
-            if ( (*d_acc) != 0 ) {
-              if ( building_segment && (index != component[*d_acc]) ) {
-                vw_throw(vw::LogicErr() << "Insert seems wrong.\n");
-                // I believe the way it's processed this shouldn't
-                // happen
-              } else if (!building_segment) {
-                building_segment = true;
-                index = component[*d_acc];
-                start_c = c;
-              }
-            } else if ( building_segment ) {
-              // Looks like we're finishing up here
-              building_segment = false;
-              m_c_blob[index-1].add_row( vw::Vector2i(start_c,r),
-                                         c-start_c );
-            }
-            d_acc.next_col();
-          }
-          if ( building_segment ) {
-            m_c_blob[index-1].add_row( vw::Vector2i(start_c,r),
-                                       dst.cols()-start_c );
-          }
-          p_d_acc.next_row();
         }
+        if ( building_run )
+          run_end.push_back( src.impl().cols() );
+        row_offset.push_back( run_start.size() );
+        row_acc.next_row();
       }
 
+      label_runs( row_offset, run_start, run_end );
     }
 
     // Access points to intersting information
@@ -284,6 +167,16 @@ namespace blob {
     BlobCompressed const& blob( vw::uint32 const& index ) const;
   };
 
+  // Union-find over a fixed number of elements. The representative
+  // of a set is its smallest element.
+  class DisjointSets {
+    std::vector<vw::int32> m_parent;
+  public:
+    DisjointSets( size_t num_elements );
+    vw::int32 find( vw::int32 element );
+    void join( vw::int32 a, vw::int32 b );
+  };
+
   // Blob Index Task
   /////////////////////////////////////
   // A task wrapper to allow threading
@@ -308,14 +201,12 @@ namespace blob {
     void operator()() {
       vw::Stopwatch sw;
       sw.start();
-      vw::ImageView<vw::uint32> index_image(m_bbox.width(),
-                                            m_bbox.height() );
 
       // Render so threads don't wait on each other
       vw::ImageView<typename SourceT::pixel_type> cropped_copy = crop(m_view,m_bbox);
       // Decided only to do trimming in the global perspective. This
       // avoids weird edge effects.
-      BlobIndexCustom bindex( cropped_copy, index_image);
+      BlobIndexCustom bindex( cropped_copy );
 
       // Build local bboxes
       std::vector<vw::BBox2i> local_bboxes( bindex.num_blobs() );
@@ -0,0 +1,264 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlockCorrelation.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/BlockCorrelation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+// The per-pixel loops run over contiguous rows, several pixels at a
+// time when SIMD instructions are available.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace vw;
+
+namespace {
+
+  // Sum src over all kx by ky windows. The src image has the given
+  // width, height and stride, and dst gets (width - kx + 1) by
+  // (height - ky + 1) values. The column sums are updated by adding
+  // the row entering the window and subtracting the one leaving it.
+  // The sums are kept in double precision, so that they do not drift
+  // and so that the cross correlation does not lose its precision
+  // when the window means are subtracted.
+  template <class T>
+  void box_sum(const T* src, int width, int height, int stride,
+               int kx, int ky, double* dst){
+
+    int out_width = width - kx + 1, out_height = height - ky + 1;
+    std::vector<double> col_sum(width, 0.0);
+    for (int row = 0; row < ky; row++){
+      const T* in = src + row*stride;
+      for (int col = 0; col < width; col++)
+        col_sum[col] += in[col];
+    }
+
+    for (int row = 0; row < out_height; row++){
+      if (row > 0){
+        const T* in  = src + (row + ky - 1)*stride;
+        const T* out = src + (row - 1)*stride;
+        for (int col = 0; col < width; col++)
+          col_sum[col] += double(in[col]) - double(out[col]);
+      }
+      double sum = 0;
+      for (int col = 0; col < kx; col++)
+        sum += col_sum[col];
+      double* dst_row = dst + row*out_width;
+      dst_row[0] = sum;
+      for (int col = 1; col < out_width; col++){
+        sum += col_sum[col + kx - 1] - col_sum[col - 1];
+        dst_row[col] = sum;
+      }
+    }
+  }
+
+  // The matching term of a row of pixels: |l - r|, (l - r)^2, or l*r
+  void matching_term(stereo::CostFunctionType cost_type,
+                     const float* l, const float* r, int n, float* term){
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= n; i += 4){
+      __m128 a = _mm_loadu_ps(l + i), b = _mm_loadu_ps(r + i);
+      __m128 t;
+      if (cost_type == stereo::CROSS_CORRELATION)
+        t = _mm_mul_ps(a, b);
+      else if (cost_type == stereo::SQUARED_DIFFERENCE)
+        t = _mm_mul_ps(_mm_sub_ps(a, b), _mm_sub_ps(a, b));
+      else
+        t = _mm_and_ps(_mm_sub_ps(a, b), sign_mask);
+      _mm_storeu_ps(term + i, t);
+    }
+#endif
+    for (; i < n; i++){
+      if (cost_type == stereo::CROSS_CORRELATION)
+        term[i] = l[i]*r[i];
+      else if (cost_type == stereo::SQUARED_DIFFERENCE)
+        term[i] = (l[i] - r[i])*(l[i] - r[i]);
+      else
+        term[i] = std::abs(l[i] - r[i]);
+    }
+  }
+
+  // Window means and standard deviations times the window area, so
+  // that the normalized cross correlation is
+  // (sum l*r - area*mean_l*mean_r)/(dev_l*dev_r).
+  void window_stats(ImageView<float> const& image, int kx, int ky,
+                    std::vector<double> & mean, std::vector<double> & dev){
+
+    int out_width = image.cols() - kx + 1, out_height = image.rows() - ky + 1;
+    int num = out_width*out_height;
+    std::vector<double> squares(image.cols()*image.rows()), sum_sq(num);
+    for (int row = 0; row < image.rows(); row++)
+      for (int col = 0; col < image.cols(); col++)
+        squares[row*image.cols() + col] = double(image(col, row))*image(col, row);
+
+    mean.resize(num);
+    dev.resize(num);
+    box_sum(&image(0, 0), image.cols(), image.rows(), image.cols(), kx, ky, &mean[0]);
+    box_sum(&squares[0], image.cols(), image.rows(), image.cols(), kx, ky, &sum_sq[0]);
+    double area = double(kx)*ky;
+    for (int i = 0; i < num; i++){
+      mean[i] /= area;
+      // A constant window may come out with a tiny variance from
+      // round-off. Make it exactly zero.
+      double var = sum_sq[i] - area*mean[i]*mean[i];
+      dev[i] = (var > 1e-12*sum_sq[i]) ? std::sqrt(var) : 0.0;
+    }
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  ImageView<PixelMask<Vector2i> >
+  block_correlation(ImageView<float> const& left,
+                    ImageView<float> const& right,
+                    ImageView<uint8> const& left_mask,
+                    ImageView<uint8> const& right_mask,
+                    BBox2i const& search_range,
+                    Vector2i const& kernel_size,
+                    stereo::CostFunctionType cost_type,
+                    float xcorr_threshold){
+
+    VW_ASSERT( cost_type == stereo::ABSOLUTE_DIFFERENCE ||
+               cost_type == stereo::SQUARED_DIFFERENCE ||
+               cost_type == stereo::CROSS_CORRELATION,
+               ArgumentErr() << "block_correlation: Unsupported cost function.\n" );
+    VW_ASSERT( kernel_size.x() % 2 == 1 && kernel_size.y() % 2 == 1,
+               ArgumentErr() << "block_correlation: The kernel must have odd "
+               << "dimensions.\n" );
+    VW_ASSERT( left.cols() == left_mask.cols() && left.rows() == left_mask.rows() &&
+               right.cols() == right_mask.cols() && right.rows() == right_mask.rows(),
+               ArgumentErr() << "block_correlation: Images and masks must have "
+               << "the same sizes.\n" );
+    VW_ASSERT( right.cols() == left.cols() + search_range.width() &&
+               right.rows() == left.rows() + search_range.height(),
+               ArgumentErr() << "block_correlation: The right image must be "
+               << "the left image size grown by the search range.\n" );
+
+    int kx = kernel_size.x(), ky = kernel_size.y();
+    Vector2i half_kernel = kernel_size/2;
+    int cols = left.cols() - 2*half_kernel.x();
+    int rows = left.rows() - 2*half_kernel.y();
+    ImageView<PixelMask<Vector2i> > disparity(std::max(cols, 0), std::max(rows, 0));
+    if (cols <= 0 || rows <= 0) return disparity;
+
+    int nx = search_range.width()  + 1;
+    int ny = search_range.height() + 1;
+
+    // Window centers in the right image
+    int rcols = cols + nx - 1, rrows = rows + ny - 1;
+
+    bool ncc = (cost_type == stereo::CROSS_CORRELATION);
+    std::vector<double> left_mean, left_dev, right_mean, right_dev;
+    if (ncc){
+      window_stats(left,  kx, ky, left_mean,  left_dev );
+      window_stats(right, kx, ky, right_mean, right_dev);
+    }
+
+    // The best cost and label of each left pixel, and of each right
+    // pixel for the right-to-left check. Lower costs are better, the
+    // cross correlation is negated.
+    const double max_cost = std::numeric_limits<double>::max();
+    std::vector<double> best_cost(cols*rows, max_cost), right_best_cost(rcols*rrows, max_cost);
+    std::vector<int>    best_label(cols*rows, -1),      right_best_label(rcols*rrows, -1);
+
+    std::vector<float>  term(left.cols()*left.rows());
+    std::vector<double> cost(cols*rows);
+    double area = double(kx)*ky;
+    for (int dy = 0; dy < ny; dy++){
+      for (int dx = 0; dx < nx; dx++){
+        int label = dy*nx + dx;
+
+        for (int row = 0; row < left.rows(); row++)
+          matching_term(cost_type, &left(0, row), &right(dx, row + dy),
+                        left.cols(), &term[row*left.cols()]);
+        box_sum(&term[0], left.cols(), left.rows(), left.cols(), kx, ky, &cost[0]);
+
+        for (int row = 0; row < rows; row++){
+          double* row_cost = &cost[row*cols];
+          if (ncc){
+            const double* lm = &left_mean [row*cols];
+            const double* ld = &left_dev  [row*cols];
+            const double* rm = &right_mean[(row + dy)*rcols + dx];
+            const double* rd = &right_dev [(row + dy)*rcols + dx];
+            for (int col = 0; col < cols; col++){
+              double den = ld[col]*rd[col];
+              row_cost[col] = (den > 0) ?
+                -(row_cost[col] - area*lm[col]*rm[col])/den : 0.0;
+            }
+          }
+
+          const uint8* lmask = &left_mask(half_kernel.x(), row + half_kernel.y());
+          const uint8* rmask = &right_mask(half_kernel.x() + dx, row + half_kernel.y() + dy);
+          double* lbest  = &best_cost [row*cols];
+          int*    llabel = &best_label[row*cols];
+          double* rbest  = &right_best_cost [(row + dy)*rcols + dx];
+          int*    rlabel = &right_best_label[(row + dy)*rcols + dx];
+          for (int col = 0; col < cols; col++){
+            if (!lmask[col] || !rmask[col]) continue;
+            double c = row_cost[col];
+            if (c < lbest[col]){
+              lbest[col]  = c;
+              llabel[col] = label;
+            }
+            if (c < rbest[col]){
+              rbest[col]  = c;
+              rlabel[col] = label;
+            }
+          }
+        }
+      }
+    }
+
+    for (int row = 0; row < rows; row++){
+      for (int col = 0; col < cols; col++){
+        int label = best_label[row*cols + col];
+        if (label < 0) continue;
+
+        // The cross correlation is undefined for a textureless left
+        // window, as its cost is the same at all disparities.
+        if (ncc && left_dev[row*cols + col] <= 0) continue;
+        int bx = label % nx, by = label / nx;
+
+        if (xcorr_threshold >= 0){
+          int rl = right_best_label[(row + by)*rcols + col + bx];
+          if (rl < 0 ||
+              std::abs(rl % nx - bx) > xcorr_threshold ||
+              std::abs(rl / nx - by) > xcorr_threshold)
+            continue;
+        }
+
+        disparity(col, row) = PixelMask<Vector2i>(Vector2i(bx, by) + search_range.min());
+      }
+    }
+
+    return disparity;
+  }
+
+} // namespace asp
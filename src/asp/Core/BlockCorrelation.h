@@ -0,0 +1,72 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlockCorrelation.h
+///
+/// Integer disparity by exhaustive block matching, with the window
+/// costs aggregated by box filtering.
+///
+/// For each disparity, the per-pixel matching term is computed once
+/// and summed over the windows with running sums, so the cost of a
+/// disparity does not depend on the kernel size. For normalized cross
+/// correlation the window means and variances of both images do not
+/// depend on the disparity, so they are computed once, and only the
+/// sum of products is aggregated per disparity.
+
+#ifndef __ASP_CORE_BLOCK_CORRELATION_H__
+#define __ASP_CORE_BLOCK_CORRELATION_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vw/Stereo/CostFunctions.h>
+
+namespace asp {
+
+  /// Compute the integer disparity by block matching with the given
+  /// cost, which must be ABSOLUTE_DIFFERENCE, SQUARED_DIFFERENCE or
+  /// CROSS_CORRELATION.
+  ///
+  /// The inputs follow the conventions of semi_global_matching(). If
+  /// the kernel has half-size (hx, hy), the output has size
+  /// (left.cols() - 2*hx, left.rows() - 2*hy), and its pixel (i, j)
+  /// corresponds to the pixel (i + hx, j + hy) of the left image. The
+  /// right image must be the region of the full right image starting
+  /// at the left image origin plus search_range.min(), of size
+  /// left size plus search_range.size(). The search range is
+  /// inclusive of its max corner.
+  ///
+  /// Pixels whose mask value is zero are not matched, nor, for cross
+  /// correlation, pixels whose left window is constant. If
+  /// xcorr_threshold is non-negative, disparities which disagree by
+  /// more than that many pixels with the right-to-left match are
+  /// invalidated.
+  vw::ImageView<vw::PixelMask<vw::Vector2i> >
+  block_correlation(vw::ImageView<float> const& left,
+                    vw::ImageView<float> const& right,
+                    vw::ImageView<vw::uint8> const& left_mask,
+                    vw::ImageView<vw::uint8> const& right_mask,
+                    vw::BBox2i const& search_range,
+                    vw::Vector2i const& kernel_size,
+                    vw::stereo::CostFunctionType cost_type,
+                    float xcorr_threshold);
+
+} // namespace asp
+
+#endif//__ASP_CORE_BLOCK_CORRELATION_H__
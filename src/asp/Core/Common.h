@@ -25,12 +25,16 @@
 #include <boost/program_options.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/shared_ptr.hpp>
+#include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
 #include <vw/Image/ImageIO.h>
 #include <vw/FileIO/DiskImageResourceGDAL.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Math/Vector.h>
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Cartography/GeoReference.h>
+#include <cmath>
+#include <limits>
 #include <map>
 #include <string>
 
@@ -303,12 +307,135 @@ namespace asp {
       ( image.impl(), RoundImagePixels<typename ImageT::pixel_type>(rounding_error) );
   }
 
+  // Multiply each channel of given vector image by the matching
+  // channel of a given vector.
+  template <class VecT>
+  struct ScaleChannels: public vw::ReturnFixedType<VecT> {
+    VecT m_scale;
+    ScaleChannels(VecT const& scale):m_scale(scale){}
+    VecT operator() (VecT const& pt) const {
+      return elem_prod(pt, m_scale);
+    }
+  };
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, ScaleChannels<typename ImageT::pixel_type> >
+  inline scale_channels( vw::ImageViewBase<ImageT> const& image,
+                         typename ImageT::pixel_type const& scale ) {
+    return vw::UnaryPerPixelView<ImageT, ScaleChannels<typename ImageT::pixel_type> >
+      ( image.impl(), ScaleChannels<typename ImageT::pixel_type>(scale) );
+  }
+
+  // Convert the pixels of a point cloud to integers. The first 3
+  // components become multiples of rounding_error away from the
+  // shift, and the others, the triangulation error, multiples of
+  // error_rounding_error, clamped to 32 bits. Missing points, with the
+  // first 3 components (0, 0, 0), stay that way.
+  //
+  // Two kinds of valid points cannot be stored as they are. A point
+  // within rounding_error/2 of the shift would become (0, 0, 0) and
+  // read back as missing, so it is moved by one rounding_error along
+  // its largest offset instead. A point too far from the shift to be
+  // stored in 32 bits becomes missing. Both are counted, in counters
+  // shared by all copies of the functor, so that a writer can report
+  // them with warn_if_points_changed().
+  template <class VecT>
+  struct QuantizePoints: public vw::ReturnFixedType< vw::Vector<vw::int32, vw::CompoundNumChannels<VecT>::value> > {
+    typedef vw::Vector<vw::int32, vw::CompoundNumChannels<VecT>::value> result_type;
+
+    struct Counts {
+      vw::Mutex mutex;
+      vw::uint64 num_moved, num_dropped;
+      Counts(): num_moved(0), num_dropped(0){}
+    };
+
+    vw::Vector3 m_shift;
+    double m_rounding_error, m_error_rounding_error;
+    boost::shared_ptr<Counts> m_counts;
+    QuantizePoints(vw::Vector3 const& shift, double rounding_error,
+                   double error_rounding_error):
+      m_shift(shift), m_rounding_error(rounding_error),
+      m_error_rounding_error(error_rounding_error), m_counts(new Counts){
+      VW_ASSERT( m_rounding_error > 0.0 && m_error_rounding_error > 0.0,
+                 vw::ArgumentErr() << "Rounding error must be positive.");
+    }
+    result_type operator() (VecT const& pt) const {
+      result_type result;
+      int len = std::min(3, (int)pt.size());
+      if (subvector(pt, 0, len) == subvector(vw::Vector3(), 0, len))
+        return result;
+      double max_value = std::numeric_limits<vw::int32>::max();
+      for (int i = 0; i < (int)pt.size(); i++){
+        double value;
+        if (i < 3){
+          value = round((pt[i] - m_shift[i])/m_rounding_error);
+          if (!(std::abs(value) <= max_value)){ // Catches NaN
+            vw::Mutex::Lock lock(m_counts->mutex);
+            m_counts->num_dropped++;
+            return result_type();
+          }
+        }else{
+          value = round(pt[i]/m_error_rounding_error);
+          value = std::max(-max_value, std::min(max_value, value));
+        }
+        result[i] = vw::int32(value);
+      }
+
+      if (subvector(result, 0, len) == subvector(result_type(), 0, len)){
+        int axis = 0;
+        for (int i = 1; i < len; i++){
+          if (std::abs(pt[i] - m_shift[i]) > std::abs(pt[axis] - m_shift[axis]))
+            axis = i;
+        }
+        result[axis] = (pt[axis] >= m_shift[axis]) ? 1 : -1;
+        vw::Mutex::Lock lock(m_counts->mutex);
+        m_counts->num_moved++;
+      }
+      return result;
+    }
+
+    // Warn about the points changed so far by more than the rounding
+    void warn_if_points_changed() const {
+      vw::Mutex::Lock lock(m_counts->mutex);
+      if (m_counts->num_moved > 0)
+        vw::vw_out(vw::WarningMessage) << m_counts->num_moved
+                                       << " point(s) within half the rounding error of the "
+                                       << "point cloud center were moved by one rounding "
+                                       << "error, so that they are not read as missing.\n";
+      if (m_counts->num_dropped > 0)
+        vw::vw_out(vw::WarningMessage) << m_counts->num_dropped
+                                       << " point(s) too far from the point cloud center "
+                                       << "to be stored as 32-bit integers were written as "
+                                       << "missing. Use a larger rounding error.\n";
+    }
+  };
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, QuantizePoints<typename ImageT::pixel_type> >
+  inline quantize_points( vw::ImageViewBase<ImageT> const& image,
+                          QuantizePoints<typename ImageT::pixel_type> const& quantizer ) {
+    return vw::UnaryPerPixelView<ImageT, QuantizePoints<typename ImageT::pixel_type> >
+      ( image.impl(), quantizer );
+  }
+  template <class ImageT>
+  vw::UnaryPerPixelView<ImageT, QuantizePoints<typename ImageT::pixel_type> >
+  inline quantize_points( vw::ImageViewBase<ImageT> const& image,
+                          vw::Vector3 const& shift, double rounding_error,
+                          double error_rounding_error ) {
+    return quantize_points(image, QuantizePoints<typename ImageT::pixel_type>
+                           (shift, rounding_error, error_rounding_error));
+  }
+
   // Note: We use this constant in the python code as well
   const std::string POINT_OFFSET = "POINT_OFFSET";
 
+  // Present in point clouds stored as integers. Each channel must be
+  // multiplied by its value from here before adding the shift.
+  // Note: We use this constant in the python code as well
+  const std::string POINT_SCALE = "POINT_SCALE";
+
   // Given an image with each pixel a vector of size m, return the
   // first n channels of that image. We must have 1 <= n <= m <= 6.
-  // If the image was written by subtracting a shift, put that shift back.
+  // If the image was written by subtracting a shift, put that shift
+  // back. If it was quantized, scale it back.
   template<int n>
   vw::ImageViewRef< vw::Vector<double, n> > read_n_channels(std::string filename){
 
@@ -321,6 +448,13 @@ namespace asp {
     if (vw::cartography::read_header_string(*rsrc.get(), POINT_OFFSET, shift_str)){
       shift = str_to_vec<vw::Vector3>(shift_str);
     }
+    bool quantized = false;
+    vw::Vector<double, n> scale;
+    std::string scale_str;
+    if (vw::cartography::read_header_string(*rsrc.get(), POINT_SCALE, scale_str)){
+      quantized = true;
+      scale = str_to_vec< vw::Vector<double, n> >(scale_str);
+    }
 
     VW_ASSERT( 1 <= n,
                vw::ArgumentErr() << "Attempting to read " << n << " channel(s) from an image.");
@@ -339,6 +473,8 @@ namespace asp {
     else if (m == 5) out_image = select_points<n, 5>(vw::DiskImageView< vw::Vector<double, 5> >(filename));
     else if (m == 6) out_image = select_points<n, 6>(vw::DiskImageView< vw::Vector<double, 6> >(filename));
 
+    if (quantized)
+      out_image = scale_channels(out_image, scale);
     out_image = subtract_shift(out_image, -shift);
 
     return out_image;
@@ -411,6 +547,65 @@ namespace asp {
     }
   }
 
+  // Block write a point cloud as integers, with quantize_points(),
+  // saving the shift and the scale of each channel in the header.
+  template <class ImageT>
+  void block_write_quantized_gdal_image( const std::string &filename,
+                                         vw::Vector3 const& shift,
+                                         double rounding_error,
+                                         double error_rounding_error,
+                                         vw::ImageViewBase<ImageT> const& image,
+                                         BaseOptions const& opt,
+                                         vw::ProgressCallback const& progress_callback
+                                         = vw::ProgressCallback::dummy_instance() ) {
+
+    QuantizePoints<typename ImageT::pixel_type>
+      quantizer(shift, rounding_error, error_rounding_error);
+    typename ImageT::pixel_type scale;
+    for (int i = 0; i < (int)scale.size(); i++)
+      scale[i] = (i < 3) ? rounding_error : error_rounding_error;
+
+    boost::scoped_ptr<vw::DiskImageResourceGDAL>
+      rsrc( build_gdal_rsrc( filename,
+                             quantize_points(image.impl(), quantizer),
+                             opt ) );
+    vw::cartography::write_header_string(*rsrc, POINT_OFFSET, vec_to_str(shift));
+    vw::cartography::write_header_string(*rsrc, POINT_SCALE, vec_to_str(scale));
+    vw::block_write_image( *rsrc,
+                           quantize_points(image.impl(), quantizer),
+                           progress_callback );
+    quantizer.warn_if_points_changed();
+  }
+
+  // Same as above, using a single thread.
+  template <class ImageT>
+  void write_quantized_gdal_image( const std::string &filename,
+                                   vw::Vector3 const& shift,
+                                   double rounding_error,
+                                   double error_rounding_error,
+                                   vw::ImageViewBase<ImageT> const& image,
+                                   BaseOptions const& opt,
+                                   vw::ProgressCallback const& progress_callback
+                                   = vw::ProgressCallback::dummy_instance() ) {
+
+    QuantizePoints<typename ImageT::pixel_type>
+      quantizer(shift, rounding_error, error_rounding_error);
+    typename ImageT::pixel_type scale;
+    for (int i = 0; i < (int)scale.size(); i++)
+      scale[i] = (i < 3) ? rounding_error : error_rounding_error;
+
+    boost::scoped_ptr<vw::DiskImageResourceGDAL>
+      rsrc( build_gdal_rsrc( filename,
+                             quantize_points(image.impl(), quantizer),
+                             opt ) );
+    vw::cartography::write_header_string(*rsrc, POINT_OFFSET, vec_to_str(shift));
+    vw::cartography::write_header_string(*rsrc, POINT_SCALE, vec_to_str(scale));
+    vw::write_image( *rsrc,
+                     quantize_points(image.impl(), quantizer),
+                     progress_callback );
+    quantizer.warn_if_points_changed();
+  }
+
 } // namespace asp
 
 // Custom Boost Program Options validators for VW/ASP types
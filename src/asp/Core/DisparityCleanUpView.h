@@ -0,0 +1,137 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityCleanUpView.h
+///
+
+#ifndef __ASP_CORE_DISPARITY_CLEANUP_VIEW_H__
+#define __ASP_CORE_DISPARITY_CLEANUP_VIEW_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Stereo/DisparityMap.h>
+
+namespace asp {
+
+  /// Several disparity cleanup passes, fused. Each pass looks at the
+  /// neighborhood of a pixel in the output of the previous pass, so
+  /// chaining the passes lazily recomputes the earlier passes many
+  /// times over. Here the input tile is read once, with a halo
+  /// covering all passes, and each pass is rasterized in memory over
+  /// the tile and what is left of the halo. Each pass sees its input
+  /// as a full-size view which is invalid outside the region in
+  /// memory, so the result is the same as for the chained passes.
+  ///
+  /// With filter_mode 1 the passes are
+  /// stereo::disparity_cleanup_using_mean() with max_mean_diff, and
+  /// with filter_mode 2 they are
+  /// stereo::disparity_cleanup_using_thresh() with rm_threshold and
+  /// rm_min_matches, the latter a percentage.
+  template <class ViewT>
+  class FusedDisparityCleanUpView : public vw::ImageViewBase<FusedDisparityCleanUpView<ViewT> > {
+    ViewT m_input;
+    int m_num_passes, m_filter_mode;
+    vw::Vector2i m_half_kernel;
+    double m_max_mean_diff, m_rm_threshold, m_rm_min_matches;
+
+    typedef typename ViewT::pixel_type InputPixelT;
+
+    // A tile held in memory as a view of the size of the input, which
+    // is invalid outside the tile.
+    typedef vw::CropView<vw::EdgeExtendView<vw::ImageView<InputPixelT>, vw::ZeroEdgeExtension> > TileViewT;
+    TileViewT tile_view( vw::ImageView<InputPixelT> const& tile, vw::BBox2i const& region ) const {
+      return vw::crop( vw::edge_extend(tile, vw::ZeroEdgeExtension()),
+                       -region.min().x(), -region.min().y(), cols(), rows() );
+    }
+
+  public:
+    typedef InputPixelT pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<FusedDisparityCleanUpView> pixel_accessor;
+
+    FusedDisparityCleanUpView( vw::ImageViewBase<ViewT> const& input, int num_passes,
+                               int filter_mode, vw::Vector2i const& half_kernel,
+                               double max_mean_diff, double rm_threshold,
+                               double rm_min_matches ) :
+      m_input(input.impl()), m_num_passes(num_passes), m_filter_mode(filter_mode),
+      m_half_kernel(half_kernel), m_max_mean_diff(max_mean_diff),
+      m_rm_threshold(rm_threshold), m_rm_min_matches(rm_min_matches) {
+      if (filter_mode != 1 && filter_mode != 2)
+        vw::vw_throw( vw::ArgumentErr() << "\nExpecting value of 1 or 2 for filter-mode. "
+                      << "Got: " << filter_mode << "\n" );
+    }
+
+    inline vw::int32 cols() const { return m_input.cols(); }
+    inline vw::int32 rows() const { return m_input.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p = 0 ) const {
+      return prerasterize( vw::BBox2i(i, j, 1, 1) )(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize( vw::BBox2i const& bbox ) const {
+
+      vw::BBox2i region = bbox;
+      region.min() -= m_num_passes*m_half_kernel;
+      region.max() += m_num_passes*m_half_kernel;
+      region.crop( bounding_box(m_input) );
+      vw::ImageView<pixel_type> tile = vw::crop( m_input, region );
+
+      for ( int pass = 1; pass <= m_num_passes; pass++ ) {
+        // The pixels of the next region see only pixels of this one
+        vw::BBox2i next_region = bbox;
+        next_region.min() -= (m_num_passes - pass)*m_half_kernel;
+        next_region.max() += (m_num_passes - pass)*m_half_kernel;
+        next_region.crop( bounding_box(m_input) );
+
+        vw::ImageView<pixel_type> next_tile;
+        if ( m_filter_mode == 1 )
+          next_tile = vw::crop( vw::stereo::disparity_cleanup_using_mean
+                                (tile_view(tile, region),
+                                 m_half_kernel.x(), m_half_kernel.y(),
+                                 m_max_mean_diff),
+                                next_region );
+        else
+          next_tile = vw::crop( vw::stereo::disparity_cleanup_using_thresh
+                                (tile_view(tile, region),
+                                 m_half_kernel.x(), m_half_kernel.y(),
+                                 m_rm_threshold, m_rm_min_matches/100.0),
+                                next_region );
+        tile   = next_tile;
+        region = next_region;
+      }
+
+      return prerasterize_type( tile, -region.min().x(), -region.min().y(),
+                                cols(), rows() );
+    }
+
+    template <class DestT>
+    inline void rasterize( DestT const& dest, vw::BBox2i const& bbox ) const {
+      vw::rasterize( prerasterize(bbox), dest, bbox );
+    }
+  };
+
+} // namespace asp
+
+#endif//__ASP_CORE_DISPARITY_CLEANUP_VIEW_H__
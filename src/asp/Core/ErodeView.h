@@ -70,7 +70,7 @@ class ErodeView : public vw::ImageViewBase<ErodeView<ViewT> > {
       if ( bbox->contains(lookup) ) {
         // Determing now if the compressed blob really does contain this point
         vw::Vector2i local = lookup - bbox->min();
-        typedef std::list<vw::int32>::const_iterator inner_iter;
+        typedef blob::BlobCompressed::segment_iterator inner_iter;
         for ( inner_iter start = blob->start(local.y()).begin(),
                 end = blob->end(local.y()).begin();
               start != blob->start(local.y()).end();
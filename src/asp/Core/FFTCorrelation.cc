@@ -0,0 +1,458 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file FFTCorrelation.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <asp/Core/FFTCorrelation.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace vw;
+
+namespace {
+
+  typedef std::complex<double> ComplexT;
+  typedef PixelMask<Vector2i>  DispT;
+
+  int next_power_of_two(int n){
+    int p = 1;
+    while (p < n) p *= 2;
+    return p;
+  }
+
+  // Radix-2 transform of n values spaced by stride
+  void fft_1d(ComplexT * data, int n, int stride, bool inverse){
+
+    // Bit-reversal permutation
+    for (int i = 1, j = 0; i < n; i++){
+      int bit = n >> 1;
+      for ( ; j & bit; bit >>= 1)
+        j ^= bit;
+      j ^= bit;
+      if (i < j)
+        std::swap(data[i*stride], data[j*stride]);
+    }
+
+    for (int len = 2; len <= n; len *= 2){
+      double angle = 2*M_PI/len * (inverse ? 1 : -1);
+      ComplexT step(std::cos(angle), std::sin(angle));
+      for (int i = 0; i < n; i += len){
+        ComplexT w(1.0, 0.0);
+        for (int k = 0; k < len/2; k++){
+          ComplexT a = data[(i + k)*stride];
+          ComplexT b = data[(i + k + len/2)*stride] * w;
+          data[(i + k)*stride]         = a + b;
+          data[(i + k + len/2)*stride] = a - b;
+          w *= step;
+        }
+      }
+    }
+  }
+
+  // Sums over the rectangles of an image, with a row and column of
+  // zeros before the first ones.
+  struct IntegralImage {
+    int cols;
+    std::vector<double> sums;
+
+    template <class FuncT>
+    IntegralImage(int image_cols, int image_rows, FuncT const& func):
+      cols(image_cols + 1), sums((image_cols + 1)*(image_rows + 1), 0.0) {
+      for (int row = 0; row < image_rows; row++){
+        double row_sum = 0;
+        for (int col = 0; col < image_cols; col++){
+          row_sum += func(col, row);
+          sums[(row + 1)*cols + col + 1] = sums[row*cols + col + 1] + row_sum;
+        }
+      }
+    }
+
+    double sum(int col, int row, int width, int height) const {
+      return sums[(row + height)*cols + col + width] - sums[row*cols + col + width]
+        - sums[(row + height)*cols + col] + sums[row*cols + col];
+    }
+  };
+
+  struct PixelValue {
+    ImageView<float> const& image;
+    PixelValue(ImageView<float> const& image): image(image) {}
+    double operator()(int col, int row) const { return image(col, row); }
+  };
+  struct SquaredValue {
+    ImageView<float> const& image;
+    SquaredValue(ImageView<float> const& image): image(image) {}
+    double operator()(int col, int row) const {
+      return double(image(col, row))*image(col, row);
+    }
+  };
+  struct InvalidCount {
+    ImageView<uint8> const& mask;
+    InvalidCount(ImageView<uint8> const& mask): mask(mask) {}
+    double operator()(int col, int row) const { return mask(col, row) == 0; }
+  };
+
+  // The matching of the cells of one grid, and the state they share
+  struct CellMatcher {
+    ImageView<float> const& left;
+    ImageView<float> const& right;
+    ImageView<uint8> const& left_mask;
+    ImageView<uint8> const& right_mask;
+    double min_score;
+
+    CellMatcher(ImageView<float> const& left, ImageView<float> const& right,
+                ImageView<uint8> const& left_mask, ImageView<uint8> const& right_mask,
+                double min_score):
+      left(left), right(right), left_mask(left_mask), right_mask(right_mask),
+      min_score(min_score) {}
+
+    // Match the given box of the left image over the given inclusive
+    // search range. The right image outside its bounds is invalid.
+    DispT match(BBox2i const& tmpl_box, BBox2i const& search_range) const {
+
+      BBox2i search_box(tmpl_box.min() + search_range.min(),
+                        tmpl_box.max() + search_range.max());
+
+      ImageView<float> tmpl(tmpl_box.width(), tmpl_box.height());
+      ImageView<uint8> tmpl_mask(tmpl_box.width(), tmpl_box.height());
+      for (int row = 0; row < tmpl.rows(); row++){
+        for (int col = 0; col < tmpl.cols(); col++){
+          tmpl(col, row)      = left(tmpl_box.min().x() + col, tmpl_box.min().y() + row);
+          tmpl_mask(col, row) = left_mask(tmpl_box.min().x() + col, tmpl_box.min().y() + row);
+        }
+      }
+
+      ImageView<float> search(search_box.width(), search_box.height());
+      ImageView<uint8> search_mask(search_box.width(), search_box.height());
+      for (int row = 0; row < search.rows(); row++){
+        for (int col = 0; col < search.cols(); col++){
+          int x = search_box.min().x() + col, y = search_box.min().y() + row;
+          bool inside = (x >= 0 && y >= 0 && x < right.cols() && y < right.rows());
+          search(col, row)      = inside ? right(x, y) : 0.0f;
+          search_mask(col, row) = inside ? right_mask(x, y) : 0;
+        }
+      }
+
+      DispT disp;
+      invalidate(disp);
+      Vector2i offset;
+      double score;
+      if (!asp::fft_template_match(tmpl, tmpl_mask, search, search_mask, offset, score) ||
+          score < min_score)
+        return disp;
+      disp = DispT(search_box.min() + offset - tmpl_box.min());
+      return disp;
+    }
+  };
+
+  // The valid disparities among the neighbors of a cell
+  std::vector<Vector2i> valid_neighbors(ImageView<DispT> const& grid, int col, int row){
+    std::vector<Vector2i> neighbors;
+    for (int j = std::max(row - 1, 0); j <= std::min(row + 1, grid.rows() - 1); j++){
+      for (int i = std::max(col - 1, 0); i <= std::min(col + 1, grid.cols() - 1); i++){
+        if ((i != col || j != row) && is_valid(grid(i, j)))
+          neighbors.push_back(grid(i, j).child());
+      }
+    }
+    return neighbors;
+  }
+
+  int median(std::vector<int> values){
+    std::nth_element(values.begin(), values.begin() + values.size()/2, values.end());
+    return values[values.size()/2];
+  }
+
+  // Match one row of cells. Coarse cells are matched with a template
+  // at their center over the whole search range. Fine cells are
+  // matched whole over the range of the coarse matches around them.
+  class CellRowTask: public Task, private boost::noncopyable {
+    CellMatcher const& m_matcher;
+    int m_row, m_cell_size, m_template_size;
+    BBox2i m_search_range;
+    ImageView<DispT> const* m_coarse; // null for the coarse pass
+    ImageView<DispT> & m_grid;
+  public:
+    CellRowTask(CellMatcher const& matcher, int row, int cell_size, int template_size,
+                BBox2i const& search_range, ImageView<DispT> const* coarse,
+                ImageView<DispT> & grid):
+      m_matcher(matcher), m_row(row), m_cell_size(cell_size),
+      m_template_size(template_size), m_search_range(search_range),
+      m_coarse(coarse), m_grid(grid) {}
+
+    void operator()() {
+      Vector2i image_size(m_matcher.left.cols(), m_matcher.left.rows());
+      for (int col = 0; col < m_grid.cols(); col++){
+
+        BBox2i cell(col*m_cell_size, m_row*m_cell_size, m_cell_size, m_cell_size);
+        cell.crop(BBox2i(Vector2i(0, 0), image_size));
+        invalidate(m_grid(col, m_row));
+
+        if (!m_coarse){
+          // The template at the center of the cell, moved inside the image
+          Vector2i corner = (cell.min() + cell.max())/2 - Vector2i(1, 1)*(m_template_size/2);
+          for (int i = 0; i < 2; i++)
+            corner[i] = std::max(0, std::min(corner[i], image_size[i] - m_template_size));
+          BBox2i tmpl_box(corner, corner + Vector2i(1, 1)*m_template_size);
+          m_grid(col, m_row) = m_matcher.match(tmpl_box, m_search_range);
+          continue;
+        }
+
+        // The range of the coarse matches around the cell center,
+        // grown by half a cell for the variation within the cells.
+        Vector2i center = (cell.min() + cell.max())/2;
+        int coarse_cell_size = 4*m_cell_size;
+        int ci = center.x()/coarse_cell_size, cj = center.y()/coarse_cell_size;
+        bool has_range = false;
+        Vector2i range_min, range_max;
+        for (int j = std::max(cj - 1, 0); j <= std::min(cj + 1, m_coarse->rows() - 1); j++){
+          for (int i = std::max(ci - 1, 0); i <= std::min(ci + 1, m_coarse->cols() - 1); i++){
+            if (!is_valid((*m_coarse)(i, j))) continue;
+            Vector2i disp = (*m_coarse)(i, j).child();
+            range_min = has_range ? elem_min(range_min, disp) : disp;
+            range_max = has_range ? elem_max(range_max, disp) : disp;
+            has_range = true;
+          }
+        }
+        if (!has_range)
+          continue; // nothing to go by
+        Vector2i margin = Vector2i(1, 1)*(m_cell_size/2);
+        m_grid(col, m_row) = m_matcher.match(cell, BBox2i(range_min - margin,
+                                                          range_max + margin));
+      }
+    }
+  };
+
+  // Match all cells of the given size, one task per row
+  void match_grid(CellMatcher const& matcher, int cell_size, int template_size,
+                  BBox2i const& search_range, ImageView<DispT> const* coarse,
+                  ImageView<DispT> & grid){
+    grid.set_size((matcher.left.cols() + cell_size - 1)/cell_size,
+                  (matcher.left.rows() + cell_size - 1)/cell_size);
+    FifoWorkQueue queue( vw_settings().default_num_threads() );
+    for (int row = 0; row < grid.rows(); row++){
+      boost::shared_ptr<CellRowTask>
+        task(new CellRowTask(matcher, row, cell_size, template_size,
+                             search_range, coarse, grid));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  void fft_2d(ImageView<ComplexT> & data, bool inverse){
+
+    int cols = data.cols(), rows = data.rows();
+    VW_ASSERT( cols == next_power_of_two(cols) && rows == next_power_of_two(rows),
+               ArgumentErr() << "fft_2d: The image dimensions must be powers of two.\n" );
+
+    ComplexT * ptr = &data(0, 0);
+    for (int row = 0; row < rows; row++)
+      fft_1d(ptr + row*cols, cols, 1, inverse);
+    for (int col = 0; col < cols; col++)
+      fft_1d(ptr + col, rows, cols, inverse);
+
+    if (inverse){
+      double scale = 1.0/(double(cols)*rows);
+      for (int row = 0; row < rows; row++)
+        for (int col = 0; col < cols; col++)
+          data(col, row) *= scale;
+    }
+  }
+
+  bool fft_template_match(ImageView<float> const& tmpl,
+                          ImageView<uint8> const& tmpl_mask,
+                          ImageView<float> const& search,
+                          ImageView<uint8> const& search_mask,
+                          Vector2i & offset, double & score){
+
+    int tc = tmpl.cols(), tr = tmpl.rows();
+    int sc = search.cols(), sr = search.rows();
+    if (tc <= 0 || tr <= 0 || sc < tc || sr < tr)
+      return false;
+
+    // The template minus its mean. Since it sums to zero, its
+    // correlation with a window does not depend on the window mean.
+    double n = double(tc)*tr, mean = 0;
+    for (int row = 0; row < tr; row++){
+      for (int col = 0; col < tc; col++){
+        if (tmpl_mask(col, row) == 0)
+          return false;
+        mean += tmpl(col, row);
+      }
+    }
+    mean /= n;
+
+    int pc = next_power_of_two(sc), pr = next_power_of_two(sr);
+    ImageView<ComplexT> tmpl_fft(pc, pr), search_fft(pc, pr);
+    double tmpl_norm2 = 0;
+    for (int row = 0; row < pr; row++){
+      for (int col = 0; col < pc; col++){
+        tmpl_fft(col, row)   = 0;
+        search_fft(col, row) = 0;
+      }
+    }
+    for (int row = 0; row < tr; row++){
+      for (int col = 0; col < tc; col++){
+        double val = tmpl(col, row) - mean;
+        tmpl_fft(col, row) = val;
+        tmpl_norm2 += val*val;
+      }
+    }
+    if (tmpl_norm2 <= 1e-10*n)
+      return false; // no texture
+    for (int row = 0; row < sr; row++)
+      for (int col = 0; col < sc; col++)
+        if (search_mask(col, row) != 0)
+          search_fft(col, row) = search(col, row);
+
+    // The correlation at each offset is the inverse transform of the
+    // conjugate template spectrum times the search spectrum. Offsets
+    // of valid placements do not wrap around.
+    fft_2d(tmpl_fft, false);
+    fft_2d(search_fft, false);
+    for (int row = 0; row < pr; row++)
+      for (int col = 0; col < pc; col++)
+        search_fft(col, row) *= std::conj(tmpl_fft(col, row));
+    fft_2d(search_fft, true);
+
+    IntegralImage sums(sc, sr, PixelValue(search));
+    IntegralImage sums2(sc, sr, SquaredValue(search));
+    IntegralImage invalid(sc, sr, InvalidCount(search_mask));
+
+    bool found = false;
+    score = -1;
+    for (int v = 0; v <= sr - tr; v++){
+      for (int u = 0; u <= sc - tc; u++){
+        if (invalid.sum(u, v, tc, tr) > 0)
+          continue;
+        double sum = sums.sum(u, v, tc, tr);
+        double var = sums2.sum(u, v, tc, tr) - sum*sum/n;
+        if (var <= 1e-10*n)
+          continue;
+        double ncc = search_fft(u, v).real()/std::sqrt(tmpl_norm2*var);
+        if (!found || ncc > score){
+          found  = true;
+          score  = ncc;
+          offset = Vector2i(u, v);
+        }
+      }
+    }
+    return found;
+  }
+
+  void fft_seed_disparity(ImageView<float> const& left,
+                          ImageView<float> const& right,
+                          ImageView<uint8> const& left_mask,
+                          ImageView<uint8> const& right_mask,
+                          BBox2i const& search_range,
+                          int template_size, double min_score,
+                          ImageView<DispT> & disparity,
+                          ImageView<DispT> & spread){
+
+    VW_ASSERT( template_size > 1,
+               ArgumentErr() << "fft_seed_disparity: The template size must be at least 2.\n" );
+
+    disparity.set_size(left.cols(), left.rows());
+    spread.set_size(left.cols(), left.rows());
+    for (int row = 0; row < left.rows(); row++){
+      for (int col = 0; col < left.cols(); col++){
+        invalidate(disparity(col, row));
+        invalidate(spread(col, row));
+      }
+    }
+    if (left.cols() < template_size || left.rows() < template_size)
+      return;
+
+    CellMatcher matcher(left, right, left_mask, right_mask, min_score);
+
+    // Coarse matches over the whole search range
+    ImageView<DispT> coarse;
+    match_grid(matcher, 4*template_size, template_size, search_range, NULL, coarse);
+
+    // Drop the coarse matches which disagree with most of their neighbors
+    ImageView<DispT> filtered = copy(coarse);
+    for (int row = 0; row < coarse.rows(); row++){
+      for (int col = 0; col < coarse.cols(); col++){
+        if (!is_valid(coarse(col, row))) continue;
+        std::vector<Vector2i> neighbors = valid_neighbors(coarse, col, row);
+        if (neighbors.size() < 2) continue;
+        for (int i = 0; i < 2; i++){
+          std::vector<int> values;
+          for (size_t k = 0; k < neighbors.size(); k++)
+            values.push_back(neighbors[k][i]);
+          if (std::abs(coarse(col, row).child()[i] - median(values)) > template_size)
+            invalidate(filtered(col, row));
+        }
+      }
+    }
+
+    // Fine matches around the coarse ones
+    ImageView<DispT> fine;
+    match_grid(matcher, template_size, template_size, BBox2i(), &filtered, fine);
+
+    // Fill the cells without a match from their neighbors
+    ImageView<DispT> filled = copy(fine);
+    for (int row = 0; row < fine.rows(); row++){
+      for (int col = 0; col < fine.cols(); col++){
+        if (is_valid(fine(col, row))) continue;
+        std::vector<Vector2i> neighbors = valid_neighbors(fine, col, row);
+        if (neighbors.empty()) continue;
+        Vector2 mean;
+        for (size_t k = 0; k < neighbors.size(); k++)
+          mean += Vector2(neighbors[k]);
+        mean /= double(neighbors.size());
+        filled(col, row) = DispT(Vector2i(int(floor(mean.x() + 0.5)),
+                                             int(floor(mean.y() + 0.5))));
+      }
+    }
+
+    // The spread covers the neighbor cells, and the rounding
+    for (int row = 0; row < filled.rows(); row++){
+      for (int col = 0; col < filled.cols(); col++){
+        if (!is_valid(filled(col, row))) continue;
+        Vector2i disp = filled(col, row).child(), cell_spread(1, 1);
+        std::vector<Vector2i> neighbors = valid_neighbors(filled, col, row);
+        for (size_t k = 0; k < neighbors.size(); k++){
+          for (int i = 0; i < 2; i++)
+            cell_spread[i] = std::max(cell_spread[i], std::abs(neighbors[k][i] - disp[i]) + 1);
+        }
+
+        BBox2i cell(col*template_size, row*template_size, template_size, template_size);
+        cell.crop(bounding_box(left));
+        for (int y = cell.min().y(); y < cell.max().y(); y++){
+          for (int x = cell.min().x(); x < cell.max().x(); x++){
+            if (left_mask(x, y) == 0) continue;
+            disparity(x, y) = DispT(disp);
+            spread(x, y)    = DispT(cell_spread);
+          }
+        }
+      }
+    }
+  }
+
+} // namespace asp
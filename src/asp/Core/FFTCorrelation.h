@@ -0,0 +1,84 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file FFTCorrelation.h
+///
+/// Low-resolution disparity by template matching with normalized
+/// cross-correlation computed in the frequency domain, as done by
+/// sparse_disp. The cost of matching a template does not depend on
+/// its size, only on the size of the search window, so this can
+/// seed scenes whose search range is too large for block matching.
+
+#ifndef __ASP_CORE_FFT_CORRELATION_H__
+#define __ASP_CORE_FFT_CORRELATION_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <complex>
+
+namespace asp {
+
+  /// Discrete Fourier transform of an image, in place. Both
+  /// dimensions must be powers of two. The inverse transform is
+  /// scaled so that it undoes the forward one.
+  void fft_2d(vw::ImageView<std::complex<double> > & data, bool inverse);
+
+  /// Find the placement of the template within the search image with
+  /// the largest normalized cross-correlation. The offset of the
+  /// template corner within the search image is returned in offset,
+  /// and the correlation, between -1 and 1, in score. Placements
+  /// covering pixels whose mask value is zero are not considered.
+  /// Return false if there is no valid placement, if the template has
+  /// invalid pixels, or if it has no texture.
+  bool fft_template_match(vw::ImageView<float> const& tmpl,
+                          vw::ImageView<vw::uint8> const& tmpl_mask,
+                          vw::ImageView<float> const& search,
+                          vw::ImageView<vw::uint8> const& search_mask,
+                          vw::Vector2i & offset, double & score);
+
+  /// Compute the disparity from the left to the right image, and its
+  /// spread, at each pixel of the left image.
+  ///
+  /// The left image is first split into cells of four times the
+  /// given template size, and the template at the center of each
+  /// cell is matched over the whole search range. Matches which
+  /// disagree with their neighbors are dropped. Then the left image
+  /// is split into cells of the template size, and each is matched
+  /// over the range of the coarse matches around it. A cell is kept
+  /// if its correlation is at least min_score.
+  ///
+  /// All pixels of a cell get the disparity of the cell. The spread
+  /// is the largest difference with the disparities of the neighbor
+  /// cells, so that the disparity plus or minus the spread covers the
+  /// neighborhood. Cells without a match get the mean disparity of
+  /// their neighbors, if any. Pixels whose left mask value is zero
+  /// are invalid. The work is split among the VW threads.
+  void fft_seed_disparity(vw::ImageView<float> const& left,
+                          vw::ImageView<float> const& right,
+                          vw::ImageView<vw::uint8> const& left_mask,
+                          vw::ImageView<vw::uint8> const& right_mask,
+                          vw::BBox2i const& search_range,
+                          int template_size, double min_score,
+                          vw::ImageView<vw::PixelMask<vw::Vector2i> > & disparity,
+                          vw::ImageView<vw::PixelMask<vw::Vector2i> > & spread);
+
+} // namespace asp
+
+#endif//__ASP_CORE_FFT_CORRELATION_H__
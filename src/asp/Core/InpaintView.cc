@@ -0,0 +1,210 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file InpaintView.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/InpaintView.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace vw;
+
+namespace {
+
+  // The averaging kernel of the grassfire sweeps in InpaintTask
+  const float CORNER_WEIGHT = .176765;
+  const float EDGE_WEIGHT   = .073235;
+
+  const int NUM_PRE_SWEEPS  = 2;
+  const int NUM_POST_SWEEPS = 2;
+  const int MAX_V_CYCLES    = 30;
+
+  // A level of the multigrid hierarchy. We solve
+  //   x(p) - sum_q w_q x(q) = b(p)
+  // for the unknown pixels p, where q runs over the 8 neighbors of p
+  // inside the level. The other pixels keep their values, which are
+  // the known data on the finest level and zero on coarser ones,
+  // where x is a correction.
+  struct Level {
+    int cols, rows;
+    std::vector<uint8> unknown;
+    std::vector<float> x, b;
+    Level( int c, int r ) : cols(c), rows(r), unknown(c*r,0), x(c*r,0), b(c*r,0) {}
+  };
+
+  // Neighbor average minus the pixel, plus the right hand side
+  inline float residual( Level const& level, int col, int row ) {
+    float sum = 0;
+    for ( int dy = -1; dy <= 1; dy++ ) {
+      int r = row + dy;
+      if ( r < 0 || r >= level.rows ) continue;
+      for ( int dx = -1; dx <= 1; dx++ ) {
+        int c = col + dx;
+        if ( c < 0 || c >= level.cols || ( dx == 0 && dy == 0 ) ) continue;
+        sum += ( dx != 0 && dy != 0 ? CORNER_WEIGHT : EDGE_WEIGHT ) *
+          level.x[r*level.cols + c];
+      }
+    }
+    int p = row*level.cols + col;
+    return level.b[p] + sum - level.x[p];
+  }
+
+  // Gauss-Seidel
+  void smooth( Level & level, int num_sweeps ) {
+    for ( int s = 0; s < num_sweeps; s++ )
+      for ( int row = 0; row < level.rows; row++ )
+        for ( int col = 0; col < level.cols; col++ ) {
+          int p = row*level.cols + col;
+          if ( level.unknown[p] )
+            level.x[p] += residual( level, col, row );
+        }
+  }
+
+  float max_residual( Level const& level ) {
+    float result = 0;
+    for ( int row = 0; row < level.rows; row++ )
+      for ( int col = 0; col < level.cols; col++ )
+        if ( level.unknown[row*level.cols + col] )
+          result = std::max( result, std::abs( residual( level, col, row ) ) );
+    return result;
+  }
+
+  // Each coarse pixel covers 2x2 fine ones and is unknown only if all
+  // of them are. Unknown fine pixels next to the data are anchored by
+  // it and settle under smoothing alone, while letting the coarse
+  // grid correct them overshoots on thin holes. Doubling the grid
+  // spacing quadruples the operator, hence the right hand side is the
+  // sum of the four fine residuals.
+  Level restrict_residual( Level const& fine ) {
+    Level coarse( (fine.cols + 1)/2, (fine.rows + 1)/2 );
+    std::vector<int> count( coarse.cols*coarse.rows, 0 );
+    for ( int row = 0; row < fine.rows; row++ )
+      for ( int col = 0; col < fine.cols; col++ ) {
+        int p = (row/2)*coarse.cols + col/2;
+        if ( fine.unknown[row*fine.cols + col] ) {
+          coarse.b[p] += residual( fine, col, row );
+          count[p]++;
+        } else {
+          count[p] = -4;
+        }
+      }
+    for ( size_t p = 0; p < coarse.b.size(); p++ ) {
+      if ( count[p] > 0 ) {
+        coarse.unknown[p] = 1;
+        coarse.b[p] *= 4.0 / count[p];
+      } else {
+        coarse.b[p] = 0;
+      }
+    }
+    return coarse;
+  }
+
+  inline float coarse_value( Level const& coarse, int col, int row ) {
+    if ( col < 0 || col >= coarse.cols || row < 0 || row >= coarse.rows )
+      return 0;
+    return coarse.x[row*coarse.cols + col];
+  }
+
+  // Add the bilinear interpolation of the coarse correction. Coarse
+  // pixel centers sit between their fine pixels, so each fine pixel
+  // takes 9/16 from its own coarse pixel, 3/16 from the two coarse
+  // pixels toward it, and 1/16 from the diagonal one.
+  void prolong_correction( Level const& coarse, Level & fine ) {
+    for ( int row = 0; row < fine.rows; row++ ) {
+      int r = row/2, dr = ( row % 2 == 0 ) ? -1 : 1;
+      for ( int col = 0; col < fine.cols; col++ ) {
+        int p = row*fine.cols + col;
+        if ( !fine.unknown[p] ) continue;
+        int c = col/2, dc = ( col % 2 == 0 ) ? -1 : 1;
+        fine.x[p] += ( 9.0 * coarse_value( coarse, c,    r    ) +
+                       3.0 * coarse_value( coarse, c+dc, r    ) +
+                       3.0 * coarse_value( coarse, c,    r+dr ) +
+                       1.0 * coarse_value( coarse, c+dc, r+dr ) ) / 16.0;
+      }
+    }
+  }
+
+  void v_cycle( Level & level ) {
+    if ( level.cols <= 2 || level.rows <= 2 ) {
+      smooth( level, 20 );
+      return;
+    }
+
+    smooth( level, NUM_PRE_SWEEPS );
+    Level coarse = restrict_residual( level );
+    v_cycle( coarse );
+    prolong_correction( coarse, level );
+    smooth( level, NUM_POST_SWEEPS );
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+namespace inpaint_p {
+
+  void harmonic_fill_multigrid( ImageView<float> & values,
+                                ImageView<uint8> const& hole ) {
+    VW_ASSERT( values.cols() == hole.cols() && values.rows() == hole.rows(),
+               ArgumentErr() << "harmonic_fill_multigrid: The values and the hole "
+               << "must have the same size.\n" );
+
+    Level level( values.cols(), values.rows() );
+    float known_min = 0, known_max = 0, known_sum = 0;
+    int num_known = 0;
+    for ( int row = 0; row < level.rows; row++ )
+      for ( int col = 0; col < level.cols; col++ ) {
+        int p = row*level.cols + col;
+        level.unknown[p] = hole(col,row) != 0;
+        if ( level.unknown[p] )
+          continue;
+        level.x[p] = values(col,row);
+        if ( num_known == 0 )
+          known_min = known_max = level.x[p];
+        known_min = std::min( known_min, level.x[p] );
+        known_max = std::max( known_max, level.x[p] );
+        known_sum += level.x[p];
+        num_known++;
+      }
+    if ( num_known == 0 )
+      return;
+
+    // Start from the mean of the data and iterate until the residual
+    // is negligible compared to the data range.
+    float mean = known_sum / num_known;
+    for ( size_t p = 0; p < level.x.size(); p++ )
+      if ( level.unknown[p] )
+        level.x[p] = mean;
+    float tolerance = 1e-6 * std::max( known_max - known_min,
+                                       std::max( std::abs(known_min), std::abs(known_max) ) );
+    for ( int i = 0; i < MAX_V_CYCLES; i++ ) {
+      v_cycle( level );
+      if ( max_residual( level ) <= tolerance )
+        break;
+    }
+
+    for ( int row = 0; row < level.rows; row++ )
+      for ( int col = 0; col < level.cols; col++ )
+        if ( level.unknown[row*level.cols + col] )
+          values(col,row) = level.x[row*level.cols + col];
+  }
+
+}} // end namespace asp::inpaint_p
@@ -30,7 +30,9 @@
 #include <vw/Core/ThreadPool.h>
 #include <vw/Core/Stopwatch.h>
 #include <vw/Image/Algorithms.h>
+#include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewBase.h>
+#include <vw/Image/PixelMask.h>
 
 // ASP
 #include <asp/Core/BlobIndexThreaded.h>
@@ -39,6 +41,43 @@
 namespace asp {
   namespace inpaint_p {
 
+    // Replace the values where the hole is nonzero with the solution
+    // of the equations that the grassfire sweeps in InpaintTask
+    // iterate towards, each pixel being the kernel weighted average
+    // of its 8 neighbors. This uses multigrid, so the cost is close
+    // to linear in the hole area. Hole pixels on the image border see
+    // only their neighbors inside the image.
+    void harmonic_fill_multigrid( vw::ImageView<float> & values,
+                                  vw::ImageView<vw::uint8> const& hole );
+
+    // Apply the above to each channel of a masked image, and mark
+    // the filled pixels valid.
+    template <class PixelT>
+    void multigrid_fill( vw::ImageView<PixelT> & image,
+                         vw::ImageView<vw::uint8> const& hole ) {
+      using namespace vw;
+      typedef typename UnmaskedPixelType<PixelT>::type unmasked_type;
+      typedef typename CompoundChannelType<unmasked_type>::type channel_type;
+      const int num_channels = CompoundNumChannels<unmasked_type>::value;
+
+      ImageView<float> values( image.cols(), image.rows() );
+      for ( int c = 0; c < num_channels; c++ ) {
+        for ( int j = 0; j < image.rows(); j++ )
+          for ( int i = 0; i < image.cols(); i++ )
+            values(i,j) = compound_select_channel<channel_type const&>( image(i,j).child(), c );
+        harmonic_fill_multigrid( values, hole );
+        for ( int j = 0; j < image.rows(); j++ )
+          for ( int i = 0; i < image.cols(); i++ )
+            if ( hole(i,j) )
+              compound_select_channel<channel_type&>( image(i,j).child(), c ) =
+                channel_type( values(i,j) );
+      }
+      for ( int j = 0; j < image.rows(); j++ )
+        for ( int i = 0; i < image.cols(); i++ )
+          if ( hole(i,j) )
+            image(i,j).validate();
+    }
+
     // Semi-private tasks that I wouldn't like the user to know about
     //
     // This is used for threaded rendering
@@ -46,7 +85,7 @@ namespace asp {
     class InpaintTask : public vw::Task, boost::noncopyable {
       ViewT const& m_view;
       blob::BlobCompressed m_c_blob;
-      bool m_use_grassfire;
+      bool m_use_grassfire, m_use_multigrid;
       typename ViewT::pixel_type m_default_inpaint_val;
       SparseCompositeView<SViewT> & m_patches; // Store our output
 
@@ -55,9 +94,11 @@ namespace asp {
                    blob::BlobCompressed const& c_blob,
                    bool use_grassfire,
                    typename ViewT::pixel_type default_inpaint_val,
-                   SparseCompositeView<SViewT> & sparse ) :
+                   SparseCompositeView<SViewT> & sparse,
+                   bool use_multigrid = false ) :
         m_view(view.impl()), m_c_blob(c_blob),
-        m_use_grassfire(use_grassfire), m_default_inpaint_val(default_inpaint_val),
+        m_use_grassfire(use_grassfire), m_use_multigrid(use_multigrid),
+        m_default_inpaint_val(default_inpaint_val),
         m_patches(sparse) {}
 
       void operator()() {
@@ -93,7 +134,9 @@ namespace asp {
               iter != blob.end(); iter++ )
           mask( iter->x(), iter->y() ) = 255;
 
-        if (m_use_grassfire){
+        if (m_use_grassfire && m_use_multigrid){
+          multigrid_fill( cropped_copy, mask );
+        }else if (m_use_grassfire){
           ImageView<int32> distance = grassfire(mask);
           int max_distance = max_pixel_value( distance );
 
@@ -155,7 +198,7 @@ namespace asp {
 
     ViewT m_child;
     BlobIndexThreaded const& m_bindex;
-    bool m_use_grassfire;
+    bool m_use_grassfire, m_use_multigrid;
     typename ViewT::pixel_type m_default_inpaint_val;
 
   public:
@@ -167,9 +210,11 @@ namespace asp {
     InpaintView( vw::ImageViewBase<ViewT> const& image,
                  BlobIndexThreaded const& bindex,
                  bool use_grassfire,
-                 typename ViewT::pixel_type default_inpaint_val):
+                 typename ViewT::pixel_type default_inpaint_val,
+                 bool use_multigrid = false ):
       m_child(image.impl()), m_bindex(bindex),
-      m_use_grassfire(use_grassfire), m_default_inpaint_val(default_inpaint_val) {}
+      m_use_grassfire(use_grassfire), m_use_multigrid(use_multigrid),
+      m_default_inpaint_val(default_inpaint_val) {}
 
     inline vw::int32 cols() const { return m_child.cols(); }
     inline vw::int32 rows() const { return m_child.rows(); }
@@ -212,9 +257,10 @@ namespace asp {
       for ( std::vector<size_t>::const_iterator it = intersections.begin();
             it != intersections.end(); it++ ) {
         task_type task( preraster, m_bindex.compressed_blob(*it), m_use_grassfire,
-                        m_default_inpaint_val, patched_view );
+                        m_default_inpaint_val, patched_view, m_use_multigrid );
         task();
       }
+      patched_view.finalize();
 
       return patched_view;
     }
@@ -228,8 +274,10 @@ namespace asp {
   inline InpaintView<SourceT> inpaint( vw::ImageViewBase<SourceT> const& src,
                                        BlobIndexThreaded const& bindex,
                                        bool use_grassfire,
-                                       typename SourceT::pixel_type default_inpaint_val) {
-    return InpaintView<SourceT>(src, bindex, use_grassfire, default_inpaint_val);
+                                       typename SourceT::pixel_type default_inpaint_val,
+                                       bool use_multigrid = false ) {
+    return InpaintView<SourceT>(src, bindex, use_grassfire, default_inpaint_val,
+                                use_multigrid);
   }
 
 } //end namespace asp
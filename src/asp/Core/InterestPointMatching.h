@@ -119,6 +119,13 @@ namespace asp {
                         vw::BBox2i const& box1, vw::BBox2i const& box2,
                         vw::cartography::Datum const& datum );
 
+  // Throw if the homography H mapping right_points to left_points,
+  // with the given inliers, is not plausible for a stereo pair.
+  void check_homography_matrix(vw::Matrix<double>       const& H,
+                               std::vector<vw::Vector3> const& left_points,
+                               std::vector<vw::Vector3> const& right_points,
+                               std::vector<size_t>      const& indices);
+
   // Homography rectification that aligns the right image to the left
   // image via a homography transform. It returns a vector2i of the
   // ideal cropping size to use for the left and right image. The left
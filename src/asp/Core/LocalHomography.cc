@@ -21,6 +21,7 @@
 
 #include <vw/Image/ImageView.h>
 #include <vw/Image/Transform.h>
+#include <vw/Core/Settings.h>
 #include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Stereo/DisparityMap.h>
@@ -28,6 +29,13 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/InterestPointMatching.h>
 
+#include <vw/Math/RANSAC.h>
+#include <vw/Math/Geometry.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <algorithm>
+
 using namespace vw;
 
 namespace asp {
@@ -58,11 +66,88 @@ namespace asp {
 
   }
 
+  // Fit a homography mapping right_points to left_points with RANSAC,
+  // as in homography_rectification(), but drawing the samples from
+  // the given generator rather than from rand(), which is shared by
+  // all threads. The inliers of the fit are returned in indices.
+  Matrix<double> seeded_homography_fit(std::vector<Vector3> const& right_points,
+                                       std::vector<Vector3> const& left_points,
+                                       double inlier_threshold, size_t min_inliers,
+                                       boost::mt19937 & gen,
+                                       std::vector<size_t> & indices){
+
+    typedef math::HomographyFittingFunctor hfit_func;
+    hfit_func fit;
+    math::InterestPointErrorMetric error;
+
+    const int    num_iterations = 100;
+    const size_t sample_size    = 4;
+    indices.clear();
+    if (right_points.size() < sample_size)
+      vw_throw( math::RANSACErr() << "seeded_homography_fit: Not enough points to fit a homography.\n" );
+
+    boost::uniform_int<size_t> dist(0, right_points.size() - 1);
+    boost::variate_generator<boost::mt19937&, boost::uniform_int<size_t> >
+      random_index(gen, dist);
+
+    std::vector<Vector3> right_sample(sample_size), left_sample(sample_size);
+    std::vector<size_t> inliers;
+    for (int iter = 0; iter < num_iterations; iter++){
+
+      // Pick distinct points
+      std::vector<size_t> sample;
+      while (sample.size() < sample_size){
+        size_t index = random_index();
+        if (std::find(sample.begin(), sample.end(), index) == sample.end())
+          sample.push_back(index);
+      }
+      for (size_t i = 0; i < sample_size; i++){
+        right_sample[i] = right_points[sample[i]];
+        left_sample[i]  = left_points[sample[i]];
+      }
+
+      Matrix<double> H;
+      try {
+        H = fit(right_sample, left_sample);
+      } catch ( const vw::Exception& e ) {
+        continue; // degenerate sample
+      }
+
+      inliers.clear();
+      for (size_t i = 0; i < right_points.size(); i++){
+        if (error(H, right_points[i], left_points[i]) < inlier_threshold)
+          inliers.push_back(i);
+      }
+      if (inliers.size() > indices.size())
+        indices = inliers;
+    }
+
+    if (indices.empty() || indices.size() < min_inliers)
+      vw_throw( math::RANSACErr() << "seeded_homography_fit: Could not find a homography "
+                << "with at least " << min_inliers << " inliers.\n" );
+
+    // Refit to the inliers of the best sample
+    std::vector<Vector3> right_inliers, left_inliers;
+    for (size_t i = 0; i < indices.size(); i++){
+      right_inliers.push_back(right_points[indices[i]]);
+      left_inliers.push_back(left_points[indices[i]]);
+    }
+    Matrix<double> H = fit(right_inliers, left_inliers);
+
+    indices.clear();
+    for (size_t i = 0; i < right_points.size(); i++){
+      if (error(H, right_points[i], left_points[i]) < inlier_threshold)
+        indices.push_back(i);
+    }
+    return H;
+  }
+
   // Given a disparity map restricted to a subregion, find the homography
   // transform which aligns best the two images based on this disparity.
   template<class SeedDispT>
   vw::math::Matrix<double> homography_for_disparity(vw::BBox2i subregion,
                                                     SeedDispT const& disparity,
+                                                    boost::mt19937 & gen,
                                                     bool & success){
     success = true;
 
@@ -79,7 +164,7 @@ namespace asp {
     split_n_into_k(disparity.cols(), std::min(disparity.cols(), N), partitionx);
     split_n_into_k(disparity.rows(), std::min(disparity.rows(), N), partitiony);
 
-    std::vector<vw::ip::InterestPoint> left_ip, right_ip;
+    std::vector<Vector3> left_points, right_points;
     for (int ix = 0; ix < (int)partitionx.size()-1; ix++){
       for (int iy = 0; iy < (int)partitiony.size()-1; iy++){
 
@@ -98,24 +183,26 @@ namespace asp {
         if (count == 0) continue; // no valid points
 
         // Do the averaging. We must add the box corner to the left and
-        // right interest points.
-        vw::ip::InterestPoint l, r;
-        l.x = subregion.min().x() + lx/count; r.x = subregion.min().x() + rx/count;
-        l.y = subregion.min().y() + ly/count; r.y = subregion.min().y() + ry/count;
-        left_ip.push_back(l);
-        right_ip.push_back(r);
+        // right points.
+        left_points.push_back (Vector3(subregion.min().x() + lx/count,
+                                       subregion.min().y() + ly/count, 1));
+        right_points.push_back(Vector3(subregion.min().x() + rx/count,
+                                       subregion.min().y() + ry/count, 1));
       }
     }
 
     try {
-      Matrix<double> left_matrix, right_matrix;
       BBox2i image_size = bounding_box(disparity);
-      homography_rectification( image_size.size(), image_size.size(),
-                                left_ip, right_ip, left_matrix, right_matrix );
-      // Undoing the shift in origin.
-      right_matrix(0,2) -= left_matrix(0,2);
-      right_matrix(1,2) -= left_matrix(1,2);
-      return right_matrix;
+      std::vector<size_t> indices;
+      Matrix<double> H
+        = seeded_homography_fit(right_points, left_points,
+                                norm_2(Vector2(image_size.size())) / 10, // inlier threshold
+                                left_points.size()*2/3, // min output inliers
+                                gen, indices);
+      check_homography_matrix(H, left_points, right_points, indices);
+
+      // Refine the homography to the inliers
+      return math::HomographyFittingFunctor()(right_points, left_points, H);
     }
     catch ( const vw::ArgumentErr& e ){}
     catch ( const vw::math::RANSACErr& e ){}
@@ -123,31 +210,64 @@ namespace asp {
     return vw::math::identity_matrix<3>();
   }
 
+  // Find the local homography of the given full-resolution tile. If
+  // the fit fails, the region of the low-resolution disparity used
+  // for it is expanded until it succeeds or covers the whole image.
+  // The RANSAC samples are drawn from a generator seeded by the
+  // index of the tile, so the result does not depend on which thread
+  // fits the tile, or in which order.
+  Matrix3x3 local_homography_for_tile(BBox2i const& bbox, Vector2 const& upscale_factor,
+                                      ImageView< PixelMask<Vector2i> > const& sub_disparity,
+                                      int tile_index){
+
+    boost::mt19937 gen(tile_index);
+
+    // The low-res version of bbox
+    BBox2i sub_bbox( elem_quot(bbox.min(), upscale_factor),
+                     elem_quot(bbox.max(), upscale_factor) );
+
+    // Expand the box until square to make sure the local
+    // homography calculation does not fail. If that does not
+    // help, keep on expanding the box.
+    bool success = false;
+    int len = std::max(sub_bbox.width(), sub_bbox.height());
+    sub_bbox = BBox2i(sub_bbox.max() - Vector2(len, len), sub_bbox.max());
+    sub_bbox.expand(1);
+    Matrix3x3 hom;
+    while(1){
+      sub_bbox.crop( bounding_box(sub_disparity) );
+      hom = homography_for_disparity(sub_bbox, crop(sub_disparity, sub_bbox), gen, success);
+      if (success) break;
+      vw_out() << "\t--> Failed to find local disparity in box: " << bbox  << std::endl;
+      vw_out() << "\t--> Trying again by increasing the local region."  << std::endl;
+      if (sub_bbox == bounding_box(sub_disparity)) break; // can't expand more
+      len = std::max(sub_bbox.width(), sub_bbox.height());
+      sub_bbox.expand(len);
+    }
+    return hom;
+  }
+
   // Task that computes local homography in a given tile
   class LocalHomTask: public vw::Task, private boost::noncopyable {
 
     int m_col, m_row;
-    BBox2i m_sub_bbox;
-    // We on purpose store a local deep copy of sub_disparity_crop to
-    // avoid segfault.
-    ImageView < PixelMask<Vector2i> > m_sub_disparity_crop;
+    BBox2i m_bbox;
+    Vector2 m_upscale_factor;
+    ImageView< PixelMask<Vector2i> > const& m_sub_disparity;
     ImageView<Matrix3x3> & m_local_hom;
   public:
-    LocalHomTask(int col, int row,
-                 BBox2i sub_bbox,
-                 ImageViewRef < PixelMask<Vector2i> > const& sub_disparity_crop,
+    LocalHomTask(int col, int row, BBox2i const& bbox,
+                 Vector2 const& upscale_factor,
+                 ImageView< PixelMask<Vector2i> > const& sub_disparity,
                  ImageView<Matrix3x3> & local_hom):
-      m_col(col), m_row(row), m_sub_bbox(sub_bbox),
-      m_sub_disparity_crop(sub_disparity_crop),
-      m_local_hom(local_hom){}
+      m_col(col), m_row(row), m_bbox(bbox), m_upscale_factor(upscale_factor),
+      m_sub_disparity(sub_disparity), m_local_hom(local_hom){}
 
     void operator()() {
-      bool success;
-      // To do: If this function is ever used, the variable 'success'
-      // needs to be treated properly.
-      exit(1); // broken, for now
+      // Each task writes its own element, so no locking is needed.
       m_local_hom(m_col, m_row)
-        = homography_for_disparity(m_sub_bbox, m_sub_disparity_crop, success);
+        = local_homography_for_tile(m_bbox, m_upscale_factor, m_sub_disparity,
+                                    m_row*m_local_hom.cols() + m_col);
     }
   };
 
@@ -156,8 +276,11 @@ namespace asp {
 
     DiskImageView< PixelGray<float> > left_sub (opt.out_prefix + "-L_sub.tif");
     DiskImageView< PixelGray<float> > left_img (opt.out_prefix + "-L.tif");
-    DiskImageView< PixelMask<Vector2i> >
-      sub_disparity(opt.out_prefix + "-D_sub.tif");
+
+    // The low-resolution disparity is small. Read it once, so that the
+    // threads share it without going to disk.
+    ImageView< PixelMask<Vector2i> > sub_disparity
+      = DiskImageView< PixelMask<Vector2i> >(opt.out_prefix + "-D_sub.tif");
 
     Vector2 upscale_factor( double(left_img.cols()) / double(left_sub.cols()),
                             double(left_img.rows()) / double(left_sub.rows()) );
@@ -167,56 +290,33 @@ namespace asp {
     int rows = (int)ceil(left_img.rows()/double(ts));
     ImageView<Matrix3x3> local_hom(cols, rows);
 
-    // Calculate the local homographies using multiple threads.
-    // To do: Each thread calls RANSAC, which calls rand(), which
-    // is not thread safe. So for now use just one thread.
-
     Stopwatch sw;
     sw.start();
 
-    //FifoWorkQueue queue( vw_settings().default_num_threads() );
+    // With one thread, fit the tiles in place. The seeded fit is the
+    // same either way, so local_hom.txt does not depend on this.
+    int num_threads = vw_settings().default_num_threads();
+    FifoWorkQueue queue( num_threads );
     for (int col = 0; col < cols; col++){
       for (int row = 0; row < rows; row++){
 
         BBox2i bbox(col*ts, row*ts, ts, ts);
         bbox.crop(bounding_box(left_img));
 
-        // The low-res version of bbox
-        BBox2i sub_bbox( elem_quot(bbox.min(), upscale_factor),
-                          elem_quot(bbox.max(), upscale_factor) );
-
-        // Expand the box until square to make sure the local
-        // homography calculation does not fail. If that does not
-        // help, keep on expanding the box.
-        bool success = false;
-        int len = std::max(sub_bbox.width(), sub_bbox.height());
-        sub_bbox = BBox2i(sub_bbox.max() - Vector2(len, len), sub_bbox.max());
-        sub_bbox.expand(1);
-        while(1){
-
-          // This code enables multi-threading. It gives different answers each time,
-          // as multiple threads pull random numbers from the same stream.
-          // This code must be kept disabled until Boost's random function is used
-          // with one random stream for each thread.
-          //boost::shared_ptr<LocalHomTask>
-          //task(new LocalHomTask(col, row, sub_bbox, crop(sub_disparity, sub_bbox),
-          //                        local_hom));
-          //queue.add_task(task);
-
-          sub_bbox.crop( bounding_box(sub_disparity) );
+        if (num_threads <= 1){
           local_hom(col, row)
-            = homography_for_disparity(sub_bbox, crop(sub_disparity, sub_bbox), success);
-          if (success) break;
-          vw_out() << "\t--> Failed to find local disparity in box: " << bbox  << std::endl;
-          vw_out() << "\t--> Trying again by increasing the local region."  << std::endl;
-          if (sub_bbox == bounding_box(sub_disparity)) break; // can't expand more
-          len = std::max(sub_bbox.width(), sub_bbox.height());
-          sub_bbox.expand(len);
+            = local_homography_for_tile(bbox, upscale_factor, sub_disparity,
+                                        row*cols + col);
+          continue;
         }
 
+        boost::shared_ptr<LocalHomTask>
+          task(new LocalHomTask(col, row, bbox, upscale_factor,
+                                sub_disparity, local_hom));
+        queue.add_task(task);
       }
     }
-    //queue.join_all();
+    queue.join_all();
 
     sw.stop();
     vw_out(DebugMessage,"asp") << "Local homographies elapsed time: "
@@ -229,6 +329,42 @@ namespace asp {
     return;
   }
 
+  void WarpedTileCache::insert(BBox2i const& tile, Matrix3x3 const& hom,
+                               ImageView<WarpedPixelT> const& image,
+                               BBox2i const& region){
+    Entry entry;
+    entry.tile   = tile;
+    entry.region = region;
+    entry.hom    = hom;
+    entry.image  = image;
+
+    Mutex::Lock lock(m_mutex);
+    m_entries.push_front(entry);
+    while (m_entries.size() > m_max_tiles)
+      m_entries.pop_back();
+  }
+
+  bool WarpedTileCache::take(BBox2i const& tile, Matrix3x3 const& hom,
+                             ImageView<WarpedPixelT> & image, BBox2i & region){
+    Mutex::Lock lock(m_mutex);
+    for (std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); it++){
+      if (it->tile != tile || it->hom != hom) continue;
+      image  = it->image;
+      region = it->region;
+      m_entries.erase(it);
+      return true;
+    }
+    return false;
+  }
+
+  // Each thread correlates a tile and then refines it, so it holds
+  // at most one entry at a time. The rest is slack for tiles whose
+  // refinement does not happen right away.
+  WarpedTileCache & warped_tile_cache(){
+    static WarpedTileCache cache(2*vw_settings().default_num_threads());
+    return cache;
+  }
+
   void write_local_homographies(std::string const& local_hom_file,
                                 ImageView<Matrix3x3> const& local_hom){
 
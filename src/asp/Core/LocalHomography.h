@@ -23,6 +23,14 @@
 #define __LOCAL_DISPARITY_H__
 
 #include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/Transform.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Core/Thread.h>
+#include <list>
 #include <vector>
 
 // Forward declaration
@@ -41,6 +49,122 @@ namespace asp {
   void read_local_homographies(std::string const& local_hom_file,
                                vw::ImageView<vw::Matrix3x3> & local_hom);
 
+  /// The pixels of the right image warped by a local homography.
+  typedef vw::PixelMask<vw::PixelGray<float> > WarpedPixelT;
+
+  /// The right image warped by the local homographies of recently
+  /// correlated tiles, over a region around each tile, so that
+  /// refinement of the same tile in the same process does not
+  /// resample it again. Thread-safe.
+  class WarpedTileCache {
+  public:
+    WarpedTileCache(size_t max_tiles): m_max_tiles(max_tiles) {}
+
+    /// Store the warped image over the given region for the given
+    /// tile and homography. The oldest entry is dropped if the cache
+    /// is full.
+    void insert(vw::BBox2i const& tile, vw::Matrix3x3 const& hom,
+                vw::ImageView<WarpedPixelT> const& image, vw::BBox2i const& region);
+
+    /// Find and remove the entry for the given tile and homography.
+    /// Return false if there is none.
+    bool take(vw::BBox2i const& tile, vw::Matrix3x3 const& hom,
+              vw::ImageView<WarpedPixelT> & image, vw::BBox2i & region);
+
+  private:
+    struct Entry {
+      vw::BBox2i tile, region;
+      vw::Matrix3x3 hom;
+      vw::ImageView<WarpedPixelT> image;
+    };
+    size_t m_max_tiles;
+    std::list<Entry> m_entries; // Newest first
+    vw::Mutex m_mutex;
+  };
+
+  /// The cache shared by correlation and refinement in this process.
+  WarpedTileCache & warped_tile_cache();
+
+  /// A view which returns the stored pixels within a region and the
+  /// pixels of the source view elsewhere. A tile fully inside the
+  /// region is returned without touching the source.
+  template <class ImageT>
+  class CachedRegionView: public vw::ImageViewBase<CachedRegionView<ImageT> > {
+    typedef typename ImageT::pixel_type PixelT;
+    vw::ImageView<PixelT> m_cache;
+    vw::BBox2i m_region;
+    ImageT m_source;
+
+  public:
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<CachedRegionView> pixel_accessor;
+
+    CachedRegionView(vw::ImageView<PixelT> const& cache, vw::BBox2i const& region,
+                     vw::ImageViewBase<ImageT> const& source):
+      m_cache(cache), m_region(region), m_source(source.impl()) {}
+
+    inline vw::int32 cols() const { return m_source.cols(); }
+    inline vw::int32 rows() const { return m_source.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p = 0 ) const {
+      if (m_region.contains(vw::Vector2i(i, j)))
+        return m_cache(i - m_region.min().x(), j - m_region.min().y(), p);
+      return m_source(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<PixelT> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      if (m_region.contains(bbox))
+        return prerasterize_type(m_cache, -m_region.min().x(), -m_region.min().y(),
+                                 cols(), rows());
+      vw::ImageView<PixelT> tile = crop(m_source, bbox);
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
+                               cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// The right image and its mask warped by the full-resolution
+  /// homography of the given tile, to the given size. If a region is
+  /// given, the warped image is computed over it and cached for the
+  /// tile. Otherwise, the cached copy from an earlier call for this
+  /// tile and homography is used, if any, and dropped from the cache.
+  template <class ImageT, class MaskT>
+  vw::ImageViewRef<WarpedPixelT>
+  warp_right_tile(vw::ImageViewBase<ImageT> const& right_image,
+                  vw::ImageViewBase<MaskT> const& right_mask,
+                  vw::Matrix3x3 const& fullres_hom, vw::Vector2i const& size,
+                  vw::BBox2i const& tile, vw::BBox2i const& cache_region){
+
+    vw::ImageViewRef<WarpedPixelT> warped
+      = vw::transform(vw::pixel_cast<WarpedPixelT>
+                      (vw::copy_mask(right_image.impl(), vw::create_mask(right_mask.impl()))),
+                      vw::HomographyTransform(fullres_hom), size.x(), size.y());
+
+    vw::ImageView<WarpedPixelT> cache;
+    vw::BBox2i region;
+    if (cache_region.empty()){
+      if (!warped_tile_cache().take(tile, fullres_hom, cache, region))
+        return warped;
+    }else{
+      region = cache_region;
+      region.crop(vw::bounding_box(warped));
+      if (region.empty())
+        return warped;
+      cache = crop(warped, region);
+      warped_tile_cache().insert(tile, fullres_hom, cache, region);
+    }
+    return CachedRegionView<vw::ImageViewRef<WarpedPixelT> >(cache, region, warped);
+  }
+
 
 } // namespace asp
 
@@ -21,6 +21,13 @@
 /// resamples the point cloud on a regular grid over the [x,y] plane
 /// of the point image; producing an evenly sampled ortho-image with
 /// interpolated z values.
+///
+/// More textures can be added, each producing a plane of the
+/// output. All planes are interpolated from the same triangles, in
+/// one traversal of the point cloud.
+///
+/// Alternatively, the points can be binned straight into the output
+/// pixels, see GriddingMode.
 
 #include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewRef.h>
@@ -32,26 +39,53 @@
 // The SoftwareRenderer actual "renders" the 3D scene, textures it,
 // and then returns a 2D orthographic view.
 #include <asp/Core/SoftwareRenderer.h>
+#include <asp/Core/PackedRTree.h>
 
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/math/special_functions/next.hpp>
 
 namespace vw {
 namespace cartography {
 
+  /// How OrthoRasterizerView produces output pixels. By default the
+  /// point cloud is triangulated and the triangles are interpolated.
+  /// The other modes bin the points into the output pixels and take
+  /// the given statistic of the texture values in each one. Binning
+  /// is much cheaper than drawing the triangles of a dense cloud, and
+  /// the point count per pixel is useful for quality control.
+  enum GriddingMode {
+    GRID_TRIANGLES,
+    GRID_MEAN,
+    GRID_MIN,
+    GRID_MAX,
+    GRID_MEDIAN,
+    GRID_COUNT
+  };
+
+  /// Antialiasing renders at a finer spacing, then blurs and
+  /// downsamples the result. That only makes sense for interpolated
+  /// triangles, as it would mix the counts and statistics of binned
+  /// pixels, so refuse oversampling in the binning modes.
+  inline void check_gridding_oversampling(GriddingMode mode, int oversampling) {
+    if (mode != GRID_TRIANGLES && oversampling > 1)
+      vw_throw( ArgumentErr() << "Oversampling for antialiasing (--fsaa) can only "
+                << "be used with the triangles gridding mode.\n" );
+  }
+
   template <class PixelT, class ImageT>
   class OrthoRasterizerView : public ImageViewBase<OrthoRasterizerView<PixelT, ImageT> > {
     ImageT m_point_image;
-    ImageViewRef<float> m_texture;
+    std::vector< ImageViewRef<float> > m_textures; // one per output plane
     BBox3 m_bbox;           // Bounding box of point cloud
     double m_spacing;       // pointcloud units (usually m or deg) per pxel
     double m_default_value;
     bool m_minz_as_default;
     bool m_use_alpha;
     int m_block_size;
+    GriddingMode m_gridding;
+    double m_search_radius; // in point units, used when binning points
     
-    // We could actually use a quadtree here .. but this should be a
-    // good enough improvement.
     typedef std::pair<BBox3, BBox2i> BBoxPair;
     std::vector<BBoxPair > m_point_image_boundaries;
     // These boundaries describe a point cloud 3D boundaries and then
@@ -59,6 +93,11 @@ namespace cartography {
     // overlapping in the pc image X/Y domain to insure that
     // everything is triangulated.
 
+    // Spatial index over the x-y extent of the boundaries above, so
+    // that each tile finds the boundaries it needs without scanning
+    // all of them.
+    asp::PackedRTree m_boundary_index;
+
     // Function to convert pixel coordinates to the point domain
     BBox3 pixel_to_point_bbox( BBox2 const& px ) const {
       BBox3 output = m_bbox;
@@ -69,6 +108,255 @@ namespace cartography {
       return output;
     }
 
+    // The value of output pixels which receive no data
+    float fill_value() const {
+      if (m_use_alpha)
+        return std::numeric_limits<float>::min(); // dummy value to denote transparency
+      if (m_minz_as_default)
+        return m_bbox.min().z();
+      return m_default_value;
+    }
+
+    // From a box in the point domain, get the box in the point cloud
+    // pixel space containing the points needed to render it. Returns
+    // an empty box if there are no such points.
+    BBox2i find_point_image_boundary( BBox3 const& local_3d_bbox ) const {
+
+      BBox2i point_image_boundary;
+      std::vector<double> cx, cy; // box centers in the point cloud pixel space
+      std::vector<int> candidates;
+      m_boundary_index.intersect(BBox2(subvector(local_3d_bbox.min(), 0, 2),
+                                       subvector(local_3d_bbox.max(), 0, 2)),
+                                 candidates);
+      BOOST_FOREACH( int index, candidates ) {
+        BBoxPair const& boundary = m_point_image_boundaries[index];
+        if (! local_3d_bbox.intersects(boundary.first) ) continue;
+        point_image_boundary.grow( boundary.second );
+        cx.push_back((boundary.second.min().x()+boundary.second.max().x())/2.0);
+        cy.push_back((boundary.second.min().y()+boundary.second.max().y())/2.0);
+      }
+
+      // In some cases, the memory usage blows up. Then, roughly
+      // estimate how much of the input point cloud region we need to
+      // see for the given DEM tile, and multiply that region by a
+      // factor of FACTOR. Place that region at the median of the
+      // centers of the boxes used to grow the image boundary earlier,
+      // and intersect that with the current box. This will not kick
+      // in unless point_image_boundary estimated above is grossly
+      // larger than what it should be.
+      int FACTOR = 4;
+      Vector3 estim = (local_3d_bbox.max() - local_3d_bbox.min())/m_pix2point;
+      int max_len = (int)ceil(FACTOR*std::max(estim[0], estim[1]));
+      if (!cx.empty() &&
+          (point_image_boundary.width()  > max_len ||
+           point_image_boundary.height() > max_len)
+          ){
+        std::sort(cx.begin(), cx.end());
+        std::sort(cy.begin(), cy.end());
+        int midx = (int)round(cx[cx.size()/2]);
+        int midy = (int)round(cy[cy.size()/2]);
+        BBox2i smaller_boundary(midx - max_len/2, midy - max_len/2,
+                                max_len, max_len );
+        smaller_boundary.expand(1);
+        point_image_boundary.crop(smaller_boundary);
+      }
+
+      if ( point_image_boundary.empty() )
+        return BBox2i();
+
+      // Bugfix, ensure we see enough beyond current tile
+      point_image_boundary.expand(5);
+      point_image_boundary.crop(vw::bounding_box(m_point_image));
+      return point_image_boundary;
+    }
+
+    // If point_image_boundary is big, subdivide it into blocks
+    // to save on memory. The blocks do not overlap.
+    std::vector<BBox2i> point_image_blocks( BBox2i const& point_image_boundary ) const {
+      int max_tile_size = 512;
+      std::vector<BBox2i> blocks;
+      if (point_image_boundary.width()  >= 2*max_tile_size ||
+          point_image_boundary.height() >= 2*max_tile_size
+          ){
+        BBox2i tile_box;
+        tile_box.min()
+          = m_block_size*floor(point_image_boundary.min()/double(m_block_size));
+        tile_box.max()
+          = m_block_size*ceil(point_image_boundary.max()/double(m_block_size));
+        blocks =
+          image_blocks( tile_box, max_tile_size, max_tile_size);
+        for (int i = 0; i < (int)blocks.size(); i++)
+          blocks[i].crop(point_image_boundary);
+      }else{
+        blocks.push_back(point_image_boundary);
+      }
+      return blocks;
+    }
+
+    // Instead of drawing triangles, bin each point into the output
+    // pixels whose centers are within the search radius from it, and
+    // compute the requested statistic of the texture values landing
+    // in each pixel. Pixel centers follow geo_transform().
+    ImageView<PixelT> bin_points( BBox2i const& bbox ) const {
+
+      int num_planes = m_textures.size();
+      int width = bbox.width(), height = bbox.height();
+      int num_cells = width*height;
+
+      // With no radius a point goes to the pixel it falls in
+      double radius = m_search_radius;
+      double reach  = std::max(radius, 0.5*m_spacing);
+
+      // The region in the point domain whose points reach this tile
+      BBox3 local_3d_bbox = m_bbox;
+      local_3d_bbox.min().x() = m_bbox.min().x() + bbox.min().x()*m_spacing - reach;
+      local_3d_bbox.max().x() = boost::math::float_next
+        (m_bbox.min().x() + (bbox.max().x() - 1)*m_spacing + reach);
+      local_3d_bbox.min().y() = m_bbox.max().y() - (bbox.max().y() - 1)*m_spacing - reach;
+      local_3d_bbox.max().y() = boost::math::float_next
+        (m_bbox.max().y() - bbox.min().y()*m_spacing + reach);
+
+      std::vector<int> counts(num_cells, 0);
+      std::vector<double> stats(num_cells*num_planes, 0.0);
+      std::vector< std::vector<float> > samples;
+      if (m_gridding == GRID_MEDIAN)
+        samples.resize(num_cells*num_planes);
+
+      BBox2i point_image_boundary = find_point_image_boundary(local_3d_bbox);
+      std::vector<BBox2i> blocks;
+      if ( !point_image_boundary.empty() )
+        blocks = point_image_blocks(point_image_boundary);
+
+      std::vector<float> values(num_planes);
+      for (int i = 0; i < (int)blocks.size(); i++){
+
+        ImageView<typename ImageT::pixel_type> point_copy =
+          crop(m_point_image, blocks[i] );
+        std::vector< ImageView<float> > texture_copies(num_planes);
+        for (int p = 0; p < num_planes; p++)
+          texture_copies[p] = crop(m_textures[p], blocks[i] );
+
+        for ( int32 row = 0; row < point_copy.rows(); ++row ) {
+          for ( int32 col = 0; col < point_copy.cols(); ++col ) {
+            Vector3 const& point = point_copy(col, row);
+            if ( boost::math::isnan(point.z()) ) continue;
+
+            // Position in output pixels, relative to the tile
+            double px = (point.x() - m_bbox.min().x())/m_spacing - bbox.min().x();
+            double py = (m_bbox.max().y() - point.y())/m_spacing - bbox.min().y();
+            int min_col, max_col, min_row, max_row;
+            if (radius > 0){
+              double r = radius/m_spacing;
+              min_col = (int)ceil(px - r);  max_col = (int)floor(px + r);
+              min_row = (int)ceil(py - r);  max_row = (int)floor(py + r);
+            }else{
+              min_col = max_col = (int)floor(px + 0.5);
+              min_row = max_row = (int)floor(py + 0.5);
+            }
+            min_col = std::max(min_col, 0);  max_col = std::min(max_col, width  - 1);
+            min_row = std::max(min_row, 0);  max_row = std::min(max_row, height - 1);
+            if (min_col > max_col || min_row > max_row) continue;
+
+            for (int p = 0; p < num_planes; p++)
+              values[p] = texture_copies[p](col, row);
+
+            for (int r = min_row; r <= max_row; r++){
+              for (int c = min_col; c <= max_col; c++){
+                if (radius > 0 &&
+                    (c - px)*(c - px) + (r - py)*(r - py) >
+                    radius*radius/(m_spacing*m_spacing) )
+                  continue;
+
+                int cell = r*width + c;
+                bool first = (counts[cell] == 0);
+                counts[cell]++;
+                double * cell_stats = &stats[cell*num_planes];
+                for (int p = 0; p < num_planes; p++){
+                  switch (m_gridding){
+                  case GRID_MEAN:
+                    cell_stats[p] += values[p]; break;
+                  case GRID_MIN:
+                    cell_stats[p] = first ? values[p] : std::min(cell_stats[p], double(values[p])); break;
+                  case GRID_MAX:
+                    cell_stats[p] = first ? values[p] : std::max(cell_stats[p], double(values[p])); break;
+                  case GRID_MEDIAN:
+                    samples[cell*num_planes + p].push_back(values[p]); break;
+                  default:
+                    break;
+                  }
+                }
+              }
+            }
+
+          }
+        }
+      }
+
+      ImageView<float> binned(width, height, num_planes);
+      float fill = fill_value();
+      for (int r = 0; r < height; r++){
+        for (int c = 0; c < width; c++){
+          int cell = r*width + c;
+          for (int p = 0; p < num_planes; p++){
+            float & out = binned(c, r, p);
+            if (counts[cell] == 0){
+              // No points is a valid count
+              out = (m_gridding == GRID_COUNT) ? 0 : fill;
+              continue;
+            }
+            switch (m_gridding){
+            case GRID_MEAN:
+              out = stats[cell*num_planes + p]/counts[cell]; break;
+            case GRID_MIN:
+            case GRID_MAX:
+              out = stats[cell*num_planes + p]; break;
+            case GRID_MEDIAN: {
+              std::vector<float> & v = samples[cell*num_planes + p];
+              int mid = v.size()/2;
+              std::nth_element(v.begin(), v.begin() + mid, v.end());
+              out = v[mid];
+              if (v.size() % 2 == 0)
+                out = 0.5*(out + *std::max_element(v.begin(), v.begin() + mid));
+              break;
+            }
+            default: // GRID_COUNT
+              out = counts[cell]; break;
+            }
+          }
+        }
+      }
+
+      ImageView<PixelT> result = binned;
+      return result;
+    }
+
+    static const int NUM_COLOR_COMPONENTS = 1;  // We only need gray scale
+    static const int NUM_VERTEX_COMPONENTS = 2; // DEMs are 2D
+    static const int MAX_BATCH_TRIANGLES = 65536;
+
+    typedef boost::shared_ptr<vw::stereo::SoftwareRenderer> RendererPtr;
+
+    static void add_vertex( std::vector<float> & vertices, Vector3 const& point ) {
+      vertices.push_back(point.x());
+      vertices.push_back(point.y());
+    }
+
+    // Draw a batch of triangles in each plane, and empty it.
+    static void draw_triangles( std::vector<RendererPtr> const& renderers,
+                                std::vector<float> & vertices,
+                                std::vector< std::vector<float> > & intensities ) {
+      int num_triangles = vertices.size()/(3*NUM_VERTEX_COMPONENTS);
+      for (size_t p = 0; p < renderers.size(); p++){
+        if (num_triangles > 0){
+          renderers[p]->SetVertexPointer(NUM_VERTEX_COMPONENTS, &vertices[0]);
+          renderers[p]->SetColorPointer(NUM_COLOR_COMPONENTS, &intensities[p][0]);
+          renderers[p]->DrawTriangles(0, num_triangles);
+        }
+        intensities[p].clear();
+      }
+      vertices.clear();
+    }
+
     // Task to parallelize the generation of bounding boxes
     template <class ViewT>
     class SubBlockBoundaryTask : public Task, private boost::noncopyable {
@@ -148,9 +436,10 @@ namespace cartography {
     template <class TextureViewT>
     OrthoRasterizerView(ImageT point_image, TextureViewT texture, double spacing = 0.0,
                         const ProgressCallback& progress = ProgressCallback::dummy_instance()) :
-      m_point_image(point_image), m_texture(ImageView<float>(1,1)), // dummy value
+      m_point_image(point_image),
       m_default_value(0), m_minz_as_default(true), m_use_alpha(false),
-      m_block_size(256) /* To do: query block size from input point cloud */ {
+      m_block_size(256) /* To do: query block size from input point cloud */,
+      m_gridding(GRID_TRIANGLES), m_search_radius(0) {
 
       set_texture(texture.impl());
 
@@ -191,6 +480,15 @@ namespace cartography {
 
       VW_OUT(DebugMessage,"asp") << "Point cloud boundary is " << m_bbox << "\n";
 
+      std::vector<BBox2> boundary_boxes;
+      boundary_boxes.reserve(m_point_image_boundaries.size());
+      BOOST_FOREACH( BBoxPair const& boundary,
+                     m_point_image_boundaries ) {
+        boundary_boxes.push_back(BBox2(subvector(boundary.first.min(), 0, 2),
+                                       subvector(boundary.first.max(), 0, 2)));
+      }
+      m_boundary_index.build(boundary_boxes);
+
       // Set the sampling rate (i.e. spacing between pixels)
       this->set_spacing(spacing);
       VW_OUT(DebugMessage,"asp") << "Pixel spacing is " << m_spacing << " pnt/px\n";
@@ -221,18 +519,28 @@ namespace cartography {
     /// You can change the texture after the class has been
     /// initialized.  The texture image must have the same dimensions
     /// as the point image, and texture pixels must correspond exactly
-    /// to point image pixels.
+    /// to point image pixels. This removes any textures added with
+    /// add_texture().
     template <class TextureViewT>
     void set_texture(TextureViewT texture) {
+      m_textures.clear();
+      add_texture(texture);
+    }
+
+    /// Add a texture to be rendered in the next plane of the output.
+    template <class TextureViewT>
+    void add_texture(TextureViewT texture) {
       VW_ASSERT(texture.impl().cols() == m_point_image.cols() && texture.impl().rows() == m_point_image.rows(),
                 ArgumentErr() << "Orthorasterizer: set_texture() failed."
                 << " Texture dimensions must match point image dimensions.");
-      m_texture = channel_cast<float>(channels_to_planes(texture.impl()));
+      m_textures.push_back(channel_cast<float>(channels_to_planes(texture.impl())));
     }
 
+    int num_textures() const { return m_textures.size(); }
+
     inline int32 cols() const { return (int) (fabs(m_bbox.max().x() - m_bbox.min().x()) / m_spacing) + 1; }
     inline int32 rows() const { return (int) (fabs(m_bbox.max().y() - m_bbox.min().y()) / m_spacing) + 1; }
-    inline int32 planes() const { return 1; }
+    inline int32 planes() const { return m_textures.size(); }
 
     inline pixel_accessor origin() const { return pixel_accessor(*this); }
 
@@ -245,102 +553,53 @@ namespace cartography {
     typedef CropView<ImageView<pixel_type> > prerasterize_type;
     inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
 
+      if (m_gridding != GRID_TRIANGLES)
+        return CropView<ImageView<pixel_type> >( bin_points(bbox),
+                                                 BBox2i(-bbox.min().x(),
+                                                        -bbox.min().y(),
+                                                        cols(), rows()) );
+
       BBox2i bbox_1 = bbox;
       bbox_1.expand(5); // bugfix, ensure we see enough beyond current tile
       
       // Used to find which polygons are actually in the draw space.
       BBox3 local_3d_bbox     = pixel_to_point_bbox(bbox_1);
 
-      ImageView<float> render_buffer(bbox_1.width(), bbox_1.height());
-
-      // Setup a software renderer and the orthographic view matrix
-      vw::stereo::SoftwareRenderer renderer(bbox_1.width(),
-                                            bbox_1.height(),
-                                            &render_buffer(0,0) );
-      renderer.Ortho2D(local_3d_bbox.min().x(), local_3d_bbox.max().x(),
-                       local_3d_bbox.min().y(), local_3d_bbox.max().y());
-
-      // Set up the default color value
-      if (m_use_alpha) {
-        renderer.Clear(std::numeric_limits<float>::min());  // use this dummy value to denote transparency
-      } else if (m_minz_as_default) {
-        renderer.Clear(m_bbox.min().z());
-      } else {
-        renderer.Clear(m_default_value);
+      int num_planes = m_textures.size();
+      ImageView<float> render_buffer(bbox_1.width(), bbox_1.height(), num_planes);
+
+      // Setup a software renderer and the orthographic view matrix for
+      // each plane.
+      std::vector<RendererPtr> renderers(num_planes);
+      for (int p = 0; p < num_planes; p++){
+        renderers[p] = RendererPtr(new vw::stereo::SoftwareRenderer(bbox_1.width(),
+                                                                    bbox_1.height(),
+                                                                    &render_buffer(0,0,p) ));
+        vw::stereo::SoftwareRenderer & renderer = *renderers[p];
+        renderer.Ortho2D(local_3d_bbox.min().x(), local_3d_bbox.max().x(),
+                         local_3d_bbox.min().y(), local_3d_bbox.max().y());
+
+        // Set up the default color value
+        renderer.Clear(fill_value());
       }
 
-      static const int NUM_COLOR_COMPONENTS = 1;  // We only need gray scale
-      static const int NUM_VERTEX_COMPONENTS = 2; // DEMs are 2D
-
-      std::valarray<float> vertices(10), intensities(5);
-      renderer.SetVertexPointer(NUM_VERTEX_COMPONENTS, &vertices[0]);
-      renderer.SetColorPointer(NUM_COLOR_COMPONENTS, &intensities[0]);
-
-      // From the box in the DEM pixel space, get the box in the point
-      // cloud pixel space.
-      BBox2i point_image_boundary;
-      std::vector<double> cx, cy; // box centers in the point cloud pixel space
-      BOOST_FOREACH( BBoxPair const& boundary,
-                     m_point_image_boundaries ) {
-        if (! local_3d_bbox.intersects(boundary.first) ) continue;
-        point_image_boundary.grow( boundary.second );
-        cx.push_back((boundary.second.min().x()+boundary.second.max().x())/2.0);
-        cy.push_back((boundary.second.min().y()+boundary.second.max().y())/2.0);
-      }
-
-      // In some cases, the memory usage blows up. Then, roughly
-      // estimate how much of the input point cloud region we need to
-      // see for the given DEM tile, and multiply that region by a
-      // factor of FACTOR. Place that region at the median of the
-      // centers of the boxes used to grow the image boundary earlier,
-      // and intersect that with the current box. This will not kick
-      // in unless point_image_boundary estimated above is grossly
-      // larger than what it should be.
-      int FACTOR = 4;
-      Vector3 estim = (local_3d_bbox.max() - local_3d_bbox.min())/m_pix2point;
-      int max_len = (int)ceil(FACTOR*std::max(estim[0], estim[1]));
-      if (!cx.empty() &&
-          (point_image_boundary.width()  > max_len ||
-           point_image_boundary.height() > max_len)
-          ){
-        std::sort(cx.begin(), cx.end());
-        std::sort(cy.begin(), cy.end());
-        int midx = (int)round(cx[cx.size()/2]);
-        int midy = (int)round(cy[cy.size()/2]);
-        BBox2i smaller_boundary(midx - max_len/2, midy - max_len/2,
-                                max_len, max_len );
-        smaller_boundary.expand(1);
-        point_image_boundary.crop(smaller_boundary);
-      }
-      
+      BBox2i point_image_boundary = find_point_image_boundary(local_3d_bbox);
       if ( point_image_boundary.empty() )
         return CropView<ImageView<pixel_type> >( render_buffer,
                                                  BBox2i(-bbox_1.min().x(),
                                                         -bbox_1.min().y(),
                                                         cols(), rows()) );
 
-      // Bugfix, ensure we see enough beyond current tile
-      point_image_boundary.expand(5);
-      point_image_boundary.crop(vw::bounding_box(m_point_image));
+      // The triangles are collected in batches and each renderer draws
+      // a whole batch in one call. The planes share the vertices, each
+      // has its own colors.
+      std::vector<float> vertices;
+      std::vector< std::vector<float> > intensities(num_planes);
+      vertices.reserve(MAX_BATCH_TRIANGLES*3*NUM_VERTEX_COMPONENTS);
+      for (int p = 0; p < num_planes; p++)
+        intensities[p].reserve(MAX_BATCH_TRIANGLES*3);
 
-      // If point_image_boundary is big, subdivide it into blocks
-      // to save on memory.
-      int max_tile_size = 512; 
-      std::vector<BBox2i> blocks;
-      if (point_image_boundary.width()  >= 2*max_tile_size ||
-          point_image_boundary.height() >= 2*max_tile_size
-          ){
-        BBox2i tile_box;
-        tile_box.min()
-          = m_block_size*floor(point_image_boundary.min()/double(m_block_size));
-        tile_box.max()
-          = m_block_size*ceil(point_image_boundary.max()/double(m_block_size));
-        blocks =
-          image_blocks( tile_box, max_tile_size, max_tile_size);
-      }else{
-        blocks.push_back(point_image_boundary);
-      }
-      
+      std::vector<BBox2i> blocks = point_image_blocks(point_image_boundary);
       for (int i = 0; i < (int)blocks.size(); i++){
 
         // Need to grow the block, as for rendering below we
@@ -351,8 +610,9 @@ namespace cartography {
         // Pull a copy of the input image in memory
         ImageView<typename ImageT::pixel_type> point_copy =
           crop(m_point_image, blocks[i] );
-        ImageView<float> texture_copy =
-          crop(m_texture, blocks[i] );
+        std::vector< ImageView<float> > texture_copies(num_planes);
+        for (int p = 0; p < num_planes; p++)
+          texture_copies[p] = crop(m_textures[p], blocks[i] );
         typedef typename ImageView<Vector3>::pixel_accessor PointAcc;
         PointAcc row_acc = point_copy.origin();
         for ( int32 row = 0; row < point_copy.rows()-1; ++row ) {
@@ -367,31 +627,32 @@ namespace cartography {
             if ( !boost::math::isnan((*point_ul).z()) &&
                  !boost::math::isnan((*point_lr).z()) ) {
               
-              vertices[0] = (*point_ul).x(); // UL
-              vertices[1] = (*point_ul).y();
-              vertices[2] = (*point_ll).x(); // LL
-              vertices[3] = (*point_ll).y();
-              vertices[4] = (*point_lr).x(); // LR
-              vertices[5] = (*point_lr).y();
-              vertices[6] = (*point_ur).x(); // UR
-              vertices[7] = (*point_ur).y();
-              vertices[8] = (*point_ul).x(); // UL
-              vertices[9] = (*point_ul).y();
-              
-              intensities[0] = texture_copy(col,  row);
-              intensities[1] = texture_copy(col,row+1);
-              intensities[2] = texture_copy(col+1,  row+1);
-              intensities[3] = texture_copy(col+1,row);
-              intensities[4] = texture_copy(col,row);
-              
               if ( !boost::math::isnan((*point_ll).z()) ) {
                 // triangle 1 is: UL LL LR
-                renderer.DrawPolygon(0, 3);
+                add_vertex(vertices, *point_ul);
+                add_vertex(vertices, *point_ll);
+                add_vertex(vertices, *point_lr);
+                for (int p = 0; p < num_planes; p++){
+                  ImageView<float> const& texture_copy = texture_copies[p];
+                  intensities[p].push_back(texture_copy(col,  row  ));
+                  intensities[p].push_back(texture_copy(col,  row+1));
+                  intensities[p].push_back(texture_copy(col+1,row+1));
+                }
               }
               if ( !boost::math::isnan((*point_ur).z()) ) {
                 // triangle 2 is: LR, UR, UL
-                renderer.DrawPolygon(2, 3);
+                add_vertex(vertices, *point_lr);
+                add_vertex(vertices, *point_ur);
+                add_vertex(vertices, *point_ul);
+                for (int p = 0; p < num_planes; p++){
+                  ImageView<float> const& texture_copy = texture_copies[p];
+                  intensities[p].push_back(texture_copy(col+1,row+1));
+                  intensities[p].push_back(texture_copy(col+1,row  ));
+                  intensities[p].push_back(texture_copy(col,  row  ));
+                }
               }
+              if ( int(vertices.size()) >= MAX_BATCH_TRIANGLES*3*NUM_VERTEX_COMPONENTS )
+                draw_triangles(renderers, vertices, intensities);
             }
             point_ul.next_col();
           }
@@ -399,6 +660,7 @@ namespace cartography {
         }
         
       }
+      draw_triangles(renderers, vertices, intensities);
       
       // The software renderer returns an image which will render
       // upside down in most image formats, so we correct that here.
@@ -423,6 +685,19 @@ namespace cartography {
     void set_use_alpha(bool val) { m_use_alpha = val; }
     void set_use_minz_as_default(bool val) { m_minz_as_default = val; }
     void set_default_value(double val) { m_default_value = val; }
+
+    /// Choose between triangulation and binning the points. When
+    /// binning, a point contributes to all pixels whose centers are
+    /// within search_radius (in point units) from it. If the radius is
+    /// zero, it goes only to the pixel it falls in. In GRID_COUNT mode
+    /// each plane holds the number of points in the pixel, which is
+    /// zero rather than the default value for pixels with no points.
+    void set_gridding(GriddingMode mode, double search_radius = 0.0) {
+      VW_ASSERT(search_radius >= 0,
+                ArgumentErr() << "Orthorasterizer: The search radius must be non-negative.");
+      m_gridding = mode;
+      m_search_radius = search_radius;
+    }
     double default_value() {
       if (m_minz_as_default) return m_bbox.min().z();
       else return m_default_value;
@@ -0,0 +1,145 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PackedRTree.cc
+///
+
+#include <asp/Core/PackedRTree.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace {
+
+  const int NODE_CAPACITY = 16;
+
+  inline bool overlaps(BBox2 const& a, BBox2 const& b){
+    return a.min().x() <= b.max().x() && b.min().x() <= a.max().x() &&
+           a.min().y() <= b.max().y() && b.min().y() <= a.max().y();
+  }
+
+  // Compare boxes by the center along a given axis
+  struct CenterLess {
+    std::vector<BBox2> const& m_boxes;
+    int m_axis;
+    CenterLess(std::vector<BBox2> const& boxes, int axis):
+      m_boxes(boxes), m_axis(axis){}
+    bool operator()(int a, int b) const {
+      return m_boxes[a].min()[m_axis] + m_boxes[a].max()[m_axis] <
+             m_boxes[b].min()[m_axis] + m_boxes[b].max()[m_axis];
+    }
+  };
+
+  // Sort-Tile-Recursive ordering. Sort the boxes by x into vertical
+  // slices holding about sqrt(number of nodes) nodes each, then sort
+  // each slice by y. Consecutive runs of NODE_CAPACITY boxes then
+  // make up compact nodes.
+  void str_order(std::vector<BBox2> const& boxes, std::vector<int> & order){
+    int num = order.size();
+    int num_nodes  = (num + NODE_CAPACITY - 1)/NODE_CAPACITY;
+    int num_slices = (int)ceil(sqrt(double(num_nodes)));
+    int slice_size = num_slices*NODE_CAPACITY;
+
+    std::sort(order.begin(), order.end(), CenterLess(boxes, 0));
+    for (int start = 0; start < num; start += slice_size){
+      int end = std::min(num, start + slice_size);
+      std::sort(order.begin() + start, order.begin() + end, CenterLess(boxes, 1));
+    }
+  }
+
+}
+
+namespace asp {
+
+  void PackedRTree::build(std::vector<BBox2> const& boxes){
+
+    m_boxes = boxes;
+    m_nodes.clear();
+    m_items.clear();
+    for (int i = 0; i < (int)boxes.size(); i++){
+      if (!boxes[i].empty()) m_items.push_back(i);
+    }
+    if (m_items.empty()) return;
+
+    // The leaves
+    str_order(m_boxes, m_items);
+    int num_items = m_items.size();
+    for (int start = 0; start < num_items; start += NODE_CAPACITY){
+      Node node;
+      node.first = start;
+      node.count = std::min(NODE_CAPACITY, num_items - start);
+      node.leaf  = true;
+      for (int k = start; k < start + node.count; k++)
+        node.bbox.grow(m_boxes[m_items[k]]);
+      m_nodes.push_back(node);
+    }
+
+    // Each pass groups the nodes of the last level into parents,
+    // until a single root is left. The nodes of a level can be
+    // reordered freely before their parents are created.
+    int level_begin = 0;
+    while ((int)m_nodes.size() - level_begin > 1){
+      int level_end = m_nodes.size();
+      std::vector<Node> level(m_nodes.begin() + level_begin, m_nodes.end());
+      std::vector<BBox2> level_boxes;
+      std::vector<int> order;
+      for (int i = 0; i < (int)level.size(); i++){
+        level_boxes.push_back(level[i].bbox);
+        order.push_back(i);
+      }
+      str_order(level_boxes, order);
+      for (int i = 0; i < (int)order.size(); i++)
+        m_nodes[level_begin + i] = level[order[i]];
+
+      for (int start = level_begin; start < level_end; start += NODE_CAPACITY){
+        Node node;
+        node.first = start;
+        node.count = std::min(NODE_CAPACITY, level_end - start);
+        node.leaf  = false;
+        for (int k = start; k < start + node.count; k++)
+          node.bbox.grow(m_nodes[k].bbox);
+        m_nodes.push_back(node);
+      }
+      level_begin = level_end;
+    }
+  }
+
+  void PackedRTree::intersect(BBox2 const& box, std::vector<int> & ids) const {
+
+    if (m_nodes.empty()) return;
+
+    size_t num_ids = ids.size();
+    std::vector<int> stack;
+    stack.push_back(m_nodes.size() - 1);
+    while (!stack.empty()){
+      Node const& node = m_nodes[stack.back()];
+      stack.pop_back();
+      if (!overlaps(node.bbox, box)) continue;
+      for (int k = node.first; k < node.first + node.count; k++){
+        if (!node.leaf)
+          stack.push_back(k);
+        else if (overlaps(m_boxes[m_items[k]], box))
+          ids.push_back(m_items[k]);
+      }
+    }
+    std::sort(ids.begin() + num_ids, ids.end());
+  }
+
+} // namespace asp
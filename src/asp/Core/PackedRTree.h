@@ -0,0 +1,68 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PackedRTree.h
+///
+/// A static R-tree over a set of 2D boxes, bulk loaded with the
+/// Sort-Tile-Recursive algorithm (Leutenegger et al., 1997). It is
+/// built once and then answers box intersection queries in
+/// logarithmic rather than linear time.
+
+#ifndef __ASP_CORE_PACKED_RTREE_H__
+#define __ASP_CORE_PACKED_RTREE_H__
+
+#include <vw/Math/BBox.h>
+#include <vector>
+
+namespace asp {
+
+  class PackedRTree {
+  public:
+    PackedRTree() {}
+
+    /// Build the tree. Queries report box i of the input as i.
+    /// Empty boxes are never reported.
+    void build(std::vector<vw::BBox2> const& boxes);
+
+    /// Append to ids the indices of the boxes intersecting the given
+    /// box, in increasing order. The boxes are treated as closed, so
+    /// boxes which only touch the given one along an edge are
+    /// reported too. Callers wanting BBox::intersects() semantics
+    /// should filter the result with it.
+    void intersect(vw::BBox2 const& box, std::vector<int> & ids) const;
+
+    /// The number of boxes in the tree.
+    size_t size() const { return m_items.size(); }
+
+  private:
+    // The children of a node are either nodes or items, at
+    // positions [first, first + count) of m_nodes or m_items.
+    struct Node {
+      vw::BBox2 bbox;
+      int first, count;
+      bool leaf;
+    };
+
+    std::vector<Node> m_nodes; // The root is the last node
+    std::vector<int> m_items;  // Indices of the boxes, in leaf order
+    std::vector<vw::BBox2> m_boxes;
+  };
+
+} // namespace asp
+
+#endif//__ASP_CORE_PACKED_RTREE_H__
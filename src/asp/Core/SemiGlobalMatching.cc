@@ -0,0 +1,312 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SemiGlobalMatching.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/SemiGlobalMatching.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace vw;
+
+namespace {
+
+  // Path costs are bounded by max_cost + P2, and we sum 8 of them.
+  typedef vw::uint16 AccumT;
+
+  inline int count_bits(vw::uint64 v){
+    int count = 0;
+    while (v){
+      v &= v - 1;
+      count++;
+    }
+    return count;
+  }
+
+  // Census transform. Bit k is set if the k-th neighbor in the window
+  // is darker than the center. Pixels too close to the boundary to
+  // fit the window, or masked out, are flagged as invalid.
+  void census_transform(ImageView<float> const& image,
+                        ImageView<uint8> const& mask,
+                        Vector2i const& half_kernel,
+                        std::vector<vw::uint64> & census,
+                        std::vector<uint8> & valid){
+
+    int cols = image.cols(), rows = image.rows();
+    census.assign(cols*rows, 0);
+    valid.assign(cols*rows, 0);
+
+    for (int row = half_kernel.y(); row < rows - half_kernel.y(); row++){
+      for (int col = half_kernel.x(); col < cols - half_kernel.x(); col++){
+        float center = image(col, row);
+        vw::uint64 bits = 0;
+        for (int dy = -half_kernel.y(); dy <= half_kernel.y(); dy++){
+          for (int dx = -half_kernel.x(); dx <= half_kernel.x(); dx++){
+            if (dx == 0 && dy == 0) continue;
+            bits <<= 1;
+            if (image(col + dx, row + dy) < center) bits |= 1;
+          }
+        }
+        census[row*cols + col] = bits;
+        valid [row*cols + col] = (mask(col, row) != 0);
+      }
+    }
+  }
+
+  // The matching cost of the output pixels against each label, the
+  // Hamming distance of the census transforms. It is recomputed by
+  // each aggregation pass rather than stored, as it is cheap, and a
+  // stored cost volume would take half as much memory as the sums.
+  class CensusCost {
+    std::vector<vw::uint64> const& m_left_census, & m_right_census;
+    std::vector<uint8> const& m_left_valid, & m_right_valid;
+    int m_left_cols, m_right_cols, m_nx, m_ny, m_max_cost;
+    Vector2i m_half_kernel;
+  public:
+    CensusCost(std::vector<vw::uint64> const& left_census,
+               std::vector<vw::uint64> const& right_census,
+               std::vector<uint8> const& left_valid,
+               std::vector<uint8> const& right_valid,
+               int left_cols, int right_cols, int nx, int ny,
+               int max_cost, Vector2i const& half_kernel):
+      m_left_census(left_census), m_right_census(right_census),
+      m_left_valid(left_valid), m_right_valid(right_valid),
+      m_left_cols(left_cols), m_right_cols(right_cols), m_nx(nx), m_ny(ny),
+      m_max_cost(max_cost), m_half_kernel(half_kernel){}
+
+    void operator()(int col, int row, uint8* pix_cost) const {
+      int lindex = (row + m_half_kernel.y())*m_left_cols + col + m_half_kernel.x();
+      if (!m_left_valid[lindex]){
+        std::fill(pix_cost, pix_cost + m_nx*m_ny, uint8(m_max_cost));
+        return;
+      }
+      vw::uint64 lbits = m_left_census[lindex];
+      for (int dy = 0; dy < m_ny; dy++){
+        for (int dx = 0; dx < m_nx; dx++){
+          int rindex = (row + m_half_kernel.y() + dy)*m_right_cols
+            + col + m_half_kernel.x() + dx;
+          pix_cost[dy*m_nx + dx] = m_right_valid[rindex] ?
+            uint8(count_bits(lbits ^ m_right_census[rindex])) : uint8(m_max_cost);
+        }
+      }
+    }
+  };
+
+  // Start a path at the image boundary.
+  inline void start_path(const uint8* cost, int num_labels,
+                         AccumT* path, AccumT & path_min){
+    path_min = std::numeric_limits<AccumT>::max();
+    for (int l = 0; l < num_labels; l++){
+      path[l] = cost[l];
+      path_min = std::min(path_min, path[l]);
+    }
+  }
+
+  // Advance a path by one pixel. The labels form an nx by ny grid,
+  // and labels adjacent on this grid are penalized by P1, the others
+  // by P2.
+  inline void update_path(const uint8* cost, const AccumT* prev, AccumT prev_min,
+                          int nx, int ny, int p1, int p2,
+                          AccumT* path, AccumT & path_min){
+    path_min = std::numeric_limits<AccumT>::max();
+    int far_cost = prev_min + p2;
+    for (int dy = 0; dy < ny; dy++){
+      for (int dx = 0; dx < nx; dx++){
+        int l = dy*nx + dx;
+        int v = std::min(int(prev[l]), far_cost);
+        if (dx > 0     ) v = std::min(v, prev[l - 1 ] + p1);
+        if (dx < nx - 1) v = std::min(v, prev[l + 1 ] + p1);
+        if (dy > 0     ) v = std::min(v, prev[l - nx] + p1);
+        if (dy < ny - 1) v = std::min(v, prev[l + nx] + p1);
+        path[l] = AccumT(cost[l] + v - prev_min);
+        path_min = std::min(path_min, path[l]);
+      }
+    }
+  }
+
+  // Aggregate the costs along the four directions arriving at a
+  // pixel from the previous row and column in the traversal order,
+  // and add the result to the sum. A forward pass goes left to right
+  // and top to bottom, a backward pass the other way around, so
+  // together they cover all 8 directions.
+  void aggregate_pass(CensusCost const& cost,
+                      int cols, int rows, int nx, int ny,
+                      int p1, int p2, bool forward,
+                      std::vector<AccumT> & sum){
+
+    int num_labels = nx*ny;
+    int sx = forward ? 1 : -1;
+    std::vector<uint8> pix_cost(num_labels);
+
+    // Paths along the diagonal, vertical, and anti-diagonal
+    // directions, for the previous and the current row.
+    const int num_row_dirs = 3;
+    std::vector<AccumT> prev_paths(num_row_dirs*cols*num_labels),
+      curr_paths(num_row_dirs*cols*num_labels);
+    std::vector<AccumT> prev_mins(num_row_dirs*cols), curr_mins(num_row_dirs*cols);
+
+    // The path along the row
+    std::vector<AccumT> prev_row_path(num_labels), curr_row_path(num_labels);
+    AccumT prev_row_min = 0, curr_row_min = 0;
+
+    for (int k = 0; k < rows; k++){
+      int row = forward ? k : rows - 1 - k;
+      for (int m = 0; m < cols; m++){
+        int col = forward ? m : cols - 1 - m;
+
+        cost(col, row, &pix_cost[0]);
+        AccumT* pix_sum = &sum[(size_t(row)*cols + col)*num_labels];
+
+        if (m == 0)
+          start_path(&pix_cost[0], num_labels, &curr_row_path[0], curr_row_min);
+        else
+          update_path(&pix_cost[0], &prev_row_path[0], prev_row_min, nx, ny, p1, p2,
+                      &curr_row_path[0], curr_row_min);
+        for (int l = 0; l < num_labels; l++)
+          pix_sum[l] += curr_row_path[l];
+        std::swap(prev_row_path, curr_row_path);
+        std::swap(prev_row_min, curr_row_min);
+
+        for (int d = 0; d < num_row_dirs; d++){
+          int prev_col = col + (d - 1)*sx;
+          AccumT* path = &curr_paths[(d*cols + col)*num_labels];
+          AccumT & path_min = curr_mins[d*cols + col];
+          if (k == 0 || prev_col < 0 || prev_col >= cols)
+            start_path(&pix_cost[0], num_labels, path, path_min);
+          else
+            update_path(&pix_cost[0], &prev_paths[(d*cols + prev_col)*num_labels],
+                        prev_mins[d*cols + prev_col], nx, ny, p1, p2,
+                        path, path_min);
+          for (int l = 0; l < num_labels; l++)
+            pix_sum[l] += path[l];
+        }
+      }
+      std::swap(prev_paths, curr_paths);
+      std::swap(prev_mins, curr_mins);
+    }
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  ImageView<PixelMask<Vector2i> >
+  semi_global_matching(ImageView<float> const& left,
+                       ImageView<float> const& right,
+                       ImageView<uint8> const& left_mask,
+                       ImageView<uint8> const& right_mask,
+                       BBox2i const& search_range,
+                       Vector2i const& census_kernel,
+                       int penalty1, int penalty2,
+                       float xcorr_threshold){
+
+    VW_ASSERT( census_kernel.x() % 2 == 1 && census_kernel.y() % 2 == 1 &&
+               census_kernel.x() <= SGM_MAX_CENSUS_WIDTH &&
+               census_kernel.y() <= SGM_MAX_CENSUS_HEIGHT,
+               ArgumentErr() << "semi_global_matching: The census kernel must have odd "
+               << "dimensions no larger than " << SGM_MAX_CENSUS_WIDTH << " x "
+               << SGM_MAX_CENSUS_HEIGHT << ".\n" );
+    VW_ASSERT( left.cols() == left_mask.cols() && left.rows() == left_mask.rows() &&
+               right.cols() == right_mask.cols() && right.rows() == right_mask.rows(),
+               ArgumentErr() << "semi_global_matching: Images and masks must have "
+               << "the same sizes.\n" );
+    VW_ASSERT( right.cols() == left.cols() + search_range.width() &&
+               right.rows() == left.rows() + search_range.height(),
+               ArgumentErr() << "semi_global_matching: The right image must be "
+               << "the left image size grown by the search range.\n" );
+
+    Vector2i half_kernel = census_kernel/2;
+    int max_cost = census_kernel.x()*census_kernel.y() - 1;
+    VW_ASSERT( penalty1 >= 0 && penalty2 >= penalty1 &&
+               8*(max_cost + penalty2) <= int(std::numeric_limits<AccumT>::max()),
+               ArgumentErr() << "semi_global_matching: Invalid penalties P1 = "
+               << penalty1 << ", P2 = " << penalty2 << ".\n" );
+
+    int cols = left.cols() - 2*half_kernel.x();
+    int rows = left.rows() - 2*half_kernel.y();
+    ImageView<PixelMask<Vector2i> > disparity(std::max(cols, 0), std::max(rows, 0));
+    if (cols <= 0 || rows <= 0) return disparity;
+
+    int nx = search_range.width()  + 1;
+    int ny = search_range.height() + 1;
+    int num_labels = nx*ny;
+
+    std::vector<vw::uint64> left_census, right_census;
+    std::vector<uint8> left_valid, right_valid;
+    census_transform(left,  left_mask,  half_kernel, left_census,  left_valid);
+    census_transform(right, right_mask, half_kernel, right_census, right_valid);
+
+    CensusCost cost(left_census, right_census, left_valid, right_valid,
+                    left.cols(), right.cols(), nx, ny, max_cost, half_kernel);
+    std::vector<AccumT> sum(size_t(cols)*rows*num_labels, 0);
+    aggregate_pass(cost, cols, rows, nx, ny, penalty1, penalty2, true,  sum);
+    aggregate_pass(cost, cols, rows, nx, ny, penalty1, penalty2, false, sum);
+
+    // Winner takes all
+    std::vector<int> best_label(cols*rows);
+    for (int p = 0; p < cols*rows; p++){
+      const AccumT* pix_sum = &sum[size_t(p)*num_labels];
+      best_label[p] = std::min_element(pix_sum, pix_sum + num_labels) - pix_sum;
+    }
+
+    for (int row = 0; row < rows; row++){
+      for (int col = 0; col < cols; col++){
+        int lindex = (row + half_kernel.y())*left.cols() + col + half_kernel.x();
+        if (!left_valid[lindex]) continue;
+
+        int label = best_label[row*cols + col];
+        int bx = label % nx, by = label / nx;
+
+        if (xcorr_threshold >= 0){
+          // Find the best match of the right pixel among the left
+          // pixels which may map to it.
+          int best_rl = -1;
+          AccumT best_rl_sum = std::numeric_limits<AccumT>::max();
+          for (int dy = 0; dy < ny; dy++){
+            int prow = row + by - dy;
+            if (prow < 0 || prow >= rows) continue;
+            for (int dx = 0; dx < nx; dx++){
+              int pcol = col + bx - dx;
+              if (pcol < 0 || pcol >= cols) continue;
+              int l = dy*nx + dx;
+              AccumT s = sum[(size_t(prow)*cols + pcol)*num_labels + l];
+              if (s < best_rl_sum){
+                best_rl_sum = s;
+                best_rl = l;
+              }
+            }
+          }
+          if (best_rl < 0 ||
+              std::abs(best_rl % nx - bx) > xcorr_threshold ||
+              std::abs(best_rl / nx - by) > xcorr_threshold)
+            continue;
+        }
+
+        disparity(col, row) = PixelMask<Vector2i>(Vector2i(bx, by) + search_range.min());
+      }
+    }
+
+    return disparity;
+  }
+
+} // namespace asp
@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SemiGlobalMatching.h
+///
+/// Integer disparity by semi-global matching (Hirschmuller, 2008).
+///
+/// The matching cost is the Hamming distance between census transforms
+/// of the two images. It is aggregated along 8 image directions,
+/// penalizing small disparity changes between neighbors by P1 and
+/// large ones by P2. Two-dimensional search ranges are supported, in
+/// which case the disparities (dx, dy) and (dx', dy') are considered
+/// small changes of each other if they differ by one in a single
+/// coordinate.
+
+#ifndef __ASP_CORE_SEMI_GLOBAL_MATCHING_H__
+#define __ASP_CORE_SEMI_GLOBAL_MATCHING_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+namespace asp {
+
+  // Largest census window we support. Its area minus the center
+  // pixel must fit in 64 bits.
+  const int SGM_MAX_CENSUS_WIDTH  = 9;
+  const int SGM_MAX_CENSUS_HEIGHT = 7;
+
+  /// Compute the integer disparity with semi-global matching.
+  ///
+  /// If the census kernel has half-size (hx, hy), the output has size
+  /// (left.cols() - 2*hx, left.rows() - 2*hy), and its pixel (i, j)
+  /// corresponds to the pixel (i + hx, j + hy) of the left image. The
+  /// right image must be the region of the full right image starting
+  /// at the left image origin plus search_range.min(), of size
+  /// left size plus search_range.size(). The search range is
+  /// inclusive of its max corner, as with the block correlators.
+  ///
+  /// Pixels whose mask value is zero are not matched. If
+  /// xcorr_threshold is non-negative, disparities which disagree by
+  /// more than that many pixels with the right-to-left match are
+  /// invalidated.
+  ///
+  /// The aggregated costs take two bytes per output pixel and label.
+  vw::ImageView<vw::PixelMask<vw::Vector2i> >
+  semi_global_matching(vw::ImageView<float> const& left,
+                       vw::ImageView<float> const& right,
+                       vw::ImageView<vw::uint8> const& left_mask,
+                       vw::ImageView<vw::uint8> const& right_mask,
+                       vw::BBox2i const& search_range,
+                       vw::Vector2i const& census_kernel,
+                       int penalty1, int penalty2,
+                       float xcorr_threshold);
+
+} // namespace asp
+
+#endif//__ASP_CORE_SEMI_GLOBAL_MATCHING_H__
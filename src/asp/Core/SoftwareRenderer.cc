@@ -47,6 +47,15 @@
 #include <asp/Core/SoftwareRenderer.h>
 
 #include <iostream>
+#include <vector>
+
+// Spans are filled several pixels at a time when SIMD instructions
+// are available, with a scalar loop for the remainder.
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 using namespace vw;
@@ -330,6 +339,45 @@ DrawFlatGraySpan(GraphicsState *gc)
               length, float(gc->rasterInfo.frag.color.r));
 }
 
+// The vector loops evaluate gray + i*drdx directly rather than
+// accumulating, so they do not drift along long spans. The scalar
+// loop for the remainder accumulates, as the original code did.
+void
+stereo::FillGraySpan(float *span, const int length, float gray, const float drdx)
+{
+  int i = 0;
+#if defined(__AVX__)
+  if (length >= 8) {
+    __m256 base  = _mm256_set1_ps(gray);
+    __m256 slope = _mm256_set1_ps(drdx);
+    __m256 index = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256 eight = _mm256_set1_ps(8);
+    for (; i + 8 <= length; i += 8) {
+      _mm256_storeu_ps(span + i, _mm256_add_ps(base, _mm256_mul_ps(index, slope)));
+      index = _mm256_add_ps(index, eight);
+    }
+    gray += float(i) * drdx;
+  }
+#elif defined(__SSE2__)
+  if (length >= 4) {
+    __m128 base  = _mm_set1_ps(gray);
+    __m128 slope = _mm_set1_ps(drdx);
+    __m128 index = _mm_set_ps(3, 2, 1, 0);
+    __m128 four  = _mm_set1_ps(4);
+    for (; i + 4 <= length; i += 4) {
+      _mm_storeu_ps(span + i, _mm_add_ps(base, _mm_mul_ps(index, slope)));
+      index = _mm_add_ps(index, four);
+    }
+    gray += float(i) * drdx;
+  }
+#endif
+
+  for (; i < length; ++i) {
+    span[i] = gray;
+    gray += drdx;
+  }
+}
+
 static void
 DrawGraySpan(GraphicsState *gc)
 {
@@ -355,11 +403,7 @@ DrawGraySpan(GraphicsState *gc)
 
   float *span =
     &(gc->buffer[gc->rasterInfo.frag.y * gc->width + x ] );
-
-  for (int i = length; i; --i) {
-    *span++ = float(gray);
-    gray += drdx;
-  }
+  FillGraySpan(span, length, float(gray), float(drdx));
 }
 
 // In the SnapX* and FillSubTriangle routines, 1s31.1s31 fixed point
@@ -763,6 +807,44 @@ SoftwareRenderer::SetColorPointer(const int numComponents, float * const colors)
   m_colorPointer = colors;
 }
 
+void
+SoftwareRenderer::DrawTriangles(const int startIndex, const int numTriangles)
+{
+  if (m_vertexPointer == 0 || numTriangles <= 0)
+    return;
+
+  if ((m_colorPointer == 0) && (m_shadeMode != eShadeFlat))
+    return;
+
+  // Map all vertices to window coordinates in one pass, then fill the
+  // triangles.
+  int numVertices = kVerticesPerTriangle * numTriangles;
+  float *vertices = &m_vertexPointer[startIndex * m_numVertexComponents];
+  float *colors = &m_colorPointer[startIndex * m_numColorComponents];
+
+  // This is the same arithmetic as MapToWindow(), so the result
+  // matches drawing the triangles one at a time.
+  double width = double(m_bufferWidth), height = double(m_bufferHeight);
+  std::vector<float> window(2 * numVertices);
+  for (int i = 0; i < numVertices; i++)
+  {
+    double xNDC = m_transformNDC[0][0] * vertices[i * m_numVertexComponents    ] + m_transformNDC[2][0];
+    double yNDC = m_transformNDC[1][1] * vertices[i * m_numVertexComponents + 1] + m_transformNDC[2][1];
+    window[2*i    ] = RealT(0.5 * (xNDC + 1.0) * width);
+    window[2*i + 1] = RealT(0.5 * (yNDC + 1.0) * height);
+  }
+
+  GraphicsState *gc = (GraphicsState *) m_graphicsState;
+  for (int i = 0; i < numTriangles; i++)
+  {
+    int v = kVerticesPerTriangle * i;
+    Vertex vertex0(&window[2*v    ], ::Color(&colors[ v    * m_numColorComponents], m_numColorComponents));
+    Vertex vertex1(&window[2*v + 2], ::Color(&colors[(v+1) * m_numColorComponents], m_numColorComponents));
+    Vertex vertex2(&window[2*v + 4], ::Color(&colors[(v+2) * m_numColorComponents], m_numColorComponents));
+    FillTriangle(gc, &vertex0, &vertex1, &vertex2);
+  }
+}
+
 void
 SoftwareRenderer::DrawPolygon(const int startIndex, const int numVertices)
 {
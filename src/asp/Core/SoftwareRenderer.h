@@ -35,6 +35,9 @@ namespace stereo {
       void SetVertexPointer(const int numComponents, float * const vertices);
       void SetColorPointer(const int numComponents, float * const colors);
       void DrawPolygon(const int startIndex, const int numVertices);
+      // Draw independent triangles, each made of the next three
+      // vertices starting at startIndex, like GL_TRIANGLES.
+      void DrawTriangles(const int startIndex, const int numTriangles);
 
     private:
       int m_numVertexComponents;
@@ -52,6 +55,13 @@ namespace stereo {
       double m_transformViewport[3][2];
       void *m_graphicsState;
     };
+
+    // Fill the length pixels of a smooth-shaded span, starting at
+    // gray and increasing by drdx per pixel. With SIMD instructions
+    // each pixel is computed as gray + i*drdx, which can differ from
+    // adding drdx pixel by pixel by about one float rounding per
+    // pixel of the span.
+    void FillGraySpan(float *span, const int length, float gray, const float drdx);
   }
 }
 
@@ -23,8 +23,14 @@
 #define __SPARSE_IMAGE_VIEW_H__
 
 // Standard
+#include <algorithm>
+#include <list>
+#include <map>
 #include <vector>
 
+// Boost
+#include <boost/shared_ptr.hpp>
+
 // VW
 #include <vw/Core/Log.h>
 #include <vw/Math/Vector.h>
@@ -49,6 +55,10 @@ namespace asp {
   // For the time being we do not support overwriting previous data. It
   // seems non trivial at this hour.
 
+  // Once all data is absorbed, finalize() moves the segments to flat
+  // arrays sorted by row and column, which are faster to read and
+  // are shared by the copies of the view made when rasterizing.
+
   template <class ImageT>
   class SparseCompositeView : public vw::ImageViewBase< SparseCompositeView<ImageT> > {
     // The key in our map is the index marking the end of the
@@ -59,6 +69,31 @@ namespace asp {
     bool m_allow_overlap;
     ImageT m_under_image;
 
+    // The read-only layout. The segments of row j are the indices
+    // row_first[j] to row_first[j+1] - 1 of the segment arrays. The
+    // pixels of segment k are the pixels from offset[k] on.
+    struct FlatData {
+      std::vector<size_t> row_first;
+      std::vector<vw::int32> begin, end;
+      std::vector<size_t> offset;
+      std::vector<typename ImageT::pixel_type> pixels;
+    };
+    boost::shared_ptr<const FlatData> m_flat;
+
+    // The index of the segment of row j containing column i, or -1
+    size_t find_segment( vw::int32 i, vw::int32 j ) const {
+      typedef std::vector<vw::int32>::const_iterator iter_type;
+      iter_type first = m_flat->end.begin() + m_flat->row_first[j];
+      iter_type last  = m_flat->end.begin() + m_flat->row_first[j+1];
+      iter_type it = std::upper_bound( first, last, i );
+      if ( it == last )
+        return size_t(-1);
+      size_t k = it - m_flat->end.begin();
+      if ( i < m_flat->begin[k] )
+        return size_t(-1);
+      return k;
+    }
+
   public:
     typedef typename ImageT::pixel_type pixel_type;
     typedef pixel_type result_type;
@@ -78,6 +113,15 @@ namespace asp {
 
     inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p=0 ) const {
 
+      if ( m_flat ) {
+        if ( j >= vw::int32(m_flat->row_first.size()) - 1 )
+          return m_under_image( i, j, p );
+        size_t k = find_segment( i, j );
+        if ( k == size_t(-1) )
+          return m_under_image( i, j, p );
+        return m_flat->pixels[ m_flat->offset[k] + (i - m_flat->begin[k]) ];
+      }
+
       typename map_type::const_iterator it;
       it = m_data[j].upper_bound(i);
       if ( it != m_data[j].end() ) {
@@ -94,7 +138,63 @@ namespace asp {
     inline prerasterize_type prerasterize( vw::BBox2i const& bbox ) const { return *this; }
     template <class DestT>
     inline void rasterize( DestT const& dest, vw::BBox2i const& bbox ) const {
-      vw::rasterize( prerasterize(bbox), dest, bbox );
+      using namespace vw;
+      if ( !m_flat ) {
+        vw::rasterize( prerasterize(bbox), dest, bbox );
+        return;
+      }
+
+      // Copy the image underneath, then each run of a segment
+      vw::rasterize( m_under_image, dest, bbox );
+      int32 last_row = std::min( bbox.max().y(), int32(m_flat->row_first.size()) - 1 );
+      for ( int32 j = bbox.min().y(); j < last_row; ++j ) {
+        typedef std::vector<int32>::const_iterator iter_type;
+        iter_type first = m_flat->end.begin() + m_flat->row_first[j];
+        iter_type last  = m_flat->end.begin() + m_flat->row_first[j+1];
+        for ( iter_type it = std::upper_bound( first, last, bbox.min().x() );
+              it != last; ++it ) {
+          size_t k = it - m_flat->end.begin();
+          if ( m_flat->begin[k] >= bbox.max().x() )
+            break;
+          int32 c_begin = std::max( m_flat->begin[k], bbox.min().x() );
+          int32 c_end   = std::min( m_flat->end[k],   bbox.max().x() );
+          for ( int32 c = c_begin; c < c_end; ++c )
+            dest( c - bbox.min().x(), j - bbox.min().y() )
+              = m_flat->pixels[ m_flat->offset[k] + (c - m_flat->begin[k]) ];
+        }
+      }
+    }
+
+    // Move the segments to the flat layout. No data may be absorbed
+    // afterwards.
+    void finalize() {
+      using namespace vw;
+      if ( m_flat )
+        return;
+
+      boost::shared_ptr<FlatData> flat( new FlatData );
+      flat->row_first.reserve( m_data.size() + 1 );
+      size_t num_pixels = 0;
+      for ( size_t r = 0; r < m_data.size(); ++r )
+        for ( typename map_type::const_iterator it = m_data[r].begin();
+              it != m_data[r].end(); ++it )
+          num_pixels += it->second.size();
+      flat->pixels.reserve( num_pixels );
+
+      for ( size_t r = 0; r < m_data.size(); ++r ) {
+        flat->row_first.push_back( flat->end.size() );
+        for ( typename map_type::const_iterator it = m_data[r].begin();
+              it != m_data[r].end(); ++it ) {
+          flat->begin.push_back( it->first - int32(it->second.size()) );
+          flat->end.push_back( it->first );
+          flat->offset.push_back( flat->pixels.size() );
+          flat->pixels.insert( flat->pixels.end(), it->second.begin(), it->second.end() );
+        }
+      }
+      flat->row_first.push_back( flat->end.size() );
+
+      m_flat = flat;
+      std::vector<map_type>().swap( m_data );
     }
 
     // Difficult insertation
@@ -103,6 +203,8 @@ namespace asp {
                  vw::ImageViewBase<InputT> const& image_base ) {
       using namespace vw;
       InputT image = image_base.impl();
+      VW_ASSERT( !m_flat,
+                 LogicErr() << "SparseCompositeView: Cannot absorb data after finalize().\n" );
       VW_DEBUG_ASSERT( starting_index[0] >= 0 && starting_index[1] >= 0,
                        NoImplErr() << "SparseCompositeView doesn't support insertation behind image origin.\n" );
 
@@ -191,10 +293,19 @@ namespace asp {
     void print_structure() const {
       using namespace vw;
       vw_out() << "SparseCompositeView Structure:\n";
-      for ( uint32 i = 0; i < m_data->size(); ++i ) {
+      if ( m_flat ) {
+        for ( size_t i = 0; i + 1 < m_flat->row_first.size(); ++i ) {
+          vw_out() << i << " | ";
+          for ( size_t k = m_flat->row_first[i]; k < m_flat->row_first[i+1]; ++k )
+            vw_out() << "(" << m_flat->begin[k] << "->" << m_flat->end[k] << ")";
+          vw_out() << "\n";
+        }
+        return;
+      }
+      for ( uint32 i = 0; i < m_data.size(); ++i ) {
         vw_out() << i << " | ";
-        for ( typename map_type::const_iterator it = (*m_data)[i].begin();
-              it != (*m_data)[i].end(); ++it ) {
+        for ( typename map_type::const_iterator it = m_data[i].begin();
+              it != m_data[i].end(); ++it ) {
           int32 start = it->first - it->second.size();
           vw_out() << "(" << start << "->" << it->first << ")";
         }
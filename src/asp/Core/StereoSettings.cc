@@ -50,6 +50,7 @@ namespace asp {
     // Must initialize this variable as it is used in mapproject
     // to get a camera pointer, and there we don't parse stereo.default
     disable_correct_velocity_aberration = false;
+    disable_dg_line_table = false;
 
     max_valid_triangulation_error = std::numeric_limits<double>::quiet_NaN();
   }
@@ -86,11 +87,15 @@ namespace asp {
       ("prefilter-mode", po::value(&global.pre_filter_mode)->default_value(2),
        "Preprocessing filter mode. [0 None, 1 Gaussian, 2 LoG, 3 Sign of LoG]")
       ("corr-seed-mode", po::value(&global.seed_mode)->default_value(1),
-       "Correlation seed strategy. [0 None, 1 Use low-res disparity from stereo, 2 Use low-res disparity from provided DEM (see disparity-estimation-dem), 3 Use low-res disparity produced by sparse_disp (in development)]")
+       "Correlation seed strategy. [0 None, 1 Use low-res disparity from stereo, 2 Use low-res disparity from provided DEM (see disparity-estimation-dem), 3 Use low-res disparity produced by sparse_disp (in development), 4 Use low-res disparity from FFT correlation of the low-res images]")
       ("corr-sub-seed-percent", po::value(&global.seed_percent_pad)->default_value(0.25),
        "Percent fudge factor for disparity seed's search range")
       ("cost-mode", po::value(&global.cost_mode)->default_value(2),
-       "Correlation cost metric. [0 Absolute, 1 Squared, 2 Normalized Cross Correlation]")
+       "Correlation cost metric. [0 Absolute, 1 Squared, 2 Normalized Cross Correlation, 3 Semi-Global Matching]")
+      ("sgm-penalty1", po::value(&global.sgm_penalty1)->default_value(8),
+       "Semi-global matching penalty for neighbors whose disparities differ by one pixel (for cost-mode 3).")
+      ("sgm-penalty2", po::value(&global.sgm_penalty2)->default_value(64),
+       "Semi-global matching penalty for neighbors whose disparities differ by more than one pixel (for cost-mode 3).")
       ("xcorr-threshold", po::value(&global.xcorr_threshold)->default_value(2),
        "L-R vs R-L agreement threshold in pixels.")
       ("corr-kernel", po::value(&global.corr_kernel)->default_value(Vector2i(21,21),"21 21"),
@@ -99,6 +104,12 @@ namespace asp {
        "Disparity search range. Specify in format: hmin vmin hmax vmax.")
       ("corr-max-levels", po::value(&global.corr_max_levels)->default_value(5),
        "Max pyramid levels to process when using the integer correlator. (0 is just a single level).")
+      ("corr-box-filter", po::bool_switch(&global.corr_box_filter)->default_value(false)->implicit_value(true),
+       "For cost modes 0 to 2, search the whole range of each tile at full resolution with box-filtered window costs, instead of using the pyramid correlator. The corr-max-levels and corr-timeout options are ignored.")
+      ("corr-adaptive-tiling", po::bool_switch(&global.corr_adaptive_tiling)->default_value(false)->implicit_value(true),
+       "Split the correlation tiles with large search ranges and merge those with small ones, so that the threads have about the same amount of work.")
+      ("corr-fused-refinement", po::bool_switch(&global.corr_fused_refinement)->default_value(false)->implicit_value(true),
+       "Do subpixel refinement of each tile right after correlating it, and write only the refined disparity. The refinement stage is then skipped.")
       ("compute-low-res-disparity-only", po::bool_switch(&global.compute_low_res_disparity_only)->default_value(false)->implicit_value(true),
        "Compute only the low-resolution disparity, skip the full-resolution disparity computation.")
       ("disparity-estimation-dem", po::value(&global.disparity_estimation_dem)->default_value(""),
@@ -175,6 +186,8 @@ namespace asp {
        "Disable filling of holes using an inpainting method")
       ("fill-holes-max-size", po::value(&global.fill_hole_max_size)->default_value(100000),
        "Max size in pixels of holes that can be filled in.")
+      ("fill-holes-method", po::value(&global.fill_holes_method)->default_value(0),
+       "Hole filling method. [0 Iterative averaging, 1 Multigrid solver (much faster for large holes)]")
       ("mask-flatfield", po::bool_switch(&global.mask_flatfield)->default_value(false)->implicit_value(true),
        "Mask dust found on the sensor or film. (For use with Apollo Metric Cameras only!)");
 
@@ -204,6 +217,10 @@ namespace asp {
        "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. [Default: 1/2^10]")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
        "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
+      ("quantize-point-cloud", po::bool_switch(&global.quantize_point_cloud)->default_value(false)->implicit_value(true),
+       "Save the final point cloud as 32-bit integer multiples of the point cloud rounding error away from its center, which compresses better than float.")
+      ("point-cloud-error-rounding-error", po::value(&global.point_cloud_error_rounding_error)->default_value(0.0),
+       "How much to round the triangulation error of a quantized point cloud, in meters. [Default: the point cloud rounding error]")
       ("compute-point-cloud-center-only", po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
        "Only compute the center of triangulated point cloud and exit.")
       ("compute-error-vector", po::bool_switch(&global.compute_error_vector)->default_value(false)->implicit_value(true),
@@ -215,7 +232,9 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("disable-correct-velocity-aberration", po::bool_switch(&global.disable_correct_velocity_aberration)->default_value(false)->implicit_value(true),
-       "Apply the velocity aberration correction for Digital Globe cameras.");
+       "Apply the velocity aberration correction for Digital Globe cameras.")
+      ("disable-dg-line-table", po::bool_switch(&global.disable_dg_line_table)->default_value(false)->implicit_value(true),
+       "Do not tabulate the Digital Globe camera position and pose at each image line, but evaluate the ephemeris and attitude at every use. This is slower.");
   }
 
   UndocOptsDescription::UndocOptsDescription() : po::options_description("Undocumented Options") {
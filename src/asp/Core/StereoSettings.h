@@ -112,15 +112,23 @@ namespace asp {
                                       //     (see disparity-estimation-dem)
                                       // 3 = Use low-res disparity produced by sparse_disp
                                       //     (in development)
+                                      // 4 = Use low-res disparity from FFT correlation
+                                      //     of the low-res images
 
     float seed_percent_pad;           // Pad amound towards the IP found
     vw::uint16 cost_mode;             // 0 = absolute difference
                                       // 1 = squared difference
                                       // 2 = normalized cross correlation
+                                      // 3 = semi-global matching
+    int sgm_penalty1;                 // SGM penalty for disparity changes of one pixel
+    int sgm_penalty2;                 // SGM penalty for larger disparity changes
     float xcorr_threshold;            // L-R vs R-L agreement threshold in pixels
     vw::Vector2i corr_kernel;         // Correlation kernel
     vw::BBox2i search_range;          // Correlation search range
     vw::uint16 corr_max_levels;       // Max pyramid levels to process. 0 hits only once.
+    bool corr_box_filter;             // Use the box-filter block correlator (cost modes 0-2)
+    bool corr_adaptive_tiling;        // Balance the correlation tiles by their search ranges
+    bool corr_fused_refinement;       // Refine each tile right after correlating it
     bool compute_low_res_disparity_only;      // Skip the full-resolution disparity computation
     std::string disparity_estimation_dem;     // DEM to use in estimating the low-resolution disparity
     double disparity_estimation_dem_error; // Error (in meters) of the disparity estimation DEM
@@ -153,6 +161,7 @@ namespace asp {
     bool disable_fill_holes;
     int fill_hole_max_size;           // Maximum hole size in pixels that we'll attempt
                                       // to fill
+    int fill_holes_method;            // 0 = iterative averaging, 1 = multigrid
     bool mask_flatfield;              // Masks pixels in the input images that are less
                                       // than 0 (for use with Apollo Metric Camera)
 
@@ -164,11 +173,14 @@ namespace asp {
     bool use_least_squares;           // Use a more rigorous triangulation
     bool save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;// How much to round the output point cloud values
+    bool quantize_point_cloud;        // Save the point cloud as integer multiples of the rounding error
+    double point_cloud_error_rounding_error; // How much to round the error of a quantized point cloud
     bool compute_point_cloud_center_only; // Only compute the center of triangulated point cloud and exit.
     bool compute_error_vector;        // Compute the triangulation error vector, not just its length
 
     // DG Options
     bool disable_correct_velocity_aberration;
+    bool disable_dg_line_table;       // Evaluate the DG camera functions at every call
 
     // Undocumented options
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
@@ -0,0 +1,121 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileBalancing.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TileBalancing.h>
+
+#include <algorithm>
+
+using namespace vw;
+
+namespace {
+
+  // Consecutive groups which are scheduled together, with their
+  // total cost.
+  struct GroupRun {
+    std::vector<asp::TileGroup> groups;
+    double cost;
+    bool operator<(GroupRun const& other) const { return cost > other.cost; }
+  };
+
+  // Split the box in halves along each dimension until the pieces
+  // cost no more than the target, or would become too small.
+  void split_box(BBox2i const& box, double box_cost,
+                 boost::function<double (BBox2i const&)> const& cost,
+                 double target, int min_tile_size, GroupRun & run){
+
+    int nx = (box.width()  / 2 >= min_tile_size) ? 2 : 1;
+    int ny = (box.height() / 2 >= min_tile_size) ? 2 : 1;
+    if (box_cost <= target || nx*ny == 1){
+      run.groups.push_back(asp::TileGroup(1, box));
+      run.cost += box_cost;
+      return;
+    }
+
+    int xs[3] = {box.min().x(), box.min().x() + box.width()/nx,  box.max().x()};
+    int ys[3] = {box.min().y(), box.min().y() + box.height()/ny, box.max().y()};
+    if (nx == 1) xs[1] = box.max().x();
+    if (ny == 1) ys[1] = box.max().y();
+    for (int j = 0; j < ny; j++){
+      for (int i = 0; i < nx; i++){
+        BBox2i piece(Vector2i(xs[i], ys[j]), Vector2i(xs[i+1], ys[j+1]));
+        split_box(piece, cost(piece), cost, target, min_tile_size, run);
+      }
+    }
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  std::vector<TileGroup>
+  balance_tiles(std::vector<BBox2i> const& tiles,
+                boost::function<double (BBox2i const&)> const& cost,
+                int num_tasks, int min_tile_size){
+
+    VW_ASSERT( num_tasks > 0 && min_tile_size > 0,
+               ArgumentErr() << "balance_tiles: The number of tasks and the "
+               << "minimum tile size must be positive.\n" );
+
+    std::vector<double> tile_costs(tiles.size());
+    double total_cost = 0;
+    for (size_t i = 0; i < tiles.size(); i++){
+      tile_costs[i] = cost(tiles[i]);
+      total_cost += tile_costs[i];
+    }
+    double target = total_cost / num_tasks;
+
+    std::vector<GroupRun> runs;
+    GroupRun merged;
+    merged.groups.push_back(TileGroup());
+    merged.cost = 0;
+    for (size_t i = 0; i < tiles.size(); i++){
+
+      if (tile_costs[i] < target/2){
+        merged.groups.back().push_back(tiles[i]);
+        merged.cost += tile_costs[i];
+        if (merged.cost >= target){
+          runs.push_back(merged);
+          merged.groups.back().clear();
+          merged.cost = 0;
+        }
+        continue;
+      }
+
+      GroupRun run;
+      run.cost = 0;
+      split_box(tiles[i], tile_costs[i], cost, target, min_tile_size, run);
+      runs.push_back(run);
+    }
+    if (!merged.groups.back().empty())
+      runs.push_back(merged);
+
+    // Longest processing time first. The sort is stable so that ties,
+    // such as tiles of a uniform image, stay in the input order.
+    std::stable_sort(runs.begin(), runs.end());
+
+    std::vector<TileGroup> groups;
+    for (size_t i = 0; i < runs.size(); i++)
+      groups.insert(groups.end(), runs[i].groups.begin(), runs[i].groups.end());
+    return groups;
+  }
+
+} // namespace asp
@@ -0,0 +1,60 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileBalancing.h
+///
+/// Group the tiles of an image into tasks of roughly equal cost, for
+/// processing on a thread pool. When the cost of a tile varies a lot
+/// across the image, as for correlation with a per-tile search range,
+/// processing the tiles one per task leaves most threads idle while
+/// the few most expensive tiles finish.
+
+#ifndef __ASP_CORE_TILE_BALANCING_H__
+#define __ASP_CORE_TILE_BALANCING_H__
+
+#include <vw/Math/BBox.h>
+#include <boost/function.hpp>
+#include <vector>
+
+namespace asp {
+
+  /// The boxes processed by one task, in order.
+  typedef std::vector<vw::BBox2i> TileGroup;
+
+  /// Split and merge the given tiles into groups of roughly equal
+  /// cost. The target cost of a group is the total cost of the tiles
+  /// divided by num_tasks.
+  ///
+  /// A tile costing more than the target is split in halves along
+  /// each dimension, recursively, as long as the pieces are at least
+  /// min_tile_size on a side. Each piece of a split tile is a group of
+  /// its own. Tiles costing less than half of the target are merged,
+  /// in the given order, into groups costing about the target. The
+  /// groups, with the pieces of a split tile kept together, are sorted
+  /// by decreasing cost, so that the longest tasks start first.
+  ///
+  /// The pieces of all groups partition the input tiles, and each
+  /// piece lies within one input tile.
+  std::vector<TileGroup>
+  balance_tiles(std::vector<vw::BBox2i> const& tiles,
+                boost::function<double (vw::BBox2i const&)> const& cost,
+                int num_tasks, int min_tile_size);
+
+} // namespace asp
+
+#endif//__ASP_CORE_TILE_BALANCING_H__
@@ -70,3 +70,48 @@ TEST(BlobIndexThreaded, BlobCompressedIntersect) {
   EXPECT_TRUE( test_blob.intersects( BBox2i(3,4,6,2) ) );
   EXPECT_TRUE( test_blob.intersects( BBox2i(4,7,2,2) ) );
 }
+
+TEST(BlobIndexThreaded, RunLabeling) {
+  // A U shape opening upwards, a blob touching it only at a
+  // diagonal, and a separate single pixel.
+  ImageView<PixelMask<uint8> > input(8,5);
+  int32 pixels[][2] = { {0,0}, {2,0}, {0,1}, {2,1}, {0,2}, {1,2}, {2,2},
+                        {3,3}, {4,3}, {4,4}, {7,0} };
+  for ( size_t i = 0; i < sizeof(pixels)/sizeof(pixels[0]); i++ )
+    input(pixels[i][0],pixels[i][1]) = PixelMask<uint8>(1);
+
+  blob::BlobIndexCustom bindex( input );
+  ASSERT_EQ( 2u, bindex.num_blobs() );
+  EXPECT_EQ( 10, bindex.blob(0).size() );
+  EXPECT_EQ( BBox2i(0,0,5,5), bindex.blob(0).bounding_box() );
+  EXPECT_EQ( 1, bindex.blob(1).size() );
+  EXPECT_EQ( BBox2i(7,0,1,1), bindex.blob(1).bounding_box() );
+
+  // Row 0 of the U is two segments
+  EXPECT_EQ( 2, int(bindex.blob(0).start(0).size()) );
+  EXPECT_EQ( 1, int(bindex.blob(0).start(2).size()) );
+}
+
+TEST(BlobIndexThreaded, BlobCompressedAbsorb) {
+  // Two halves of a ring meeting end to end on each row
+  blob::BlobCompressed left, right;
+  left.add_row( Vector2i(2,0), 3 );
+  left.add_row( Vector2i(1,1), 2 );
+  right.add_row( Vector2i(5,0), 1 );
+  right.add_row( Vector2i(5,1), 2 );
+  right.add_row( Vector2i(4,2), 2 );
+
+  left.absorb( right );
+  EXPECT_EQ( 10, left.size() );
+  EXPECT_EQ( BBox2i(1,0,6,3), left.bounding_box() );
+  ASSERT_EQ( 3, left.num_rows() );
+  EXPECT_EQ( 1, int(left.start(0).size()) );
+  EXPECT_EQ( 2, int(left.start(1).size()) );
+  EXPECT_EQ( 1, int(left.start(2).size()) );
+
+  std::list<Vector2i> pixels;
+  left.decompress( pixels );
+  EXPECT_EQ( 10u, pixels.size() );
+  EXPECT_EQ( Vector2i(2,0), pixels.front() );
+  EXPECT_EQ( Vector2i(5,2), pixels.back() );
+}
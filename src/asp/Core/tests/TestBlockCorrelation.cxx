@@ -0,0 +1,182 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/BlockCorrelation.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/Algorithms.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+
+namespace {
+
+  // Brute force cost of the windows centered at the given left and
+  // right pixels. The cross correlation is negated, as in
+  // block_correlation().
+  double window_cost(ImageView<float> const& left, ImageView<float> const& right,
+                     Vector2i const& lpix, Vector2i const& rpix,
+                     Vector2i const& kernel, stereo::CostFunctionType cost_type) {
+    double sum = 0, sum_l = 0, sum_r = 0, sum_ll = 0, sum_rr = 0;
+    for (int dy = -kernel.y()/2; dy <= kernel.y()/2; dy++){
+      for (int dx = -kernel.x()/2; dx <= kernel.x()/2; dx++){
+        double l = left (lpix.x() + dx, lpix.y() + dy);
+        double r = right(rpix.x() + dx, rpix.y() + dy);
+        if (cost_type == stereo::ABSOLUTE_DIFFERENCE)     sum += std::abs(l - r);
+        else if (cost_type == stereo::SQUARED_DIFFERENCE) sum += (l - r)*(l - r);
+        else {
+          sum += l*r; sum_l += l; sum_r += r; sum_ll += l*l; sum_rr += r*r;
+        }
+      }
+    }
+    if (cost_type != stereo::CROSS_CORRELATION)
+      return sum;
+    double n = kernel.x()*kernel.y();
+    return -(sum - sum_l*sum_r/n) /
+      std::sqrt((sum_ll - sum_l*sum_l/n)*(sum_rr - sum_r*sum_r/n));
+  }
+
+  const stereo::CostFunctionType COST_TYPES[] = { stereo::ABSOLUTE_DIFFERENCE,
+                                                  stereo::SQUARED_DIFFERENCE,
+                                                  stereo::CROSS_CORRELATION };
+}
+
+TEST(BlockCorrelation, CrossCorrelationGainAndOffset) {
+  // The left image is the right image shifted by (3, 1), with a gain
+  // and an offset, which the cross correlation does not see.
+  ImageView<float> source(120, 100);
+  boost::mt19937 gen(42);
+  boost::uniform_int<> dist(0, 255);
+  for (int row = 0; row < source.rows(); row++)
+    for (int col = 0; col < source.cols(); col++)
+      source(col, row) = dist(gen);
+
+  BBox2i search_range(Vector2i(-2, -1), Vector2i(5, 2));
+  Vector2i kernel(7, 5);
+  Vector2i origin(30, 30);
+  ImageView<float> left  = crop(source, origin.x() + 3, origin.y() + 1, 40, 30);
+  ImageView<float> right = crop(source, origin.x() + search_range.min().x(),
+                                origin.y() + search_range.min().y(),
+                                40 + search_range.width(), 30 + search_range.height());
+  for (int row = 0; row < left.rows(); row++)
+    for (int col = 0; col < left.cols(); col++)
+      left(col, row) = 1.7*left(col, row) + 40;
+  ImageView<uint8> left_mask(left.cols(), left.rows()), right_mask(right.cols(), right.rows());
+  fill(left_mask, 1);
+  fill(right_mask, 1);
+
+  ImageView<PixelMask<Vector2i> > disparity
+    = asp::block_correlation(left, right, left_mask, right_mask,
+                             search_range, kernel, stereo::CROSS_CORRELATION, 1);
+  ASSERT_EQ( 34, disparity.cols() );
+  ASSERT_EQ( 26, disparity.rows() );
+  for (int row = 0; row < disparity.rows(); row++){
+    for (int col = 0; col < disparity.cols(); col++){
+      ASSERT_TRUE( is_valid(disparity(col, row)) );
+      EXPECT_VECTOR_EQ( Vector2i(3, 1), disparity(col, row).child() );
+    }
+  }
+}
+
+TEST(BlockCorrelation, CrossCorrelationTextureless) {
+  // A constant patch in the left image. The windows within it have no
+  // defined cross correlation, and are not matched. The windows away
+  // from it still find the shift.
+  boost::mt19937 gen(11);
+  boost::uniform_int<> dist(0, 255);
+  BBox2i search_range(Vector2i(0, 0), Vector2i(4, 2));
+  Vector2i kernel(5, 5);
+  ImageView<float> right(44, 32);
+  for (int row = 0; row < right.rows(); row++)
+    for (int col = 0; col < right.cols(); col++)
+      right(col, row) = dist(gen);
+  BBox2i patch(10, 8, 16, 12);
+  for (int row = patch.min().y(); row < patch.max().y(); row++)
+    for (int col = patch.min().x(); col < patch.max().x(); col++)
+      right(col + 2, row + 1) = 100;
+  ImageView<float> left = crop(right, 2, 1, 40, 30);
+  ImageView<uint8> left_mask(left.cols(), left.rows()), right_mask(right.cols(), right.rows());
+  fill(left_mask, 1);
+  fill(right_mask, 1);
+
+  ImageView<PixelMask<Vector2i> > disparity
+    = asp::block_correlation(left, right, left_mask, right_mask,
+                             search_range, kernel, stereo::CROSS_CORRELATION, -1);
+  Vector2i half_kernel = kernel/2;
+  BBox2i inner = patch;
+  inner.contract(half_kernel.x());
+  BBox2i outer = patch;
+  outer.expand(half_kernel.x() + search_range.width());
+  for (int row = 0; row < disparity.rows(); row++){
+    for (int col = 0; col < disparity.cols(); col++){
+      Vector2i lpix = Vector2i(col, row) + half_kernel;
+      if (inner.contains(lpix)){
+        EXPECT_FALSE( is_valid(disparity(col, row)) );
+      }else if (!outer.contains(lpix)){
+        ASSERT_TRUE( is_valid(disparity(col, row)) );
+        EXPECT_VECTOR_EQ( Vector2i(2, 1), disparity(col, row).child() );
+      }
+    }
+  }
+}
+
+TEST(BlockCorrelation, MatchesBruteForce) {
+  // Unrelated images, so that the best match is decided by the cost
+  // function alone.
+  boost::mt19937 gen(7);
+  boost::uniform_int<> dist(0, 255);
+  BBox2i search_range(Vector2i(-1, 0), Vector2i(3, 2));
+  Vector2i kernel(5, 3);
+  ImageView<float> left(20, 12), right(20 + search_range.width(), 12 + search_range.height());
+  for (int row = 0; row < left.rows(); row++)
+    for (int col = 0; col < left.cols(); col++)
+      left(col, row) = dist(gen);
+  for (int row = 0; row < right.rows(); row++)
+    for (int col = 0; col < right.cols(); col++)
+      right(col, row) = dist(gen);
+  ImageView<uint8> left_mask(left.cols(), left.rows()), right_mask(right.cols(), right.rows());
+  fill(left_mask, 1);
+  fill(right_mask, 1);
+
+  // No right-to-left check
+  Vector2i half_kernel = kernel/2;
+  for (int k = 0; k < 3; k++){
+    ImageView<PixelMask<Vector2i> > disparity
+      = asp::block_correlation(left, right, left_mask, right_mask,
+                               search_range, kernel, COST_TYPES[k], -1);
+    for (int row = 0; row < disparity.rows(); row++){
+      for (int col = 0; col < disparity.cols(); col++){
+        ASSERT_TRUE( is_valid(disparity(col, row)) );
+        Vector2i lpix = Vector2i(col, row) + half_kernel;
+        double best = std::numeric_limits<double>::max();
+        for (int dy = 0; dy <= search_range.height(); dy++)
+          for (int dx = 0; dx <= search_range.width(); dx++)
+            best = std::min(best, window_cost(left, right, lpix, lpix + Vector2i(dx, dy),
+                                              kernel, COST_TYPES[k]));
+        Vector2i d = disparity(col, row).child() - search_range.min();
+        EXPECT_NEAR( best, window_cost(left, right, lpix, lpix + d, kernel, COST_TYPES[k]),
+                     1e-4*std::max(1.0, std::abs(best)) );
+      }
+    }
+  }
+}
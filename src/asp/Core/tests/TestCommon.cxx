@@ -0,0 +1,123 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/Common.h>
+#include <vw/Image/ImageView.h>
+
+using namespace vw;
+
+namespace vw {
+  template<> struct PixelFormatID<Vector<double, 4> >  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_4_CHANNEL; };
+  template<> struct PixelFormatID<Vector<double, 6> >  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
+  template<> struct PixelFormatID<Vector<int32, 4> >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_4_CHANNEL; };
+  template<> struct PixelFormatID<Vector<int32, 6> >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
+}
+
+namespace {
+
+  const Vector3 CENTER(-2.5e6, 4.1e6, 3.3e6);
+
+  // A point cloud around CENTER, with the triangulation error in the
+  // channels after the first 3. Pixel (1, 1) is missing, the point at
+  // (2, 1) rounds to the center, and the one at (3, 2) is too far
+  // from it to be stored in 32 bits.
+  template <int m>
+  ImageView< Vector<double, m> > test_cloud() {
+    ImageView< Vector<double, m> > cloud(5, 4);
+    for (int row = 0; row < cloud.rows(); row++){
+      for (int col = 0; col < cloud.cols(); col++){
+        Vector<double, m> pt;
+        subvector(pt, 0, 3) = CENTER + Vector3(1.3*col - 2, 1 - 0.7*row, 0.05*col*row);
+        for (int i = 3; i < m; i++)
+          pt[i] = 0.013*(col + row + i);
+        cloud(col, row) = pt;
+      }
+    }
+    cloud(1, 1) = Vector<double, m>();
+    subvector(cloud(2, 1), 0, 3) = CENTER + Vector3(1e-4, -2e-4, 0);
+    subvector(cloud(3, 2), 0, 3) = CENTER + Vector3(1e9, 0, 0);
+    return cloud;
+  }
+
+  // Quantize a cloud with m channels, and read back its first n
+  template <int n, int m>
+  void quantize_round_trip() {
+    double rounding_error = asp::APPROX_ONE_MM, error_rounding_error = 1.0/128;
+    ImageView< Vector<double, m> > cloud = test_cloud<m>();
+    UnlinkName file("quantized_cloud.tif");
+    asp::BaseOptions opt;
+    asp::write_quantized_gdal_image(file, CENTER, rounding_error, error_rounding_error,
+                                    cloud, opt);
+    EXPECT_EQ( m, asp::get_num_channels(file) );
+
+    ImageView< Vector<double, n> > result = asp::read_n_channels<n>(file);
+    ASSERT_EQ( cloud.cols(), result.cols() );
+    ASSERT_EQ( cloud.rows(), result.rows() );
+    for (int row = 0; row < cloud.rows(); row++){
+      for (int col = 0; col < cloud.cols(); col++){
+        Vector<double, n> const& out = result(col, row);
+        if ((col == 1 && row == 1) || (col == 3 && row == 2)){
+          // Missing, or dropped as too far
+          EXPECT_EQ( Vector3(), Vector3(subvector(out, 0, 3)) ) << col << " " << row;
+          continue;
+        }
+
+        // The point at the center is moved by one rounding error at
+        // most, rather than becoming missing.
+        double tol = (col == 2 && row == 1) ? rounding_error : rounding_error/2;
+        Vector<double, m> const& pt = cloud(col, row);
+        for (int i = 0; i < n; i++){
+          if (i < 3)
+            EXPECT_NEAR( pt[i], out[i], tol + 1e-9 ) << col << " " << row << " " << i;
+          else
+            EXPECT_NEAR( pt[i], out[i], error_rounding_error/2 + 1e-12 )
+              << col << " " << row << " " << i;
+        }
+      }
+    }
+  }
+}
+
+TEST(Common, QuantizePoints) {
+  asp::QuantizePoints<Vector4> quantizer(CENTER, 0.5, 0.25);
+  EXPECT_EQ( Vector<int32, 4>(), quantizer(Vector4()) );
+  EXPECT_EQ( Vector<int32, 4>(2, -1, 0, 3),
+             quantizer(Vector4(CENTER[0] + 1.1, CENTER[1] - 0.4, CENTER[2], 0.8)) );
+
+  // Near the center, moved along the largest offset
+  EXPECT_EQ( Vector<int32, 4>(0, -1, 0, 0),
+             quantizer(Vector4(CENTER[0] + 0.1, CENTER[1] - 0.2, CENTER[2], 0)) );
+
+  // Too far, or not a number
+  EXPECT_EQ( Vector<int32, 4>(), quantizer(Vector4(CENTER[0] + 1e10, CENTER[1], CENTER[2], 0)) );
+  EXPECT_EQ( Vector<int32, 4>(),
+             quantizer(Vector4(std::numeric_limits<double>::quiet_NaN(), 0, 0, 0)) );
+
+  // The error is clamped instead
+  EXPECT_EQ( std::numeric_limits<int32>::max(),
+             quantizer(Vector4(CENTER[0] + 1, CENTER[1], CENTER[2], 1e10))[3] );
+}
+
+TEST(Common, QuantizedPointCloudRoundTrip) {
+  quantize_round_trip<3, 4>();
+  quantize_round_trip<4, 4>();
+  quantize_round_trip<3, 6>();
+  quantize_round_trip<4, 6>();
+  quantize_round_trip<6, 6>();
+}
@@ -0,0 +1,119 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DisparityCleanUpView.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Stereo/DisparityMap.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+
+using namespace vw;
+
+namespace {
+
+  typedef PixelMask<Vector2f> DispPixelT;
+
+  // A smooth disparity with scattered holes and outliers, and a
+  // larger hole.
+  ImageView<DispPixelT> noisy_disparity() {
+    ImageView<DispPixelT> disparity(57, 43);
+    boost::mt19937 gen(5);
+    boost::uniform_int<> dist(0, 99);
+    for (int row = 0; row < disparity.rows(); row++){
+      for (int col = 0; col < disparity.cols(); col++){
+        disparity(col, row) = DispPixelT(Vector2f(0.1*col + 5, 0.05*row - 2));
+        int r = dist(gen);
+        if (r < 10)
+          invalidate(disparity(col, row));
+        else if (r < 15)
+          disparity(col, row).child() += Vector2f(30, -20);
+      }
+    }
+    for (int row = 20; row < 28; row++)
+      for (int col = 30; col < 41; col++)
+        invalidate(disparity(col, row));
+    return disparity;
+  }
+
+  // The passes chained lazily, as stereo_fltr did before fusing them
+  ImageViewRef<DispPixelT> chained_cleanup(ImageView<DispPixelT> const& input,
+                                           int num_passes, int filter_mode,
+                                           Vector2i const& half_kernel) {
+    ImageViewRef<DispPixelT> out = input;
+    for (int i = 0; i < num_passes; i++){
+      if (filter_mode == 1)
+        out = stereo::disparity_cleanup_using_mean(out, half_kernel.x(), half_kernel.y(), 3.0);
+      else
+        out = stereo::disparity_cleanup_using_thresh(out, half_kernel.x(), half_kernel.y(),
+                                                     3.0, 0.6);
+    }
+    return out;
+  }
+
+  int num_valid(ImageView<DispPixelT> const& disparity) {
+    int count = 0;
+    for (int row = 0; row < disparity.rows(); row++)
+      for (int col = 0; col < disparity.cols(); col++)
+        count += is_valid(disparity(col, row));
+    return count;
+  }
+}
+
+TEST(DisparityCleanUpView, MatchesChainedPasses) {
+  ImageView<DispPixelT> input = noisy_disparity();
+  Vector2i half_kernel(3, 2);
+
+  for (int filter_mode = 1; filter_mode <= 2; filter_mode++){
+    for (int num_passes = 1; num_passes <= 3; num_passes++){
+      ImageView<DispPixelT> expected
+        = chained_cleanup(input, num_passes, filter_mode, half_kernel);
+      EXPECT_LT( num_valid(expected), num_valid(input) );
+
+      // Rasterize in tiles which do not divide the image, so that the
+      // halos are cut by both the tile and the image edges.
+      asp::FusedDisparityCleanUpView<ImageView<DispPixelT> >
+        fused(input, num_passes, filter_mode, half_kernel, 3, 3, 60);
+      ImageView<DispPixelT> result(input.cols(), input.rows());
+      const int ts = 16;
+      for (int row = 0; row < input.rows(); row += ts){
+        for (int col = 0; col < input.cols(); col += ts){
+          BBox2i tile(col, row, ts, ts);
+          tile.crop(bounding_box(input));
+          crop(result, tile) = crop(fused, tile);
+        }
+      }
+
+      for (int row = 0; row < input.rows(); row++){
+        for (int col = 0; col < input.cols(); col++){
+          ASSERT_EQ( is_valid(expected(col, row)), is_valid(result(col, row)) )
+            << "mode " << filter_mode << ", " << num_passes << " passes, at "
+            << col << " " << row;
+          if (!is_valid(expected(col, row))) continue;
+          EXPECT_EQ( expected(col, row).child()[0], result(col, row).child()[0] );
+          EXPECT_EQ( expected(col, row).child()[1], result(col, row).child()[1] );
+        }
+      }
+    }
+  }
+
+  EXPECT_THROW( asp::FusedDisparityCleanUpView<ImageView<DispPixelT> >
+                (input, 1, 3, half_kernel, 3, 3, 60), ArgumentErr );
+}
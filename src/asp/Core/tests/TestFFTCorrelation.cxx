@@ -0,0 +1,142 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/FFTCorrelation.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  ImageView<float> random_image(int cols, int rows, boost::mt19937 & gen) {
+    boost::uniform_real<float> dist(0.0, 1.0);
+    ImageView<float> image(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        image(col, row) = dist(gen);
+    return image;
+  }
+
+  ImageView<uint8> full_mask(int cols, int rows) {
+    ImageView<uint8> mask(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        mask(col, row) = 255;
+    return mask;
+  }
+
+}
+
+TEST(FFTCorrelation, MatchesDirectTransform) {
+  boost::mt19937 gen(3);
+  ImageView<float> image = random_image(8, 4, gen);
+  ImageView<std::complex<double> > data(8, 4);
+  for (int row = 0; row < 4; row++)
+    for (int col = 0; col < 8; col++)
+      data(col, row) = image(col, row);
+
+  fft_2d(data, false);
+  for (int v = 0; v < 4; v++){
+    for (int u = 0; u < 8; u++){
+      std::complex<double> expected = 0;
+      for (int row = 0; row < 4; row++)
+        for (int col = 0; col < 8; col++)
+          expected += double(image(col, row))
+            * std::polar(1.0, -2*M_PI*(double(u*col)/8 + double(v*row)/4));
+      EXPECT_NEAR( expected.real(), data(u, v).real(), 1e-9 );
+      EXPECT_NEAR( expected.imag(), data(u, v).imag(), 1e-9 );
+    }
+  }
+
+  fft_2d(data, true);
+  for (int row = 0; row < 4; row++)
+    for (int col = 0; col < 8; col++){
+      EXPECT_NEAR( image(col, row), data(col, row).real(), 1e-9 );
+      EXPECT_NEAR( 0.0, data(col, row).imag(), 1e-9 );
+    }
+}
+
+TEST(FFTCorrelation, TemplateMatch) {
+  boost::mt19937 gen(5);
+  ImageView<float> search = random_image(50, 40, gen);
+  ImageView<uint8> search_mask = full_mask(50, 40);
+
+  // A template cut out of the search image, with its values scaled
+  // and shifted, which the normalized correlation ignores.
+  ImageView<float> tmpl(12, 10);
+  for (int row = 0; row < tmpl.rows(); row++)
+    for (int col = 0; col < tmpl.cols(); col++)
+      tmpl(col, row) = 3*search(col + 31, row + 17) + 5;
+
+  Vector2i offset;
+  double score;
+  ASSERT_TRUE( fft_template_match(tmpl, full_mask(12, 10), search, search_mask,
+                                  offset, score) );
+  EXPECT_EQ( Vector2i(31, 17), offset );
+  EXPECT_NEAR( 1.0, score, 1e-6 );
+
+  // Placements over invalid pixels are skipped
+  search_mask(35, 20) = 0;
+  ASSERT_TRUE( fft_template_match(tmpl, full_mask(12, 10), search, search_mask,
+                                  offset, score) );
+  EXPECT_NE( Vector2i(31, 17), offset );
+  EXPECT_LT( score, 0.9 );
+
+  // A flat template cannot be matched
+  ImageView<float> flat(12, 10);
+  EXPECT_FALSE( fft_template_match(flat, full_mask(12, 10), search, search_mask,
+                                   offset, score) );
+}
+
+TEST(FFTCorrelation, SeedDisparity) {
+  boost::mt19937 gen(7);
+  const int size = 128;
+  const Vector2i shift(13, -5);
+  ImageView<float> left  = random_image(size, size, gen);
+  ImageView<float> right = random_image(size, size, gen);
+  for (int row = 0; row < size; row++){
+    for (int col = 0; col < size; col++){
+      int x = col - shift.x(), y = row - shift.y();
+      if (x >= 0 && y >= 0 && x < size && y < size)
+        right(col, row) = left(x, y);
+    }
+  }
+
+  ImageView<PixelMask<Vector2i> > disparity, spread;
+  fft_seed_disparity(left, right, full_mask(size, size), full_mask(size, size),
+                     BBox2i(Vector2i(-40, -20), Vector2i(40, 20)), 16, 0.5,
+                     disparity, spread);
+  ASSERT_EQ( size, disparity.cols() );
+  ASSERT_EQ( size, spread.rows() );
+
+  int count = 0;
+  for (int row = 0; row < size; row++){
+    for (int col = 0; col < size; col++){
+      if (!is_valid(disparity(col, row)) || disparity(col, row).child() != shift)
+        continue;
+      count++;
+      ASSERT_TRUE( is_valid(spread(col, row)) );
+      EXPECT_GE( spread(col, row).child().x(), 1 );
+      EXPECT_GE( spread(col, row).child().y(), 1 );
+    }
+  }
+  EXPECT_GT( count, size*size*9/10 );
+}
@@ -0,0 +1,62 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/InpaintView.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+
+using namespace vw;
+
+TEST(InpaintView, MultigridRecoversPlane) {
+  // A plane is left unchanged by the averaging kernel, so filling a
+  // hole in it must give back the plane.
+  ImageView<float> values(70,50), expected(70,50);
+  ImageView<uint8> hole(70,50);
+  for ( int j = 0; j < values.rows(); j++ )
+    for ( int i = 0; i < values.cols(); i++ ) {
+      expected(i,j) = 2.0*i - 3.0*j + 10;
+      bool in_disk = (i-30)*(i-30) + (j-25)*(j-25) < 20*20;
+      bool in_slit = j == 40 && i > 5 && i < 65;
+      hole(i,j) = ( in_disk || in_slit ) ? 255 : 0;
+      values(i,j) = hole(i,j) ? 0 : expected(i,j);
+    }
+
+  asp::inpaint_p::harmonic_fill_multigrid( values, hole );
+  for ( int j = 0; j < values.rows(); j++ )
+    for ( int i = 0; i < values.cols(); i++ )
+      EXPECT_NEAR( expected(i,j), values(i,j), 1e-2 );
+}
+
+TEST(InpaintView, MultigridFillMasked) {
+  ImageView<PixelMask<Vector2f> > image(20,20);
+  ImageView<uint8> hole(20,20);
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ ) {
+      hole(i,j) = ( i > 4 && i < 15 && j > 4 && j < 15 ) ? 255 : 0;
+      if ( !hole(i,j) )
+        image(i,j) = PixelMask<Vector2f>( Vector2f( 5, -1 ) );
+    }
+
+  asp::inpaint_p::multigrid_fill( image, hole );
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ ) {
+      EXPECT_TRUE( is_valid( image(i,j) ) );
+      EXPECT_VECTOR_NEAR( Vector2f( 5, -1 ), image(i,j).child(), 1e-3 );
+    }
+}
@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/LocalHomography.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  ImageView<WarpedPixelT> ramp(int cols, int rows) {
+    ImageView<WarpedPixelT> image(cols, rows);
+    for (int row = 0; row < rows; row++)
+      for (int col = 0; col < cols; col++)
+        image(col, row) = WarpedPixelT(PixelGray<float>(col + 100*row));
+    return image;
+  }
+
+}
+
+TEST(LocalHomography, WarpedTileCache) {
+  WarpedTileCache cache(2);
+  Matrix3x3 hom = math::identity_matrix<3>();
+  Matrix3x3 shift = hom; shift(0, 2) = 5;
+  BBox2i region(0, 0, 8, 8);
+  ImageView<WarpedPixelT> image = ramp(8, 8), found;
+  BBox2i found_region;
+
+  cache.insert(BBox2i(0, 0, 4, 4), hom, image, region);
+  cache.insert(BBox2i(4, 0, 4, 4), hom, image, region);
+
+  // The homography is part of the key
+  EXPECT_FALSE( cache.take(BBox2i(0, 0, 4, 4), shift, found, found_region) );
+
+  // An entry is found once
+  ASSERT_TRUE( cache.take(BBox2i(0, 0, 4, 4), hom, found, found_region) );
+  EXPECT_EQ( region, found_region );
+  EXPECT_EQ( 8, found.cols() );
+  EXPECT_FALSE( cache.take(BBox2i(0, 0, 4, 4), hom, found, found_region) );
+
+  // The oldest entry is dropped when full
+  cache.insert(BBox2i(0, 4, 4, 4), hom, image, region);
+  cache.insert(BBox2i(4, 4, 4, 4), hom, image, region);
+  EXPECT_FALSE( cache.take(BBox2i(4, 0, 4, 4), hom, found, found_region) );
+  EXPECT_TRUE ( cache.take(BBox2i(0, 4, 4, 4), hom, found, found_region) );
+  EXPECT_TRUE ( cache.take(BBox2i(4, 4, 4, 4), hom, found, found_region) );
+}
+
+TEST(LocalHomography, CachedRegionView) {
+  ImageView<WarpedPixelT> source = ramp(16, 16);
+  BBox2i region(4, 4, 8, 8);
+
+  // A cache which differs from the source, to tell them apart
+  ImageView<WarpedPixelT> cache = crop(source, region);
+  for (int row = 0; row < cache.rows(); row++)
+    for (int col = 0; col < cache.cols(); col++)
+      cache(col, row).child() += 1000;
+
+  CachedRegionView<ImageView<WarpedPixelT> > view(cache, region, source);
+  EXPECT_EQ( 16, view.cols() );
+  EXPECT_EQ( 16, view.rows() );
+
+  // Inside the region, the cache is used
+  ImageView<WarpedPixelT> inside = crop(view, BBox2i(5, 6, 4, 4));
+  EXPECT_EQ( 1000 + 5 + 600, inside(0, 0).child() );
+  EXPECT_EQ( 1000 + 8 + 900, inside(3, 3).child() );
+
+  // A tile partly outside of the region comes from the source
+  ImageView<WarpedPixelT> outside = crop(view, BBox2i(0, 0, 6, 6));
+  EXPECT_EQ( 0,         outside(0, 0).child() );
+  EXPECT_EQ( 5 + 500,   outside(5, 5).child() );
+
+  // Per pixel access uses the cache within the region only
+  EXPECT_EQ( 1000 + 4 + 400, view(4, 4).child() );
+  EXPECT_EQ( 12 + 400,       view(12, 4).child() );
+}
@@ -0,0 +1,114 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/OrthoRasterizer.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelTypes.h>
+
+using namespace vw;
+using namespace vw::cartography;
+
+namespace {
+
+  const int SIZE = 10;
+
+  // A planar cloud with one point on each DEM pixel center, at unit
+  // spacing, with the top row of the image at the largest y.
+  ImageView<Vector3> planar_cloud() {
+    ImageView<Vector3> cloud(SIZE, SIZE);
+    for (int row = 0; row < SIZE; row++)
+      for (int col = 0; col < SIZE; col++)
+        cloud(col, row) = Vector3(col, SIZE - 1 - row, 2*col + 3*row);
+    return cloud;
+  }
+
+  typedef OrthoRasterizerView<PixelGray<float>, ImageView<Vector3> > RasterizerT;
+
+  ImageView<PixelGray<float> > bin(ImageView<Vector3> const& cloud,
+                                   GriddingMode mode, double radius) {
+    RasterizerT rasterizer(cloud, select_channel(cloud, 2), 1.0);
+    rasterizer.set_use_minz_as_default(false);
+    rasterizer.set_default_value(-1);
+    rasterizer.set_gridding(mode, radius);
+    return rasterizer;
+  }
+}
+
+TEST(OrthoRasterizer, BinningNearestPixel) {
+  ImageView<Vector3> cloud = planar_cloud();
+  cloud(4, 4).z() = std::numeric_limits<double>::quiet_NaN();
+
+  ImageView<PixelGray<float> > mean  = bin(cloud, GRID_MEAN, 0);
+  ImageView<PixelGray<float> > count = bin(cloud, GRID_COUNT, 0);
+  ASSERT_EQ( SIZE, mean.cols() );
+  ASSERT_EQ( SIZE, mean.rows() );
+
+  for (int row = 0; row < SIZE; row++){
+    for (int col = 0; col < SIZE; col++){
+      if (col == 4 && row == 4){
+        // An empty pixel has no mean, but its count is zero
+        EXPECT_EQ( -1, mean (col, row)[0] );
+        EXPECT_EQ(  0, count(col, row)[0] );
+        continue;
+      }
+      EXPECT_NEAR( cloud(col, row).z(), mean(col, row)[0], 1e-5 );
+      EXPECT_EQ( 1, count(col, row)[0] );
+    }
+  }
+}
+
+TEST(OrthoRasterizer, BinningSearchRadius) {
+  ImageView<Vector3> cloud = planar_cloud();
+
+  // The radius reaches the 4 neighbors but not the diagonal ones
+  ImageView<PixelGray<float> > count  = bin(cloud, GRID_COUNT,  1.0);
+  ImageView<PixelGray<float> > mean   = bin(cloud, GRID_MEAN,   1.0);
+  ImageView<PixelGray<float> > median = bin(cloud, GRID_MEDIAN, 1.0);
+  ImageView<PixelGray<float> > minv   = bin(cloud, GRID_MIN,    1.0);
+  ImageView<PixelGray<float> > maxv   = bin(cloud, GRID_MAX,    1.0);
+
+  EXPECT_EQ( 3, count(0, 0)[0] );
+  EXPECT_EQ( 4, count(5, 0)[0] );
+  for (int row = 1; row < SIZE-1; row++){
+    for (int col = 1; col < SIZE-1; col++){
+      float z = cloud(col, row).z();
+      EXPECT_EQ( 5, count(col, row)[0] );
+      // The cloud is planar, so the mean and median are the center
+      EXPECT_NEAR( z,     mean  (col, row)[0], 1e-5 );
+      EXPECT_NEAR( z,     median(col, row)[0], 1e-5 );
+      EXPECT_NEAR( z - 3, minv  (col, row)[0], 1e-5 );
+      EXPECT_NEAR( z + 3, maxv  (col, row)[0], 1e-5 );
+    }
+  }
+
+  // Corner: the point itself and its right and lower neighbors
+  EXPECT_NEAR( (0 + 2 + 3)/3.0, mean  (0, 0)[0], 1e-5 );
+  EXPECT_NEAR( 2,               median(0, 0)[0], 1e-5 );
+}
+
+TEST(OrthoRasterizer, BinningRejectsOversampling) {
+  // Antialiasing would blur the counts and statistics across pixels
+  EXPECT_NO_THROW( check_gridding_oversampling(GRID_TRIANGLES, 3) );
+  EXPECT_NO_THROW( check_gridding_oversampling(GRID_COUNT,     1) );
+  EXPECT_THROW( check_gridding_oversampling(GRID_MEAN,   3), ArgumentErr );
+  EXPECT_THROW( check_gridding_oversampling(GRID_MIN,    2), ArgumentErr );
+  EXPECT_THROW( check_gridding_oversampling(GRID_MAX,    2), ArgumentErr );
+  EXPECT_THROW( check_gridding_oversampling(GRID_MEDIAN, 2), ArgumentErr );
+  EXPECT_THROW( check_gridding_oversampling(GRID_COUNT,  2), ArgumentErr );
+}
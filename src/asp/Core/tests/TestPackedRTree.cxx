@@ -0,0 +1,68 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/PackedRTree.h>
+#include <vw/Math/BBox.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+
+using namespace vw;
+
+namespace {
+  bool closed_overlap(BBox2 const& a, BBox2 const& b){
+    return a.min().x() <= b.max().x() && b.min().x() <= a.max().x() &&
+           a.min().y() <= b.max().y() && b.min().y() <= a.max().y();
+  }
+}
+
+TEST(PackedRTree, Empty) {
+  asp::PackedRTree tree;
+  tree.build(std::vector<BBox2>());
+  std::vector<int> ids;
+  tree.intersect(BBox2(0, 0, 10, 10), ids);
+  EXPECT_EQ( 0u, tree.size() );
+  EXPECT_TRUE( ids.empty() );
+}
+
+TEST(PackedRTree, MatchesLinearScan) {
+  boost::mt19937 gen(7);
+  boost::uniform_real<> pos(0, 1000), len(0.5, 30);
+
+  // Enough boxes for several levels
+  std::vector<BBox2> boxes;
+  for (int i = 0; i < 3000; i++)
+    boxes.push_back(BBox2(pos(gen), pos(gen), len(gen), len(gen)));
+  boxes[5] = BBox2(); // Empty boxes are skipped
+
+  asp::PackedRTree tree;
+  tree.build(boxes);
+  EXPECT_EQ( boxes.size() - 1, tree.size() );
+
+  for (int q = 0; q < 100; q++){
+    BBox2 query(pos(gen), pos(gen), 5*len(gen), 5*len(gen));
+    std::vector<int> ids, expected;
+    tree.intersect(query, ids);
+    for (int i = 0; i < (int)boxes.size(); i++){
+      if (!boxes[i].empty() && closed_overlap(boxes[i], query))
+        expected.push_back(i);
+    }
+    ASSERT_EQ( expected.size(), ids.size() );
+    EXPECT_RANGE_EQ( expected.begin(), expected.end(), ids.begin(), ids.end() );
+  }
+}
@@ -0,0 +1,66 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/SemiGlobalMatching.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/Algorithms.h>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+
+using namespace vw;
+
+TEST(SemiGlobalMatching, ConstantShift) {
+  // The left image is the right image shifted by (3, 1)
+  ImageView<float> source(120, 100);
+  boost::mt19937 gen(42);
+  boost::uniform_int<> dist(0, 255);
+  for (int row = 0; row < source.rows(); row++)
+    for (int col = 0; col < source.cols(); col++)
+      source(col, row) = dist(gen);
+
+  BBox2i search_range(Vector2i(-2, -1), Vector2i(5, 2));
+  Vector2i census_kernel(9, 7);
+  Vector2i origin(30, 30);
+  ImageView<float> left  = crop(source, origin.x() + 3, origin.y() + 1, 40, 30);
+  ImageView<float> right = crop(source, origin.x() + search_range.min().x(),
+                                origin.y() + search_range.min().y(),
+                                40 + search_range.width(), 30 + search_range.height());
+  ImageView<uint8> left_mask(left.cols(), left.rows()), right_mask(right.cols(), right.rows());
+  fill(left_mask, 1);
+  fill(right_mask, 1);
+
+  ImageView<PixelMask<Vector2i> > disparity
+    = asp::semi_global_matching(left, right, left_mask, right_mask,
+                                search_range, census_kernel, 8, 64, 1);
+  ASSERT_EQ( 32, disparity.cols() );
+  ASSERT_EQ( 24, disparity.rows() );
+  for (int row = 0; row < disparity.rows(); row++){
+    for (int col = 0; col < disparity.cols(); col++){
+      ASSERT_TRUE( is_valid(disparity(col, row)) );
+      EXPECT_VECTOR_EQ( Vector2i(3, 1), disparity(col, row).child() );
+    }
+  }
+
+  // Masked out pixels are not matched
+  left_mask(10, 10) = 0;
+  disparity = asp::semi_global_matching(left, right, left_mask, right_mask,
+                                        search_range, census_kernel, 8, 64, 1);
+  EXPECT_FALSE( is_valid(disparity(10 - census_kernel.x()/2, 10 - census_kernel.y()/2)) );
+}
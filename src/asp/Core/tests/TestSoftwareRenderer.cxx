@@ -21,6 +21,8 @@
 #include <vw/Image/Manipulation.h>
 #include <asp/Core/SoftwareRenderer.h>
 
+#include <cfloat>
+#include <cmath>
 #include <vector>
 
 #include <boost/assign/list_of.hpp>
@@ -185,3 +187,62 @@ TEST_F( SoftwareRenderTest, ExtremelyLargeTriangle ) {
     }
   }
 }
+
+TEST_F( SoftwareRenderTest, DrawTrianglesMatchesDrawPolygon ) {
+  // Two triangles sharing an edge, and a third overlapping them
+  vertices.clear();
+  vertices += 0.1,0.1, 0.1,0.8, 0.8,0.8,
+              0.8,0.8, 0.8,0.1, 0.1,0.1,
+              0.5,0.05, 0.2,0.95, 0.95,0.6;
+  color.clear();
+  color += 1.0,2.0,3.0, 3.0,4.0,1.0, 5.0,6.0,7.0;
+  renderer.SetVertexPointer( 2, &vertices[0] );
+  renderer.SetColorPointer( 1, &color[0] );
+
+  renderer.Clear(0.0);
+  for ( int i = 0; i < 3; i++ )
+    renderer.DrawPolygon(3*i, 3);
+  ImageView<float> ground_truth = copy(render_buffer);
+
+  renderer.Clear(0.0);
+  renderer.DrawTriangles(0, 3);
+  EXPECT_SEQ_EQ( ground_truth, render_buffer );
+
+  // A later start index skips the first triangles
+  renderer.Clear(0.0);
+  renderer.DrawPolygon(6, 3);
+  ground_truth = copy(render_buffer);
+  renderer.Clear(0.0);
+  renderer.DrawTriangles(6, 1);
+  EXPECT_SEQ_EQ( ground_truth, render_buffer );
+}
+
+TEST( SoftwareRenderer, FillGraySpanMatchesScalar ) {
+  // Compare the span fill against the scalar loop, which adds drdx
+  // pixel by pixel. Each addition rounds, so the two may differ by
+  // one float epsilon of the magnitude per pixel. Against the exact
+  // value the fill is off by only a few roundings, wherever the
+  // vector loop ends.
+  const float grays[] = { 0.0f, 1.0f, -3.7f, 1234.5f };
+  const float slopes[] = { 0.0f, 0.1f, -0.0137f, 2.9f };
+  const int lengths[] = { 1, 3, 4, 7, 8, 9, 17, 31, 1000 };
+  for ( int g = 0; g < 4; g++ ) {
+    for ( int s = 0; s < 4; s++ ) {
+      for ( int l = 0; l < 9; l++ ) {
+        int length = lengths[l];
+        std::vector<float> span( length + 1, -1.0f );
+        stereo::FillGraySpan( &span[0], length, grays[g], slopes[s] );
+        EXPECT_EQ( -1.0f, span[length] ); // Nothing past the span
+
+        float scalar = grays[g];
+        for ( int i = 0; i < length; i++ ) {
+          double exact = double(grays[g]) + double(i)*slopes[s];
+          double scale = std::abs(grays[g]) + i*std::abs(slopes[s]);
+          EXPECT_NEAR( exact,  span[i], 16*FLT_EPSILON*scale );
+          EXPECT_NEAR( scalar, span[i], (i + 16)*FLT_EPSILON*scale );
+          scalar += slopes[s];
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,75 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/SparseView.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+
+using namespace vw;
+
+namespace {
+
+  // A patch whose valid pixels are a ring, so that most rows hold two
+  // segments.
+  ImageView<PixelMask<float> > ring_patch( int size, float value ) {
+    ImageView<PixelMask<float> > patch(size,size);
+    float c = (size-1)/2.0;
+    for ( int j = 0; j < size; j++ )
+      for ( int i = 0; i < size; i++ ) {
+        float r2 = (i-c)*(i-c) + (j-c)*(j-c);
+        if ( r2 < c*c && r2 > c*c/4 )
+          patch(i,j) = PixelMask<float>( value + i + 100*j );
+      }
+    return patch;
+  }
+
+}
+
+TEST(SparseView, FinalizeKeepsPixels) {
+  ImageView<PixelMask<float> > under(60,40);
+  for ( int j = 0; j < under.rows(); j++ )
+    for ( int i = 0; i < under.cols(); i++ )
+      under(i,j) = PixelMask<float>( -1 );
+
+  asp::SparseCompositeView<ImageView<PixelMask<float> > > sparse(under);
+  sparse.absorb( Vector2i(2,3),   ring_patch(16, 1000) );
+  sparse.absorb( Vector2i(18,3),  ring_patch(16, 2000) );
+  sparse.absorb( Vector2i(30,20), ring_patch(20, 3000) );
+
+  ImageView<float> before(60,40);
+  for ( int j = 0; j < under.rows(); j++ )
+    for ( int i = 0; i < under.cols(); i++ )
+      before(i,j) = sparse(i,j).child();
+
+  sparse.finalize();
+  EXPECT_THROW( sparse.absorb( Vector2i(0,0), ring_patch(4, 0) ), LogicErr );
+
+  // Reading pixels and rasterizing a region give the same pixels as
+  // before.
+  for ( int j = 0; j < under.rows(); j++ )
+    for ( int i = 0; i < under.cols(); i++ )
+      EXPECT_EQ( before(i,j), sparse(i,j).child() );
+
+  BBox2i region(11,5,37,30);
+  ImageView<PixelMask<float> > dest(region.width(), region.height());
+  sparse.rasterize( dest, region );
+  for ( int j = 0; j < dest.rows(); j++ )
+    for ( int i = 0; i < dest.cols(); i++ )
+      EXPECT_EQ( before(i+region.min().x(), j+region.min().y()), dest(i,j).child() );
+}
@@ -0,0 +1,117 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/TileBalancing.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  const int TILE = 1024;
+
+  // A 4x4 grid of tiles
+  std::vector<BBox2i> grid() {
+    std::vector<BBox2i> tiles;
+    for (int row = 0; row < 4; row++)
+      for (int col = 0; col < 4; col++)
+        tiles.push_back(BBox2i(col*TILE, row*TILE, TILE, TILE));
+    return tiles;
+  }
+
+  // The cost is the area, times 100 within the first tile
+  double steep_corner_cost(BBox2i const& box) {
+    double area = double(box.width())*box.height();
+    BBox2i steep(0, 0, TILE, TILE);
+    if (!steep.intersects(box)) return area;
+    steep.crop(box);
+    return area + 99.0*steep.width()*steep.height();
+  }
+
+  double area_cost(BBox2i const& box) {
+    return double(box.width())*box.height();
+  }
+
+  // The total area of the groups, which must equal the input area if
+  // they partition it with no overlaps.
+  double total_area(std::vector<TileGroup> const& groups, BBox2i & bounds) {
+    double area = 0;
+    for (size_t i = 0; i < groups.size(); i++){
+      for (size_t j = 0; j < groups[i].size(); j++){
+        area += double(groups[i][j].width())*groups[i][j].height();
+        bounds.grow(groups[i][j]);
+      }
+    }
+    return area;
+  }
+}
+
+TEST(TileBalancing, SplitsExpensiveTiles) {
+  std::vector<BBox2i> tiles = grid();
+  std::vector<TileGroup> groups = balance_tiles(tiles, steep_corner_cost, 16, 256);
+
+  // The expensive tile comes first, split into 256 pixel pieces.
+  ASSERT_GE( groups.size(), 16u );
+  for (size_t i = 0; i < 16; i++){
+    ASSERT_EQ( 1u, groups[i].size() );
+    EXPECT_EQ( 256, groups[i][0].width() );
+    EXPECT_EQ( 256, groups[i][0].height() );
+    EXPECT_TRUE( BBox2i(0, 0, TILE, TILE).contains(groups[i][0]) );
+  }
+
+  BBox2i bounds;
+  EXPECT_EQ( 16.0*TILE*TILE, total_area(groups, bounds) );
+  EXPECT_EQ( BBox2i(0, 0, 4*TILE, 4*TILE), bounds );
+}
+
+TEST(TileBalancing, MergesCheapTiles) {
+  std::vector<BBox2i> tiles = grid();
+
+  // Four tasks for sixteen tiles of equal cost
+  std::vector<TileGroup> groups = balance_tiles(tiles, area_cost, 4, 256);
+  ASSERT_EQ( 4u, groups.size() );
+  for (size_t i = 0; i < groups.size(); i++){
+    ASSERT_EQ( 4u, groups[i].size() );
+    for (size_t j = 0; j < 4; j++)
+      EXPECT_EQ( tiles[4*i + j], groups[i][j] );
+  }
+
+  // As many tasks as tiles leaves the tiles alone
+  groups = balance_tiles(tiles, area_cost, 16, 256);
+  ASSERT_EQ( 16u, groups.size() );
+  for (size_t i = 0; i < groups.size(); i++){
+    ASSERT_EQ( 1u, groups[i].size() );
+    EXPECT_EQ( tiles[i], groups[i][0] );
+  }
+}
+
+TEST(TileBalancing, MinimumTileSize) {
+  // An edge tile too narrow to split across
+  std::vector<BBox2i> tiles;
+  tiles.push_back(BBox2i(0, 0, 300, TILE));
+  std::vector<TileGroup> groups = balance_tiles(tiles, area_cost, 64, 256);
+
+  ASSERT_EQ( 4u, groups.size() );
+  for (size_t i = 0; i < groups.size(); i++){
+    EXPECT_EQ( 300, groups[i][0].width() );
+    EXPECT_EQ( 256, groups[i][0].height() );
+  }
+  BBox2i bounds;
+  EXPECT_EQ( 300.0*TILE, total_area(groups, bounds) );
+}
@@ -0,0 +1,157 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file BatchStereoModel.cc
+///
+
+#include <vw/Camera/CameraModel.h>
+#include <asp/Sessions/BatchStereoModel.h>
+
+#include <algorithm>
+
+using namespace vw;
+
+namespace asp {
+
+  void triangulate_rays(Vector3Array const& origin1, Vector3Array const& dir1,
+                        Vector3Array const& origin2, Vector3Array const& dir2,
+                        bool reflect_behind,
+                        Vector3Array & points, Vector3Array & errors) {
+
+    const size_t n = origin1.size();
+    VW_ASSERT( dir1.size() == n && origin2.size() == n && dir2.size() == n,
+               ArgumentErr() << "triangulate_rays: Expecting as many rays in each array.\n" );
+    points.resize(n);
+    errors.resize(n);
+    if (n == 0) return;
+
+    // Plain pointers, so that the loop below is a simple one over arrays
+    const double *ax = &origin1.x[0], *ay = &origin1.y[0], *az = &origin1.z[0];
+    const double *ux = &dir1.x[0],    *uy = &dir1.y[0],    *uz = &dir1.z[0];
+    const double *bx = &origin2.x[0], *by = &origin2.y[0], *bz = &origin2.z[0];
+    const double *vx = &dir2.x[0],    *vy = &dir2.y[0],    *vz = &dir2.z[0];
+
+    // The results go to local arrays first, which the compiler knows
+    // do not overlap the inputs, so it can vectorize without checks.
+    const size_t block = 64;
+    double px[block], py[block], pz[block], ex[block], ey[block], ez[block];
+
+    for (size_t start = 0; start < n; start += block){
+      const size_t len = std::min(block, n - start);
+
+      for (size_t b = 0; b < len; b++){
+        const size_t k = start + b;
+
+        // The normal to both rays, and the normals to each ray within
+        // the planes they make with it.
+        double wx = uy[k]*vz[k] - uz[k]*vy[k];
+        double wy = uz[k]*vx[k] - ux[k]*vz[k];
+        double wz = ux[k]*vy[k] - uy[k]*vx[k];
+        double n1x = wy*uz[k] - wz*uy[k];
+        double n1y = wz*ux[k] - wx*uz[k];
+        double n1z = wx*uy[k] - wy*ux[k];
+        double n2x = wy*vz[k] - wz*vy[k];
+        double n2y = wz*vx[k] - wx*vz[k];
+        double n2z = wx*vy[k] - wy*vx[k];
+
+        double dx = bx[k] - ax[k], dy = by[k] - ay[k], dz = bz[k] - az[k];
+        double t1 = (n2x*dx + n2y*dy + n2z*dz)
+          / (n2x*ux[k] + n2y*uy[k] + n2z*uz[k]);
+        double t2 = (n1x*(-dx) + n1y*(-dy) + n1z*(-dz))
+          / (n1x*vx[k] + n1y*vy[k] + n1z*vz[k]);
+
+        double cax = ax[k] + t1*ux[k], cay = ay[k] + t1*uy[k], caz = az[k] + t1*uz[k];
+        double cbx = bx[k] + t2*vx[k], cby = by[k] + t2*vy[k], cbz = bz[k] + t2*vz[k];
+        ex[b] = cax - cbx;
+        ey[b] = cay - cby;
+        ez[b] = caz - cbz;
+        double mx = 0.5*(cax + cbx), my = 0.5*(cay + cby), mz = 0.5*(caz + cbz);
+
+        // No short-circuit evaluation, which would be a branch
+        bool behind = reflect_behind &
+          ( ((mx - ax[k])*ux[k] + (my - ay[k])*uy[k] + (mz - az[k])*uz[k] < 0) |
+            ((mx - bx[k])*vx[k] + (my - by[k])*vy[k] + (mz - bz[k])*vz[k] < 0) );
+        px[b] = behind ? -mx + 2*ax[k] : mx;
+        py[b] = behind ? -my + 2*ay[k] : my;
+        pz[b] = behind ? -mz + 2*az[k] : mz;
+      }
+
+      std::copy(px, px + len, points.x.begin() + start);
+      std::copy(py, py + len, points.y.begin() + start);
+      std::copy(pz, pz + len, points.z.begin() + start);
+      std::copy(ex, ex + len, errors.x.begin() + start);
+      std::copy(ey, ey + len, errors.y.begin() + start);
+      std::copy(ez, ez + len, errors.z.begin() + start);
+    }
+  }
+
+  void BatchStereoModel::operator()(std::vector<Vector2> const& pix1,
+                                    std::vector<Vector2> const& pix2,
+                                    std::vector<Vector3> & points,
+                                    std::vector<Vector3> & errorVecs) const {
+
+    VW_ASSERT( pix1.size() == pix2.size(),
+               ArgumentErr() << "BatchStereoModel: Expecting as many left as right pixels.\n" );
+
+    points.assign(pix1.size(), Vector3());
+    errorVecs.assign(pix1.size(), Vector3());
+
+    if ( m_least_squares ){
+      for (size_t i = 0; i < pix1.size(); i++)
+        points[i] = vw::stereo::StereoModel::operator()(pix1[i], pix2[i], errorVecs[i]);
+      return;
+    }
+
+    // Gather the rays of the pairs which can be triangulated, one
+    // camera at a time. Pairs with NaN values, whose rays cannot be
+    // found, or whose rays are nearly parallel are left out.
+    std::vector<size_t> index;
+    Vector3Array origin1, dir1, origin2, dir2;
+    origin1.resize(pix1.size()); dir1.resize(pix1.size());
+    origin2.resize(pix1.size()); dir2.resize(pix1.size());
+    size_t count = 0;
+    for (size_t i = 0; i < pix1.size(); i++){
+      if (pix1[i] != pix1[i] || pix2[i] != pix2[i]) continue;
+      try {
+        Vector3 vec1 = m_camera1->pixel_to_vector(pix1[i]);
+        Vector3 vec2 = m_camera2->pixel_to_vector(pix2[i]);
+        if ( are_nearly_parallel(vec1, vec2) ) continue;
+        dir1.set(count, vec1);
+        dir2.set(count, vec2);
+        origin1.set(count, m_camera1->camera_center(pix1[i]));
+        origin2.set(count, m_camera2->camera_center(pix2[i]));
+      } catch (const camera::PixelToRayErr& /*e*/) {
+        continue;
+      }
+      index.push_back(i);
+      count++;
+    }
+    origin1.resize(count); dir1.resize(count);
+    origin2.resize(count); dir2.resize(count);
+    if (count == 0) return;
+
+    Vector3Array batch_points, batch_errors;
+    triangulate_rays(origin1, dir1, origin2, dir2, true,
+                     batch_points, batch_errors);
+
+    for (size_t k = 0; k < count; k++){
+      points[index[k]]    = batch_points.get(k);
+      errorVecs[index[k]] = batch_errors.get(k);
+    }
+  }
+
+} // namespace asp
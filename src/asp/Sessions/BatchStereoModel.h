@@ -0,0 +1,83 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+/// \file BatchStereoModel.h
+///
+/// Triangulation of many pixel pairs at once. The camera centers and
+/// ray directions are gathered into one array per coordinate, and the
+/// closest approach of the rays is then found in a loop which the
+/// compiler can vectorize.
+
+#ifndef __ASP_SESSIONS_BATCHSTEREOMODEL_H__
+#define __ASP_SESSIONS_BATCHSTEREOMODEL_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Stereo/StereoModel.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// Many 3D vectors, stored with one array per coordinate.
+  struct Vector3Array {
+    std::vector<double> x, y, z;
+
+    void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+    size_t size() const { return x.size(); }
+    void set(size_t k, vw::Vector3 const& v) { x[k] = v[0]; y[k] = v[1]; z[k] = v[2]; }
+    vw::Vector3 get(size_t k) const { return vw::Vector3(x[k], y[k], z[k]); }
+  };
+
+  /// Find the points closest to pairs of rays, each given by an
+  /// origin and a direction. The same arithmetic as
+  /// vw::stereo::StereoModel::triangulate_point() is used. The error
+  /// is the vector from the closest point of the second ray to the
+  /// closest point of the first one. If reflect_behind is true, the
+  /// points behind either camera are reflected about the first camera
+  /// center, as the stereo model does.
+  void triangulate_rays(Vector3Array const& origin1, Vector3Array const& dir1,
+                        Vector3Array const& origin2, Vector3Array const& dir2,
+                        bool reflect_behind,
+                        Vector3Array & points, Vector3Array & errors);
+
+  /// A stereo model which also triangulates a whole tile of pixel
+  /// pairs in one call. This avoids the per-pixel overhead of the
+  /// stereo model when the cameras are cheap to evaluate, as pinhole
+  /// cameras are.
+  class BatchStereoModel: public vw::stereo::StereoModel {
+
+  public:
+
+    BatchStereoModel(vw::camera::CameraModel const* camera_model1,
+                     vw::camera::CameraModel const* camera_model2,
+                     bool least_squares_refine = false):
+      vw::stereo::StereoModel(camera_model1, camera_model2, least_squares_refine){}
+
+    using vw::stereo::StereoModel::operator();
+
+    /// Triangulate many pairs of image coordinates at once, with the
+    /// same results as the single pair version. With least squares
+    /// refinement the pairs are triangulated one at a time.
+    void operator()(std::vector<vw::Vector2> const& pix1,
+                    std::vector<vw::Vector2> const& pix2,
+                    std::vector<vw::Vector3> & points,
+                    std::vector<vw::Vector3> & errorVecs) const;
+  };
+
+} // namespace asp
+
+#endif  // __ASP_SESSIONS_BATCHSTEREOMODEL_H__
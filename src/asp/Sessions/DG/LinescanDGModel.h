@@ -25,9 +25,14 @@
 #define __STEREO_SESSION_DG_LINESCAN_DG_MODEL_H__
 
 #include <vw/Math/Quaternion.h>
+#include <vw/Math/Matrix.h>
 #include <vw/Camera/CameraModel.h>
 #include <vw/Camera/PinholeModel.h>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 namespace asp {
 
   // This is potentially a more generic line scan camera model that
@@ -61,6 +66,178 @@ namespace asp {
 
     bool m_correct_velocity_aberration;
 
+    // The time, camera position, velocity and pose at each image
+    // line, so that the camera at a line is found by interpolating
+    // between two table entries instead of evaluating the time,
+    // ephemeris and attitude functions. The position is interpolated
+    // with cubic Hermite polynomials using the velocity, the pose by
+    // normalized linear interpolation of the quaternions. This agrees
+    // with the functions to far below a millimeter and a
+    // microradian. Lines outside of the image use the functions.
+    struct LineState {
+      double time;
+      vw::Vector3 position, velocity;
+      vw::Quat pose;
+    };
+    std::vector<LineState> m_line_table;
+
+    // The camera position and world to camera rotation at a few
+    // evenly spaced lines. These let point_to_pixel find the two
+    // lines between which a point projects without evaluating the
+    // position and pose interpolation functions.
+    std::vector<double> m_bracket_lines;
+    std::vector<vw::Vector3> m_bracket_positions;
+    std::vector<vw::Matrix3x3> m_bracket_world_to_cam;
+
+    void build_bracket_table() {
+      const int num_intervals = 64;
+      double last_line = std::max( m_image_size.y() - 1, 1 );
+      for ( int k = 0; k <= num_intervals; k++ ) {
+        double y = last_line * k / num_intervals;
+        double t = m_time_func( y );
+        m_bracket_lines.push_back( y );
+        m_bracket_positions.push_back( m_position_func(t) );
+        m_bracket_world_to_cam.push_back( inverse( m_pose_func(t) ).rotation_matrix() );
+      }
+    }
+
+    void build_line_table() {
+      int num_lines = m_image_size.y();
+      if ( num_lines < 2 )
+        return;
+      m_line_table.resize( num_lines );
+      for ( int k = 0; k < num_lines; k++ ) {
+        LineState & state = m_line_table[k];
+        state.time     = m_time_func( k );
+        state.position = m_position_func( state.time );
+        state.velocity = m_velocity_func( state.time );
+        state.pose     = m_pose_func( state.time );
+      }
+    }
+
+    // Find the table entries around line y and the weight of the
+    // second one. Return false if y is not within the table.
+    bool line_table_segment( double y, size_t & k, double & f ) const {
+      if ( m_line_table.empty() ||
+           !( y >= 0 && y <= double( m_line_table.size() - 1 ) ) ) // Catches NaN
+        return false;
+      k = std::min( size_t( y ), m_line_table.size() - 2 );
+      f = y - double( k );
+      return true;
+    }
+
+    vw::Vector3 line_position( double y ) const {
+      size_t k; double f;
+      if ( !line_table_segment( y, k, f ) )
+        return m_position_func( m_time_func( y ) );
+      LineState const& a = m_line_table[k];
+      LineState const& b = m_line_table[k+1];
+      double h = b.time - a.time;
+      double f2 = f * f, f3 = f2 * f;
+      return ( 2*f3 - 3*f2 + 1 ) * a.position + ( f3 - 2*f2 + f ) * h * a.velocity
+        + ( 3*f2 - 2*f3 ) * b.position + ( f3 - f2 ) * h * b.velocity;
+    }
+
+    vw::Vector3 line_velocity( double y ) const {
+      size_t k; double f;
+      if ( !line_table_segment( y, k, f ) )
+        return m_velocity_func( m_time_func( y ) );
+      return ( 1 - f ) * m_line_table[k].velocity + f * m_line_table[k+1].velocity;
+    }
+
+    vw::Quat line_pose( double y ) const {
+      size_t k; double f;
+      if ( !line_table_segment( y, k, f ) )
+        return m_pose_func( m_time_func( y ) );
+      vw::Quat const& a = m_line_table[k].pose;
+      vw::Quat const& b = m_line_table[k+1].pose;
+      double fb = f;
+      if ( a.w()*b.w() + a.x()*b.x() + a.y()*b.y() + a.z()*b.z() < 0 )
+        fb = -f; // Interpolate along the shorter arc
+      double w = ( 1 - f ) * a.w() + fb * b.w();
+      double x = ( 1 - f ) * a.x() + fb * b.x();
+      double yq = ( 1 - f ) * a.y() + fb * b.y();
+      double z = ( 1 - f ) * a.z() + fb * b.z();
+      double len = sqrt( w*w + x*x + yq*yq + z*z );
+      return vw::Quat( w/len, x/len, yq/len, z/len );
+    }
+
+    // The same error as LinescanLMA, for a point in camera coordinates
+    double detector_error( vw::Vector3 const& cam_pt ) const {
+      return m_focal_length * cam_pt.y() / cam_pt.z() - m_detector_origin[1];
+    }
+
+    double line_error( vw::Vector3 const& point, double y ) const {
+      return detector_error( inverse( line_pose(y) ).rotate( point - line_position(y) ) );
+    }
+
+    // Solve for the line number the point projects to. The table
+    // gives a bracketing pair of lines, which is refined by regula
+    // falsi with the Illinois modification, so only a handful of
+    // model evaluations are needed. Points beyond the first or last
+    // line are handled by secant steps from the nearest end of the
+    // table. Returns false if this fails, for example for points
+    // behind the camera, so the caller can fall back to LinescanLMA.
+    bool solve_line( vw::Vector3 const& point, double & line ) const {
+
+      const double tolerance = 1e-6; // pixels
+      const int max_iterations = 50;
+
+      double a = 0, fa = 0, b = 0, fb = 0;
+      double first_error = 0, second_error = 0, prev_error = 0, prev_prev_error = 0;
+      bool bracketed = false;
+      size_t num_lines = m_bracket_lines.size();
+      for ( size_t k = 0; k < num_lines; k++ ) {
+        vw::Vector3 cam_pt = m_bracket_world_to_cam[k] * ( point - m_bracket_positions[k] );
+        if ( cam_pt.z() <= 0 )
+          return false;
+        double error = detector_error( cam_pt );
+        if ( k == 0 ) first_error  = error;
+        if ( k == 1 ) second_error = error;
+        if ( k > 0 && ( error > 0 ) != ( prev_error > 0 ) ) {
+          a = m_bracket_lines[k-1]; fa = prev_error;
+          b = m_bracket_lines[k];   fb = error;
+          bracketed = true;
+          break;
+        }
+        prev_prev_error = prev_error;
+        prev_error = error;
+      }
+      if ( !bracketed ) {
+        if ( std::abs( first_error ) < std::abs( prev_error ) ) {
+          a = m_bracket_lines[1]; fa = second_error;
+          b = m_bracket_lines[0]; fb = first_error;
+        } else {
+          a = m_bracket_lines[num_lines-2]; fa = prev_prev_error;
+          b = m_bracket_lines[num_lines-1]; fb = prev_error;
+        }
+      }
+
+      for ( int i = 0; i < max_iterations; i++ ) {
+        if ( std::abs( fb ) < tolerance ) {
+          line = b;
+          return true;
+        }
+        if ( fb == fa )
+          return false;
+        double c = b - fb * ( b - a ) / ( fb - fa );
+        if ( !( std::abs( c ) < 10.0 * ( m_image_size.y() + 1 ) ) ) // Catches NaN
+          return false;
+        double fc = line_error( point, c );
+        if ( bracketed ) {
+          if ( ( fc > 0 ) != ( fb > 0 ) ) {
+            a = b; fa = fb;
+          } else {
+            fa *= 0.5;
+          }
+        } else {
+          a = b; fa = fb;
+        }
+        b = c; fb = fc;
+      }
+      return false;
+    }
+
     // Levenberg Marquardt solver for linescan number
     //
     // We solve for the line number of the image that position the
@@ -79,10 +256,8 @@ namespace asp {
         m_model(model), m_point(pt) {}
 
       inline result_type operator()( domain_type const& y ) const {
-        double t = m_model->m_time_func( y[0] );
-
         // Rotate the point into our camera's frame
-        vw::Vector3 pt = inverse( m_model->m_pose_func(t) ).rotate( m_point - m_model->m_position_func(t) );
+        vw::Vector3 pt = inverse( m_model->line_pose( y[0] ) ).rotate( m_point - m_model->line_position( y[0] ) );
         pt *= m_model->m_focal_length / pt.z(); // Rescale to pixel units
         result_type result(1);
         result[0] = pt.y() -
@@ -129,13 +304,18 @@ namespace asp {
                     vw::Vector2i const& image_size,
                     vw::Vector2 const& detector_origin,
                     double focal_length,
-                    bool correct_velocity_aberration
+                    bool correct_velocity_aberration,
+                    bool use_line_table = true
                     ) :
       m_position_func(position), m_velocity_func(velocity),
       m_pose_func(pose), m_time_func(time),
       m_image_size(image_size), m_detector_origin(detector_origin),
       m_focal_length(focal_length),
-      m_correct_velocity_aberration(correct_velocity_aberration){}
+      m_correct_velocity_aberration(correct_velocity_aberration){
+      if ( use_line_table )
+        build_line_table();
+      build_bracket_table();
+    }
 
     virtual ~LinescanDGModel() {}
     virtual std::string type() const { return "LinescanDG"; }
@@ -154,41 +334,94 @@ namespace asp {
       using namespace vw;
 
       // Solve for the correct line number to use
-      LinescanLMA model( this, point );
-      int status;
-      Vector<double> objective(1), start(1);
-      start[0] = m_image_size.y()/2;
-      Vector<double> solution =
-        math::levenberg_marquardt( model, start, objective, status,
-                                   1e-2, 1e-5, 1e3 );
-      // The ending numbers define:
-      //   Attempt to solve solution to 0.01 pixels.
-      //   Give up with a relative change of 0.00001 pixels.
-      //   Try with a max of a 1000 iterations.
-
-      VW_ASSERT( status > 0,
-                 camera::PointToPixelErr() << "Unable to project point into LinescanDG model" );
+      double line;
+      if ( !solve_line( point, line ) ) {
+        LinescanLMA model( this, point );
+        int status;
+        Vector<double> objective(1), start(1);
+        start[0] = m_image_size.y()/2;
+        Vector<double> solution =
+          math::levenberg_marquardt( model, start, objective, status,
+                                     1e-2, 1e-5, 1e3 );
+        // The ending numbers define:
+        //   Attempt to solve solution to 0.01 pixels.
+        //   Give up with a relative change of 0.00001 pixels.
+        //   Try with a max of a 1000 iterations.
+
+        VW_ASSERT( status > 0,
+                   camera::PointToPixelErr() << "Unable to project point into LinescanDG model" );
+        line = solution[0];
+      }
 
       // Solve for sample location
-      double t = m_time_func( solution[0] );
-      Vector3 pt = inverse( m_pose_func(t) ).rotate( point - m_position_func(t) );
+      Vector3 pt = inverse( line_pose(line) ).rotate( point - line_position(line) );
       pt *= m_focal_length / pt.z();
 
-      return vw::Vector2(pt.x() - m_detector_origin[0], solution[0]);
+      return vw::Vector2(pt.x() - m_detector_origin[0], line);
     }
 
-    vw::Vector2 point_to_pixel_corrected(vw::Vector3 const& point) const {
+    // Gauss-Newton refinement of the uncorrected pixel for the
+    // velocity aberration. The correction moves the pixel by a few
+    // pixels at most and hardly changes the Jacobian over that
+    // distance, so the Jacobian is only recomputed if the steps stop
+    // shrinking quickly.
+    bool refine_corrected( vw::Vector3 const& point, vw::Vector2 const& start,
+                           vw::Vector2 & solution ) const {
 
       using namespace vw;
 
+      const double tolerance = 1e-8; // pixels
+      const int max_iterations = 20;
+
       LinescanCorrLMA model( this, point );
-      int status;
+      Vector2 pix = start;
+      Vector3 error = model( pix );
+      Matrix<double, 3, 2> jacobian;
+      Matrix2x2 normal_inverse;
+      double last_step_norm = -1;
+      bool update_jacobian = true;
+      for ( int i = 0; i < max_iterations; i++ ) {
+        if ( update_jacobian ) {
+          // Unit steps are small compared to the scale over which the
+          // pointing direction changes nonlinearly.
+          select_col( jacobian, 0 ) = model( pix + Vector2(1, 0) ) - error;
+          select_col( jacobian, 1 ) = model( pix + Vector2(0, 1) ) - error;
+          Matrix2x2 normal = transpose( jacobian ) * jacobian;
+          if ( !( std::abs( det( normal ) ) > 0 ) )
+            return false;
+          normal_inverse = inverse( normal );
+        }
+        Vector2 step = normal_inverse * ( transpose( jacobian ) * error );
+        double step_norm = norm_2( step );
+        if ( !( step_norm < 1e3 ) ) // Catches NaN
+          return false;
+        pix -= step;
+        if ( step_norm < tolerance ) {
+          solution = pix;
+          return true;
+        }
+        error = model( pix );
+        update_jacobian = last_step_norm >= 0 && step_norm > 0.1 * last_step_norm;
+        last_step_norm = step_norm;
+      }
+      return false;
+    }
+
+    vw::Vector2 point_to_pixel_corrected(vw::Vector3 const& point) const {
+
+      using namespace vw;
+
       Vector2 start = point_to_pixel_uncorrected(point);
+      Vector2 solution;
+      if ( refine_corrected( point, start, solution ) )
+        return solution;
 
+      LinescanCorrLMA model( this, point );
+      int status;
       Vector3 objective(0, 0, 0);
       // Need such tight tolerances below otherwise the solution is
       // inaccurate.
-      Vector2 solution =
+      solution =
         math::levenberg_marquardt( model, start, objective, status,
                                    1e-10, 1e-10, 50 );
       VW_ASSERT( status > 0,
@@ -202,11 +435,10 @@ namespace asp {
 
       using namespace vw;
 
-      double t = m_time_func( pix.y() );
       Vector3 pix_to_vec
-        = normalize(m_pose_func( t ).rotate( vw::Vector3(pix[0]+m_detector_origin[0],
-                                                         m_detector_origin[1],
-                                                         m_focal_length) ) );
+        = normalize(line_pose( pix.y() ).rotate( vw::Vector3(pix[0]+m_detector_origin[0],
+                                                             m_detector_origin[1],
+                                                             m_focal_length) ) );
 
       if (!m_correct_velocity_aberration) return pix_to_vec;
 
@@ -241,16 +473,16 @@ namespace asp {
 
     // Gives the camera position in world coordinates.
     virtual vw::Vector3 camera_center(vw::Vector2 const& pix ) const {
-      return m_position_func( m_time_func( pix.y() ) );
+      return line_position( pix.y() );
     }
 
     // Gives the camera velocity in world coordinates.
     vw::Vector3 camera_velocity(vw::Vector2 const& pix ) const {
-      return m_velocity_func( m_time_func( pix.y() ) );
+      return line_velocity( pix.y() );
     }
     // Gives a pose vector which represents the rotation from camera to world units
     virtual vw::Quat camera_pose(vw::Vector2 const& pix) const {
-      return m_pose_func( m_time_func( pix.y() ) );
+      return line_pose( pix.y() );
     }
 
     vw::camera::PinholeModel linescan_to_pinhole(double y) const{
@@ -258,8 +490,7 @@ namespace asp {
       // Create a fake pinhole model. It will return the same results
       // as the linescan camera at current line y, but we will use it
       // by extension at neighboring lines as well.
-      double t = m_time_func( y );
-      return vw::camera::PinholeModel(m_position_func(t),  m_pose_func(t).rotation_matrix(),
+      return vw::camera::PinholeModel(line_position(y),  line_pose(y).rotation_matrix(),
                                       m_focal_length, -m_focal_length,
                                       -m_detector_origin[0], y - m_detector_origin[1]
                                       );
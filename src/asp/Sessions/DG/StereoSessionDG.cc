@@ -110,6 +110,7 @@ namespace asp {
     geo.detector_origin /= geo.detector_pixel_pitch;
 
     bool correct_velocity_aberration = !stereo_settings().disable_correct_velocity_aberration;
+    bool use_line_table = !stereo_settings().disable_dg_line_table;
 
     // Convert all time measurements to something that boost::date_time can read.
     boost::replace_all( eph.start_time, "T", " " );
@@ -174,7 +175,8 @@ namespace asp {
                                        subvector(inverse(sensor_coordinate).rotate(Vector3(geo.detector_origin[0],
                                                                                            geo.detector_origin[1],
                                                                                            0)), 0, 2),
-                                       geo.principal_distance, correct_velocity_aberration)
+                                       geo.principal_distance, correct_velocity_aberration,
+                                       use_line_table)
                       );
   }
 
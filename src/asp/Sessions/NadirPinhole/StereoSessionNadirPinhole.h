@@ -41,7 +41,7 @@ namespace asp {
     // For reversing our arithmetic applied in preprocessing.
     typedef vw::HomographyTransform left_tx_type;
     typedef vw::HomographyTransform right_tx_type;
-    typedef vw::stereo::StereoModel stereo_model_type;
+    typedef asp::BatchStereoModel stereo_model_type;
     left_tx_type tx_left() const;
     right_tx_type tx_right() const;
 
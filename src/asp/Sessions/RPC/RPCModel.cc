@@ -32,6 +32,42 @@
 
 using namespace vw;
 
+namespace {
+
+  // An RPC polynomial and its partial derivatives in the first two
+  // variables, with the terms in the order of calculate_terms().
+  // They are written out so that loops over arrays of points calling
+  // them vectorize.
+  inline double rpc_polynomial( const double* c, double x, double y, double z ) {
+    return c[ 0] + c[ 1]*x + c[ 2]*y + c[ 3]*z + c[ 4]*x*y + c[ 5]*x*z + c[ 6]*y*z
+      + c[ 7]*x*x + c[ 8]*y*y + c[ 9]*z*z + c[10]*x*y*z + c[11]*x*x*x + c[12]*x*y*y
+      + c[13]*x*z*z + c[14]*x*x*y + c[15]*y*y*y + c[16]*y*z*z + c[17]*x*x*z
+      + c[18]*y*y*z + c[19]*z*z*z;
+  }
+
+  inline double rpc_polynomial_dx( const double* c, double x, double y, double z ) {
+    return c[ 1] + c[ 4]*y + c[ 5]*z + 2.0*c[ 7]*x + c[10]*y*z + 3.0*c[11]*x*x
+      + c[12]*y*y + c[13]*z*z + 2.0*c[14]*x*y + 2.0*c[17]*x*z;
+  }
+
+  inline double rpc_polynomial_dy( const double* c, double x, double y, double z ) {
+    return c[ 2] + c[ 4]*x + c[ 6]*z + 2.0*c[ 8]*y + c[10]*x*z + 2.0*c[12]*x*y
+      + c[14]*x*x + 3.0*c[15]*y*y + c[16]*z*z + 2.0*c[18]*y*z;
+  }
+
+  // The quotient num/den and its derivatives in x and y
+  inline void rpc_quotient( const double* num, const double* den,
+                            double x, double y, double z,
+                            double & value, double & dx, double & dy ) {
+    double n = rpc_polynomial( num, x, y, z );
+    double d = rpc_polynomial( den, x, y, z );
+    value = n / d;
+    dx = ( rpc_polynomial_dx( num, x, y, z ) - value * rpc_polynomial_dx( den, x, y, z ) ) / d;
+    dy = ( rpc_polynomial_dy( num, x, y, z ) - value * rpc_polynomial_dy( den, x, y, z ) ) / d;
+  }
+
+}
+
 namespace asp {
 
   void RPCModel::initialize( DiskImageResourceGDAL* resource ) {
@@ -422,6 +458,131 @@ namespace asp {
     dir = normalize(P_dn - P);
   }
 
+  void RPCModel::normalized_geodetic_to_normalized_pixel
+  ( int num_points, const double* normalized_lon, const double* normalized_lat,
+    const double* normalized_height, double* normalized_sample,
+    double* normalized_line ) const {
+
+    const double *sn = &m_sample_num_coeff[0], *sd = &m_sample_den_coeff[0];
+    const double *ln = &m_line_num_coeff[0],   *ld = &m_line_den_coeff[0];
+    for ( int i = 0; i < num_points; i++ ) {
+      double x = normalized_lon[i], y = normalized_lat[i], z = normalized_height[i];
+      normalized_sample[i] = rpc_polynomial( sn, x, y, z ) / rpc_polynomial( sd, x, y, z );
+      normalized_line[i]   = rpc_polynomial( ln, x, y, z ) / rpc_polynomial( ld, x, y, z );
+    }
+  }
+
+  void RPCModel::geodetic_to_pixel( std::vector<Vector3> const& geodetic,
+                                    std::vector<Vector2> & pixels ) const {
+
+    int num_points = geodetic.size();
+    pixels.resize( num_points );
+    if ( num_points == 0 ) return;
+
+    std::vector<double> x( num_points ), y( num_points ), z( num_points );
+    for ( int i = 0; i < num_points; i++ ) {
+      x[i] = ( geodetic[i][0] - m_lonlatheight_offset[0] ) / m_lonlatheight_scale[0];
+      y[i] = ( geodetic[i][1] - m_lonlatheight_offset[1] ) / m_lonlatheight_scale[1];
+      z[i] = ( geodetic[i][2] - m_lonlatheight_offset[2] ) / m_lonlatheight_scale[2];
+    }
+
+    // Reuse the input arrays for the output
+    normalized_geodetic_to_normalized_pixel( num_points, &x[0], &y[0], &z[0], &x[0], &y[0] );
+
+    for ( int i = 0; i < num_points; i++ )
+      pixels[i] = Vector2( x[i] * m_xy_scale[0] + m_xy_offset[0],
+                           y[i] * m_xy_scale[1] + m_xy_offset[1] );
+  }
+
+  void RPCModel::image_to_ground( std::vector<Vector2> const& pixels, double height,
+                                  std::vector<Vector2> & lonlats ) const {
+
+    // The same Newton's method as for a single pixel, applied to all
+    // pixels at once. Each iteration works on contiguous copies of
+    // the pixels which have not converged yet.
+
+    double abs_tolerance = 1e-6;
+    int num_points = pixels.size();
+    bool have_guess = ( lonlats.size() == pixels.size() );
+
+    Vector2 lonlat_offset = subvector(m_lonlatheight_offset, 0, 2);
+    Vector2 lonlat_scale  = subvector(m_lonlatheight_scale,  0, 2);
+    double normalized_height = (height - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+
+    std::vector<Vector2> normalized_pixel( num_points ), normalized_lonlat( num_points );
+    std::vector<int> active( num_points );
+    for ( int i = 0; i < num_points; i++ ) {
+      normalized_pixel[i] = elem_quot(pixels[i] - m_xy_offset, m_xy_scale);
+      Vector2 lonlat_guess = have_guess ? lonlats[i] : Vector2(0.0, 0.0);
+      if (lonlat_guess == Vector2(0.0, 0.0))
+        lonlat_guess = lonlat_offset;
+      normalized_lonlat[i] = elem_quot(lonlat_guess - lonlat_offset, lonlat_scale);
+      double len = norm_2(normalized_lonlat[i]);
+      if (len != len || len > 1.5)
+        normalized_lonlat[i] = Vector2(0.0, 0.0);
+      active[i] = i;
+    }
+
+    const double *sn = &m_sample_num_coeff[0], *sd = &m_sample_den_coeff[0];
+    const double *ln = &m_line_num_coeff[0],   *ld = &m_line_den_coeff[0];
+    std::vector<double> x( num_points ), y( num_points ),
+      s( num_points ), s_x( num_points ), s_y( num_points ),
+      l( num_points ), l_x( num_points ), l_y( num_points );
+    for (int iter = 0; iter < 10 && !active.empty(); iter++){
+
+      int num_active = active.size();
+      for ( int k = 0; k < num_active; k++ ) {
+        x[k] = normalized_lonlat[active[k]][0];
+        y[k] = normalized_lonlat[active[k]][1];
+      }
+
+      for ( int k = 0; k < num_active; k++ ) {
+        rpc_quotient( sn, sd, x[k], y[k], normalized_height, s[k], s_x[k], s_y[k] );
+        rpc_quotient( ln, ld, x[k], y[k], normalized_height, l[k], l_x[k], l_y[k] );
+      }
+
+      int num_left = 0;
+      for ( int k = 0; k < num_active; k++ ) {
+        int i = active[k];
+        double error_s = s[k] - normalized_pixel[i][0];
+        double error_l = l[k] - normalized_pixel[i][1];
+        double det = s_x[k]*l_y[k] - s_y[k]*l_x[k];
+        normalized_lonlat[i][0] -= (  l_y[k]*error_s - s_y[k]*error_l ) / det;
+        normalized_lonlat[i][1] -= ( -l_x[k]*error_s + s_x[k]*error_l ) / det;
+        if ( error_s*error_s + error_l*error_l < abs_tolerance*abs_tolerance )
+          continue;
+        active[num_left++] = i;
+      }
+      active.resize( num_left );
+    }
+
+    lonlats.resize( num_points );
+    for ( int i = 0; i < num_points; i++ )
+      lonlats[i] = elem_prod( normalized_lonlat[i], lonlat_scale ) + lonlat_offset;
+  }
+
+  void RPCModel::point_and_dir( std::vector<Vector2> const& pixels,
+                                std::vector<Vector3> & P,
+                                std::vector<Vector3> & dir ) const {
+
+    double  height_up = m_lonlatheight_offset[2];
+    double  height_dn = m_lonlatheight_offset[2] - m_lonlatheight_scale[2];
+
+    std::vector<Vector2> lonlat_up, lonlat_dn;
+    image_to_ground( pixels, height_up, lonlat_up );
+    lonlat_dn = lonlat_up;
+    image_to_ground( pixels, height_dn, lonlat_dn );
+
+    int num_points = pixels.size();
+    P.resize( num_points );
+    dir.resize( num_points );
+    for ( int i = 0; i < num_points; i++ ) {
+      P[i] = m_datum.geodetic_to_cartesian( Vector3(lonlat_up[i][0], lonlat_up[i][1], height_up) );
+      Vector3 P_dn = m_datum.geodetic_to_cartesian( Vector3(lonlat_dn[i][0], lonlat_dn[i][1], height_dn) );
+      dir[i] = normalize(P_dn - P[i]);
+    }
+  }
+
   Vector3 RPCModel::camera_center(Vector2 const& pix ) const{
     // Return an arbitrarily chosen point on the ray back-projected
     // through the camera from the current pixel.
@@ -33,6 +33,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -106,6 +107,24 @@ namespace asp {
 
     void point_and_dir(vw::Vector2 const& pix, vw::Vector3 & P, vw::Vector3 & dir ) const;
 
+    // Batch versions of the above for many points at once. The
+    // normalized coordinates are kept in separate arrays, so the
+    // loops over the points vectorize and avoid the cost of
+    // assembling the terms and Jacobians for each point.
+    void normalized_geodetic_to_normalized_pixel
+    ( int num_points, const double* normalized_lon, const double* normalized_lat,
+      const double* normalized_height, double* normalized_sample,
+      double* normalized_line ) const;
+    void geodetic_to_pixel( std::vector<vw::Vector3> const& geodetic,
+                            std::vector<vw::Vector2> & pixels ) const;
+    // If lonlats has the same size as pixels on input, its elements
+    // are used as initial guesses.
+    void image_to_ground( std::vector<vw::Vector2> const& pixels, double height,
+                          std::vector<vw::Vector2> & lonlats ) const;
+    void point_and_dir( std::vector<vw::Vector2> const& pixels,
+                        std::vector<vw::Vector3> & P,
+                        std::vector<vw::Vector3> & dir ) const;
+
   private:
     vw::cartography::Datum m_datum;
 
@@ -23,6 +23,7 @@
 #include <vw/Camera/CameraModel.h>
 #include <vw/Cartography/Datum.h>
 
+#include <asp/Sessions/BatchStereoModel.h>
 #include <asp/Sessions/RPC/RPCModel.h>
 #include <asp/Sessions/RPC/RPCStereoModel.h>
 
@@ -82,36 +83,118 @@ namespace asp {
       rpc_model1->point_and_dir(pix1, origin1, vec1);
       rpc_model2->point_and_dir(pix2, origin2, vec2);
 
-      if (are_nearly_parallel(vec1, vec2)){
-        return Vector3();
-      }
+      return triangulate_pair(rpc_model1, rpc_model2, pix1, pix2,
+                              origin1, vec1, origin2, vec2, errorVec);
+
+    } catch (...) {}
+    return Vector3();
+  }
+
+  void RPCStereoModel::operator()(std::vector<Vector2> const& pix1,
+                                  std::vector<Vector2> const& pix2,
+                                  std::vector<Vector3> & points,
+                                  std::vector<Vector3> & errorVecs) const {
 
-      Vector3 result = triangulate_point(origin1, vec1,
-                                         origin2, vec2,
-                                         errorVec);
+    VW_ASSERT( pix1.size() == pix2.size(),
+               ArgumentErr() << "RPCStereoModel: Expecting as many left as right pixels.\n" );
 
-      if ( m_least_squares ){
+    points.assign(pix1.size(), Vector3());
+    errorVecs.assign(pix1.size(), Vector3());
 
-        // Refine triangulation
+    const RPCModel *rpc_model1 = dynamic_cast<const RPCModel*>(m_camera1);
+    const RPCModel *rpc_model2 = dynamic_cast<const RPCModel*>(m_camera2);
 
-        detail::RPCTriangulateLMA model(rpc_model1, rpc_model2);
-        Vector4 objective( pix1[0], pix1[1], pix2[0], pix2[1] );
-        int status = 0;
+    if (rpc_model1 == NULL || rpc_model2 == NULL){
+      VW_OUT(ErrorMessage) << "RPC camera models expected.\n";
+      return;
+    }
 
-        Vector3 initialGeodetic = rpc_model1->datum().cartesian_to_geodetic(result);
+    // Leave out pairs with NaN values
+    std::vector<size_t> index;
+    std::vector<Vector2> valid_pix1, valid_pix2;
+    for (size_t i = 0; i < pix1.size(); i++){
+      if (pix1[i] != pix1[i] || pix2[i] != pix2[i]) continue;
+      index.push_back(i);
+      valid_pix1.push_back(pix1[i]);
+      valid_pix2.push_back(pix2[i]);
+    }
 
-        // To do: Find good values for the numbers controlling the convergence
-        Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
-                                                     objective, status, 1e-3, 1e-6, 10 );
+    std::vector<Vector3> origin1, vec1, origin2, vec2;
+    try {
+      rpc_model1->point_and_dir(valid_pix1, origin1, vec1);
+      rpc_model2->point_and_dir(valid_pix2, origin2, vec2);
+    } catch (...) {
+      return;
+    }
 
-        if ( status > 0 )
-          result = rpc_model1->datum().geodetic_to_cartesian(finalGeodetic);
+    // Intersect the rays which are not nearly parallel all at once
+    std::vector<size_t> ray_index;
+    Vector3Array ray_origin1, ray_dir1, ray_origin2, ray_dir2;
+    ray_origin1.resize(index.size()); ray_dir1.resize(index.size());
+    ray_origin2.resize(index.size()); ray_dir2.resize(index.size());
+    for (size_t k = 0; k < index.size(); k++){
+      if (are_nearly_parallel(vec1[k], vec2[k])) continue;
+      size_t count = ray_index.size();
+      ray_origin1.set(count, origin1[k]); ray_dir1.set(count, vec1[k]);
+      ray_origin2.set(count, origin2[k]); ray_dir2.set(count, vec2[k]);
+      ray_index.push_back(index[k]);
+    }
+    ray_origin1.resize(ray_index.size()); ray_dir1.resize(ray_index.size());
+    ray_origin2.resize(ray_index.size()); ray_dir2.resize(ray_index.size());
+
+    Vector3Array ray_points, ray_errors;
+    asp::triangulate_rays(ray_origin1, ray_dir1, ray_origin2, ray_dir2, false,
+                          ray_points, ray_errors);
+
+    for (size_t k = 0; k < ray_index.size(); k++){
+      size_t i = ray_index[k];
+      errorVecs[i] = ray_errors.get(k);
+      try {
+        points[i] = ray_points.get(k);
+        if ( m_least_squares )
+          refine_point_lma(rpc_model1, rpc_model2, pix1[i], pix2[i], points[i]);
+      } catch (...) {
+        points[i] = Vector3();
       }
+    }
+  }
 
-      return result;
+  Vector3 RPCStereoModel::triangulate_pair(RPCModel const* rpc_model1, RPCModel const* rpc_model2,
+                                           Vector2 const& pix1, Vector2 const& pix2,
+                                           Vector3 const& origin1, Vector3 const& vec1,
+                                           Vector3 const& origin2, Vector3 const& vec2,
+                                           Vector3& errorVec) const {
 
-    } catch (...) {}
-    return Vector3();
+    if (are_nearly_parallel(vec1, vec2)){
+      return Vector3();
+    }
+
+    Vector3 result = triangulate_point(origin1, vec1,
+                                       origin2, vec2,
+                                       errorVec);
+
+    if ( m_least_squares )
+      refine_point_lma(rpc_model1, rpc_model2, pix1, pix2, result);
+
+    return result;
+  }
+
+  void RPCStereoModel::refine_point_lma(RPCModel const* rpc_model1, RPCModel const* rpc_model2,
+                                        Vector2 const& pix1, Vector2 const& pix2,
+                                        Vector3& result) const {
+
+    detail::RPCTriangulateLMA model(rpc_model1, rpc_model2);
+    Vector4 objective( pix1[0], pix1[1], pix2[0], pix2[1] );
+    int status = 0;
+
+    Vector3 initialGeodetic = rpc_model1->datum().cartesian_to_geodetic(result);
+
+    // To do: Find good values for the numbers controlling the convergence
+    Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
+                                                 objective, status, 1e-3, 1e-6, 10 );
+
+    if ( status > 0 )
+      result = rpc_model1->datum().geodetic_to_cartesian(finalGeodetic);
   }
 
   Vector3 RPCStereoModel::operator()(Vector2 const& pix1, Vector2 const& pix2,
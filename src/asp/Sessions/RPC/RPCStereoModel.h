@@ -22,6 +22,8 @@
 #include <vw/Stereo/DisparityMap.h>
 #include <vw/Stereo/StereoModel.h>
 
+#include <vector>
+
 // forward declaration
 namespace vw {
   namespace camera {
@@ -31,6 +33,8 @@ namespace vw {
 
 namespace asp {
 
+  class RPCModel;
+
   class RPCStereoModel: public vw::stereo::StereoModel {
 
   public:
@@ -57,6 +61,31 @@ namespace asp {
     virtual vw::Vector3 operator()(vw::Vector2 const& pix1, vw::Vector2 const& pix2,
                                    double& error) const;
 
+    /// Triangulate many pairs of image coordinates at once, with the
+    /// same results as the above. The rays are found with the batch
+    /// RPCModel methods, and intersected with asp::triangulate_rays(),
+    /// which is much faster than doing it one pair at a time.
+    void operator()(std::vector<vw::Vector2> const& pix1,
+                    std::vector<vw::Vector2> const& pix2,
+                    std::vector<vw::Vector3> & points,
+                    std::vector<vw::Vector3> & errorVecs) const;
+
+  private:
+
+    // Intersect the rays through pix1 and pix2, and refine the result
+    // if requested.
+    vw::Vector3 triangulate_pair(RPCModel const* rpc_model1, RPCModel const* rpc_model2,
+                                 vw::Vector2 const& pix1, vw::Vector2 const& pix2,
+                                 vw::Vector3 const& origin1, vw::Vector3 const& vec1,
+                                 vw::Vector3 const& origin2, vw::Vector3 const& vec2,
+                                 vw::Vector3& errorVec) const;
+
+    // Refine a triangulated point by least squares on the pixel
+    // reprojection errors.
+    void refine_point_lma(RPCModel const* rpc_model1, RPCModel const* rpc_model2,
+                          vw::Vector2 const& pix1, vw::Vector2 const& pix2,
+                          vw::Vector3& result) const;
+
   };
 
 } // namespace asp
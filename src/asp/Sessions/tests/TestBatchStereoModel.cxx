@@ -0,0 +1,64 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Sessions/BatchStereoModel.h>
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Math/Matrix.h>
+#include <test/Helpers.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( BatchStereoModel, MatchesStereoModel ) {
+
+  // Two cameras looking down, the second one turned a bit
+  Matrix3x3 nadir = math::identity_matrix<3>();
+  Matrix3x3 turned = nadir;
+  double a = 0.05;
+  turned(0,0) = cos(a); turned(0,2) = sin(a);
+  turned(2,0) = -sin(a); turned(2,2) = cos(a);
+  camera::PinholeModel left ( Vector3(0, 0, 0),    nadir,  1000, 1000, 500, 500 );
+  camera::PinholeModel right( Vector3(100, 5, 2),  turned, 1000, 1000, 500, 500 );
+
+  std::vector<Vector2> pix1, pix2;
+  for ( int j = 0; j < 1000; j += 37 ) {
+    for ( int i = 0; i < 1000; i += 29 ) {
+      pix1.push_back( Vector2(i, j) );
+      pix2.push_back( Vector2(i - 40 - i%7, j + 0.5) );
+    }
+  }
+
+  // A pair with a NaN, and one of parallel rays
+  pix1[3] = Vector2( std::numeric_limits<double>::quiet_NaN(), 0 );
+  pix1[4] = Vector2( 500, 500 );
+  pix2[4] = Vector2( 500 - 1000*tan(a), 500 );
+
+  BatchStereoModel model( &left, &right );
+  std::vector<Vector3> points, errors;
+  model( pix1, pix2, points, errors );
+  ASSERT_EQ( pix1.size(), points.size() );
+  ASSERT_EQ( pix1.size(), errors.size() );
+
+  for ( size_t k = 0; k < pix1.size(); k++ ) {
+    Vector3 error;
+    Vector3 point = model( pix1[k], pix2[k], error );
+    EXPECT_VECTOR_NEAR( point, points[k], 1e-8 );
+    EXPECT_VECTOR_NEAR( error, errors[k], 1e-8 );
+  }
+  EXPECT_EQ( Vector3(), points[3] );
+  EXPECT_EQ( Vector3(), points[4] );
+}
@@ -16,6 +16,7 @@
 // __END_LICENSE__
 
 
+#include <asp/Core/StereoSettings.h>
 #include <asp/Sessions/DG/StereoSessionDG.h>
 #include <asp/Sessions/DG/XML.h>
 #include <asp/Sessions/RPC/RPCModel.h>
@@ -146,6 +147,45 @@ TEST(StereoSessionDG, CreateCamera) {
   EXPECT_NO_THROW( boost::shared_ptr<camera::CameraModel> cam3( session.camera_model("", "dg_example3.xml") ) );
 }
 
+TEST(StereoSessionDG, ProjectOutsideImage) {
+  StereoSessionDG session;
+
+  boost::shared_ptr<camera::CameraModel> cam1( session.camera_model("", "dg_example1.xml") );
+  ASSERT_TRUE( cam1.get() != 0 );
+
+  // Lines before the first and after the last one are found by
+  // extrapolation rather than bracketing, so check them separately.
+  for ( int i = -2000; i <= 32000; i += 4000 ) {
+    for ( int j = -1500; j <= 25500; j += 27000 ) {
+      Vector2 pix(i,j);
+      EXPECT_VECTOR_NEAR( pix,
+                          cam1->point_to_pixel( cam1->camera_center(pix) +
+                                                2e4 * cam1->pixel_to_vector(pix) ),
+                          1e-1 /*pixels*/);
+    }
+  }
+}
+
+TEST(StereoSessionDG, LineTable) {
+  StereoSessionDG session;
+
+  // The same camera, with and without the table of lines
+  boost::shared_ptr<camera::CameraModel> table_cam( session.camera_model("", "dg_example1.xml") );
+  stereo_settings().disable_dg_line_table = true;
+  boost::shared_ptr<camera::CameraModel> func_cam( session.camera_model("", "dg_example1.xml") );
+  stereo_settings().disable_dg_line_table = false;
+  ASSERT_TRUE( table_cam.get() != 0 && func_cam.get() != 0 );
+
+  // Lines between table entries, and outside of the table
+  for ( double j = -10.5; j < 24000; j += 1733.37 ) {
+    for ( double i = 0; i < 35000; i += 7000.25 ) {
+      Vector2 pix(i,j);
+      EXPECT_VECTOR_NEAR( func_cam->camera_center(pix), table_cam->camera_center(pix), 1e-4 );
+      EXPECT_VECTOR_NEAR( func_cam->pixel_to_vector(pix), table_cam->pixel_to_vector(pix), 1e-9 );
+    }
+  }
+}
+
 TEST(StereoSessionDG, ReadRPC) {
   XMLPlatformUtils::Initialize();
 
@@ -89,3 +89,61 @@ TEST( StereoSessionRPC, CheckStereo ) {
   
   EXPECT_NEAR( error, 54682.96251543280232, 1e-3 );
 }
+
+TEST( StereoSessionRPC, BatchEvaluation ) {
+
+  XMLPlatformUtils::Initialize();
+
+  RPCXML xml1;
+  xml1.read_from_file( "dg_example1.xml" );
+  RPCModel model1( *xml1.rpc_ptr() );
+
+  RPCXML xml2;
+  xml2.read_from_file( "dg_example4.xml" );
+  RPCModel model2( *xml2.rpc_ptr() );
+
+  // The batch methods must agree with the single point ones
+  std::vector<Vector2> pixels;
+  std::vector<Vector3> geodetic;
+  for ( int i = 0; i <= 35000; i += 5000 ) {
+    for ( int j = 0; j <= 24000; j += 4000 ) {
+      pixels.push_back( Vector2(i,j) );
+      geodetic.push_back( Vector3(-105.29 + 1e-6*i, 39.745 - 1e-6*j, 2000 + 0.01*i) );
+    }
+  }
+
+  std::vector<Vector2> batch_pixels;
+  model1.geodetic_to_pixel( geodetic, batch_pixels );
+  ASSERT_EQ( geodetic.size(), batch_pixels.size() );
+  for ( size_t i = 0; i < geodetic.size(); i++ )
+    EXPECT_VECTOR_NEAR( model1.geodetic_to_pixel( geodetic[i] ), batch_pixels[i], 1e-8 );
+
+  double h = 10.0;
+  std::vector<Vector2> lonlats;
+  model1.image_to_ground( pixels, h, lonlats );
+  ASSERT_EQ( pixels.size(), lonlats.size() );
+  for ( size_t i = 0; i < pixels.size(); i++ )
+    EXPECT_VECTOR_NEAR( model1.image_to_ground( pixels[i], h ), lonlats[i], 1e-12 );
+
+  std::vector<Vector3> P, dir;
+  model1.point_and_dir( pixels, P, dir );
+  ASSERT_EQ( pixels.size(), P.size() );
+  for ( size_t i = 0; i < pixels.size(); i++ ) {
+    Vector3 P0, dir0;
+    model1.point_and_dir( pixels[i], P0, dir0 );
+    EXPECT_VECTOR_NEAR( P0, P[i], 1e-6 );
+    EXPECT_VECTOR_NEAR( dir0, dir[i], 1e-12 );
+  }
+
+  RPCStereoModel RPC_stereo(&model1, &model2);
+  std::vector<Vector3> points, errors;
+  RPC_stereo( pixels, pixels, points, errors );
+  ASSERT_EQ( pixels.size(), points.size() );
+  for ( size_t i = 0; i < pixels.size(); i++ ) {
+    Vector3 error;
+    EXPECT_VECTOR_NEAR( RPC_stereo( pixels[i], pixels[i], error ), points[i], 1e-6 );
+    EXPECT_VECTOR_NEAR( error, errors[i], 1e-6 );
+  }
+
+  XMLPlatformUtils::Terminate();
+}
@@ -63,6 +63,7 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
 
@@ -442,11 +443,6 @@ double dem_height_diff(Vector3 const& xyz, GeoReference const& dem_georef,
   return std::abs(llh[2] - dem(c, r));
 }
 
-void null_check(const char* token, string const& line){
-  if (token == NULL)
-    vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-}
-
 template<typename T>
 typename PointMatcher<T>::DataPoints::Labels form_labels(int dim){
 
@@ -508,6 +504,200 @@ void random_pc_subsample(int m, typename PointMatcher<T>::DataPoints& points){
   points.features.conservativeResize(Eigen::NoChange, m);
 }
 
+// The outcome of parsing a line of a CSV file
+enum CsvLineStatus {
+  CSV_POINT,   // Read a point
+  CSV_SKIPPED, // A valid line without a usable point
+  CSV_IGNORED, // A line to ignore, which does not count as the first line
+  CSV_FAILED   // Could not parse the line
+};
+
+inline bool is_csv_separator(char c){
+  return c == ',' || c == ' ' || c == '\t';
+}
+
+// Find the next token in [ptr, end) by the same rules as strtok, and
+// advance ptr past it. Return false if there are no more tokens.
+inline bool next_csv_token(const char* & ptr, const char* end,
+                           const char* & token_begin, const char* & token_end){
+  while (ptr < end && is_csv_separator(*ptr)) ptr++;
+  if (ptr == end) return false;
+  token_begin = ptr;
+  while (ptr < end && !is_csv_separator(*ptr)) ptr++;
+  token_end = ptr;
+  return true;
+}
+
+// Parse the number at the start of [begin, end) like sscanf's %lg
+// would. Plain decimal numbers whose digits and power of ten fit
+// exactly in a double are converted directly, which is correctly
+// rounded. Anything else is handed to strtod.
+bool parse_double(const char* begin, const char* end, double & val){
+
+  const uint64 max_exact = uint64(1) << 53;
+  const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const int max_power = 22;
+
+  const char* ptr = begin;
+  bool negative = false;
+  if (ptr < end && (*ptr == '+' || *ptr == '-')){
+    negative = (*ptr == '-');
+    ptr++;
+  }
+
+  uint64 mantissa = 0;
+  int exponent = 0, num_digits = 0;
+  bool is_exact = true;
+  for (; ptr < end && *ptr >= '0' && *ptr <= '9'; ptr++){
+    num_digits++;
+    if (mantissa < max_exact) mantissa = 10*mantissa + (*ptr - '0');
+    else                      is_exact = false;
+  }
+  if (ptr < end && (*ptr == 'x' || *ptr == 'X')) is_exact = false; // hex
+  if (ptr < end && *ptr == '.'){
+    for (ptr++; ptr < end && *ptr >= '0' && *ptr <= '9'; ptr++){
+      num_digits++;
+      if (mantissa < max_exact){
+        mantissa = 10*mantissa + (*ptr - '0');
+        exponent--;
+      }else{
+        is_exact = false;
+      }
+    }
+  }
+  if (num_digits > 0 && ptr < end && (*ptr == 'e' || *ptr == 'E')){
+    const char* exp_ptr = ptr + 1;
+    bool exp_negative = false;
+    if (exp_ptr < end && (*exp_ptr == '+' || *exp_ptr == '-')){
+      exp_negative = (*exp_ptr == '-');
+      exp_ptr++;
+    }
+    if (exp_ptr < end && *exp_ptr >= '0' && *exp_ptr <= '9'){
+      int exp_val = 0;
+      for (; exp_ptr < end && *exp_ptr >= '0' && *exp_ptr <= '9'; exp_ptr++)
+        if (exp_val < 10000) exp_val = 10*exp_val + (*exp_ptr - '0');
+      exponent += exp_negative ? -exp_val : exp_val;
+    }
+  }
+
+  if (num_digits > 0 && is_exact && mantissa <= max_exact &&
+      exponent >= -max_power && exponent <= max_power){
+    val = double(mantissa);
+    if (exponent < 0) val /= powers_of_ten[-exponent];
+    else              val *= powers_of_ten[exponent];
+    if (negative) val = -val;
+    return true;
+  }
+
+  // Long mantissas, large exponents, nan, inf, etc.
+  const int bufSize = 1024;
+  char temp[bufSize];
+  int len = std::min(int(end - begin), bufSize - 1);
+  memcpy(temp, begin, len);
+  temp[len] = '\0';
+  return sscanf(temp, "%lg", &val) == 1;
+}
+
+// Parse a line of a CSV file. The lon is saved to find the mean
+// longitude of the points.
+CsvLineStatus parse_csv_line(const char* begin, const char* end,
+                             Datum const& datum, CsvConv const& C,
+                             bool is_lola_rdr_format,
+                             Vector3 & xyz, double & lon){
+
+  const char *ptr = begin, *token_begin = NULL, *token_end = NULL;
+  lon = 0.0;
+
+  if (C.csv_format_str != ""){
+    // Parse a custom CSV file
+    Vector3 vals;
+    int num_read = 0;
+    for (int col_index = 0; num_read < (int)vals.size() &&
+           next_csv_token(ptr, end, token_begin, token_end); col_index++){
+
+      // Look only at indices we are supposed to read
+      if (C.col2name.find(col_index) == C.col2name.end()) continue;
+
+      if (!parse_double(token_begin, token_end, vals[num_read]))
+        return CSV_FAILED;
+      num_read++;
+    }
+    if (num_read != (int)vals.size()) return CSV_FAILED;
+
+    // Save for the future the longitude of the point
+    if (C.lon_index >= 0 && C.lon_index < (int)vals.size()){
+      lon = vals[C.lon_index];
+    }
+
+    xyz = csv_to_cartesian(vals, datum, C);
+    return CSV_POINT;
+  }
+
+  if (!is_lola_rdr_format){
+
+    // lat,lon,height format
+    double lat = 0, height = 0;
+    int ret = 0;
+    if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+    ret += parse_double(token_begin, token_end, lat);
+    if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+    ret += parse_double(token_begin, token_end, lon);
+    if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+    ret += parse_double(token_begin, token_end, height);
+    if (ret != 3) return CSV_FAILED;
+
+    Vector3 llh( lon, lat, height );
+    xyz = datum.geodetic_to_cartesian( llh );
+    if ( xyz == Vector3() || !(xyz == xyz) ) return CSV_SKIPPED; // invalid and NaN check
+    return CSV_POINT;
+  }
+
+  // Load a RDR_*PointPerRow_csv_table.csv file used for LOLA. Code
+  // copied from Ara Nefian's lidar2dem tool.
+  // We will ignore lines which do not start with year (or a value that
+  // cannot be converted into an integer greater than zero, specifically).
+
+  int year = 0, month, day, hour, min;
+  double lat = 0, rad = 0, sec, is_invalid = 0;
+
+  if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+  const int bufSize = 1024;
+  char temp[bufSize];
+  int len = std::min(int(token_end - token_begin), bufSize - 1);
+  memcpy(temp, token_begin, len);
+  temp[len] = '\0';
+  int ret = sscanf(temp, "%d-%d-%dT%d:%d:%lg", &year, &month, &day, &hour,
+                   &min, &sec);
+  if( year <= 0 ) return CSV_IGNORED;
+
+  if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+  ret += parse_double(token_begin, token_end, lon);
+  if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+  ret += parse_double(token_begin, token_end, lat);
+  if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+  ret += parse_double(token_begin, token_end, rad);
+  rad *= 1000; // km to m
+
+  // Scan 7 more fields, until we get to the is_invalid flag.
+  for (int i = 0; i < 7; i++)
+    if (!next_csv_token(ptr, end, token_begin, token_end)) return CSV_FAILED;
+  ret += parse_double(token_begin, token_end, is_invalid);
+
+  if (ret != 10) return CSV_FAILED;
+  if (is_invalid) return CSV_SKIPPED;
+
+  Vector3 lonlatrad( lon, lat, 0 );
+  xyz = datum.geodetic_to_cartesian( lonlatrad );
+  if ( xyz == Vector3() || !(xyz == xyz) ) return CSV_SKIPPED; // invalid and NaN check
+
+  // Adjust the point so that it is at the right distance from
+  // planet center.
+  xyz = rad*(xyz/norm_2(xyz));
+  return CSV_POINT;
+}
+
 template<typename T>
 void load_csv(string const& file_name,
               int num_points_to_load,
@@ -525,39 +715,73 @@ void load_csv(string const& file_name,
 
   is_lola_rdr_format = false;
 
-  const int bufSize = 1024;
-  char temp[bufSize];
-  ifstream file( file_name.c_str() );
-  if( !file ) {
-    vw_throw( vw::IOErr() << "Unable to open file \"" << file_name << "\"" );
+  // The file is memory-mapped and split into ranges of whole lines,
+  // which are parsed in parallel. The points are then collected in
+  // file order, so the result is the same as when reading the lines
+  // one at a time.
+  boost::iostreams::mapped_file_source file;
+  const char *file_begin = NULL, *file_end = NULL;
+  if (fs::file_size(file_name) > 0){
+    try {
+      file.open(file_name);
+    } catch (std::exception const& e) {
+      vw_throw( vw::IOErr() << "Unable to open file \"" << file_name << "\"" );
+    }
+    file_begin = file.data();
+    file_end   = file_begin + file.size();
+  }
+
+  const size_t range_size = 1 << 24; // 16 MB
+  vector<const char*> range_begin(1, file_begin);
+  while (file_end - range_begin.back() > (ptrdiff_t)range_size){
+    const char* start = range_begin.back() + range_size;
+    const char* eol = (const char*)memchr(start, '\n', file_end - start);
+    if (eol == NULL) break;
+    range_begin.push_back(eol + 1);
   }
+  int num_ranges = range_begin.size();
+  range_begin.push_back(file_end);
 
   // Find how many lines are in the file
-  int num_points = 0;
-  string line;
-  while ( getline(file, line, '\n') ){
-    num_points++;
+  vector<size_t> range_lines(num_ranges);
+#pragma omp parallel for schedule(dynamic)
+  for (int r = 0; r < num_ranges; r++){
+    const char *begin = range_begin[r], *end = range_begin[r+1];
+    range_lines[r] = std::count(begin, end, '\n');
+    if (end > begin && end[-1] != '\n') range_lines[r]++;
   }
-  file.clear(); file.seekg(0, ios_base::beg); // go back to start of file
+  size_t num_points = 0;
+  for (int r = 0; r < num_ranges; r++) num_points += range_lines[r];
 
-  // We will randomly pick or not a point with probability load_ratio
+  // We will randomly pick or not a point with probability
+  // load_ratio. The draws are made in file order, so the same lines
+  // are picked as when reading the file one line at a time.
   double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_points);
-
-  data.features.conservativeResize(DIM+1, std::min(num_points_to_load, num_points));
-  data.featureLabels = form_labels<T>(DIM);
-
-  char sep[] = ", \t";
+  bool pick_all = (load_ratio >= 1.0);
+  vector<bool> picked;
+  vector<size_t> range_picked(range_lines);
+  if (!pick_all){
+    picked.resize(num_points);
+    size_t line = 0;
+    for (int r = 0; r < num_ranges; r++){
+      range_picked[r] = 0;
+      for (size_t k = 0; k < range_lines[r]; k++){
+        double rand_val = (double)std::rand()/(double)RAND_MAX;
+        picked[line] = !(rand_val > load_ratio);
+        range_picked[r] += picked[line];
+        line++;
+      }
+    }
+  }
 
   // Peek at first line and see how many elements it has
-  getline(file, line);
-  file.clear(); file.seekg(0, ios_base::beg); // go back to start of file
-  strncpy(temp, line.c_str(), bufSize);
-  const char* token = strtok (temp, sep);
+  const char* ptr = file_begin;
+  const char* first_eol = file_begin;
+  while (first_eol < file_end && *first_eol != '\n') first_eol++;
+  const char *token_begin, *token_end;
   int numTokens = 0;
-  while (token != NULL){
+  while (next_csv_token(ptr, first_eol, token_begin, token_end))
     numTokens++;
-    token = strtok (NULL, sep);
-  }
   if (numTokens < 3){
     vw_throw( vw::IOErr() << "Expecting at least three fields on each "
               << "line of file: " << file_name << "\n" );
@@ -585,155 +809,76 @@ void load_csv(string const& file_name,
               << "as expected for the Moon.\n" );
   }
 
-  bool shift_was_calc = false;
-  bool is_first_line = true;
-  int points_count = 0;
-  mean_longitude = 0.0;
-
-  while ( getline(file, line, '\n') ){
-
-    double r = (double)std::rand()/(double)RAND_MAX;
-    if (r > load_ratio) continue;
-
-    // We went with C-style file reading instead of C++ in this instance
-    // because we found it to be significantly faster on large files.
-
-    Vector3 xyz;
-    double lon;
-    
-    if (C.csv_format_str != ""){
-      // Parse a custom CSV file
-      strncpy(temp, line.c_str(), bufSize);
-
-      int col_index = -1;
-      int num_read = 0;
-      
-      char * ptr = temp;
-      Vector3 vals;
-      bool success = true;
-      while(1){
-        
-        col_index++;
-        const char* token = strtok(ptr, sep); ptr = NULL; 
-        if ( token == NULL ) break; // no more tokens
-        if ( num_read >= 3 ) break; // read enough numbers
-
-        // Look only at indices we are supposed to read
-        if (C.col2name.find(col_index) == C.col2name.end()) continue;
-
-        double val;
-        int flag = sscanf(token, "%lg", &val);
-        if (flag == 0){
-          success = false;
-          break;
-        }
-        vals[num_read] = val;
-        num_read++;
-      }
-
-      if (num_read != (int)vals.size()) success = false;
-
-      // Be prepared for the fact that the first line may be the header.
-      if (!success){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
-          continue;
-        }
-      }
-      is_first_line = false;
-
-      // Save for the future the longitude of the point
-      lon = 0.0;
-      if (C.lon_index >= 0 && C.lon_index < (int)vals.size()){
-        lon = vals[C.lon_index];
-      }
-      
-      xyz = csv_to_cartesian(vals, datum, C);
-      
-    }else if (!is_lola_rdr_format){
+  // Where the lines picked from each range start in the list of
+  // picked lines, and the first line of each range
+  vector<size_t> range_picked_start(num_ranges + 1, 0), range_line_start(num_ranges + 1, 0);
+  for (int r = 0; r < num_ranges; r++){
+    range_picked_start[r+1] = range_picked_start[r] + range_picked[r];
+    range_line_start[r+1]   = range_line_start[r]   + range_lines[r];
+  }
+  size_t num_picked = range_picked_start[num_ranges];
 
-      // lat,lon,height format
-      double lat, height;
-      
-      strncpy(temp, line.c_str(), bufSize);
-      const char* token = strtok(temp, sep); null_check(token, line);
-      int ret = sscanf(token, "%lg", &lat);
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lon);
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &height);
-
-      // Be prepared for the fact that the first line may be the header.
-      if (ret != 3){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
-          continue;
+  // Parse the picked lines. A point goes to the column of its line in
+  // the list of picked lines, with its longitude in the last row for
+  // now. The text of the first two lines in each range which fail to
+  // parse is kept for the error message.
+  data.features.conservativeResize(DIM+1, num_picked);
+  data.featureLabels = form_labels<T>(DIM);
+  vector<vw::uint8> status(num_picked);
+  vector< vector< pair<size_t, string> > > failed_lines(num_ranges);
+#pragma omp parallel for schedule(dynamic)
+  for (int r = 0; r < num_ranges; r++){
+    size_t line = range_line_start[r], out = range_picked_start[r];
+    const char *begin = range_begin[r], *end = range_begin[r+1];
+    while (begin < end){
+      const char* eol = (const char*)memchr(begin, '\n', end - begin);
+      if (eol == NULL) eol = end;
+      if (pick_all || picked[line]){
+        Vector3 xyz;
+        double lon;
+        status[out] = parse_csv_line(begin, eol, datum, C, is_lola_rdr_format, xyz, lon);
+        if (status[out] == CSV_POINT){
+          for (int row = 0; row < DIM; row++)
+            data.features(row, out) = xyz[row];
+          data.features(DIM, out) = lon;
+        }else if (status[out] == CSV_FAILED && failed_lines[r].size() < 2){
+          failed_lines[r].push_back(make_pair(out, string(begin, eol)));
         }
+        out++;
       }
-      is_first_line = false;
-
-      Vector3 llh( lon, lat, height );
-      xyz = datum.geodetic_to_cartesian( llh );
-      if ( xyz == Vector3() || !(xyz == xyz) ) continue; // invalid and NaN check
-
-    }else{
+      line++;
+      begin = eol + 1;
+    }
+  }
 
-      // Load a RDR_*PointPerRow_csv_table.csv file used for LOLA. Code
-      // copied from Ara Nefian's lidar2dem tool.
-      // We will ignore lines which do not start with year (or a value that
-      // cannot be converted into an integer greater than zero, specifically).
+  bool shift_was_calc = false;
+  bool is_first_line = true;
+  int points_count = 0;
+  mean_longitude = 0.0;
 
-      int year, month, day, hour, min;
-      double lat, rad, sec, is_invalid;
-      
-      strncpy(temp, line.c_str(), bufSize);
-      const char* token = strtok(temp, sep); null_check(token, line);
-
-      int ret = sscanf(token, "%d-%d-%dT%d:%d:%lg", &year, &month, &day, &hour,
-                       &min, &sec);
-      if( year <= 0 ) { continue; }
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lon);
-
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &lat);
-      token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &rad);
-      rad *= 1000; // km to m
-
-      // Scan 7 more fields, until we get to the is_invalid flag.
-      for (int i = 0; i < 7; i++)
-        token = strtok(NULL, sep); null_check(token, line);
-      ret += sscanf(token, "%lg", &is_invalid);
-
-      // Be prepared for the fact that the first line may be the header.
-      if (ret != 10){
-        if (!is_first_line){
-          vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
-        }else{
-          is_first_line = false;
-          continue;
-        }
+  for (size_t k = 0; k < num_picked && points_count < num_points_to_load; k++){
+
+    // Be prepared for the fact that the first line may be the header.
+    if (status[k] == CSV_IGNORED) continue;
+    if (status[k] == CSV_FAILED){
+      if (!is_first_line){
+        int r = std::upper_bound(range_picked_start.begin(), range_picked_start.end(), k)
+          - range_picked_start.begin() - 1;
+        string line;
+        for (size_t i = 0; i < failed_lines[r].size(); i++)
+          if (failed_lines[r][i].first == k) line = failed_lines[r][i].second;
+        vw_throw( vw::IOErr() << "Failed to read line: " << line << "\n" );
       }
       is_first_line = false;
-
-      if (is_invalid) continue;
-
-      Vector3 lonlatrad( lon, lat, 0 );
-      xyz = datum.geodetic_to_cartesian( lonlatrad );
-      if ( xyz == Vector3() || !(xyz == xyz) ) continue; // invalid and NaN check
-
-      // Adjust the point so that it is at the right distance from
-      // planet center.
-      xyz = rad*(xyz/norm_2(xyz));
+      continue;
     }
+    is_first_line = false;
+    if (status[k] == CSV_SKIPPED) continue;
+
+    Vector3 xyz;
+    for (int row = 0; row < DIM; row++)
+      xyz[row] = data.features(row, k);
+    double lon = data.features(DIM, k);
 
     if (calc_shift && !shift_was_calc){
       shift = xyz;
@@ -746,9 +891,6 @@ void load_csv(string const& file_name,
 
     points_count++;
     mean_longitude += lon;
-
-    if (points_count >= num_points_to_load) break;
-
   }
   data.features.conservativeResize(Eigen::NoChange, points_count);
 
@@ -77,6 +77,9 @@ struct Options : asp::BaseOptions {
   BBox2 target_projwin;
   BBox2i target_projwin_pixels;
   uint32 fsaa;
+  std::string gridding_mode_string;
+  GriddingMode gridding_mode;
+  double search_radius;
 
   // Output
   std::string  out_prefix, output_file_type;
@@ -137,6 +140,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("orthoimage", po::value(&opt.texture_filename), "Write an orthoimage based on the texture file given as an argument to this command line option")
     ("errorimage", po::bool_switch(&opt.do_error)->default_value(false), "Write a triangulation intersection error image.")
     ("fsaa", po::value(&opt.fsaa)->implicit_value(3), "Oversampling amount to perform antialiasing.")
+    ("gridding-mode", po::value(&opt.gridding_mode_string)->default_value("triangles"),
+     "How to compute the output pixels. Options: triangles (interpolate the triangulated point cloud), or bin the points into the pixels and take their mean, min, max, median, or count.")
+    ("search-radius", po::value(&opt.search_radius)->default_value(0.0),
+     "When binning points, each point contributes to the pixels whose centers are within this distance from it (in target georeferenced units). If 0, a point goes only to the pixel it falls in.")
     ("output-prefix,o", po::value(&opt.out_prefix), "Specify the output prefix.")
     ("output-filetype,t", po::value(&opt.output_file_type)->default_value("tif"), "Specify the output file")
     ("no-dem", po::bool_switch(&opt.no_dem)->default_value(false), "Skip writing a DEM.")
@@ -167,6 +174,21 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   }
   opt.dem_spacing = std::max(dem_spacing1, dem_spacing2);
 
+  boost::to_lower( opt.gridding_mode_string );
+  if      ( opt.gridding_mode_string == "triangles" ) opt.gridding_mode = GRID_TRIANGLES;
+  else if ( opt.gridding_mode_string == "mean"      ) opt.gridding_mode = GRID_MEAN;
+  else if ( opt.gridding_mode_string == "min"       ) opt.gridding_mode = GRID_MIN;
+  else if ( opt.gridding_mode_string == "max"       ) opt.gridding_mode = GRID_MAX;
+  else if ( opt.gridding_mode_string == "median"    ) opt.gridding_mode = GRID_MEDIAN;
+  else if ( opt.gridding_mode_string == "count"     ) opt.gridding_mode = GRID_COUNT;
+  else
+    vw_throw( ArgumentErr() << "Unknown gridding mode: " << opt.gridding_mode_string << ".\n"
+              << usage << general_options );
+  if ( opt.search_radius < 0 )
+    vw_throw( ArgumentErr() << "The search radius must be non-negative.\n"
+              << usage << general_options );
+  check_gridding_oversampling( opt.gridding_mode, opt.fsaa );
+
   if ( opt.pointcloud_filename.empty() )
     vw_throw( ArgumentErr() << "Missing point cloud.\n"
               << usage << general_options );
@@ -509,6 +531,20 @@ namespace asp{
 
 }
 
+// Removes a temporary file when it goes out of scope, so that the
+// file is not left behind if writing one of the products throws.
+class TemporaryFileRemover {
+  std::string m_file;
+  TemporaryFileRemover(TemporaryFileRemover const&);
+  TemporaryFileRemover& operator=(TemporaryFileRemover const&);
+public:
+  explicit TemporaryFileRemover(std::string const& file): m_file(file) {}
+  ~TemporaryFileRemover() {
+    if ( !m_file.empty() )
+      unlink( m_file.c_str() );
+  }
+};
+
 template <class ViewT>
 void do_software_rasterization( const ImageViewBase<ViewT>& proj_point_input,
                                 Options& opt,
@@ -535,6 +571,8 @@ void do_software_rasterization( const ImageViewBase<ViewT>& proj_point_input,
   if (opt.has_alpha)
     rasterizer.set_use_alpha(true);
 
+  rasterizer.set_gridding(opt.gridding_mode, opt.search_radius);
+
   // Now we are ready to specify the affine transform.
   georef.set_transform(rasterizer.geo_transform());
 
@@ -579,8 +617,60 @@ void do_software_rasterization( const ImageViewBase<ViewT>& proj_point_input,
 
   vw_out() << "\nOutput Georeference: \n\t" << georef << std::endl;
 
+  // The textures of the other products are added to the rasterizer,
+  // so that all of them are interpolated in a single traversal of
+  // the point cloud. The DEM is in the first plane.
+  int error_plane = -1, drg_plane = -1;
+  int num_channels = 0;
+  if ( opt.do_error ) {
+    num_channels = asp::get_num_channels(opt.pointcloud_filename);
+    error_plane = rasterizer.num_textures();
+    if (num_channels == 4){
+      // The error is a scalar.
+      ImageViewRef<Vector4> point_disk_image = asp::read_n_channels<4>(opt.pointcloud_filename);
+      ImageViewRef<double> error_channel = select_channel(point_disk_image,3);
+      rasterizer.add_texture( error_channel );
+    }else if (num_channels == 6){
+      // The error is a 3D vector. Convert it to NED coordinate system,
+      // and rasterize it.
+      ImageViewRef<Vector6> point_disk_image = asp::read_n_channels<6>(opt.pointcloud_filename);
+      ImageViewRef<Vector3> ned_err = asp::error_to_NED(point_disk_image, georef);
+      for (int ch_index = 0; ch_index < 3; ch_index++){
+        ImageViewRef<double> ch = select_channel(ned_err, ch_index);
+        rasterizer.add_texture(ch);
+      }
+    }else{
+      vw_throw( ArgumentErr() << "Expecting the input point cloud to have points of size 4 or 6.");
+    }
+  }
+  if (!opt.texture_filename.empty()) {
+    drg_plane = rasterizer.num_textures();
+    DiskImageView<PixelGray<float> > texture(opt.texture_filename);
+    rasterizer.add_texture(texture);
+  }
+
+  // With more than one product, render all the planes once to a
+  // temporary file, and make each product from its planes.
+  ImageViewRef<PixelGray<float> > rendered = rasterizer;
+  std::string planes_file;
+  if ( rasterizer.num_textures() > 1 )
+    planes_file = opt.out_prefix + "-rasterized-tmp.tif";
+  TemporaryFileRemover planes_file_remover(planes_file);
+  if ( !planes_file.empty() ) {
+    vw_out() << "Rendering " << rasterizer.num_textures()
+             << " planes to: " << planes_file << "\n";
+    Stopwatch sw2;
+    sw2.start();
+    asp::block_write_gdal_image( planes_file, rasterizer, opt,
+                                 TerminalProgressCallback("asp", "Rasterizing: ") );
+    sw2.stop();
+    vw_out(DebugMessage,"asp") << "Render time: "
+                               << sw2.elapsed_seconds() << std::endl;
+    rendered = DiskImageView<PixelGray<float> >(planes_file);
+  }
+
   ImageViewRef<PixelGray<float> > rasterizer_fsaa =
-    generate_fsaa_raster( rasterizer, opt );
+    generate_fsaa_raster( select_plane(rendered, 0), opt );
   vw_out()<< "Creating output file that is " << bounding_box(rasterizer_fsaa).size() << " px.\n";
 
   if ( !opt.no_dem ) { // Write out the DEM. (Normally users want this.)
@@ -598,52 +688,31 @@ void do_software_rasterization( const ImageViewBase<ViewT>& proj_point_input,
 
   // Write triangulation error image if requested
   if ( opt.do_error ) {
-    int num_channels = asp::get_num_channels(opt.pointcloud_filename);
-
     if (num_channels == 4){
-      // The error is a scalar.
-      DiskImageView<Vector4> point_disk_image(opt.pointcloud_filename);
-      ImageViewRef<double> error_channel = select_channel(point_disk_image,3);
-      rasterizer.set_texture( error_channel );
-      rasterizer_fsaa = generate_fsaa_raster( rasterizer, opt );
+      rasterizer_fsaa = generate_fsaa_raster( select_plane(rendered, error_plane), opt );
       save_image(opt,
                  asp::round_image_pixels_skip_nodata(rasterizer_fsaa,
                                                      opt.rounding_error,
                                                      opt.nodata_value),
                  georef, "IntersectionErr");
-    }else if (num_channels == 6){
-      // The error is a 3D vector. Convert it to NED coordinate system,
-      // and rasterize it.
-      DiskImageView<Vector6> point_disk_image(opt.pointcloud_filename);
-      ImageViewRef<Vector3> ned_err = asp::error_to_NED(point_disk_image, georef);
+    }else{
       std::vector< ImageViewRef<PixelGray<float> > >  rasterized(3);
-      for (int ch_index = 0; ch_index < 3; ch_index++){
-        // Cache the channel to disk, to force the rasterization
-        // to happen right away, before we switch to the next one.
-        ImageViewRef<double> ch = select_channel(ned_err, ch_index);
-        rasterizer.set_texture(ch);
-        rasterizer_fsaa = generate_fsaa_raster( rasterizer, opt );
+      for (int ch_index = 0; ch_index < 3; ch_index++)
         rasterized[ch_index] =
-          block_cache(rasterizer_fsaa,Vector2i(vw_settings().default_tile_size(),
-                                               vw_settings().default_tile_size()),0);
-      }
+          generate_fsaa_raster( select_plane(rendered, error_plane + ch_index), opt );
       save_image(opt,
                  asp::round_image_pixels_skip_nodata
                  (asp::combine_channels(opt.nodata_value,
                                         rasterized[0], rasterized[1], rasterized[2]),
                   opt.rounding_error, opt.nodata_value),
                  georef, "IntersectionErr");
-    }else{
-      vw_throw( ArgumentErr() << "Expecting the input point cloud to have points of size 4 or 6.");
     }
   }
 
   // Write DRG if the user requested and provided a texture file
   if (!opt.texture_filename.empty()) {
-    DiskImageView<PixelGray<float> > texture(opt.texture_filename);
-    rasterizer.set_texture(texture);
     rasterizer_fsaa =
-      generate_fsaa_raster( rasterizer, opt );
+      generate_fsaa_raster( select_plane(rendered, drg_plane), opt );
     std::string output_file = opt.out_prefix + "-DRG.tif";
     vw_out() << "Writing DRG: " << output_file << "\n";
     boost::scoped_ptr<DiskImageResourceGDAL> rsrc( asp::build_gdal_rsrc( output_file, rasterizer_fsaa, opt ) );
@@ -29,6 +29,8 @@
 #include <asp/Core/Common.h>
 #include <asp/Tools/point2dem.h> // We share common functions with point2dem
 
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO.h>
 #include <vw/Image.h>
 #include <vw/Math.h>
@@ -52,6 +54,66 @@ struct Options : asp::BaseOptions {
   std::string out_prefix;
 };
 
+// Grow the bounding box of the cloud by the valid points of a block
+template <class ViewT>
+class PointCloudBBoxTask : public Task, private boost::noncopyable {
+  ViewT m_view;
+  BBox2i m_block;
+  BBox3 & m_bbox;
+  Mutex & m_mutex;
+
+public:
+  PointCloudBBoxTask( ImageViewBase<ViewT> const& view, BBox2i const& block,
+                      BBox3 & bbox, Mutex & mutex ) :
+    m_view(view.impl()), m_block(block), m_bbox(bbox), m_mutex(mutex) {}
+
+  void operator()() {
+    ImageView<Vector3> points = crop( m_view, m_block );
+    BBox3 local_bbox;
+    bool has_points = false;
+    for (int row = 0; row < points.rows(); row++){
+      for (int col = 0; col < points.cols(); col++){
+        if ( points(col, row) == Vector3() ) continue;
+        local_bbox.grow( points(col, row) );
+        has_points = true;
+      }
+    }
+    if ( !has_points ) return;
+    Mutex::Lock lock( m_mutex );
+    m_bbox.grow( local_bbox );
+  }
+};
+
+// Convert the valid points of a block to the integer coordinates
+// stored in the LAS file
+template <class ViewT>
+class QuantizePointsTask : public Task, private boost::noncopyable {
+  ViewT m_view;
+  BBox2i m_block;
+  Vector3 m_offset, m_scale;
+  std::vector<Vector3> & m_las_points;
+
+public:
+  QuantizePointsTask( ImageViewBase<ViewT> const& view, BBox2i const& block,
+                      Vector3 const& offset, Vector3 const& scale,
+                      std::vector<Vector3> & las_points ) :
+    m_view(view.impl()), m_block(block), m_offset(offset), m_scale(scale),
+    m_las_points(las_points) {}
+
+  void operator()() {
+    ImageView<Vector3> points = crop( m_view, m_block );
+    for (int row = 0; row < points.rows(); row++){
+      for (int col = 0; col < points.cols(); col++){
+
+        Vector3 point = points(col, row);
+        if ( point == Vector3() ) continue; // skip no-data points
+
+        m_las_points.push_back( round( elem_quot((point - m_offset), m_scale) ) );
+      }
+    }
+  }
+};
+
 void handle_arguments( int argc, char *argv[], Options& opt ) {
 
   po::options_description general_options("General Options");
@@ -93,16 +155,30 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 
 int main( int argc, char *argv[] ) {
 
-  // To do: need to understand what is the optimal strategy for
-  // traversing the input point cloud file to minimize the reading
-  // time.
-
   Options opt;
   try {
     handle_arguments( argc, argv, opt );
 
     ImageViewRef<Vector3> point_image = asp::read_n_channels<3>(opt.pointcloud_filename);
-    BBox3 cloud_bbox = pointcloud_bbox(point_image);
+
+    // The cloud is processed block by block on a thread pool. Only
+    // writing the points to the file is serial.
+    std::vector<BBox2i> blocks =
+      image_blocks( point_image, opt.raster_tile_size[0], opt.raster_tile_size[1] );
+    int num_threads = vw_settings().default_num_threads();
+    FifoWorkQueue queue( num_threads );
+
+    BBox3 cloud_bbox;
+    {
+      typedef PointCloudBBoxTask< ImageViewRef<Vector3> > task_type;
+      Mutex mutex;
+      for ( size_t i = 0; i < blocks.size(); i++ ) {
+        boost::shared_ptr<task_type>
+          task( new task_type( point_image, blocks[i], cloud_bbox, mutex ) );
+        queue.add_task( task );
+      }
+      queue.join_all();
+    }
 
     // The las format stores the values as 32 bit integers. So, for a
     // given point, we store round((point-offset)/scale), as well as
@@ -137,29 +213,41 @@ int main( int argc, char *argv[] ) {
     ofs.open(lasFile.c_str(), std::ios::out | std::ios::binary);
     liblas::Writer writer(ofs, header);
 
-    TerminalProgressCallback progress_bar("asp","LAS: ");
-    for (int row = 0; row < point_image.rows(); row++){
-      progress_bar.report_fractional_progress(row, point_image.rows());
-      for (int col = 0; col < point_image.cols(); col++){
-
-        Vector3 point = point_image(col, row);
-        if ( point == Vector3() ) continue; // skip no-data points
-
-#if 0
-        // For comparison later with las2txt.
-        std::cout.precision(16);
-        std::cout << "\npoint " << point[0] << ' ' << point[1] << ' '
-                  << point[2] << std::endl;
-#endif
-
-        point = round( elem_quot((point - offset), scale) );
+    // Quantize the blocks a batch at a time. While one batch is
+    // written, in block order, the next one is being quantized.
+    typedef QuantizePointsTask< ImageViewRef<Vector3> > task_type;
+    size_t num_blocks = blocks.size();
+    size_t batch_size = 4*std::max(num_threads, 1);
+    std::vector< std::vector<Vector3> > las_points( num_blocks );
+    for ( size_t i = 0; i < std::min(batch_size, num_blocks); i++ ) {
+      boost::shared_ptr<task_type>
+        task( new task_type( point_image, blocks[i], offset, scale, las_points[i] ) );
+      queue.add_task( task );
+    }
 
-        liblas::Point las_point;
-        las_point.SetCoordinates(point[0], point[1], point[2]);
-        writer.WritePoint(las_point);
+    TerminalProgressCallback progress_bar("asp","LAS: ");
+    for ( size_t batch_start = 0; batch_start < num_blocks; batch_start += batch_size ) {
+      queue.join_all();
+
+      size_t batch_end = std::min(batch_start + batch_size, num_blocks);
+      for ( size_t i = batch_end; i < std::min(batch_end + batch_size, num_blocks); i++ ) {
+        boost::shared_ptr<task_type>
+          task( new task_type( point_image, blocks[i], offset, scale, las_points[i] ) );
+        queue.add_task( task );
+      }
 
+      for ( size_t i = batch_start; i < batch_end; i++ ) {
+        progress_bar.report_fractional_progress(i, num_blocks);
+        for ( size_t j = 0; j < las_points[i].size(); j++ ) {
+          Vector3 const& point = las_points[i][j];
+          liblas::Point las_point;
+          las_point.SetCoordinates(point[0], point[1], point[2]);
+          writer.WritePoint(las_point);
+        }
+        std::vector<Vector3>().swap( las_points[i] ); // free the memory
       }
     }
+    queue.join_all();
     progress_bar.report_finished();
 
   } ASP_STANDARD_CATCHES;
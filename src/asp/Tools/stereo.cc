@@ -257,11 +257,34 @@ namespace asp {
     }
     
     // Seed mode valid values
-    if ( stereo_settings().seed_mode > 3 ){
+    if ( stereo_settings().seed_mode > 4 ){
       vw_throw( ArgumentErr() << "Invalid value for seed-mode: "
                 << stereo_settings().seed_mode << ".\n" );
     }
 
+    // Cost mode valid values
+    if ( stereo_settings().cost_mode > 3 ){
+      vw_throw( ArgumentErr() << "Invalid value for cost-mode: "
+                << stereo_settings().cost_mode << ".\n" );
+    }
+
+    // Hole filling method valid values
+    if ( stereo_settings().fill_holes_method < 0 ||
+         stereo_settings().fill_holes_method > 1 ){
+      vw_throw( ArgumentErr() << "Invalid value for fill-holes-method: "
+                << stereo_settings().fill_holes_method << ".\n" );
+    }
+
+    // Semi-global matching penalties. The upper bound keeps the
+    // aggregated costs within 16 bits.
+    if ( stereo_settings().cost_mode == 3 &&
+         ( stereo_settings().sgm_penalty1 < 0 ||
+           stereo_settings().sgm_penalty2 < stereo_settings().sgm_penalty1 ||
+           stereo_settings().sgm_penalty2 > 8000 ) ){
+      vw_throw( ArgumentErr() << "The semi-global matching penalties must satisfy "
+                << "0 <= sgm-penalty1 <= sgm-penalty2 <= 8000.\n" );
+    }
+
     // Local homography needs D_sub
     if ( stereo_settings().seed_mode == 0 &&
          stereo_settings().use_local_homography ){
@@ -0,0 +1,886 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file stereo_bench.cc
+///
+/// Time the kernels behind each stereo stage, point2dem and pc_align
+/// on a synthetic scene generated in memory, so that performance can
+/// be compared between builds without any input data. The results are
+/// written as CSV, one line per kernel.
+///
+/// The scene is a pair of nadir pinhole cameras over a terrain with a
+/// random texture, for which the disparity, the heights and the point
+/// cloud are known exactly, and a pair of RPC cameras over the same
+/// terrain. Each kernel starts from the ground truth rather than from
+/// the output of the previous one, so that any subset of them can be
+/// run, and reports its error against the ground truth as a sanity
+/// check.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Cartography/Datum.h>
+#include <vw/Image.h>
+#include <vw/Math.h>
+#include <vw/Stereo/CorrelationView.h>
+#include <vw/Stereo/CostFunctions.h>
+#include <vw/Stereo/DisparityMap.h>
+#include <vw/Stereo/PreFilter.h>
+#include <vw/Stereo/StereoModel.h>
+#include <vw/Stereo/SubpixelView.h>
+
+#include <asp/Core/BlobIndexThreaded.h>
+#include <asp/Core/BlockCorrelation.h>
+#include <asp/Core/Common.h>
+#include <asp/Core/InpaintView.h>
+#include <asp/Core/Macros.h>
+#include <asp/Core/OrthoRasterizer.h>
+#include <asp/Core/SemiGlobalMatching.h>
+#include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Sessions/BatchStereoModel.h>
+#include <asp/Sessions/RPC/RPCModel.h>
+#include <asp/Sessions/RPC/RPCStereoModel.h>
+
+#include <pointmatcher/PointMatcher.h>
+
+using namespace vw;
+namespace po = boost::program_options;
+
+typedef PointMatcher<double> PM;
+typedef PM::DataPoints DP;
+
+struct Options : asp::BaseOptions {
+  int size, trials;
+  std::string kernels, output_file;
+};
+
+namespace {
+
+  // The pinhole cameras are at this altitude above the zero height,
+  // separated by the baseline along x. All distances are in meters.
+  const double FOCAL_LENGTH    = 1000.0;
+  const double CAMERA_ALTITUDE = 1000.0;
+  const double BASELINE        = 20.0;
+
+  // Parameters of the kernels, the defaults of the stereo tools
+  const float  PREFILTER_WIDTH  = 1.5;
+  const int    XCORR_THRESHOLD  = 2;
+  const int    CORR_MAX_LEVELS  = 5;
+  const int    SGM_PENALTY1     = 8;
+  const int    SGM_PENALTY2     = 64;
+  const int    SUBPIXEL_LEVELS  = 2;
+  const int    RM_HALF_KERNEL   = 5;
+  const double RM_THRESHOLD     = 3.0;
+  const double RM_MIN_MATCHES   = 0.6;
+  const int    FILL_HOLE_SIZE   = 100000;
+
+  // The expensive kernels run on the central part of the scene only
+  const int SGM_MAX_SIZE      = 512;
+  const int BAYES_EM_MAX_SIZE = 256;
+
+  inline float lattice_value( int i, int j, uint32 seed ) {
+    uint32 h = uint32(i)*73856093u ^ uint32(j)*19349663u ^ seed*83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return float(h & 0xffffff) / float(0x1000000);
+  }
+
+  // Bilinear interpolation of random values on the integer lattice
+  float value_noise( double x, double y, uint32 seed ) {
+    double fx = std::floor(x), fy = std::floor(y);
+    int i = int(fx), j = int(fy);
+    double a = x - fx, b = y - fy;
+    return (1-a)*(1-b)*lattice_value(i,   j,   seed) + a*(1-b)*lattice_value(i+1, j,   seed)
+      +    (1-a)*b    *lattice_value(i,   j+1, seed) + a*b    *lattice_value(i+1, j+1, seed);
+  }
+
+  // The texture is continuous, so it can be sampled at fractional
+  // pixels, and never zero, which is the no-data value.
+  float texture( double x, double y ) {
+    return 0.1 + 0.5*value_noise(x/3.0, y/3.0, 1) + 0.4*value_noise(x/11.0, y/11.0, 2);
+  }
+
+  // Terrain height seen by a pixel of the left image: rolling hills
+  // and a mountain.
+  double terrain_height( double x, double y, int size ) {
+    double mx = x - 0.3*size, my = y - 0.6*size;
+    return 150.0 + 100.0*std::sin(2*M_PI*x/400.0)*std::cos(2*M_PI*y/300.0)
+      + 60.0*std::exp(-(mx*mx + my*my)/(2*80.0*80.0));
+  }
+
+  // The horizontal disparity of a left pixel seeing the given height
+  inline double true_disparity( double height ) {
+    return -FOCAL_LENGTH*BASELINE/(CAMERA_ALTITUDE - height);
+  }
+
+  struct SyntheticScene {
+    int size;
+
+    // The pinhole pair. Both cameras look straight down. The right
+    // one is displaced by the baseline along x, so the disparity is
+    // horizontal.
+    camera::PinholeModel left_camera, right_camera;
+    ImageView<float> left_image, right_image;
+    ImageView<uint8> left_mask, right_mask;
+    BBox2i search_range;
+
+    // Ground truth. The disparity is invalid where the left image has
+    // no data, or the left pixel is not seen in the right image.
+    ImageView<float> height;
+    ImageView<PixelMask<Vector2f> > disparity;
+    ImageView<Vector3> point_cloud; // Vector3() where invalid
+
+    // Damaged disparities for the filtering kernels
+    ImageView<PixelMask<Vector2f> > noisy_disparity, holey_disparity;
+
+    // The RPC pair, and ground points inside the area they see
+    boost::shared_ptr<asp::RPCModel> left_rpc, right_rpc;
+    std::vector<Vector3> rpc_lonlatheights;
+    std::vector<Vector2> rpc_left_pixels, rpc_right_pixels;
+  };
+
+  // An RPC camera over a small area of the WGS84 ellipsoid. The
+  // sample depends on the height with the given factor, so two
+  // cameras with opposite factors form a stereo pair.
+  boost::shared_ptr<asp::RPCModel> synthetic_rpc( int size, double parallax ) {
+    asp::RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
+    line_num.set_all(0.0); line_den.set_all(0.0);
+    samp_num.set_all(0.0); samp_den.set_all(0.0);
+    line_num[2] = -1.0;     // lat
+    line_num[4] = 0.002;    // lon*lat
+    line_den[0] = 1.0;
+    samp_num[1] = 1.0;      // lon
+    samp_num[3] = parallax; // height
+    samp_num[7] = 0.003;    // lon^2
+    samp_den[0] = 1.0;
+    samp_den[3] = 0.001;    // height
+    return boost::shared_ptr<asp::RPCModel>
+      ( new asp::RPCModel( cartography::Datum("WGS84"),
+                           line_num, line_den, samp_num, samp_den,
+                           Vector2(size/2.0, size/2.0), Vector2(size/2.0, size/2.0),
+                           Vector3(-105.0, 39.0, 150.0), Vector3(0.005, 0.005, 200.0) ) );
+  }
+
+  void generate_scene( int size, SyntheticScene & scene ) {
+
+    scene.size = size;
+    double cu = size/2.0, cv = size/2.0;
+    Matrix3x3 nadir = math::identity_matrix<3>();
+    nadir(1,1) = -1;
+    nadir(2,2) = -1;
+    scene.left_camera  = camera::PinholeModel( Vector3(0, 0, CAMERA_ALTITUDE), nadir,
+                                               FOCAL_LENGTH, FOCAL_LENGTH, cu, cv );
+    scene.right_camera = camera::PinholeModel( Vector3(BASELINE, 0, CAMERA_ALTITUDE), nadir,
+                                               FOCAL_LENGTH, FOCAL_LENGTH, cu, cv );
+
+    scene.left_image.set_size(size, size);
+    scene.right_image.set_size(size, size);
+    scene.left_mask.set_size(size, size);
+    scene.right_mask.set_size(size, size);
+    scene.height.set_size(size, size);
+    scene.disparity.set_size(size, size);
+    scene.point_cloud.set_size(size, size);
+
+    double min_disp = std::numeric_limits<double>::max(), max_disp = -min_disp;
+    for (int row = 0; row < size; row++){
+      // A jagged no-data strip along the left edge, for the edge mask
+      int nodata_cols = 16 + (row % 64)/4;
+      for (int col = 0; col < size; col++){
+        double h = terrain_height(col, row, size);
+        double d = true_disparity(h);
+        min_disp = std::min(min_disp, d);
+        max_disp = std::max(max_disp, d);
+        scene.height(col, row) = h;
+
+        bool valid = ( col >= nodata_cols );
+        scene.left_image(col, row) = valid ? texture(col, row) : 0.0;
+        scene.left_mask (col, row) = valid ? 255 : 0;
+        scene.right_mask(col, row) = 255;
+
+        scene.point_cloud(col, row) = Vector3();
+        scene.disparity  (col, row) = PixelMask<Vector2f>();
+        if ( !valid || col + d < 0 ) continue;
+        scene.disparity(col, row) = PixelMask<Vector2f>(Vector2f(d, 0));
+        double depth = CAMERA_ALTITUDE - h;
+        scene.point_cloud(col, row) = Vector3( (col - cu)*depth/FOCAL_LENGTH,
+                                               -(row - cv)*depth/FOCAL_LENGTH, h );
+      }
+
+      // The right pixel x sees the left pixel x - d(x - d). That is a
+      // contraction, as the disparity varies slowly.
+      for (int col = 0; col < size; col++){
+        double x = col - min_disp;
+        for (int i = 0; i < 10; i++)
+          x = col - true_disparity(terrain_height(x, row, size));
+        scene.right_image(col, row) = texture(x, row);
+      }
+    }
+    scene.search_range = BBox2i( Vector2i(int(std::floor(min_disp)) - 2, -2),
+                                 Vector2i(int(std::ceil (max_disp)) + 2,  2) );
+
+    // Outliers in a small fraction of the pixels, and round holes of
+    // many sizes.
+    scene.noisy_disparity = copy(scene.disparity);
+    scene.holey_disparity = copy(scene.disparity);
+    for (int row = 0; row < size; row++){
+      for (int col = 0; col < size; col++){
+        if ( lattice_value(col, row, 3) < 0.02 && is_valid(scene.noisy_disparity(col, row)) )
+          scene.noisy_disparity(col, row).child() +=
+            Vector2f( 30*lattice_value(col, row, 4) - 15, 6*lattice_value(col, row, 5) - 3 );
+      }
+    }
+    int num_holes = std::max(1, size*size/(64*64));
+    for (int i = 0; i < num_holes; i++){
+      int hx = int(size*lattice_value(i, 0, 6));
+      int hy = int(size*lattice_value(i, 0, 7));
+      int r  = 3 + int(17*lattice_value(i, 0, 8));
+      for (int row = std::max(0, hy - r); row < std::min(size, hy + r + 1); row++){
+        for (int col = std::max(0, hx - r); col < std::min(size, hx + r + 1); col++){
+          if ( (col - hx)*(col - hx) + (row - hy)*(row - hy) <= r*r )
+            invalidate( scene.holey_disparity(col, row) );
+        }
+      }
+    }
+
+    // Ground points of the terrain seen by the RPC pair
+    scene.left_rpc  = synthetic_rpc(size,  0.2);
+    scene.right_rpc = synthetic_rpc(size, -0.2);
+    int step = 2;
+    scene.rpc_lonlatheights.clear();
+    for (int row = 0; row < size; row += step){
+      for (int col = 0; col < size; col += step){
+        double lon = -105.0 + 0.009*(col/double(size) - 0.5);
+        double lat =   39.0 - 0.009*(row/double(size) - 0.5);
+        scene.rpc_lonlatheights.push_back( Vector3(lon, lat, terrain_height(col, row, size)) );
+      }
+    }
+    scene.left_rpc ->geodetic_to_pixel( scene.rpc_lonlatheights, scene.rpc_left_pixels  );
+    scene.right_rpc->geodetic_to_pixel( scene.rpc_lonlatheights, scene.rpc_right_pixels );
+  }
+
+  double nan_value() { return std::numeric_limits<double>::quiet_NaN(); }
+
+  BBox2i central_box( int size, int max_size ) {
+    int s = std::min(size, max_size);
+    return BBox2i( (size - s)/2, (size - s)/2, s, s );
+  }
+
+  // Fraction of the valid pixels of the disparity further than one
+  // pixel from the truth
+  template <class DispT>
+  double bad_pixel_fraction( ImageView<DispT> const& disp,
+                             ImageView<PixelMask<Vector2f> > const& truth,
+                             Vector2i const& origin ) {
+    double num_valid = 0, num_bad = 0;
+    for (int row = 0; row < disp.rows(); row++){
+      for (int col = 0; col < disp.cols(); col++){
+        PixelMask<Vector2f> t = truth(col + origin.x(), row + origin.y());
+        if ( !is_valid(disp(col, row)) || !is_valid(t) ) continue;
+        num_valid++;
+        if ( norm_2( Vector2(disp(col, row).child()) - Vector2(t.child()) ) > 1.0 )
+          num_bad++;
+      }
+    }
+    return num_valid > 0 ? num_bad/num_valid : nan_value();
+  }
+
+  // Mean distance from the truth of the valid disparities. If a
+  // reference is given, only the pixels invalid in it are counted.
+  double mean_disparity_error( ImageView<PixelMask<Vector2f> > const& disp,
+                               ImageView<PixelMask<Vector2f> > const& truth,
+                               Vector2i const& origin,
+                               ImageView<PixelMask<Vector2f> > const* reference = NULL ) {
+    double count = 0, sum = 0;
+    for (int row = 0; row < disp.rows(); row++){
+      for (int col = 0; col < disp.cols(); col++){
+        PixelMask<Vector2f> t = truth(col + origin.x(), row + origin.y());
+        if ( !is_valid(disp(col, row)) || !is_valid(t) ) continue;
+        if ( reference && is_valid((*reference)(col, row)) ) continue;
+        count++;
+        sum += norm_2( Vector2(disp(col, row).child()) - Vector2(t.child()) );
+      }
+    }
+    return count > 0 ? sum/count : nan_value();
+  }
+
+  struct KernelResult {
+    double num_items; // pixels or points processed
+    double error;     // against the ground truth, NaN if not applicable
+    KernelResult() : num_items(0), error(nan_value()) {}
+  };
+
+  //------------------------------------------------------------------
+  // The kernels. Only the work between sw.start() and sw.stop() is
+  // timed, not the setup and the error computation.
+  //------------------------------------------------------------------
+
+  // stereo_pprc: edge mask and normalization of the left image
+  KernelResult pprc_mask_normalize( SyntheticScene const& scene, Options const& opt,
+                                    Stopwatch & sw ) {
+    KernelResult result;
+    sw.start();
+    ImageView<PixelMask<uint8> > mask =
+      block_rasterize( copy_mask( constant_view(uint8(255), scene.size, scene.size),
+                                  asp::threaded_edge_mask(scene.left_image, 0, 0, 1024) ),
+                       opt.raster_tile_size, opt.num_threads );
+    float lo, hi;
+    min_max_channel_values( scene.left_image, lo, hi );
+    ImageView<float> normalized =
+      block_rasterize( normalize( scene.left_image, lo, hi, 0.0, 1.0 ),
+                       opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    // The error is the fraction of pixels with the wrong mask
+    double num_wrong = 0;
+    for (int row = 0; row < scene.size; row++)
+      for (int col = 0; col < scene.size; col++)
+        num_wrong += ( is_valid(mask(col, row)) != (scene.left_mask(col, row) != 0) );
+    result.num_items = double(scene.size)*scene.size;
+    result.error = num_wrong/result.num_items;
+    return result;
+  }
+
+  // stereo_corr: pyramid block correlation
+  KernelResult corr_block( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    KernelResult result;
+    typedef stereo::PyramidCorrelationView<ImageView<float>, ImageView<float>,
+                                           ImageView<uint8>, ImageView<uint8>,
+                                           stereo::LaplacianOfGaussian> CorrView;
+    sw.start();
+    CorrView corr_view( scene.left_image, scene.right_image,
+                        scene.left_mask, scene.right_mask,
+                        stereo::LaplacianOfGaussian(PREFILTER_WIDTH), scene.search_range,
+                        Vector2i(21, 21), stereo::CROSS_CORRELATION,
+                        0, 0.0, XCORR_THRESHOLD, CORR_MAX_LEVELS );
+    ImageView<PixelMask<Vector2i> > disp =
+      block_rasterize( corr_view, opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    result.num_items = double(scene.size)*scene.size;
+    result.error = bad_pixel_fraction( disp, scene.disparity, Vector2i() );
+    return result;
+  }
+
+  // The inputs of the tile matchers for the given box. The left
+  // region is grown by the kernel, and the right one in addition by
+  // the search range.
+  struct MatchingCrops {
+    ImageView<float> left, right;
+    ImageView<uint8> left_mask, right_mask;
+    MatchingCrops( SyntheticScene const& scene, BBox2i const& box, Vector2i const& kernel ) {
+      Vector2i half_kernel = kernel/2;
+      BBox2i left_box = box;
+      left_box.min() -= half_kernel;
+      left_box.max() += half_kernel;
+      BBox2i right_box = left_box + scene.search_range.min();
+      right_box.max() += scene.search_range.size();
+      left       = crop( edge_extend(scene.left_image,  ZeroEdgeExtension()), left_box  );
+      right      = crop( edge_extend(scene.right_image, ZeroEdgeExtension()), right_box );
+      left_mask  = crop( edge_extend(scene.left_mask,  ZeroEdgeExtension()), left_box  );
+      right_mask = crop( edge_extend(scene.right_mask, ZeroEdgeExtension()), right_box );
+    }
+  };
+
+  // stereo_corr: box-filter block correlation, on the same region as
+  // semi-global matching
+  KernelResult corr_box_filter( SyntheticScene const& scene, Options const& /*opt*/,
+                                Stopwatch & sw ) {
+    KernelResult result;
+    BBox2i box = central_box( scene.size, SGM_MAX_SIZE );
+    Vector2i kernel(21, 21);
+    MatchingCrops crops( scene, box, kernel );
+
+    sw.start();
+    stereo::LaplacianOfGaussian prefilter(PREFILTER_WIDTH);
+    ImageView<float> left  = prefilter.filter( crops.left  );
+    ImageView<float> right = prefilter.filter( crops.right );
+    ImageView<PixelMask<Vector2i> > disp =
+      asp::block_correlation( left, right, crops.left_mask, crops.right_mask,
+                              scene.search_range, kernel, stereo::CROSS_CORRELATION,
+                              XCORR_THRESHOLD );
+    sw.stop();
+
+    result.num_items = double(box.width())*box.height();
+    result.error = bad_pixel_fraction( disp, scene.disparity, box.min() );
+    return result;
+  }
+
+  // stereo_corr: semi-global matching
+  KernelResult corr_sgm( SyntheticScene const& scene, Options const& /*opt*/, Stopwatch & sw ) {
+    KernelResult result;
+    BBox2i box = central_box( scene.size, SGM_MAX_SIZE );
+    Vector2i census_kernel( asp::SGM_MAX_CENSUS_WIDTH, asp::SGM_MAX_CENSUS_HEIGHT );
+    MatchingCrops crops( scene, box, census_kernel );
+    ImageView<float> const& left  = crops.left;
+    ImageView<float> const& right = crops.right;
+    ImageView<uint8> const& left_mask  = crops.left_mask;
+    ImageView<uint8> const& right_mask = crops.right_mask;
+
+    sw.start();
+    ImageView<PixelMask<Vector2i> > disp =
+      asp::semi_global_matching( left, right, left_mask, right_mask,
+                                 scene.search_range, census_kernel,
+                                 SGM_PENALTY1, SGM_PENALTY2, XCORR_THRESHOLD );
+    sw.stop();
+
+    result.num_items = double(box.width())*box.height();
+    result.error = bad_pixel_fraction( disp, scene.disparity, box.min() );
+    return result;
+  }
+
+  // The truth rounded to integers, the input of subpixel refinement
+  ImageView<PixelMask<Vector2i> > integer_disparity( SyntheticScene const& scene, BBox2i const& box ) {
+    ImageView<PixelMask<Vector2i> > disp( box.width(), box.height() );
+    for (int row = 0; row < box.height(); row++){
+      for (int col = 0; col < box.width(); col++){
+        PixelMask<Vector2f> t = scene.disparity(col + box.min().x(), row + box.min().y());
+        if ( !is_valid(t) ) continue;
+        disp(col, row) = PixelMask<Vector2i>( Vector2i( int(std::floor(t.child()[0] + 0.5)),
+                                                        int(std::floor(t.child()[1] + 0.5)) ) );
+      }
+    }
+    return disp;
+  }
+
+  // stereo_rfne: parabola subpixel refinement
+  KernelResult rfne_parabola( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    KernelResult result;
+    BBox2i box = bounding_box( scene.left_image );
+    ImageView<PixelMask<Vector2i> > int_disp = integer_disparity( scene, box );
+
+    sw.start();
+    ImageView<PixelMask<Vector2f> > disp =
+      block_rasterize( parabola_subpixel( int_disp, scene.left_image, scene.right_image,
+                                          stereo::LaplacianOfGaussian(PREFILTER_WIDTH),
+                                          Vector2i(35, 35) ),
+                       opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    result.num_items = double(box.width())*box.height();
+    result.error = mean_disparity_error( disp, scene.disparity, box.min() );
+    return result;
+  }
+
+  // stereo_rfne: Bayes EM subpixel refinement
+  KernelResult rfne_bayes_em( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    KernelResult result;
+    BBox2i box = central_box( scene.size, BAYES_EM_MAX_SIZE );
+    ImageView<PixelMask<Vector2i> > int_disp = integer_disparity( scene, box );
+    ImageView<float> left  = crop( scene.left_image,  box );
+    ImageView<float> right = crop( scene.right_image, box );
+
+    sw.start();
+    ImageView<PixelMask<Vector2f> > disp =
+      block_rasterize( bayes_em_subpixel( int_disp, left, right,
+                                          stereo::LaplacianOfGaussian(PREFILTER_WIDTH),
+                                          Vector2i(35, 35), SUBPIXEL_LEVELS ),
+                       opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    result.num_items = double(box.width())*box.height();
+    result.error = mean_disparity_error( disp, scene.disparity, box.min() );
+    return result;
+  }
+
+  // stereo_fltr: outlier removal. The error is the fraction of the
+  // remaining pixels which are outliers.
+  KernelResult fltr_cleanup( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    KernelResult result;
+    sw.start();
+    ImageView<PixelMask<Vector2f> > disp =
+      block_rasterize( stereo::disparity_cleanup_using_thresh
+                       ( scene.noisy_disparity, RM_HALF_KERNEL, RM_HALF_KERNEL,
+                         RM_THRESHOLD, RM_MIN_MATCHES ),
+                       opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    result.num_items = double(scene.size)*scene.size;
+    result.error = bad_pixel_fraction( disp, scene.disparity, Vector2i() );
+    return result;
+  }
+
+  // stereo_fltr: hole filling. The error is the mean error in the
+  // filled pixels.
+  KernelResult fltr_fill_holes_impl( SyntheticScene const& scene, Options const& opt,
+                                     Stopwatch & sw, bool use_multigrid ) {
+    KernelResult result;
+    sw.start();
+    asp::BlobIndexThreaded bindex( invert_mask( scene.holey_disparity ), FILL_HOLE_SIZE );
+    ImageView<PixelMask<Vector2f> > disp =
+      block_rasterize( asp::inpaint( scene.holey_disparity, bindex, true,
+                                     PixelMask<Vector2f>(), use_multigrid ),
+                       opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    result.num_items = double(scene.size)*scene.size;
+    result.error = mean_disparity_error( disp, scene.disparity, Vector2i(),
+                                         &scene.holey_disparity );
+    return result;
+  }
+
+  KernelResult fltr_fill_holes( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    return fltr_fill_holes_impl( scene, opt, sw, false );
+  }
+
+  KernelResult fltr_fill_holes_multigrid( SyntheticScene const& scene, Options const& opt,
+                                          Stopwatch & sw ) {
+    return fltr_fill_holes_impl( scene, opt, sw, true );
+  }
+
+  // Triangulate the disparity of a block with the pinhole cameras, in
+  // one batch as stereo_tri does
+  class PinholeTriangulationTask : public Task, private boost::noncopyable {
+    SyntheticScene const& m_scene;
+    BBox2i m_block;
+    ImageView<Vector3> & m_points;
+
+  public:
+    PinholeTriangulationTask( SyntheticScene const& scene, BBox2i const& block,
+                              ImageView<Vector3> & points ) :
+      m_scene(scene), m_block(block), m_points(points) {}
+
+    void operator()() {
+      asp::BatchStereoModel model( &m_scene.left_camera, &m_scene.right_camera );
+      std::vector<Vector2> pix1, pix2;
+      std::vector<Vector2i> locations;
+      for (int row = m_block.min().y(); row < m_block.max().y(); row++){
+        for (int col = m_block.min().x(); col < m_block.max().x(); col++){
+          PixelMask<Vector2f> d = m_scene.disparity(col, row);
+          if ( !is_valid(d) ) continue;
+          pix1.push_back( Vector2(col, row) );
+          pix2.push_back( Vector2(col + d.child()[0], row + d.child()[1]) );
+          locations.push_back( Vector2i(col, row) );
+        }
+      }
+      std::vector<Vector3> points, errors;
+      model( pix1, pix2, points, errors );
+      for (size_t k = 0; k < locations.size(); k++)
+        m_points( locations[k].x(), locations[k].y() ) = points[k];
+    }
+  };
+
+  // stereo_tri: pinhole cameras. The error is the mean distance to
+  // the true points.
+  KernelResult tri_pinhole( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    KernelResult result;
+    ImageView<Vector3> points( scene.size, scene.size );
+    std::vector<BBox2i> blocks =
+      image_blocks( points, opt.raster_tile_size[0], opt.raster_tile_size[1] );
+
+    sw.start();
+    FifoWorkQueue queue( vw_settings().default_num_threads() );
+    for (size_t i = 0; i < blocks.size(); i++){
+      boost::shared_ptr<PinholeTriangulationTask>
+        task( new PinholeTriangulationTask( scene, blocks[i], points ) );
+      queue.add_task( task );
+    }
+    queue.join_all();
+    sw.stop();
+
+    double count = 0, sum = 0;
+    for (int row = 0; row < scene.size; row++){
+      for (int col = 0; col < scene.size; col++){
+        if ( scene.point_cloud(col, row) == Vector3() ) continue;
+        count++;
+        sum += norm_2( points(col, row) - scene.point_cloud(col, row) );
+      }
+    }
+    result.num_items = double(scene.size)*scene.size;
+    result.error = count > 0 ? sum/count : nan_value();
+    return result;
+  }
+
+  // Triangulate a range of the RPC pixel pairs
+  class RPCTriangulationTask : public Task, private boost::noncopyable {
+    SyntheticScene const& m_scene;
+    size_t m_begin, m_end;
+    std::vector<Vector3> & m_points;
+
+  public:
+    RPCTriangulationTask( SyntheticScene const& scene, size_t begin, size_t end,
+                          std::vector<Vector3> & points ) :
+      m_scene(scene), m_begin(begin), m_end(end), m_points(points) {}
+
+    void operator()() {
+      asp::RPCStereoModel model( m_scene.left_rpc.get(), m_scene.right_rpc.get() );
+      std::vector<Vector2> pix1( m_scene.rpc_left_pixels.begin()  + m_begin,
+                                 m_scene.rpc_left_pixels.begin()  + m_end );
+      std::vector<Vector2> pix2( m_scene.rpc_right_pixels.begin() + m_begin,
+                                 m_scene.rpc_right_pixels.begin() + m_end );
+      std::vector<Vector3> points, errors;
+      model( pix1, pix2, points, errors );
+      std::copy( points.begin(), points.end(), m_points.begin() + m_begin );
+    }
+  };
+
+  // stereo_tri: RPC cameras, with the batch triangulation. The error
+  // is the mean distance to the true points.
+  KernelResult tri_rpc( SyntheticScene const& scene, Options const& opt, Stopwatch & sw ) {
+    KernelResult result;
+    size_t num_points = scene.rpc_lonlatheights.size();
+    size_t block_size = size_t(opt.raster_tile_size[0])*opt.raster_tile_size[1];
+    std::vector<Vector3> points( num_points );
+
+    sw.start();
+    FifoWorkQueue queue( vw_settings().default_num_threads() );
+    for (size_t begin = 0; begin < num_points; begin += block_size){
+      boost::shared_ptr<RPCTriangulationTask>
+        task( new RPCTriangulationTask( scene, begin, std::min(begin + block_size, num_points),
+                                        points ) );
+      queue.add_task( task );
+    }
+    queue.join_all();
+    sw.stop();
+
+    double sum = 0;
+    cartography::Datum const& datum = scene.left_rpc->datum();
+    for (size_t i = 0; i < num_points; i++)
+      sum += norm_2( points[i] - datum.geodetic_to_cartesian(scene.rpc_lonlatheights[i]) );
+    result.num_items = num_points;
+    result.error = num_points > 0 ? sum/num_points : nan_value();
+    return result;
+  }
+
+  // point2dem: rasterization of the true point cloud at about the
+  // image resolution. The error is the fraction of DEM heights
+  // outside of the terrain height range.
+  KernelResult point2dem_rasterize( SyntheticScene const& scene, Options const& opt,
+                                    Stopwatch & sw ) {
+    KernelResult result;
+    double nodata = -32768.0;
+    sw.start();
+    cartography::OrthoRasterizerView<PixelGray<float>, ImageView<Vector3> >
+      rasterizer( scene.point_cloud, select_channel(scene.point_cloud, 2), 1.0 );
+    rasterizer.set_use_minz_as_default(false);
+    rasterizer.set_default_value(nodata);
+    ImageView<PixelGray<float> > dem =
+      block_rasterize( rasterizer, opt.raster_tile_size, opt.num_threads );
+    sw.stop();
+
+    double num_valid = 0, num_bad = 0;
+    for (int row = 0; row < dem.rows(); row++){
+      for (int col = 0; col < dem.cols(); col++){
+        float h = dem(col, row).v();
+        if ( h == nodata ) continue;
+        num_valid++;
+        num_bad += ( h < -10.0 - 1e-3 || h > 310.0 + 1e-3 );
+      }
+    }
+    result.num_items = double(scene.size)*scene.size;
+    result.error = num_valid > 0 ? num_bad/num_valid : nan_value();
+    return result;
+  }
+
+  void points_to_data_points( std::vector<Vector3> const& points, DP & data ) {
+    DP::Labels labels;
+    labels.push_back( DP::Label("x", 1) );
+    labels.push_back( DP::Label("y", 1) );
+    labels.push_back( DP::Label("z", 1) );
+    labels.push_back( DP::Label("pad", 1) );
+    data.featureLabels = labels;
+    data.features.resize( 4, points.size() );
+    for (size_t i = 0; i < points.size(); i++){
+      for (int k = 0; k < 3; k++)
+        data.features(k, i) = points[i][k];
+      data.features(3, i) = 1.0;
+    }
+  }
+
+  // pc_align: ICP between the true point cloud and a shifted subset
+  // of it. The error is the distance of the recovered translation
+  // from the true one.
+  KernelResult pc_align_icp( SyntheticScene const& scene, Options const& /*opt*/,
+                             Stopwatch & sw ) {
+    KernelResult result;
+    Vector3 shift( 1.5, -2.0, 0.75 );
+    std::vector<Vector3> ref_points, source_points;
+    for (int row = 0; row < scene.size; row++){
+      for (int col = 0; col < scene.size; col++){
+        Vector3 p = scene.point_cloud(col, row);
+        if ( p == Vector3() ) continue;
+        ref_points.push_back( p );
+        // Keep the source away from the edges of the reference
+        if ( row % 4 == 0 && col % 4 == 0 && row > scene.size/8 && row < 7*scene.size/8 &&
+             col > scene.size/8 && col < 7*scene.size/8 )
+          source_points.push_back( p + shift );
+      }
+    }
+    DP ref, source;
+    points_to_data_points( ref_points,    ref    );
+    points_to_data_points( source_points, source );
+
+    std::string method = "point-to-plane";
+    sw.start();
+    PM::ICP icp;
+    icp.initRefTree( ref, method, false, false );
+    icp.setParams( "", 40, 0.75, (2.0*M_PI/360.0)*1e-8, 1e-3, method, false );
+    PM::Matrix T = icp( source, ref, PM::Matrix::Identity(4, 4), false );
+    sw.stop();
+
+    result.num_items = source_points.size();
+    result.error = norm_2( Vector3( T(0, 3), T(1, 3), T(2, 3) ) + shift );
+    return result;
+  }
+
+  typedef KernelResult (*KernelFunc)( SyntheticScene const&, Options const&, Stopwatch & );
+
+  struct Kernel {
+    const char* stage;
+    const char* name;
+    KernelFunc  func;
+  };
+
+  const Kernel KERNELS[] = {
+    { "pprc",      "pprc_mask_normalize",       pprc_mask_normalize       },
+    { "corr",      "corr_block",                corr_block                },
+    { "corr",      "corr_box_filter",           corr_box_filter           },
+    { "corr",      "corr_sgm",                  corr_sgm                  },
+    { "rfne",      "rfne_parabola",             rfne_parabola             },
+    { "rfne",      "rfne_bayes_em",             rfne_bayes_em             },
+    { "fltr",      "fltr_cleanup",              fltr_cleanup              },
+    { "fltr",      "fltr_fill_holes",           fltr_fill_holes           },
+    { "fltr",      "fltr_fill_holes_multigrid", fltr_fill_holes_multigrid },
+    { "tri",       "tri_pinhole",               tri_pinhole               },
+    { "tri",       "tri_rpc",                   tri_rpc                   },
+    { "point2dem", "point2dem_rasterize",       point2dem_rasterize       },
+    { "pc_align",  "pc_align_icp",              pc_align_icp              }
+  };
+  const int NUM_KERNELS = sizeof(KERNELS)/sizeof(Kernel);
+
+} // end anonymous namespace
+
+void handle_arguments( int argc, char *argv[], Options& opt ) {
+
+  po::options_description general_options("General Options");
+  general_options.add_options()
+    ("size", po::value(&opt.size)->default_value(1024),
+     "The width and height of the synthetic images.")
+    ("trials", po::value(&opt.trials)->default_value(3),
+     "Number of times to run each kernel. The minimum and median times are reported.")
+    ("kernels", po::value(&opt.kernels)->default_value("all"),
+     "Comma-separated list of kernels or stages (pprc, corr, rfne, fltr, tri, point2dem, pc_align) to run.")
+    ("output-file,o", po::value(&opt.output_file)->default_value(""),
+     "Write the results to this file instead of the standard output.")
+    ("list", "List the kernels and exit.");
+
+  general_options.add( asp::BaseOptionsDescription(opt) );
+
+  po::options_description positional("");
+  po::positional_options_description positional_desc;
+
+  std::string usage("[options]");
+  po::variables_map vm =
+    asp::check_command_line( argc, argv, opt, general_options, general_options,
+                             positional, positional_desc, usage );
+
+  if ( vm.count("list") ){
+    for (int i = 0; i < NUM_KERNELS; i++)
+      vw_out() << KERNELS[i].name << " (" << KERNELS[i].stage << ")\n";
+    exit(0);
+  }
+
+  if ( opt.size < 64 )
+    vw_throw( ArgumentErr() << "The image size must be at least 64.\n"
+              << usage << general_options );
+  if ( opt.trials < 1 )
+    vw_throw( ArgumentErr() << "The number of trials must be positive.\n"
+              << usage << general_options );
+
+  if ( opt.num_threads == 0 )
+    opt.num_threads = vw_settings().default_num_threads();
+}
+
+int main( int argc, char *argv[] ) {
+
+  Options opt;
+  try {
+    handle_arguments( argc, argv, opt );
+
+    std::vector<std::string> requested;
+    boost::split( requested, opt.kernels, boost::is_any_of(", "), boost::token_compress_on );
+    std::vector<int> selected;
+    for (size_t r = 0; r < requested.size(); r++){
+      if ( requested[r].empty() ) continue;
+      bool found = false;
+      for (int i = 0; i < NUM_KERNELS; i++){
+        if ( requested[r] == "all" || requested[r] == KERNELS[i].name ||
+             requested[r] == KERNELS[i].stage ){
+          found = true;
+          if ( std::find(selected.begin(), selected.end(), i) == selected.end() )
+            selected.push_back(i);
+        }
+      }
+      if ( !found )
+        vw_throw( ArgumentErr() << "Unknown kernel or stage: " << requested[r] << "\n" );
+    }
+    std::sort( selected.begin(), selected.end() );
+
+    std::ofstream ofs;
+    if ( !opt.output_file.empty() ){
+      ofs.open( opt.output_file.c_str() );
+      if ( !ofs.good() )
+        vw_throw( IOErr() << "Cannot open for writing: " << opt.output_file << "\n" );
+    }
+    std::ostream & out = opt.output_file.empty() ? std::cout : ofs;
+
+    vw_out() << "Generating a synthetic scene of size " << opt.size << "\n";
+    SyntheticScene scene;
+    generate_scene( opt.size, scene );
+
+    out << "kernel,stage,size,threads,tile_size,trials,min_seconds,median_seconds,"
+        << "items_per_second,error\n";
+    for (size_t s = 0; s < selected.size(); s++){
+      Kernel const& kernel = KERNELS[selected[s]];
+      vw_out() << "Running " << kernel.name << "\n";
+
+      std::vector<double> times;
+      KernelResult result;
+      for (int t = 0; t < opt.trials; t++){
+        Stopwatch sw;
+        result = kernel.func( scene, opt, sw );
+        times.push_back( sw.elapsed_seconds() );
+      }
+      std::sort( times.begin(), times.end() );
+      double median = times[times.size()/2];
+
+      out.precision(6);
+      out << kernel.name << ',' << kernel.stage << ',' << opt.size << ','
+          << opt.num_threads << ',' << opt.raster_tile_size[0] << ','
+          << opt.trials << ',' << times.front() << ',' << median << ','
+          << ( times.front() > 0 ? result.num_items/times.front() : nan_value() ) << ','
+          << result.error << std::endl;
+    }
+
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
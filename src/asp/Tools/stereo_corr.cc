@@ -20,6 +20,7 @@
 ///
 
 #include <asp/Tools/stereo.h>
+#include <asp/Tools/stereo_rfne.h>
 #include <vw/InterestPoint.h>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
@@ -28,16 +29,17 @@
 #include <vw/Stereo/CostFunctions.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/DemDisparity.h>
+#include <asp/Core/FFTCorrelation.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/SemiGlobalMatching.h>
+#include <asp/Core/BlockCorrelation.h>
+#include <asp/Core/TileBalancing.h>
+#include <boost/bind.hpp>
 
 using namespace vw;
 using namespace vw::stereo;
 using namespace asp;
 
-namespace vw {
-  template<> struct PixelFormatID<PixelMask<Vector<float, 5> > >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
-}
-
 void produce_lowres_disparity( Options & opt ) {
 
   DiskImageView<vw::uint8> Lmask(opt.out_prefix + "-lMask.tif"),
@@ -98,6 +100,34 @@ void produce_lowres_disparity( Options & opt ) {
     produce_dem_disparity(opt, left_camera_model, right_camera_model);
   }else if ( stereo_settings().seed_mode == 3 ) {
     // D_sub is already generated by now by sparse_disp
+  }else if ( stereo_settings().seed_mode == 4 ) {
+    // Match a grid of templates with FFT correlation, as sparse_disp
+    // does, to get the low-res disparity and its spread.
+    Vector2i expansion( search_range.width(),
+                        search_range.height() );
+    expansion *= stereo_settings().seed_percent_pad / 2.0f;
+    search_range.min() -= expansion;
+    search_range.max() += expansion;
+    VW_OUT(DebugMessage,"asp") << "D_sub search range: "
+                               << search_range << " px\n";
+
+    const int    template_size = 32;  // pixels of the low-res images
+    const double min_score     = 0.5; // normalized cross-correlation
+    ImageView<float> left_sub_img  = select_channel(left_sub, 0);
+    ImageView<float> right_sub_img = select_channel(right_sub, 0);
+    ImageView<uint8> left_mask_sub_img  = left_mask_sub;
+    ImageView<uint8> right_mask_sub_img = right_mask_sub;
+    ImageView<PixelMask<Vector2i> > fft_disp, fft_disp_spread;
+    vw_out() << "\t--> Low-resolution disparity from FFT correlation.\n";
+    asp::fft_seed_disparity(left_sub_img, right_sub_img,
+                            left_mask_sub_img, right_mask_sub_img,
+                            search_range, template_size, min_score,
+                            fft_disp, fft_disp_spread);
+
+    asp::block_write_gdal_image( opt.out_prefix + "-D_sub.tif", fft_disp, opt,
+                                 TerminalProgressCallback("asp", "\t--> Low-resolution disparity:") );
+    asp::block_write_gdal_image( opt.out_prefix + "-D_sub_spread.tif", fft_disp_spread, opt,
+                                 TerminalProgressCallback("asp", "\t--> Low-resolution disparity spread:") );
   }
 
   ImageView<PixelMask<Vector2i> > sub_disp;
@@ -306,112 +336,179 @@ public:
     return disparity;
   }
 
-  inline prerasterize_type prerasterize_helper(BBox2i const& bbox) const {
-
-    bool use_local_homography = stereo_settings().use_local_homography;
+  // The correlation tile containing the given box. With adaptive
+  // tiling, a box may be a piece of a split tile.
+  BBox2i parent_tile(BBox2i const& bbox) const {
+    int ts = Options::corr_tile_size();
+    BBox2i tile( (bbox.min()/ts)*ts, (bbox.min()/ts)*ts + Vector2i(ts, ts) );
+    tile.crop( bounding_box(m_left_image) );
+    if (!tile.contains(bbox))
+      return bbox;
+    return tile;
+  }
 
-    Matrix<double> lowres_hom  = math::identity_matrix<3>();
-    Matrix<double> fullres_hom = math::identity_matrix<3>();
-    ImageViewRef<typename Image2T::pixel_type> right_trans_img;
-    ImageViewRef<typename Mask2T::pixel_type> right_trans_mask;
+  // The search range of the correlation tile containing the given
+  // box, from the low-resolution disparity and its spread within it,
+  // at full resolution. The pieces of a split tile use the range of
+  // the whole tile, so that the disparity does not depend on the
+  // tiling. With local homography, the disparities are transformed
+  // by the homography of the tile, which is returned in lowres_hom.
+  BBox2i seeded_search_range(BBox2i const& box, Matrix<double> & lowres_hom) const {
 
+    BBox2i bbox = parent_tile(box);
+    bool use_local_homography = stereo_settings().use_local_homography;
     bool do_round = true; // round integer disparities after transform
 
-    // User strategies
+    // The low-res version of bbox
+    BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
+                      elem_quot(bbox.max(), m_upscale_factor) );
+    seed_bbox.expand(1);
+    seed_bbox.crop( m_seed_bbox );
+    VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : "
+                                   << seed_bbox << "\n";
+    SeedDispT disparity_in_box = crop( m_sub_disp, seed_bbox );
+
     BBox2f local_search_range;
-    if ( stereo_settings().seed_mode > 0 ) {
+    if (!use_local_homography){
+      local_search_range = stereo::get_disparity_range( disparity_in_box );
+    }else{
+      int ts = Options::corr_tile_size();
+      lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
+      local_search_range = stereo::get_disparity_range
+        (transform_disparities(do_round, seed_bbox,
+                               lowres_hom, disparity_in_box));
+    }
 
-      // The low-res version of bbox
-      BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
-                        elem_quot(bbox.max(), m_upscale_factor) );
-      seed_bbox.expand(1);
-      seed_bbox.crop( m_seed_bbox );
-      VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : "
-                                     << seed_bbox << "\n";
-      SeedDispT disparity_in_box = crop( m_sub_disp, seed_bbox );
+    bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 && m_sub_disp_spread.rows() != 0 );
+
+    // Sanity check: If m_sub_disp_spread was provided, it better have
+    // the same size as sub_disp.
+    if ( has_sub_disp_spread &&
+         m_sub_disp_spread.cols() != m_sub_disp.cols() &&
+         m_sub_disp_spread.rows() != m_sub_disp.rows() ){
+      vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+    }
+
+    if (has_sub_disp_spread){
+
+      // Expand the disparity range by m_sub_disp_spread.
+      SeedDispT spread_in_box = crop( m_sub_disp_spread, seed_bbox );
 
       if (!use_local_homography){
-        local_search_range = stereo::get_disparity_range( disparity_in_box );
+        BBox2f spread = stereo::get_disparity_range( spread_in_box );
+        local_search_range.min() -= spread.max();
+        local_search_range.max() += spread.max();
       }else{
-        int ts = Options::corr_tile_size();
-        lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
-        local_search_range = stereo::get_disparity_range
-          (transform_disparities(do_round, seed_bbox,
-                                 lowres_hom, disparity_in_box));
+        SeedDispT upper_disp
+          = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                  disparity_in_box + spread_in_box);
+        SeedDispT lower_disp
+          = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                  disparity_in_box - spread_in_box);
+        BBox2f upper_range = stereo::get_disparity_range(upper_disp);
+        BBox2f lower_range = stereo::get_disparity_range(lower_disp);
+
+        local_search_range = upper_range;
+        local_search_range.grow(lower_range);
       }
+    }
 
-      bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 && m_sub_disp_spread.rows() != 0 );
+    local_search_range = grow_bbox_to_int(local_search_range);
+    // Expand local_search_range by 1. This is necessary since
+    // m_sub_disp is integer-valued, and perhaps the search
+    // range was supposed to be a fraction of integer bigger.
+    local_search_range.expand(1);
+    // Scale the search range to full-resolution
+    local_search_range.min() = floor(elem_prod(local_search_range.min(),
+                                               m_upscale_factor));
+    local_search_range.max() = ceil(elem_prod(local_search_range.max(),
+                                              m_upscale_factor));
+
+    VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
+                                   << bbox << ") search range "
+                                   << local_search_range << " vs "
+                                   << stereo_settings().search_range << "\n";
+    return local_search_range;
+  }
 
-      // Sanity check: If m_sub_disp_spread was provided, it better have
-      // the same size as sub_disp.
-      if ( has_sub_disp_spread &&
-           m_sub_disp_spread.cols() != m_sub_disp.cols() &&
-           m_sub_disp_spread.rows() != m_sub_disp.rows() ){
-        vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
-      }
+  // An estimate of the time needed to correlate the given tile, in
+  // arbitrary units. Every pixel is read and filtered, and each pixel
+  // within m_trans_crop_win is matched at each disparity.
+  double work_estimate(BBox2i const& bbox) const {
+    double work = double(bbox.width())*bbox.height();
+    if (!bbox.intersects(m_trans_crop_win))
+      return work;
+    BBox2i intersection = bbox; intersection.crop(m_trans_crop_win);
 
-      if (has_sub_disp_spread){
-
-        // Expand the disparity range by m_sub_disp_spread.
-        SeedDispT spread_in_box = crop( m_sub_disp_spread, seed_bbox );
-
-        if (!use_local_homography){
-          BBox2f spread = stereo::get_disparity_range( spread_in_box );
-          local_search_range.min() -= spread.max();
-          local_search_range.max() += spread.max();
-        }else{
-          SeedDispT upper_disp
-            = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                    disparity_in_box + spread_in_box);
-          SeedDispT lower_disp
-            = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                    disparity_in_box - spread_in_box);
-          BBox2f upper_range = stereo::get_disparity_range(upper_disp);
-          BBox2f lower_range = stereo::get_disparity_range(lower_disp);
-
-          local_search_range = upper_range;
-          local_search_range.grow(lower_range);
-        }
-      }
+    BBox2i search_range = stereo_settings().search_range;
+    if ( stereo_settings().seed_mode > 0 ){
+      Matrix<double> lowres_hom = math::identity_matrix<3>();
+      search_range = seeded_search_range(bbox, lowres_hom);
+    }
+    double num_disparities
+      = double(search_range.width() + 1)*(search_range.height() + 1);
+    return work + double(intersection.width())*intersection.height()*num_disparities;
+  }
+
+  inline prerasterize_type prerasterize_helper(BBox2i const& bbox) const {
+
+    bool use_local_homography = stereo_settings().use_local_homography;
+
+    Matrix<double> lowres_hom  = math::identity_matrix<3>();
+    Matrix<double> fullres_hom = math::identity_matrix<3>();
+    ImageViewRef<typename Image2T::pixel_type> right_trans_img;
+    ImageViewRef<typename Mask2T::pixel_type> right_trans_mask;
+
+    // User strategies
+    BBox2i local_search_range;
+    if ( stereo_settings().seed_mode > 0 ) {
+
+      local_search_range = seeded_search_range(bbox, lowres_hom);
 
       if (use_local_homography){
         Vector3 upscale( m_upscale_factor[0], m_upscale_factor[1], 1 );
         Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
         fullres_hom = diagonal_matrix(upscale)*lowres_hom*diagonal_matrix(dnscale);
 
-        ImageViewRef< PixelMask<typename Image2T::pixel_type> >
-          right_trans_masked_img
-          = transform (copy_mask( m_right_image.impl(),
-                                  create_mask(m_right_mask.impl()) ),
-                       HomographyTransform(fullres_hom),
-                       m_left_image.impl().cols(), m_left_image.impl().rows());
+        // When refinement follows in this process, keep the warped
+        // right image around the tile, so that it is not resampled
+        // again. The region covers the pyramid and kernel margins of
+        // correlation and refinement, plus the search range.
+        BBox2i cache_region;
+        if (stereo_settings().corr_fused_refinement){
+          int max_kernel = std::max(std::max(m_kernel_size[0], m_kernel_size[1]),
+                                    std::max(stereo_settings().subpixel_kernel[0],
+                                             stereo_settings().subpixel_kernel[1]));
+          int margin = max_kernel*(1 << int(stereo_settings().corr_max_levels))/2 + 32;
+          cache_region = BBox2i(bbox.min() + local_search_range.min(),
+                                bbox.max() + local_search_range.max());
+          cache_region.expand(margin);
+        }
+
+        ImageViewRef<asp::WarpedPixelT> right_trans_masked_img
+          = asp::warp_right_tile(m_right_image, m_right_mask, fullres_hom,
+                                 bounding_box(m_left_image.impl()).size(),
+                                 bbox, cache_region);
         right_trans_img = apply_mask(right_trans_masked_img);
         right_trans_mask
           = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
       }
 
-      local_search_range = grow_bbox_to_int(local_search_range);
-      // Expand local_search_range by 1. This is necessary since
-      // m_sub_disp is integer-valued, and perhaps the search
-      // range was supposed to be a fraction of integer bigger.
-      local_search_range.expand(1);
-      // Scale the search range to full-resolution
-      local_search_range.min() = floor(elem_prod(local_search_range.min(),
-                                                 m_upscale_factor));
-      local_search_range.max() = ceil(elem_prod(local_search_range.max(),
-                                                m_upscale_factor));
-
-      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
-                                     << bbox << ") search range "
-                                     << local_search_range << " vs "
-                                     << stereo_settings().search_range << "\n";
-
     } else{
       local_search_range = stereo_settings().search_range;
       VW_OUT(DebugMessage,"stereo") << "Searching with "
                                     << stereo_settings().search_range << "\n";
     }
 
+    if (stereo_settings().cost_mode == 3 || stereo_settings().corr_box_filter){
+      if (use_local_homography)
+        return block_prerasterize(bbox, right_trans_img, right_trans_mask,
+                                  local_search_range);
+      else
+        return block_prerasterize(bbox, m_right_image, m_right_mask,
+                                  local_search_range);
+    }
+
     if (use_local_homography){
       typedef stereo::PyramidCorrelationView<Image1T, ImageViewRef<typename Image2T::pixel_type>, Mask1T,ImageViewRef<typename Mask2T::pixel_type>, PProcT> CorrView;
       CorrView corr_view( m_left_image, right_trans_img,
@@ -435,6 +532,111 @@ public:
     }
   }
 
+  // Semi-global matching or box-filter block correlation of the
+  // tile. For semi-global matching the cost volume is the tile size
+  // times the number of disparities, so the tile is processed in
+  // blocks small enough for it to fit in memory. Each block is grown
+  // by a margin, so that the aggregation paths have some context, and
+  // only the block proper is kept. The margin is a fraction of the
+  // block, so that large search ranges get smaller blocks rather than
+  // spending most of the volume on the margin. The block correlator
+  // needs memory only proportional to the tile size, and no margin.
+  // If the search range is so large that even the smallest block
+  // would exceed the memory budget of semi-global matching, the tile
+  // is matched with the block correlator instead.
+  template <class RImageT, class RMaskT>
+  prerasterize_type block_prerasterize(BBox2i const& bbox,
+                                       ImageViewBase<RImageT> const& right_image,
+                                       ImageViewBase<RMaskT> const& right_mask,
+                                       BBox2i const& search_range) const {
+
+    bool use_sgm = (stereo_settings().cost_mode == 3);
+
+    // The number of pixels times disparities in the cost volume of
+    // one block with its margin, at two bytes each, and the limits on
+    // the block and margin sizes.
+    const double max_volume = 24*1024*1024;
+    const int min_block_size = 16, min_margin = 4, max_margin = 32;
+    double num_labels = double(search_range.width() + 1)*(search_range.height() + 1);
+    int side = int(std::sqrt(max_volume/num_labels));
+    if (use_sgm && side < min_block_size + 2*min_margin){
+      vw_out(WarningMessage) << "The search range " << search_range << " of tile "
+                             << bbox << " is too large for semi-global matching "
+                             << "to fit in memory. Using block matching for it.\n";
+      use_sgm = false;
+    }
+
+    // The kernel must be odd-sized. The census window must also fit
+    // in 64 bits.
+    Vector2i kernel = m_kernel_size;
+    if (use_sgm){
+      kernel = Vector2i( std::min(m_kernel_size[0], asp::SGM_MAX_CENSUS_WIDTH),
+                         std::min(m_kernel_size[1], asp::SGM_MAX_CENSUS_HEIGHT) );
+    }
+    for (int i = 0; i < 2; i++){
+      if (kernel[i] % 2 == 0) kernel[i]--;
+    }
+    Vector2i half_kernel = kernel/2;
+
+    int margin = 0;
+    int block_size = std::max(bbox.width(), bbox.height());
+    if (use_sgm){
+      // A margin of about 1/8 of the block
+      margin     = std::max(min_margin, std::min(max_margin, side/10));
+      block_size = side - 2*margin;
+    }
+
+    ImageView<pixel_type> disparity(bbox.width(), bbox.height());
+    for (int row = bbox.min().y(); row < bbox.max().y(); row += block_size){
+      for (int col = bbox.min().x(); col < bbox.max().x(); col += block_size){
+
+        BBox2i block(col, row,
+                     std::min(block_size, bbox.max().x() - col),
+                     std::min(block_size, bbox.max().y() - row));
+        BBox2i region = block;
+        region.expand(margin);
+
+        BBox2i left_win = region;
+        left_win.min() -= half_kernel;
+        left_win.max() += half_kernel;
+        BBox2i right_win(left_win.min() + search_range.min(),
+                         left_win.max() + search_range.max());
+
+        ImageView<float> left_crop
+          = select_channel(crop(m_preproc_func.filter
+                                (edge_extend(m_left_image, ConstantEdgeExtension())),
+                                left_win), 0);
+        ImageView<float> right_crop
+          = select_channel(crop(m_preproc_func.filter
+                                (edge_extend(right_image.impl(), ConstantEdgeExtension())),
+                                right_win), 0);
+        ImageView<uint8> left_mask_crop
+          = crop(edge_extend(m_left_mask, ZeroEdgeExtension()), left_win);
+        ImageView<uint8> right_mask_crop
+          = crop(edge_extend(right_mask.impl(), ZeroEdgeExtension()), right_win);
+
+        ImageView<pixel_type> region_disp;
+        if (use_sgm)
+          region_disp = asp::semi_global_matching(left_crop, right_crop,
+                                                  left_mask_crop, right_mask_crop,
+                                                  search_range, kernel,
+                                                  stereo_settings().sgm_penalty1,
+                                                  stereo_settings().sgm_penalty2,
+                                                  stereo_settings().xcorr_threshold);
+        else
+          region_disp = asp::block_correlation(left_crop, right_crop,
+                                               left_mask_crop, right_mask_crop,
+                                               search_range, kernel, m_cost_mode,
+                                               stereo_settings().xcorr_threshold);
+
+        crop(disparity, block - bbox.min()) = crop(region_disp, block - region.min());
+      }
+    }
+
+    return prerasterize_type(disparity, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows() );
+  }
+
   template <class DestT>
   inline void rasterize(DestT const& dest, BBox2i bbox) const {
     vw::rasterize(prerasterize(bbox), dest, bbox);
@@ -462,6 +664,207 @@ seeded_correlation( ImageViewBase<Image1T> const& left,
                       cost_type, corr_timeout, seconds_per_op );
 }
 
+// Write the disparity tiles to disk as they are computed. The
+// pieces of a tile which was split are assembled in memory, and the
+// tile is written when its last piece arrives.
+template <class PixelT>
+class DisparityTileWriter {
+  DiskImageResourceGDAL & m_rsrc;
+  int m_tile_size;
+  BBox2i m_image_bbox;
+  ProgressCallback const& m_progress;
+  Mutex m_mutex;
+
+  struct PartialTile {
+    ImageView<PixelT> disparity;
+    double num_missing; // pixels
+  };
+  std::map<std::pair<int, int>, PartialTile> m_partial_tiles;
+
+public:
+  DisparityTileWriter( DiskImageResourceGDAL & rsrc, int tile_size,
+                       BBox2i const& image_bbox, ProgressCallback const& progress ) :
+    m_rsrc(rsrc), m_tile_size(tile_size), m_image_bbox(image_bbox),
+    m_progress(progress) {}
+
+  void write( ImageView<PixelT> const& disparity, BBox2i const& bbox ) {
+
+    BBox2i tile( (bbox.min()/m_tile_size)*m_tile_size,
+                 (bbox.min()/m_tile_size)*m_tile_size + Vector2i(m_tile_size, m_tile_size) );
+    tile.crop(m_image_bbox);
+    double inc_amt = double(bbox.width())*bbox.height()
+      / (double(m_image_bbox.width())*m_image_bbox.height());
+
+    Mutex::Lock lock( m_mutex );
+    m_progress.report_incremental_progress( inc_amt );
+    if ( bbox == tile ) {
+      m_rsrc.write( disparity.buffer(), bbox );
+      return;
+    }
+
+    std::pair<int, int> key( tile.min().x(), tile.min().y() );
+    PartialTile & partial = m_partial_tiles[key];
+    if ( partial.disparity.cols() == 0 ) {
+      partial.disparity.set_size( tile.width(), tile.height() );
+      partial.num_missing = double(tile.width())*tile.height();
+    }
+    crop( partial.disparity, bbox - tile.min() ) = disparity;
+    partial.num_missing -= double(bbox.width())*bbox.height();
+    if ( partial.num_missing <= 0 ) {
+      m_rsrc.write( partial.disparity.buffer(), tile );
+      m_partial_tiles.erase( key );
+    }
+  }
+};
+
+// Correlate the boxes of a group of tiles, in order
+template <class ViewT>
+class CorrelationGroupTask : public Task, private boost::noncopyable {
+  typedef typename ViewT::pixel_type pixel_type;
+  ViewT m_view;
+  TileGroup m_group;
+  DisparityTileWriter<pixel_type> & m_writer;
+
+public:
+  CorrelationGroupTask( ImageViewBase<ViewT> const& view, TileGroup const& group,
+                        DisparityTileWriter<pixel_type> & writer ) :
+    m_view(view.impl()), m_group(group), m_writer(writer) {}
+
+  void operator()() {
+    for ( size_t i = 0; i < m_group.size(); i++ ) {
+      ImageView<pixel_type> disparity = crop( m_view, m_group[i] );
+      m_writer.write( disparity, m_group[i] );
+    }
+  }
+};
+
+// Integer correlation followed by subpixel refinement of each tile.
+// The integer disparity of a tile stays in memory, and the images
+// are read through the same views, and so the same cache, as for
+// correlation. The refinement sees no integer disparity outside the
+// tile.
+template <class CorrViewT, class Image1T, class Image2T>
+class FusedRefinementView : public ImageViewBase<FusedRefinementView<CorrViewT, Image1T, Image2T> > {
+  CorrViewT m_correlator;
+  Image1T m_left_image;
+  Image2T m_right_image;
+  ImageViewRef<uint8> m_right_mask;
+  ImageViewRef<PixelMask<Vector2i> > m_sub_disp;
+  ImageView<Matrix3x3> m_local_hom;
+  Options const& m_opt;
+
+public:
+  FusedRefinementView( ImageViewBase<CorrViewT> const& correlator,
+                       ImageViewBase<Image1T> const& left_image,
+                       ImageViewBase<Image2T> const& right_image,
+                       ImageViewRef<uint8> const& right_mask,
+                       ImageViewRef<PixelMask<Vector2i> > const& sub_disp,
+                       ImageView<Matrix3x3> const& local_hom,
+                       Options const& opt ) :
+    m_correlator(correlator.impl()), m_left_image(left_image.impl()),
+    m_right_image(right_image.impl()), m_right_mask(right_mask),
+    m_sub_disp(sub_disp), m_local_hom(local_hom), m_opt(opt) {}
+
+  // Image View interface
+  typedef PixelMask<Vector2f> pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<FusedRefinementView> pixel_accessor;
+
+  inline int32 cols() const { return m_correlator.cols(); }
+  inline int32 rows() const { return m_correlator.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "FusedRefinementView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  double work_estimate(BBox2i const& bbox) const {
+    return m_correlator.work_estimate(bbox);
+  }
+
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    ImageView<PixelMask<Vector2i> > integer_tile = crop( m_correlator, bbox );
+    ImageViewRef<PixelMask<Vector2i> > integer_disp
+      = crop( edge_extend(integer_tile, ZeroEdgeExtension()),
+              -bbox.min().x(), -bbox.min().y(), cols(), rows() );
+    return per_tile_rfne( m_left_image, m_right_image, m_right_mask,
+                          integer_disp, m_sub_disp, m_local_hom, m_opt ).prerasterize(bbox);
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+// Write the given disparity. With adaptive tiling, the correlation
+// tiles are split and merged according to the size of their search
+// ranges, so that all threads have about the same amount of work,
+// and the most expensive tiles start first.
+template <class ViewT>
+void write_tiles( Options const& opt, ViewT const& disparity,
+                  std::string const& filename, std::string const& tag ) {
+
+  TerminalProgressCallback progress("asp", tag);
+  if ( !stereo_settings().corr_adaptive_tiling ) {
+    asp::block_write_gdal_image( filename, disparity, opt, progress );
+    return;
+  }
+
+  int ts = Options::corr_tile_size();
+  int num_threads = vw_settings().default_num_threads();
+  std::vector<BBox2i> tiles = image_blocks( disparity, ts, ts );
+  std::vector<TileGroup> groups
+    = balance_tiles( tiles, boost::bind(&ViewT::work_estimate, &disparity, _1),
+                     4*num_threads, ts/4 );
+  VW_OUT(DebugMessage, "asp") << "Correlating " << tiles.size() << " tiles in "
+                              << groups.size() << " tasks.\n";
+
+  typedef typename ViewT::pixel_type pixel_type;
+  boost::scoped_ptr<DiskImageResourceGDAL>
+    rsrc( asp::build_gdal_rsrc( filename, disparity, opt ) );
+  DisparityTileWriter<pixel_type> writer( *rsrc, ts, bounding_box(disparity), progress );
+  FifoWorkQueue queue( num_threads );
+  typedef CorrelationGroupTask<ViewT> task_type;
+  for ( size_t i = 0; i < groups.size(); i++ ) {
+    boost::shared_ptr<task_type> task( new task_type( disparity, groups[i], writer ) );
+    queue.add_task( task );
+  }
+  queue.join_all();
+  progress.report_finished();
+}
+
+// Write the integer disparity, or, in the fused mode, refine each
+// tile of it and write only the refined disparity.
+template <class ViewT, class Image1T, class Image2T>
+void write_disparity( Options const& opt, ViewT const& integer_disp,
+                      Image1T const& left_image, Image2T const& right_image,
+                      ImageViewRef<uint8> const& right_mask,
+                      ImageViewRef<PixelMask<Vector2i> > const& sub_disp,
+                      ImageView<Matrix3x3> const& local_hom ) {
+
+  if ( !stereo_settings().corr_fused_refinement ) {
+    write_tiles( opt, integer_disp, opt.out_prefix + "-D.tif", "\t--> Correlation :" );
+    return;
+  }
+
+  // Print the refinement settings
+  bool verbose = true;
+  ImageView<PixelGray<float> > left_dummy(1, 1), right_dummy(1, 1);
+  ImageView<PixelMask<Vector2i> > dummy_disp(1, 1);
+  refine_disparity(left_dummy, right_dummy, dummy_disp, opt, verbose);
+
+  FusedRefinementView<ViewT, Image1T, Image2T>
+    refined_disp( integer_disp, left_image, right_image, right_mask,
+                  sub_disp, local_hom, opt );
+  write_tiles( opt, refined_disp, opt.out_prefix + "-RD.tif",
+               "\t--> Correlation and refinement :" );
+}
+
 void stereo_correlation( Options& opt ) {
 
   lowres_correlation(opt);
@@ -482,6 +885,11 @@ void stereo_correlation( Options& opt ) {
     vw_out() << "\t   Search Range:   "
              << stereo_settings().search_range << std::endl;
   vw_out()   << "\t   Cost Mode:      " << stereo_settings().cost_mode << std::endl;
+  if ( stereo_settings().cost_mode == 3 )
+    vw_out() << "\t   SGM Penalties:  " << stereo_settings().sgm_penalty1 << " "
+             << stereo_settings().sgm_penalty2 << std::endl;
+  else if ( stereo_settings().corr_box_filter )
+    vw_out() << "\t   Box Filter:     single level, full search range" << std::endl;
   vw_out(DebugMessage) << "\t   XCorr Threshold: " << stereo_settings().xcorr_threshold << std::endl;
   vw_out(DebugMessage) << "\t   Prefilter:       " << stereo_settings().pre_filter_mode << std::endl;
   vw_out(DebugMessage) << "\t   Prefilter Size:  " << stereo_settings().slogW << std::endl;
@@ -497,8 +905,9 @@ void stereo_correlation( Options& opt ) {
     sub_disp =
       DiskImageView<PixelMask<Vector2i> >(opt.out_prefix+"-D_sub.tif");
   ImageViewRef<PixelMask<Vector2i> > sub_disp_spread;
-  if ( stereo_settings().seed_mode == 2 ||  stereo_settings().seed_mode == 3 ){
-    // D_sub_spread is mandatory for seed_mode 2 and 3.
+  if ( stereo_settings().seed_mode == 2 || stereo_settings().seed_mode == 3 ||
+       stereo_settings().seed_mode == 4 ){
+    // D_sub_spread is mandatory for seed_mode 2, 3 and 4.
     sub_disp_spread =
       DiskImageView<PixelMask<Vector2i> >(opt.out_prefix+"-D_sub_spread.tif");
   }else if ( stereo_settings().seed_mode == 1 ){
@@ -522,11 +931,13 @@ void stereo_correlation( Options& opt ) {
   if      (stereo_settings().cost_mode == 0) cost_mode = stereo::ABSOLUTE_DIFFERENCE;
   else if (stereo_settings().cost_mode == 1) cost_mode = stereo::SQUARED_DIFFERENCE;
   else if (stereo_settings().cost_mode == 2) cost_mode = stereo::CROSS_CORRELATION;
+  // Semi-global matching does its own cost computation. This value
+  // is only used to estimate the timeout, which it does not obey.
+  else if (stereo_settings().cost_mode == 3) cost_mode = stereo::ABSOLUTE_DIFFERENCE;
   else
     vw_throw( ArgumentErr() << "Unknown value " << stereo_settings().cost_mode
               << " for cost-mode.\n" );
 
-  ImageViewRef<PixelMask<Vector2i> > fullres_disparity;
   Vector2i kernel_size = stereo_settings().corr_kernel;
   BBox2i trans_crop_win = stereo_settings().trans_crop_win;
   int corr_timeout      = stereo_settings().corr_timeout;
@@ -538,35 +949,34 @@ void stereo_correlation( Options& opt ) {
   if ( stereo_settings().pre_filter_mode == 2 ) {
     vw_out() << "\t--> Using LOG pre-processing filter with "
              << stereo_settings().slogW << " sigma blur.\n";
-    fullres_disparity =
+    write_disparity( opt,
       seeded_correlation( left_disk_image, right_disk_image, Lmask, Rmask,
                           sub_disp, sub_disp_spread, local_hom,
                           stereo::LaplacianOfGaussian(stereo_settings().slogW),
                           trans_crop_win, kernel_size, cost_mode, corr_timeout,
-                          seconds_per_op );
+                          seconds_per_op ),
+      left_disk_image, right_disk_image, Rmask, sub_disp, local_hom );
   } else if ( stereo_settings().pre_filter_mode == 1 ) {
     vw_out() << "\t--> Using Subtracted Mean pre-processing filter with "
              << stereo_settings().slogW << " sigma blur.\n";
-    fullres_disparity =
+    write_disparity( opt,
       seeded_correlation( left_disk_image, right_disk_image, Lmask, Rmask,
                           sub_disp, sub_disp_spread, local_hom,
                           stereo::SubtractedMean(stereo_settings().slogW),
                           trans_crop_win, kernel_size, cost_mode, corr_timeout,
-                          seconds_per_op );
+                          seconds_per_op ),
+      left_disk_image, right_disk_image, Rmask, sub_disp, local_hom );
   } else {
     vw_out() << "\t--> Using NO pre-processing filter." << std::endl;
-    fullres_disparity =
+    write_disparity( opt,
       seeded_correlation( left_disk_image, right_disk_image, Lmask, Rmask,
                           sub_disp, sub_disp_spread, local_hom,
                           stereo::NullOperation(),
                           trans_crop_win, kernel_size, cost_mode, corr_timeout,
-                          seconds_per_op );
+                          seconds_per_op ),
+      left_disk_image, right_disk_image, Rmask, sub_disp, local_hom );
   }
 
-  asp::block_write_gdal_image( opt.out_prefix + "-D.tif",
-                               fullres_disparity, opt,
-                               TerminalProgressCallback("asp", "\t--> Correlation :") );
-
   vw_out() << "\n[ " << current_posix_time_string()
            << " ] : CORRELATION FINISHED \n";
 
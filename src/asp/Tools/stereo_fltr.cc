@@ -27,6 +27,7 @@
 #include <asp/Core/InpaintView.h>
 #include <asp/Core/ErodeView.h>
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/DisparityCleanUpView.h>
 
 using namespace vw;
 using namespace asp;
@@ -39,31 +40,14 @@ namespace vw {
 template <class ViewT>
 struct MultipleDisparityCleanUp {
   typedef ImageViewRef< typename ViewT::pixel_type > result_type;
-  
-  inline result_type operator()( ImageViewBase<ViewT> const& input, int N) {
 
-    result_type out = input;
-    for (int i = 0; i < N; i++){
-      int mode = stereo_settings().filter_mode;
-      if (mode == 1){
-        out = stereo::disparity_cleanup_using_mean
-          (out.impl(),
-           stereo_settings().rm_half_kernel.x(),
-           stereo_settings().rm_half_kernel.y(),
-           stereo_settings().max_mean_diff);
-      }else if (mode == 2){
-        out = stereo::disparity_cleanup_using_thresh
-          (out.impl(),
-           stereo_settings().rm_half_kernel.x(),
-           stereo_settings().rm_half_kernel.y(),
-           stereo_settings().rm_threshold,
-           stereo_settings().rm_min_matches/100.0);
-      }else
-        vw_throw( ArgumentErr() << "\nExpecting value of 1 or 2 for filter-mode. "
-                  << "Got: " << mode << "\n" );
-    }
-
-    return out;
+  inline result_type operator()( ImageViewBase<ViewT> const& input, int N) {
+    return FusedDisparityCleanUpView<ViewT>(input, N,
+                                            stereo_settings().filter_mode,
+                                            stereo_settings().rm_half_kernel,
+                                            stereo_settings().max_mean_diff,
+                                            stereo_settings().rm_threshold,
+                                            stereo_settings().rm_min_matches);
   }
 };
 
@@ -95,10 +79,12 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
                               stereo_settings().fill_hole_max_size );
     vw_out() << "\t    * Identified " << bindex.num_blobs() << " holes\n";
     bool use_grassfire = true;
+    bool use_multigrid = ( stereo_settings().fill_holes_method == 1 );
     typename ImageT::pixel_type default_inpaint_val;
     asp::block_write_gdal_image( opt.out_prefix + "-F.tif",
                                  inpaint(inputview.impl(), bindex,
-                                         use_grassfire, default_inpaint_val),
+                                         use_grassfire, default_inpaint_val,
+                                         use_multigrid),
                                  opt, TerminalProgressCallback
                                  ("asp","\t--> Filtering: ") );
 
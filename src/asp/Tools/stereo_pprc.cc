@@ -91,7 +91,8 @@ bool skip_image_normalization(Options const& opt ){
   return
     stereo_settings().skip_image_normalization                    && 
     stereo_settings().alignment_method == "none"                  &&
-    stereo_settings().cost_mode == 2                              &&
+    ( stereo_settings().cost_mode == 2 ||
+      stereo_settings().cost_mode == 3 )                          &&
     is_tif_or_ntf(opt.in_file1)                                   && 
     is_tif_or_ntf(opt.in_file2);
 }
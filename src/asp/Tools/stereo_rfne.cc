@@ -20,268 +20,115 @@
 ///
 //#define USE_GRAPHICS
 
-#include <asp/Tools/stereo.h>
-#include <vw/Stereo/PreFilter.h>
-#include <vw/Stereo/CostFunctions.h>
-#include <vw/Stereo/SubpixelView.h>
-#include <vw/Stereo/EMSubpixelCorrelatorView.h>
-#include <asp/Core/LocalHomography.h>
-#include <vw/Stereo/DisparityMap.h>
+#include <asp/Tools/stereo_rfne.h>
 
 using namespace vw;
 using namespace vw::stereo;
 using namespace asp;
 
-namespace vw {
-  template<> struct PixelFormatID<PixelMask<Vector<float, 5> > >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
-}
-
-template <class Image1T, class Image2T>
-ImageViewRef<PixelMask<Vector2f> >
-refine_disparity(Image1T const& left_image,
-                 Image2T const& right_image,
-                 ImageViewRef< PixelMask<Vector2i> > const& integer_disp,
-                 Options const& opt, bool verbose){
-
-  ImageViewRef<PixelMask<Vector2f> > refined_disp =
-    pixel_cast<PixelMask<Vector2f> >(integer_disp);
-
-  if (stereo_settings().subpixel_mode == 0) {
-    // Do nothing
-  } else if (stereo_settings().subpixel_mode == 1) {
-    // Parabola
-    if (verbose) vw_out() << "\t--> Using parabola subpixel mode.\n";
-    if (stereo_settings().pre_filter_mode == 2) {
-      if (verbose) vw_out() << "\t--> Using LOG pre-processing filter with "
-                            << stereo_settings().slogW << " sigma blur.\n";
-      typedef stereo::LaplacianOfGaussian PreFilter;
-      refined_disp =
-        parabola_subpixel( integer_disp,
-                           left_image, right_image,
-                           PreFilter(stereo_settings().slogW),
-                           stereo_settings().subpixel_kernel );
-    } else if (stereo_settings().pre_filter_mode == 1) {
-      if (verbose)  vw_out() << "\t--> Using Subtracted Mean pre-processing filter with "
-                             << stereo_settings().slogW << " sigma blur.\n";
-      typedef stereo::SubtractedMean PreFilter;
-      refined_disp =
-        parabola_subpixel( integer_disp,
-                           left_image, right_image,
-                           PreFilter(stereo_settings().slogW),
-                           stereo_settings().subpixel_kernel );
-    } else {
-      if (verbose) vw_out() << "\t--> NO preprocessing" << std::endl;
-      typedef stereo::NullOperation PreFilter;
-      refined_disp =
-        parabola_subpixel( integer_disp,
-                           left_image, right_image,
-                           PreFilter(),
-                           stereo_settings().subpixel_kernel );
-    }
-  } else if (stereo_settings().subpixel_mode == 2) {
-    // Bayes EM
-    if (verbose){
-      vw_out() << "\t--> Using affine adaptive subpixel mode\n";
-      vw_out() << "\t--> Forcing use of LOG filter with "
-               << stereo_settings().slogW << " sigma blur.\n";
-    }
-    typedef stereo::LaplacianOfGaussian PreFilter;
-    refined_disp =
-      bayes_em_subpixel( integer_disp,
-                         left_image, right_image,
-                         PreFilter(stereo_settings().slogW),
-                         stereo_settings().subpixel_kernel,
-                         stereo_settings().subpixel_max_levels );
-
-  } else if (stereo_settings().subpixel_mode == 3) {
-    // Affine and Bayes subpixel refinement always use the
-    // LogPreprocessingFilter...
-    if (verbose){
-      vw_out() << "\t--> Using EM Subpixel mode "
-               << stereo_settings().subpixel_mode << std::endl;
-      vw_out() << "\t--> Mode 3 does internal preprocessing;"
-               << " settings will be ignored. " << std::endl;
-    }
-
-    typedef stereo::EMSubpixelCorrelatorView<float32> EMCorrelator;
-    EMCorrelator em_correlator(channels_to_planes(left_image),
-                               channels_to_planes(right_image),
-                               pixel_cast<PixelMask<Vector2f> >(integer_disp), -1);
-    em_correlator.set_em_iter_max(stereo_settings().subpixel_em_iter);
-    em_correlator.set_inner_iter_max(stereo_settings().subpixel_affine_iter);
-    em_correlator.set_kernel_size(stereo_settings().subpixel_kernel);
-    em_correlator.set_pyramid_levels(stereo_settings().subpixel_pyramid_levels);
-
-    DiskImageResourceOpenEXR em_disparity_map_rsrc(opt.out_prefix + "-F6.exr", em_correlator.format());
-
-    block_write_image(em_disparity_map_rsrc, em_correlator,
-                      TerminalProgressCallback("asp", "\t--> EM Refinement :"));
-
-    DiskImageResource *em_disparity_map_rsrc_2 =
-      DiskImageResourceOpenEXR::construct_open(opt.out_prefix + "-F6.exr");
-    DiskImageView<PixelMask<Vector<float, 5> > > em_disparity_disk_image(em_disparity_map_rsrc_2);
-
-    ImageViewRef<Vector<float, 3> > disparity_uncertainty =
-      per_pixel_filter(em_disparity_disk_image,
-                       EMCorrelator::ExtractUncertaintyFunctor());
-    ImageViewRef<float> spectral_uncertainty =
-      per_pixel_filter(disparity_uncertainty,
-                       EMCorrelator::SpectralRadiusUncertaintyFunctor());
-    write_image(opt.out_prefix+"-US.tif", spectral_uncertainty);
-    write_image(opt.out_prefix+"-U.tif", disparity_uncertainty);
-
-    refined_disp =
-      per_pixel_filter(em_disparity_disk_image,
-                       EMCorrelator::ExtractDisparityFunctor());
-  } else {
-    if (verbose) {
-      vw_out() << "\t--> Invalid Subpixel mode selection: " << stereo_settings().subpixel_mode << std::endl;
-      vw_out() << "\t--> Doing nothing\n";
-    }
-  }
-
-  return refined_disp;
-}
-
-// Perform refinement in each tile. If using local homography,
-// apply the local homography transform for the given tile
-// to the right image before doing refinement in that tile.
-template <class Image1T, class Image2T, class SeedDispT>
-class PerTileRfne: public ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT> >{
-  Image1T m_left_image;
-  Image2T m_right_image;
-  ImageViewRef<uint8> m_right_mask;
-  SeedDispT m_integer_disp;
-  SeedDispT m_sub_disp;
-  ImageView<Matrix3x3> m_local_hom;
-  Options const& m_opt;
-  Vector2 m_upscale_factor;
+// A view which is computed only within trans_crop_win. The pixels
+// outside of it have the default value, which is invalid for masked
+// pixels.
+template <class ImageT>
+class TransCropWinView: public ImageViewBase<TransCropWinView<ImageT> > {
+  ImageT m_image;
 
 public:
-  PerTileRfne( ImageViewBase<Image1T> const& left_image,
-               ImageViewBase<Image2T> const& right_image,
-               ImageViewRef<uint8> const& right_mask,
-               ImageViewBase<SeedDispT> const& integer_disp,
-               ImageViewBase<SeedDispT> const& sub_disp,
-               ImageView<Matrix3x3> const& local_hom,
-               Options const& opt):
-    m_left_image(left_image.impl()), m_right_image(right_image.impl()),
-    m_right_mask(right_mask),
-    m_integer_disp( integer_disp.impl() ), m_sub_disp( sub_disp.impl() ),
-    m_local_hom(local_hom), m_opt(opt){
-
-    m_upscale_factor
-      = Vector2(double(m_left_image.impl().cols()) / m_sub_disp.cols(),
-                double(m_left_image.impl().rows()) / m_sub_disp.rows());
-  }
-
-  // Image View interface
-  typedef PixelMask<Vector2f> pixel_type;
+  typedef typename ImageT::pixel_type pixel_type;
   typedef pixel_type result_type;
-  typedef ProceduralPixelAccessor<PerTileRfne> pixel_accessor;
+  typedef ProceduralPixelAccessor<TransCropWinView> pixel_accessor;
 
-  inline int32 cols() const { return m_left_image.cols(); }
-  inline int32 rows() const { return m_left_image.rows(); }
+  TransCropWinView( ImageViewBase<ImageT> const& image ) : m_image(image.impl()) {}
+
+  inline int32 cols() const { return m_image.cols(); }
+  inline int32 rows() const { return m_image.rows(); }
   inline int32 planes() const { return 1; }
 
   inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
 
-  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "PerTileRfne::operator()(...) is not implemented");
-    return pixel_type();
+  inline result_type operator()( int32 i, int32 j, int32 p = 0 ) const {
+    if ( !stereo_settings().trans_crop_win.contains(Vector2i(i, j)) )
+      return pixel_type();
+    return m_image(i, j, p);
   }
 
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
-  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
-
-    // We do stereo only in trans_crop_win. Skip the current tile if
-    // it does not intersect this region.
-    BBox2i trans_crop_win = stereo_settings().trans_crop_win;
-    BBox2i intersection = bbox; intersection.crop(trans_crop_win);
-    if (intersection.empty()){
-      return prerasterize_type(ImageView<pixel_type>(bbox.width(),
-                                                     bbox.height()),
-                               -bbox.min().x(), -bbox.min().y(),
-                               cols(), rows() );
-    }
-
-    ImageView<pixel_type> tile_disparity;
-    bool verbose = false;
-    if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography){
-
-      int ts = Options::corr_tile_size();
-      Matrix<double>  lowres_hom
-        = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
-      Vector3 upscale( m_upscale_factor[0], m_upscale_factor[1], 1 );
-      Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
-      Matrix<double>  fullres_hom
-        = diagonal_matrix(upscale)*lowres_hom*diagonal_matrix(dnscale);
-
-      // Must transform the right image by the local disparity
-      // to be in the same conditions as for stereo correlation.
-      typedef typename Image2T::pixel_type right_pix_type;
-      ImageViewRef< PixelMask<right_pix_type> > right_trans_masked_img
-        = transform (copy_mask( m_right_image.impl(), create_mask(m_right_mask) ),
-                     HomographyTransform(fullres_hom),
-                     m_left_image.impl().cols(), m_left_image.impl().rows());
-      ImageViewRef<right_pix_type> right_trans_img
-        = apply_mask(right_trans_masked_img);
-
-
-      tile_disparity = crop(refine_disparity(m_left_image, right_trans_img,
-                                             m_integer_disp, m_opt, verbose), bbox);
-
-      // Must undo the local homography transform
-      bool do_round = false; // don't round floating point disparities
-      tile_disparity = transform_disparities(do_round, bbox, inverse(fullres_hom),
-                                             tile_disparity);
-
-    }else{
-      tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
-                                             m_integer_disp, m_opt, verbose), bbox);
-    }
-
-    prerasterize_type disparity
-      = prerasterize_type(tile_disparity,
-                          -bbox.min().x(), -bbox.min().y(),
-                          cols(), rows() );
-
-    // Set to invalid the disparity outside trans_crop_win.
-    for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
-        if (!trans_crop_win.contains(Vector2(col, row))){
-          disparity(col, row) = pixel_type();
-        }
-      }
-    }
-
-    return disparity;
+  inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    BBox2i active = bbox;
+    active.crop(stereo_settings().trans_crop_win);
+    if ( !active.empty() )
+      crop(tile, active - bbox.min()) = crop(m_image, active);
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows() );
   }
 
   template <class DestT>
-  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+  inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
     vw::rasterize(prerasterize(bbox), dest, bbox);
   }
 };
 
-template <class Image1T, class Image2T, class SeedDispT>
-PerTileRfne<Image1T, Image2T, SeedDispT>
-per_tile_rfne( ImageViewBase<Image1T> const& left,
-               ImageViewBase<Image2T> const& right,
-               ImageViewRef<uint8> const& right_mask,
-               ImageViewBase<SeedDispT> const& integer_disp,
-               ImageViewBase<SeedDispT> const& sub_disp,
-               ImageView<Matrix3x3> const& local_hom,
-               Options const& opt) {
-  typedef PerTileRfne<Image1T, Image2T, SeedDispT> return_type;
-  return return_type( left.impl(), right.impl(), right_mask,
-                      integer_disp.impl(), sub_disp.impl(), local_hom, opt );
+// Affine EM refinement (subpixel mode 3) of the whole image. The
+// disparity and its uncertainty are written to F6.tif, from which the
+// refined disparity and the uncertainty images are extracted. All
+// are written with the block-threaded writer, so every tile is
+// refined on its own thread.
+void write_em_subpixel( Options const& opt,
+                        ImageViewRef<PixelGray<float> > const& left_image,
+                        ImageViewRef<PixelGray<float> > const& right_image,
+                        ImageViewRef<PixelMask<Vector2i> > const& integer_disp ) {
+
+  EMCorrelator em_correlator = em_subpixel_correlator(left_image, right_image,
+                                                      integer_disp);
+  asp::block_write_gdal_image( opt.out_prefix + "-F6.tif",
+                               TransCropWinView<EMCorrelator>(em_correlator), opt,
+                               TerminalProgressCallback("asp", "\t--> EM Refinement :") );
+
+  DiskImageView<PixelMask<Vector<float, 5> > > em_disparity_disk_image(opt.out_prefix + "-F6.tif");
+
+  ImageViewRef<Vector<float, 3> > disparity_uncertainty =
+    per_pixel_filter(em_disparity_disk_image,
+                     EMCorrelator::ExtractUncertaintyFunctor());
+  ImageViewRef<float> spectral_uncertainty =
+    per_pixel_filter(disparity_uncertainty,
+                     EMCorrelator::SpectralRadiusUncertaintyFunctor());
+  asp::block_write_gdal_image( opt.out_prefix + "-US.tif", spectral_uncertainty, opt,
+                               TerminalProgressCallback("asp", "\t--> Spectral uncertainty :") );
+  asp::block_write_gdal_image( opt.out_prefix + "-U.tif", disparity_uncertainty, opt,
+                               TerminalProgressCallback("asp", "\t--> Uncertainty :") );
+
+  asp::block_write_gdal_image( opt.out_prefix + "-RD.tif",
+                               per_pixel_filter(em_disparity_disk_image,
+                                                EMCorrelator::ExtractDisparityFunctor()),
+                               opt,
+                               TerminalProgressCallback("asp", "\t--> Refinement :") );
 }
 
 void stereo_refinement( Options const& opt ) {
 
   vw_out() << "\n[ " << current_posix_time_string() << " ] : Stage 2 --> REFINEMENT \n";
 
+  // In the fused mode correlation writes RD.tif and no D.tif. Skip
+  // only if that output is there and is not older than a D.tif left
+  // from an earlier run, otherwise refine D.tif as usual.
+  if ( stereo_settings().corr_fused_refinement ) {
+    std::string rd_file = opt.out_prefix + "-RD.tif";
+    std::string d_file  = opt.out_prefix + "-D.tif";
+    bool have_rd = fs::exists(rd_file), have_d = fs::exists(d_file);
+    if ( have_rd &&
+         ( !have_d || fs::last_write_time(rd_file) >= fs::last_write_time(d_file) ) ) {
+      vw_out() << "\t--> Refinement was done during correlation. Skipping.\n";
+      return;
+    }
+    if ( !have_d )
+      vw_throw( ArgumentErr() << "\nCorrelation with --corr-fused-refinement did not "
+                << "produce " << rd_file << ", and there is no " << d_file
+                << " to refine. Run the correlation stage again.\n\n" );
+    vw_out() << "\t--> " << rd_file << " is missing or older than " << d_file
+             << ". Refining " << d_file << ".\n";
+  }
+
   ImageViewRef<PixelGray<float> > left_disk_image, right_disk_image;
   ImageViewRef<uint8> right_mask;
   ImageViewRef<PixelMask<Vector2i> > integer_disp;
@@ -313,6 +160,19 @@ void stereo_refinement( Options const& opt ) {
   ImageView<PixelMask<Vector2i> > dummy_disp(1, 1);
   refine_disparity(left_dummy, right_dummy, dummy_disp, opt, verbose);
 
+  // With local homography the right image is warped differently
+  // in each tile, so EM refinement is done per tile as well, and
+  // the uncertainties are not written.
+  if ( stereo_settings().subpixel_mode == 3 ) {
+    if ( stereo_settings().seed_mode > 0 &&
+         stereo_settings().use_local_homography ){
+      vw_out() << "\t--> The EM uncertainty images are not written with local homography.\n";
+    }else{
+      write_em_subpixel( opt, left_disk_image, right_disk_image, integer_disp );
+      return;
+    }
+  }
+
   ImageViewRef< PixelMask<Vector2f> > refined_disp
     = per_tile_rfne(left_disk_image, right_disk_image, right_mask,
                     integer_disp, sub_disp, local_hom, opt);
@@ -0,0 +1,283 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file stereo_rfne.h
+///
+/// Subpixel refinement of the integer disparity, shared by
+/// stereo_rfne and by the fused correlation and refinement mode of
+/// stereo_corr.
+
+#ifndef __ASP_TOOLS_STEREO_RFNE_H__
+#define __ASP_TOOLS_STEREO_RFNE_H__
+
+#include <asp/Tools/stereo.h>
+#include <vw/Stereo/PreFilter.h>
+#include <vw/Stereo/CostFunctions.h>
+#include <vw/Stereo/SubpixelView.h>
+#include <vw/Stereo/EMSubpixelCorrelatorView.h>
+#include <asp/Core/LocalHomography.h>
+#include <vw/Stereo/DisparityMap.h>
+
+namespace vw {
+  template<> struct PixelFormatID<PixelMask<Vector<float, 5> > >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
+}
+
+namespace asp {
+
+  typedef vw::stereo::EMSubpixelCorrelatorView<vw::float32> EMCorrelator;
+
+  /// The affine EM refinement (subpixel mode 3) of the integer
+  /// disparity, with the user's settings. Each pixel holds the
+  /// disparity and its uncertainty.
+  template <class Image1T, class Image2T>
+  EMCorrelator
+  em_subpixel_correlator(Image1T const& left_image,
+                         Image2T const& right_image,
+                         vw::ImageViewRef< vw::PixelMask<vw::Vector2i> > const& integer_disp){
+    EMCorrelator em_correlator(vw::channels_to_planes(left_image),
+                               vw::channels_to_planes(right_image),
+                               vw::pixel_cast<vw::PixelMask<vw::Vector2f> >(integer_disp), -1);
+    em_correlator.set_em_iter_max(stereo_settings().subpixel_em_iter);
+    em_correlator.set_inner_iter_max(stereo_settings().subpixel_affine_iter);
+    em_correlator.set_kernel_size(stereo_settings().subpixel_kernel);
+    em_correlator.set_pyramid_levels(stereo_settings().subpixel_pyramid_levels);
+    return em_correlator;
+  }
+
+  template <class Image1T, class Image2T>
+  vw::ImageViewRef<vw::PixelMask<vw::Vector2f> >
+  refine_disparity(Image1T const& left_image,
+                   Image2T const& right_image,
+                   vw::ImageViewRef< vw::PixelMask<vw::Vector2i> > const& integer_disp,
+                   Options const& opt, bool verbose){
+
+    vw::ImageViewRef<vw::PixelMask<vw::Vector2f> > refined_disp =
+      vw::pixel_cast<vw::PixelMask<vw::Vector2f> >(integer_disp);
+
+    if (stereo_settings().subpixel_mode == 0) {
+      // Do nothing
+    } else if (stereo_settings().subpixel_mode == 1) {
+      // Parabola
+      if (verbose) vw::vw_out() << "\t--> Using parabola subpixel mode.\n";
+      if (stereo_settings().pre_filter_mode == 2) {
+        if (verbose) vw::vw_out() << "\t--> Using LOG pre-processing filter with "
+                                  << stereo_settings().slogW << " sigma blur.\n";
+        typedef vw::stereo::LaplacianOfGaussian PreFilter;
+        refined_disp =
+          vw::stereo::parabola_subpixel( integer_disp,
+                                         left_image, right_image,
+                                         PreFilter(stereo_settings().slogW),
+                                         stereo_settings().subpixel_kernel );
+      } else if (stereo_settings().pre_filter_mode == 1) {
+        if (verbose)  vw::vw_out() << "\t--> Using Subtracted Mean pre-processing filter with "
+                                   << stereo_settings().slogW << " sigma blur.\n";
+        typedef vw::stereo::SubtractedMean PreFilter;
+        refined_disp =
+          vw::stereo::parabola_subpixel( integer_disp,
+                                         left_image, right_image,
+                                         PreFilter(stereo_settings().slogW),
+                                         stereo_settings().subpixel_kernel );
+      } else {
+        if (verbose) vw::vw_out() << "\t--> NO preprocessing" << std::endl;
+        typedef vw::stereo::NullOperation PreFilter;
+        refined_disp =
+          vw::stereo::parabola_subpixel( integer_disp,
+                                         left_image, right_image,
+                                         PreFilter(),
+                                         stereo_settings().subpixel_kernel );
+      }
+    } else if (stereo_settings().subpixel_mode == 2) {
+      // Bayes EM
+      if (verbose){
+        vw::vw_out() << "\t--> Using affine adaptive subpixel mode\n";
+        vw::vw_out() << "\t--> Forcing use of LOG filter with "
+                     << stereo_settings().slogW << " sigma blur.\n";
+      }
+      typedef vw::stereo::LaplacianOfGaussian PreFilter;
+      refined_disp =
+        vw::stereo::bayes_em_subpixel( integer_disp,
+                                       left_image, right_image,
+                                       PreFilter(stereo_settings().slogW),
+                                       stereo_settings().subpixel_kernel,
+                                       stereo_settings().subpixel_max_levels );
+
+    } else if (stereo_settings().subpixel_mode == 3) {
+      // Affine and Bayes subpixel refinement always use the
+      // LogPreprocessingFilter...
+      if (verbose){
+        vw::vw_out() << "\t--> Using EM Subpixel mode "
+                     << stereo_settings().subpixel_mode << std::endl;
+        vw::vw_out() << "\t--> Mode 3 does internal preprocessing;"
+                     << " settings will be ignored. " << std::endl;
+      }
+
+      // The disparity alone. The uncertainties are written by
+      // stereo_rfne, see write_em_subpixel().
+      refined_disp =
+        vw::per_pixel_filter(em_subpixel_correlator(left_image, right_image, integer_disp),
+                             EMCorrelator::ExtractDisparityFunctor());
+    } else {
+      if (verbose) {
+        vw::vw_out() << "\t--> Invalid Subpixel mode selection: " << stereo_settings().subpixel_mode << std::endl;
+        vw::vw_out() << "\t--> Doing nothing\n";
+      }
+    }
+
+    return refined_disp;
+  }
+
+  // Perform refinement in each tile. If using local homography,
+  // apply the local homography transform for the given tile
+  // to the right image before doing refinement in that tile.
+  template <class Image1T, class Image2T, class SeedDispT>
+  class PerTileRfne: public vw::ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT> >{
+    Image1T m_left_image;
+    Image2T m_right_image;
+    vw::ImageViewRef<vw::uint8> m_right_mask;
+    SeedDispT m_integer_disp;
+    SeedDispT m_sub_disp;
+    vw::ImageView<vw::Matrix3x3> m_local_hom;
+    Options const& m_opt;
+    vw::Vector2 m_upscale_factor;
+
+  public:
+    PerTileRfne( vw::ImageViewBase<Image1T> const& left_image,
+                 vw::ImageViewBase<Image2T> const& right_image,
+                 vw::ImageViewRef<vw::uint8> const& right_mask,
+                 vw::ImageViewBase<SeedDispT> const& integer_disp,
+                 vw::ImageViewBase<SeedDispT> const& sub_disp,
+                 vw::ImageView<vw::Matrix3x3> const& local_hom,
+                 Options const& opt):
+      m_left_image(left_image.impl()), m_right_image(right_image.impl()),
+      m_right_mask(right_mask),
+      m_integer_disp( integer_disp.impl() ), m_sub_disp( sub_disp.impl() ),
+      m_local_hom(local_hom), m_opt(opt){
+
+      m_upscale_factor
+        = vw::Vector2(double(m_left_image.impl().cols()) / m_sub_disp.cols(),
+                      double(m_left_image.impl().rows()) / m_sub_disp.rows());
+    }
+
+    // Image View interface
+    typedef vw::PixelMask<vw::Vector2f> pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<PerTileRfne> pixel_accessor;
+
+    inline vw::int32 cols() const { return m_left_image.cols(); }
+    inline vw::int32 rows() const { return m_left_image.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "PerTileRfne::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+      // We do stereo only in trans_crop_win. Skip the current tile if
+      // it does not intersect this region.
+      vw::BBox2i trans_crop_win = stereo_settings().trans_crop_win;
+      vw::BBox2i intersection = bbox; intersection.crop(trans_crop_win);
+      if (intersection.empty()){
+        return prerasterize_type(vw::ImageView<pixel_type>(bbox.width(),
+                                                           bbox.height()),
+                                 -bbox.min().x(), -bbox.min().y(),
+                                 cols(), rows() );
+      }
+
+      vw::ImageView<pixel_type> tile_disparity;
+      bool verbose = false;
+      if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography){
+
+        int ts = Options::corr_tile_size();
+        vw::Matrix<double>  lowres_hom
+          = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
+        vw::Vector3 upscale( m_upscale_factor[0], m_upscale_factor[1], 1 );
+        vw::Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
+        vw::Matrix<double>  fullres_hom
+          = vw::diagonal_matrix(upscale)*lowres_hom*vw::diagonal_matrix(dnscale);
+
+        // Must transform the right image by the local disparity
+        // to be in the same conditions as for stereo correlation.
+        // If correlation of this tile just happened in this process,
+        // the warped image is already in the cache.
+        vw::ImageViewRef<asp::WarpedPixelT> right_trans_masked_img
+          = asp::warp_right_tile(m_right_image, m_right_mask, fullres_hom,
+                                 vw::bounding_box(m_left_image.impl()).size(),
+                                 bbox, vw::BBox2i());
+        vw::ImageViewRef<typename asp::WarpedPixelT::child_type> right_trans_img
+          = vw::apply_mask(right_trans_masked_img);
+
+
+        tile_disparity = crop(refine_disparity(m_left_image, right_trans_img,
+                                               m_integer_disp, m_opt, verbose), bbox);
+
+        // Must undo the local homography transform
+        bool do_round = false; // don't round floating point disparities
+        tile_disparity = vw::stereo::transform_disparities(do_round, bbox,
+                                                           vw::inverse(fullres_hom),
+                                                           tile_disparity);
+
+      }else{
+        tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
+                                               m_integer_disp, m_opt, verbose), bbox);
+      }
+
+      prerasterize_type disparity
+        = prerasterize_type(tile_disparity,
+                            -bbox.min().x(), -bbox.min().y(),
+                            cols(), rows() );
+
+      // Set to invalid the disparity outside trans_crop_win.
+      for (int col = bbox.min().x(); col < bbox.max().x(); col++){
+        for (int row = bbox.min().y(); row < bbox.max().y(); row++){
+          if (!trans_crop_win.contains(vw::Vector2(col, row))){
+            disparity(col, row) = pixel_type();
+          }
+        }
+      }
+
+      return disparity;
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class Image1T, class Image2T, class SeedDispT>
+  PerTileRfne<Image1T, Image2T, SeedDispT>
+  per_tile_rfne( vw::ImageViewBase<Image1T> const& left,
+                 vw::ImageViewBase<Image2T> const& right,
+                 vw::ImageViewRef<vw::uint8> const& right_mask,
+                 vw::ImageViewBase<SeedDispT> const& integer_disp,
+                 vw::ImageViewBase<SeedDispT> const& sub_disp,
+                 vw::ImageView<vw::Matrix3x3> const& local_hom,
+                 Options const& opt) {
+    typedef PerTileRfne<Image1T, Image2T, SeedDispT> return_type;
+    return return_type( left.impl(), right.impl(), right_mask,
+                        integer_disp.impl(), sub_disp.impl(), local_hom, opt );
+  }
+
+} // namespace asp
+
+#endif//__ASP_TOOLS_STEREO_RFNE_H__
@@ -20,6 +20,7 @@
 ///
 
 #include <asp/Tools/stereo.h>
+#include <asp/Sessions/BatchStereoModel.h>
 #include <asp/Sessions/RPC/RPCModel.h>
 #include <asp/Sessions/RPC/RPCStereoModel.h>
 #include <vw/Cartography.h>
@@ -38,6 +39,8 @@ namespace vw {
   template<> struct PixelFormatID<Vector<float, 6> >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
   template<> struct PixelFormatID<Vector<float, 4> >   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_4_CHANNEL; };
   template<> struct PixelFormatID<Vector<float, 2> > { static const PixelFormatEnum value = VW_PIXEL_GENERIC_2_CHANNEL; };
+  template<> struct PixelFormatID<Vector<int32, 4> >  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_4_CHANNEL; };
+  template<> struct PixelFormatID<Vector<int32, 6> >  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
 }
 
 namespace asp{
@@ -66,6 +69,26 @@ namespace asp{
     std::string point_cloud_file = opt.out_prefix + "-PC.tif";
     vw_out() << "Writing point cloud: " << point_cloud_file << "\n";
 
+    if ( stereo_settings().quantize_point_cloud ){
+      double rounding_error = stereo_settings().point_cloud_rounding_error;
+      double error_rounding_error = stereo_settings().point_cloud_error_rounding_error;
+      if ( error_rounding_error <= 0 )
+        error_rounding_error = rounding_error;
+      if ( opt.session->name() == "isis" ){
+        // ISIS does not support multi-threading
+        asp::write_quantized_gdal_image
+          ( point_cloud_file, shift, rounding_error, error_rounding_error,
+            point_cloud, opt,
+            TerminalProgressCallback("asp", "\t--> Triangulating: "));
+      }else{
+        asp::block_write_quantized_gdal_image
+          ( point_cloud_file, shift, rounding_error, error_rounding_error,
+            point_cloud, opt,
+            TerminalProgressCallback("asp", "\t--> Triangulating: "));
+      }
+      return;
+    }
+
     if ( opt.session->name() == "isis" ){
       // ISIS does not support multi-threading
       asp::write_approx_gdal_image
@@ -140,6 +163,15 @@ public:
     
 };
 
+// Stereo models which triangulate a whole tile at once faster than
+// pixel by pixel.
+template <class StereoModelT>
+struct HasBatchTriangulation : public boost::false_type {};
+template <>
+struct HasBatchTriangulation<RPCStereoModel> : public boost::true_type {};
+template <>
+struct HasBatchTriangulation<BatchStereoModel> : public boost::true_type {};
+
 template <class DisparityImageT, class TX1T, class TX2T, class StereoModelT>
 class StereoTXAndErrorView : public ImageViewBase<StereoTXAndErrorView<DisparityImageT, TX1T, TX2T, StereoModelT> >
 {
@@ -180,40 +212,86 @@ public:
     return pixel_type();
   }
 
-  typedef StereoTXAndErrorView<CropView<ImageView<DPixelT> >,
-                               TX1T, TX2T, StereoModelT> prerasterize_type;
+  typedef typename boost::mpl::if_<HasBatchTriangulation<StereoModelT>,
+                                   CropView<ImageView<pixel_type> >,
+                                   StereoTXAndErrorView<CropView<ImageView<DPixelT> >,
+                                                        TX1T, TX2T, StereoModelT> >::type prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return PreRasterHelper( bbox, m_tx1, m_tx2 );
+    return PreRasterDispatch( bbox, typename HasBatchTriangulation<StereoModelT>::type() );
   }
   template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const { vw::rasterize( prerasterize(bbox), dest, bbox ); }
 
 private:
 
   template <class T>
-  inline typename boost::enable_if<IsScalar<T>,Vector3>::type
+  inline Vector3
   StereoModelHelper( size_t i, size_t j, T const& disparity, Vector3& error ) const {
+    Vector2 right_pix;
+    if ( !RightPixelHelper( i, j, disparity, right_pix ) )
+      return Vector3(); // out of bounds
     return m_stereo_model( m_tx1.reverse( Vector2(i,j) ),
-                           m_tx2.reverse( Vector2(T(i) + disparity, j) ), error );
+                           m_tx2.reverse( right_pix ), error );
   }
 
   template <class T>
-  inline typename boost::enable_if_c<IsCompound<T>::value && (CompoundNumChannels<typename UnmaskedPixelType<T>::type>::value == 1),Vector3>::type
-  StereoModelHelper( size_t i, size_t j, T const& disparity, Vector3& error ) const {
-    return m_stereo_model( m_tx1.reverse( Vector2(i,j) ),
-                           m_tx2.reverse( Vector2(float(i)+disparity, j) ), error );
+  inline typename boost::enable_if<IsScalar<T>,bool>::type
+  RightPixelHelper( size_t i, size_t j, T const& disparity, Vector2& right_pix ) const {
+    right_pix = Vector2(T(i) + disparity, j);
+    return true;
   }
 
   template <class T>
-  inline typename boost::enable_if_c<IsCompound<T>::value && (CompoundNumChannels<typename UnmaskedPixelType<T>::type>::value != 1),Vector3>::type
-  StereoModelHelper( size_t i, size_t j, T const& disparity, Vector3& error ) const {
+  inline typename boost::enable_if_c<IsCompound<T>::value && (CompoundNumChannels<typename UnmaskedPixelType<T>::type>::value == 1),bool>::type
+  RightPixelHelper( size_t i, size_t j, T const& disparity, Vector2& right_pix ) const {
+    right_pix = Vector2(float(i)+disparity, j);
+    return true;
+  }
+
+  template <class T>
+  inline typename boost::enable_if_c<IsCompound<T>::value && (CompoundNumChannels<typename UnmaskedPixelType<T>::type>::value != 1),bool>::type
+  RightPixelHelper( size_t i, size_t j, T const& disparity, Vector2& right_pix ) const {
     if ( !is_valid( disparity ) ){
-      return Vector3(); // out of bounds
+      return false;
     }
+    right_pix = Vector2( double(i) + disparity[0], double(j) + disparity[1] );
+    return true;
+  }
 
-    return m_stereo_model( m_tx1.reverse( Vector2(i,j) ),
-                           m_tx2.reverse( Vector2( double(i) + disparity[0],
-                                                   double(j) + disparity[1] ) ),
-                           error );
+  inline prerasterize_type PreRasterDispatch( BBox2i const& bbox, boost::false_type ) const {
+    return PreRasterHelper( bbox, m_tx1, m_tx2 );
+  }
+
+  // Collect the pixel pairs of the tile and triangulate them with one
+  // call to the stereo model.
+  inline prerasterize_type PreRasterDispatch( BBox2i const& bbox, boost::true_type ) const {
+    ImageView<DPixelT> disparity_preraster( crop( m_disparity_map, bbox ) );
+
+    std::vector<Vector2> left_pixels, right_pixels;
+    std::vector<Vector2i> locations;
+    for ( int32 j = 0; j < bbox.height(); j++ ) {
+      for ( int32 i = 0; i < bbox.width(); i++ ) {
+        if ( !is_valid( disparity_preraster(i,j) ) )
+          continue;
+        size_t col = bbox.min().x() + i, row = bbox.min().y() + j;
+        Vector2 right_pix;
+        if ( !RightPixelHelper( col, row, disparity_preraster(i,j), right_pix ) )
+          continue;
+        left_pixels.push_back( m_tx1.reverse( Vector2(col, row) ) );
+        right_pixels.push_back( m_tx2.reverse( right_pix ) );
+        locations.push_back( Vector2i(i,j) );
+      }
+    }
+
+    std::vector<Vector3> points, errors;
+    m_stereo_model( left_pixels, right_pixels, points, errors );
+
+    ImageView<pixel_type> result( bbox.width(), bbox.height() );
+    for ( size_t k = 0; k < locations.size(); k++ ) {
+      pixel_type & pix = result( locations[k].x(), locations[k].y() );
+      subvector(pix,0,3) = points[k];
+      subvector(pix,3,3) = errors[k];
+    }
+    return crop( result, -bbox.min().x(), -bbox.min().y(), cols(), rows() );
   }
 
   template <class T1, class T2>
@@ -372,6 +450,12 @@ void stereo_triangulation( Options const& opt ) {
 
   typedef ImageViewRef<PixelMask<Vector2f> > PVImageT;
   typedef typename SessionT::stereo_model_type StereoModelT;
+
+  if ( stereo_settings().quantize_point_cloud &&
+       stereo_settings().save_double_precision_point_cloud )
+    vw_throw( ArgumentErr() << "A quantized point cloud is stored relative to its center, "
+              << "so it cannot also be saved in double precision.\n" );
+
   try {
     PVImageT disparity_map =
       opt.session->pre_pointcloud_hook(opt.out_prefix+"-F.tif");